@@ -0,0 +1,43 @@
+#version 450 core
+
+// The front hit is never behind the quad through the center, so depth only
+// moves towards the camera and early depth testing stays on
+layout(depth_less) out float gl_FragDepth;
+
+in vec3 v_ViewPosition;
+flat in vec3 v_Center;
+flat in float v_Radius;
+flat in vec4 v_Color;
+
+layout(std140, binding = 0) uniform Camera
+{
+	mat4 View;
+	mat4 Projection;
+	mat4 ViewProjection;
+	vec4 Position;
+} u_Camera;
+
+out vec4 o_Color;
+
+void main()
+{
+	// Ray from the camera at the view space origin through this fragment
+	vec3 direction = normalize(v_ViewPosition);
+	float b = dot(direction, v_Center);
+	float c = dot(v_Center, v_Center) - v_Radius * v_Radius;
+	float discriminant = b * b - c;
+	if (discriminant < 0.0)
+		discard;
+
+	vec3 hit = direction * (b - sqrt(discriminant));
+	vec3 normal = (hit - v_Center) / v_Radius;
+
+	vec4 clip = u_Camera.Projection * vec4(hit, 1.0);
+	gl_FragDepth = (clip.z / clip.w) * 0.5 + 0.5;
+
+	// Headlight: diffuse and a little specular from the camera
+	vec3 toCamera = -direction;
+	float diffuse = max(dot(normal, toCamera), 0.0);
+	float specular = pow(diffuse, 32.0) * 0.3;
+	o_Color = vec4(v_Color.rgb * (0.25 + 0.75 * diffuse) + specular, v_Color.a);
+}
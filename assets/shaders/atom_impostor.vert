@@ -0,0 +1,65 @@
+#version 450 core
+
+// One instance per atom, four strip vertices spanning a camera-facing quad
+// that covers the sphere's silhouette. The fragment shader ray casts the
+// sphere inside it.
+
+layout(std430, binding = 0) readonly buffer AtomPositions
+{
+	vec4 PositionRadius[];   // xyz in nm, w radius
+};
+
+layout(std430, binding = 1) readonly buffer AtomColors
+{
+	uint Colors[];           // RGBA8
+};
+
+layout(std140, binding = 0) uniform Camera
+{
+	mat4 View;
+	mat4 Projection;
+	mat4 ViewProjection;
+	vec4 Position;
+} u_Camera;
+
+// Scales every radius, for thinning out dense systems
+uniform float u_RadiusScale;
+
+out vec3 v_ViewPosition;
+flat out vec3 v_Center;
+flat out float v_Radius;
+flat out vec4 v_Color;
+
+void main()
+{
+	vec4 atom = PositionRadius[gl_InstanceID];
+	vec3 center = (u_Camera.View * vec4(atom.xyz, 1.0)).xyz;
+	float radius = atom.w * u_RadiusScale;
+
+	v_Center = center;
+	v_Radius = radius;
+	v_Color = unpackUnorm4x8(Colors[gl_InstanceID]);
+
+	float distance2 = dot(center, center);
+	if (distance2 <= radius * radius)
+	{
+		// Camera inside the sphere, nothing sensible to draw
+		gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+		v_ViewPosition = vec3(0.0);
+		return;
+	}
+
+	// The quad sits in the plane through the center facing the camera. Seen in
+	// perspective the silhouette there is wider than the radius by d / sqrt(d^2 - r^2)
+	vec3 toCenter = center * inversesqrt(distance2);
+	vec3 up = abs(toCenter.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+	vec3 right = normalize(cross(toCenter, up));
+	up = cross(right, toCenter);
+
+	float extent = radius * sqrt(distance2 / (distance2 - radius * radius));
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+	vec3 position = center + (corner.x * right + corner.y * up) * extent;
+
+	v_ViewPosition = position;
+	gl_Position = u_Camera.Projection * vec4(position, 1.0);
+}
@@ -0,0 +1,175 @@
+#include "application.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "events/input.h"
+#include "logging/log.h"
+
+
+Application* Application::s_Instance = nullptr;
+
+Application::Application(const WindowProps& props, const ThreadPoolProps& threadProps)
+	: m_ThreadPool(threadProps), m_CameraController(45.0f, (float)props.Width / (float)props.Height, 0.01f, 1000.0f)
+{
+	s_Instance = this;
+
+	m_Window.Init(props);
+	m_Window.SetEventCallback(BIND_EVENT_FN(Application::OnEvent));
+
+	Input::Init();
+	Shader::Init();
+
+	m_World.SetThreadPool(&m_ThreadPool);
+	m_AtomRenderer.Init(&m_ThreadPool);
+	Shader::EnableHotReload();
+}
+
+Application::~Application()
+{
+	m_AtomRenderer.Shutdown();
+	m_World.Clear();
+	s_Instance = nullptr;
+}
+
+void Application::Run()
+{
+	double lastFrameTime = m_Window.GetTime();
+
+	while (m_Running)
+	{
+		double time = m_Window.GetTime();
+		double frameDelta = time - lastFrameTime;
+		lastFrameTime = time;
+
+		// Physics advances in fixed steps, however long rendering the frame took
+		if (IsReplaying())
+			UpdateReplay(frameDelta);
+		else
+			m_World.OnUpdate(frameDelta);
+
+		m_CameraController.OnUpdate();
+		Shader::UpdateHotReload();
+
+		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		DrawAtoms();
+
+		// Pressed keys become held once the frame that saw them is over
+		Input::OnUpdate();
+		m_Window.OnUpdate();
+	}
+}
+
+bool Application::OpenReplay(const std::string& path)
+{
+	if (!m_Replay.Open(path))
+		return false;
+
+	m_ReplayPosition = 0.0;
+	m_ReplayPaused = false;
+	m_ReplayFrame = m_Replay.GetFrame(0);
+	m_DrawnReplayFrame = UINT64_MAX;
+
+	// Start out looking down z at the whole box
+	if (m_ReplayFrame)
+	{
+		const glm::vec3 extent = m_ReplayFrame->GetBox().Size;
+		const float size = std::max({ extent.x, extent.y, extent.z });
+		m_CameraController.GetCamera().SetPosition(extent * 0.5f + glm::vec3(0.0f, 0.0f, 1.5f * size));
+	}
+	return true;
+}
+
+void Application::DrawAtoms()
+{
+	if (IsReplaying())
+	{
+		if (m_ReplayFrame && m_ReplayFrame->Index != m_DrawnReplayFrame)
+		{
+			m_AtomRenderer.SubmitPositions(m_ReplayFrame->Positions.data(), (uint32_t)m_ReplayFrame->Positions.size());
+			m_DrawnReplayFrame = m_ReplayFrame->Index;
+		}
+	}
+	else
+		m_AtomRenderer.SubmitAtoms(m_World);
+
+	m_AtomRenderer.Draw(m_CameraController.GetCamera());
+}
+
+void Application::UpdateReplay(double frameDelta)
+{
+	const uint64_t frameCount = m_Replay.GetFrameCount();
+	if (frameCount == 0)
+		return;
+	const double lastFrame = (double)(frameCount - 1);
+
+	if (Input::IsKeyPressed(GLFW_KEY_P))
+		m_ReplayPaused = !m_ReplayPaused;
+	if (Input::IsKeyPressed(GLFW_KEY_RIGHT))
+	{
+		m_ReplayPosition = std::floor(m_ReplayPosition) + 1.0;
+		m_ReplayPaused = true;
+	}
+	if (Input::IsKeyPressed(GLFW_KEY_LEFT))
+	{
+		m_ReplayPosition = std::floor(m_ReplayPosition) - 1.0;
+		m_ReplayPaused = true;
+	}
+	if (Input::IsKeyPressed(GLFW_KEY_UP))
+		m_ReplayRate *= 1.25;
+	if (Input::IsKeyPressed(GLFW_KEY_DOWN))
+		m_ReplayRate /= 1.25;
+	if (Input::IsKeyPressed(GLFW_KEY_PAGE_UP))
+		m_ReplayPosition += 0.1 * frameCount;
+	if (Input::IsKeyPressed(GLFW_KEY_PAGE_DOWN))
+		m_ReplayPosition -= 0.1 * frameCount;
+	if (Input::IsKeyPressed(GLFW_KEY_HOME))
+		m_ReplayPosition = 0.0;
+	if (Input::IsKeyPressed(GLFW_KEY_END))
+		m_ReplayPosition = lastFrame;
+
+	if (!m_ReplayPaused)
+		m_ReplayPosition += m_ReplayRate * frameDelta;
+	if (m_ReplayPosition >= lastFrame && !m_ReplayPaused)
+		m_ReplayPaused = true;
+	m_ReplayPosition = std::clamp(m_ReplayPosition, 0.0, lastFrame);
+
+	// The last frame stays up until the new one is decoded, drawing never waits on the disk
+	const uint64_t index = (uint64_t)m_ReplayPosition;
+	if (!m_ReplayFrame || m_ReplayFrame->Index != index)
+	{
+		if (std::shared_ptr<const TrajectoryFrame> frame = m_Replay.TryGetFrame(index))
+			m_ReplayFrame = frame;
+	}
+}
+
+void Application::OnEvent(Event::Event& e)
+{
+	using namespace Event;
+
+	EventDispatcher dispatcher(e);
+	dispatcher.Dispatch<WindowCloseEvent>(BIND_EVENT_FN(Application::OnWindowClose));
+	dispatcher.Dispatch<WindowResizeEvent>(BIND_EVENT_FN(Application::OnWindowResize));
+
+	dispatcher.Dispatch<KeyPressedEvent>([](KeyPressedEvent& ev) { Input::SetKeyState(ev.GetKeyCode(), true); return false; });
+	dispatcher.Dispatch<KeyReleasedEvent>([](KeyReleasedEvent& ev) { Input::SetKeyState(ev.GetKeyCode(), false); return false; });
+	dispatcher.Dispatch<MouseButtonPressedEvent>([](MouseButtonPressedEvent& ev) { Input::SetMouseButton(ev.GetMouseButton(), true); return false; });
+	dispatcher.Dispatch<MouseButtonReleasedEvent>([](MouseButtonReleasedEvent& ev) { Input::SetMouseButton(ev.GetMouseButton(), false); return false; });
+	dispatcher.Dispatch<MouseMovedEvent>([](MouseMovedEvent& ev) { Input::SetMousePosition({ ev.GetX(), ev.GetY() }); return false; });
+	dispatcher.Dispatch<MouseScrolledEvent>([](MouseScrolledEvent& ev) { Input::SetMouseScrollOffset({ ev.GetXOffset(), ev.GetYOffset() }); return false; });
+}
+
+bool Application::OnWindowClose(Event::WindowCloseEvent& e)
+{
+	m_Running = false;
+	return true;
+}
+
+bool Application::OnWindowResize(Event::WindowResizeEvent& e)
+{
+	glViewport(0, 0, e.GetWidth(), e.GetHeight());
+	if (e.GetWidth() > 0 && e.GetHeight() > 0)
+		m_CameraController.GetCamera().SetProjection(45.0f, (float)e.GetWidth() / (float)e.GetHeight(), 0.01f, 1000.0f);
+	return false;
+}
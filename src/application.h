@@ -0,0 +1,65 @@
+#pragma once
+
+#include "io/trajectory_reader.h"
+#include "renderer/atom_renderer.h"
+#include "renderer/camera/perspective_camera_controller.h"
+#include "renderer/window.h"
+#include "simulation/world.h"
+#include "threading/thread_pool.h"
+#include "events/application_event.h"
+#include "events/key_event.h"
+#include "events/mouse_event.h"
+
+
+class Application
+{
+public:
+	Application(const WindowProps& props = WindowProps("Physics Engine"), const ThreadPoolProps& threadProps = ThreadPoolProps());
+	~Application();
+
+	void Run();
+	void OnEvent(Event::Event& e);
+
+	Window& GetWindow() { return m_Window; }
+	World& GetWorld() { return m_World; }
+	ThreadPool& GetThreadPool() { return m_ThreadPool; }
+
+	// Plays a recorded trajectory instead of simulating. P pauses, the arrow
+	// keys step frames and change the rate, Page Up / Page Down jump a tenth
+	// of the run and Home / End go to either end
+	bool OpenReplay(const std::string& path);
+	bool IsReplaying() const { return m_Replay.IsOpen(); }
+	// Frame on screen, null until the first one is decoded
+	const TrajectoryFrame* GetReplayFrame() const { return m_ReplayFrame.get(); }
+
+	static Application& Get() { return *s_Instance; }
+
+private:
+	bool OnWindowClose(Event::WindowCloseEvent& e);
+	bool OnWindowResize(Event::WindowResizeEvent& e);
+
+	void UpdateReplay(double frameDelta);
+	void DrawAtoms();
+
+private:
+	Window m_Window;
+	ThreadPool m_ThreadPool;
+	World m_World;
+
+	PerspectiveCameraController m_CameraController;
+	AtomRenderer m_AtomRenderer;
+
+	TrajectoryReader m_Replay;
+	std::shared_ptr<const TrajectoryFrame> m_ReplayFrame;
+	// Fractional frame index, advances by m_ReplayRate frames per second
+	double m_ReplayPosition = 0.0;
+	double m_ReplayRate = 30.0;
+	bool m_ReplayPaused = false;
+	// Replay frame last sent to the renderer, a paused replay uploads nothing
+	uint64_t m_DrawnReplayFrame = UINT64_MAX;
+
+	bool m_Running = true;
+
+private:
+	static Application* s_Instance;
+};
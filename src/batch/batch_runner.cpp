@@ -0,0 +1,581 @@
+#include "batch_runner.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <thread>
+
+#include "../io/structure_loader.h"
+#include "../logging/log.h"
+#include "../simulation/units.h"
+#include "../simulation/forces/pme_force.h"
+
+
+namespace
+{
+	template<typename T>
+	bool ParseNumber(const char* text, T& value)
+	{
+		const char* end = text + std::strlen(text);
+		auto [ptr, ec] = std::from_chars(text, end, value);
+		return ec == std::errc() && ptr == end;
+	}
+
+	bool ParseThermostatKind(const char* text, ThermostatKind& kind)
+	{
+		if (!std::strcmp(text, "berendsen"))     kind = ThermostatKind::Berendsen;
+		else if (!std::strcmp(text, "vrescale")) kind = ThermostatKind::VelocityRescale;
+		else if (!std::strcmp(text, "nhc"))      kind = ThermostatKind::NoseHooverChain;
+		else if (!std::strcmp(text, "langevin")) kind = ThermostatKind::Langevin;
+		else return false;
+		return true;
+	}
+
+	bool ParsePrecision(const char* text, PrecisionMode& mode)
+	{
+		if (!std::strcmp(text, "single"))      mode = PrecisionMode::Single;
+		else if (!std::strcmp(text, "mixed"))  mode = PrecisionMode::Mixed;
+		else if (!std::strcmp(text, "double")) mode = PrecisionMode::Double;
+		else return false;
+		return true;
+	}
+
+	bool ParseTransportKind(const char* text, TransportKind& kind)
+	{
+		if (!std::strcmp(text, "shm"))         kind = TransportKind::SharedMemory;
+		else if (!std::strcmp(text, "socket")) kind = TransportKind::Socket;
+		else return false;
+		return true;
+	}
+
+	// Largest force and energy difference to a single rank run, relative to the largest force and the energy
+	constexpr double RankCheckTolerance = 1e-4;
+
+	// Ranks on one machine share its cores unless the worker count is given
+	uint32_t GetWorkerCount(const BatchProps& props, const TransportProps& transport)
+	{
+		if (props.WorkerCount || transport.RankCount <= 1)
+			return props.WorkerCount;
+		const uint32_t share = std::max(1u, std::thread::hardware_concurrency() / transport.RankCount);
+		return std::max(1u, share - 1);
+	}
+
+	// Pinned ranks take consecutive runs of cores, each as wide as its pool
+	ThreadPoolProps GetThreadPoolProps(const BatchProps& props, const TransportProps& transport)
+	{
+		const uint32_t workers = GetWorkerCount(props, transport);
+		const uint32_t threads = (workers ? workers : std::max(1u, std::thread::hardware_concurrency()) - 1) + 1;
+		return ThreadPoolProps(workers, props.PinThreads, transport.Rank * threads);
+	}
+
+	const char* PrecisionToString(PrecisionMode mode)
+	{
+		switch (mode)
+		{
+		case PrecisionMode::Single: return "single";
+		case PrecisionMode::Mixed:  return "mixed";
+		case PrecisionMode::Double: return "double";
+		}
+		return "unknown";
+	}
+
+	// Maxwell-Boltzmann velocities at temperature, without drift of the whole system
+	void AssignVelocities(AtomStore& atoms, float temperature, uint64_t seed)
+	{
+		std::mt19937_64 random(seed);
+		std::normal_distribution<float> normal(0.0f, 1.0f);
+		glm::dvec3 momentum(0.0);
+		double mass = 0.0;
+		for (size_t i = 0; i < atoms.Size(); i++)
+		{
+			if (atoms.Mass[i] <= 0.0f)
+				continue;
+			const float scale = std::sqrt((float)BoltzmannConstant * temperature * atoms.InvMass[i]);
+			atoms.VelX[i] = normal(random) * scale;
+			atoms.VelY[i] = normal(random) * scale;
+			atoms.VelZ[i] = normal(random) * scale;
+			momentum += glm::dvec3(atoms.VelX[i], atoms.VelY[i], atoms.VelZ[i]) * (double)atoms.Mass[i];
+			mass += atoms.Mass[i];
+		}
+		if (mass <= 0.0)
+			return;
+
+		const glm::vec3 drift = glm::vec3(momentum / mass);
+		for (size_t i = 0; i < atoms.Size(); i++)
+		{
+			if (atoms.Mass[i] <= 0.0f)
+				continue;
+			atoms.VelX[i] -= drift.x;
+			atoms.VelY[i] -= drift.y;
+			atoms.VelZ[i] -= drift.z;
+		}
+	}
+}
+
+void PrintBatchUsage()
+{
+	PY_CORE_INFO("Usage: PhysicsEngineBatch [options]\n"
+		"  --steps N              steps to run (10000)\n"
+		"  --dt PS                timestep in ps (0.002)\n"
+		"  --precision P          single, mixed or double\n"
+		"  --threads N            worker threads besides the main one, 0 for all cores (0)\n"
+		"  --pin                  pin threads to cores\n"
+		"  --ranks N              domain decompose over N local processes (1)\n"
+		"  --transport T          shm or socket between the ranks (shm)\n"
+		"  --check-ranks          compare energy and forces with a single rank run\n"
+		"  --input FILE           run a PDB, GRO or XYZ structure instead of the lattice\n"
+		"  --lattice N            N^3 atoms in the built-in system (16)\n"
+		"  --density D            atoms per nm^3 (21)\n"
+		"  --charge Q             alternate +-Q over the lattice and add PME (0)\n"
+		"  --cutoff NM            nonbonded cutoff (1.0)\n"
+		"  --epsilon KJ           Lennard-Jones well depth in kJ/mol (0.996)\n"
+		"  --sigma NM             Lennard-Jones diameter (0.3405)\n"
+		"  --temperature K        initial and thermostat temperature (120)\n"
+		"  --thermostat T         berendsen, vrescale, nhc or langevin (none)\n"
+		"  --tau-t PS             thermostat time constant (0.1)\n"
+		"  --pressure BAR         turn on the C-rescale barostat at this pressure\n"
+		"  --tau-p PS             barostat time constant (2)\n"
+		"  --seed N               initial velocities and thermostat noise (1)\n"
+		"  --output-interval N    steps between energy lines and progress reports (1000)\n"
+		"  --energies FILE        write energies as CSV\n"
+		"  --final FILE           write the last frame as XYZ\n"
+		"  --trajectory FILE      write a compressed .pytrj trajectory\n"
+		"  --trajectory-interval N  steps between trajectory frames (1000)\n"
+		"  --trajectory-precision P position steps per nm (1000)\n"
+		"  --trajectory-velocities  add velocities to the frames\n"
+		"  --trajectory-forces      add forces to the frames");
+}
+
+bool ParseBatchArgs(int argc, char** argv, BatchProps& props)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		if (!std::strcmp(arg, "--help") || !std::strcmp(arg, "-h"))
+		{
+			props.ShowHelp = true;
+			continue;
+		}
+		if (!std::strcmp(arg, "--pin"))
+		{
+			props.PinThreads = true;
+			continue;
+		}
+		if (!std::strcmp(arg, "--check-ranks"))
+		{
+			props.CheckRanks = true;
+			continue;
+		}
+		if (!std::strcmp(arg, "--trajectory-velocities"))
+		{
+			props.Trajectory.VelocityPrecision = 1000.0f;
+			continue;
+		}
+		if (!std::strcmp(arg, "--trajectory-forces"))
+		{
+			props.Trajectory.ForcePrecision = 100.0f;
+			continue;
+		}
+
+		if (i + 1 >= argc)
+		{
+			PY_CORE_ERROR("Missing value after {0}", arg);
+			return false;
+		}
+		const char* value = argv[++i];
+
+		bool ok = true;
+		if (!std::strcmp(arg, "--steps"))                ok = ParseNumber(value, props.Steps);
+		else if (!std::strcmp(arg, "--dt"))              ok = ParseNumber(value, props.Timestep) && props.Timestep > 0.0f;
+		else if (!std::strcmp(arg, "--precision"))       ok = ParsePrecision(value, props.Precision);
+		else if (!std::strcmp(arg, "--threads"))         ok = ParseNumber(value, props.WorkerCount);
+		else if (!std::strcmp(arg, "--ranks"))           ok = ParseNumber(value, props.Ranks) && props.Ranks > 0;
+		else if (!std::strcmp(arg, "--transport"))       ok = ParseTransportKind(value, props.Transport);
+		else if (!std::strcmp(arg, "--input"))           props.InputFile = value;
+		else if (!std::strcmp(arg, "--lattice"))         ok = ParseNumber(value, props.LatticeSize) && props.LatticeSize > 0;
+		else if (!std::strcmp(arg, "--density"))         ok = ParseNumber(value, props.Density) && props.Density > 0.0f;
+		else if (!std::strcmp(arg, "--charge"))          ok = ParseNumber(value, props.Charge);
+		else if (!std::strcmp(arg, "--cutoff"))          ok = ParseNumber(value, props.Cutoff) && props.Cutoff > 0.0f;
+		else if (!std::strcmp(arg, "--epsilon"))         ok = ParseNumber(value, props.Epsilon) && props.Epsilon >= 0.0f;
+		else if (!std::strcmp(arg, "--sigma"))           ok = ParseNumber(value, props.Sigma) && props.Sigma > 0.0f;
+		else if (!std::strcmp(arg, "--tau-t"))           ok = ParseNumber(value, props.Thermostat.TimeConstant);
+		else if (!std::strcmp(arg, "--tau-p"))           ok = ParseNumber(value, props.Barostat.TimeConstant);
+		else if (!std::strcmp(arg, "--seed"))            ok = ParseNumber(value, props.Seed);
+		else if (!std::strcmp(arg, "--output-interval")) ok = ParseNumber(value, props.OutputInterval);
+		else if (!std::strcmp(arg, "--energies"))        props.EnergyFile = value;
+		else if (!std::strcmp(arg, "--final"))           props.FinalFrameFile = value;
+		else if (!std::strcmp(arg, "--trajectory"))      props.TrajectoryFile = value;
+		else if (!std::strcmp(arg, "--trajectory-interval"))  ok = ParseNumber(value, props.Trajectory.Interval);
+		else if (!std::strcmp(arg, "--trajectory-precision")) ok = ParseNumber(value, props.Trajectory.PositionPrecision) && props.Trajectory.PositionPrecision > 0.0f;
+		else if (!std::strcmp(arg, "--temperature"))
+		{
+			ok = ParseNumber(value, props.Thermostat.Temperature) && props.Thermostat.Temperature >= 0.0f;
+			props.Barostat.Temperature = props.Thermostat.Temperature;
+		}
+		else if (!std::strcmp(arg, "--thermostat"))
+		{
+			ok = ParseThermostatKind(value, props.Thermostat.Kind);
+			props.UseThermostat = true;
+		}
+		else if (!std::strcmp(arg, "--pressure"))
+		{
+			ok = ParseNumber(value, props.Barostat.Pressure);
+			props.UseBarostat = true;
+		}
+		else
+		{
+			PY_CORE_ERROR("Unknown option {0}", arg);
+			return false;
+		}
+
+		if (!ok)
+		{
+			PY_CORE_ERROR("Invalid value '{0}' for {1}", value, arg);
+			return false;
+		}
+	}
+
+	props.Thermostat.Seed = props.Seed;
+	props.Barostat.Seed = props.Seed ^ 0xba5e;
+	return true;
+}
+
+BatchRunner::BatchRunner(const BatchProps& props, const TransportProps& transport)
+	: m_Props(props), m_TransportProps(transport), m_ThreadPool(GetThreadPoolProps(props, transport))
+{
+	m_World.SetThreadPool(&m_ThreadPool);
+	m_World.SetPrecision(props.Precision);
+}
+
+BatchRunner::~BatchRunner()
+{
+	m_Domain.reset();
+	m_World.Clear();
+}
+
+bool BatchRunner::BuildSystem()
+{
+	if (m_Props.InputFile.empty())
+		BuildLattice();
+	else if (!LoadInput())
+		return false;
+
+	AddForces(m_World);
+
+	auto integrator = std::make_unique<VelocityVerletIntegrator>(m_Props.Timestep);
+	if (m_Props.UseThermostat)
+		integrator->SetThermostat(std::make_unique<Thermostat>(m_Props.Thermostat));
+	if (m_Props.UseBarostat)
+		integrator->SetBarostat(std::make_unique<Barostat>(m_Props.Barostat));
+	m_Integrator = integrator.get();
+	m_World.SetIntegrator(std::move(integrator));
+	return true;
+}
+
+void BatchRunner::AddForces(World& world) const
+{
+	// One Lennard-Jones pair for everything, files bring no force field
+	const uint32_t typeCount = (uint32_t)std::max<size_t>(m_TypeElements.size(), 1);
+	NonbondedForce& nonbonded = world.GetNonbondedForce();
+	nonbonded.SetTypeCount(typeCount);
+	for (uint32_t a = 0; a < typeCount; a++)
+		for (uint32_t b = a; b < typeCount; b++)
+			nonbonded.SetPair(a, b, m_Props.Epsilon, m_Props.Sigma);
+	nonbonded.SetCutoff(m_Props.Cutoff);
+	if (m_Props.Charge != 0.0f && m_Props.InputFile.empty())
+	{
+		nonbonded.SetCoulombConstant(138.935458f);
+		world.AddForce<PmeForce>(nonbonded);
+	}
+}
+
+void BatchRunner::BuildLattice()
+{
+	const uint32_t n = m_Props.LatticeSize;
+	const float spacing = std::cbrt(1.0f / m_Props.Density);
+	const float length = n * spacing;
+	m_World.SetBox(SimulationBox(glm::vec3(length)));
+
+	std::mt19937_64 random(m_Props.Seed);
+	std::normal_distribution<float> normal(0.0f, std::sqrt((float)BoltzmannConstant * m_Props.Thermostat.Temperature / m_Props.Mass));
+	std::vector<glm::vec3> velocities((size_t)n * n * n);
+	glm::dvec3 momentum(0.0);
+	for (glm::vec3& velocity : velocities)
+	{
+		velocity = glm::vec3(normal(random), normal(random), normal(random));
+		momentum += glm::dvec3(velocity);
+	}
+	// No drift of the whole system
+	const glm::vec3 drift = glm::vec3(momentum / (double)velocities.size());
+
+	size_t atom = 0;
+	for (uint32_t x = 0; x < n; x++)
+		for (uint32_t y = 0; y < n; y++)
+			for (uint32_t z = 0; z < n; z++)
+			{
+				const glm::vec3 position = (glm::vec3(x, y, z) + 0.5f) * spacing;
+				const float charge = (x + y + z) % 2 ? m_Props.Charge : -m_Props.Charge;
+				m_World.CreateAtom(position, velocities[atom++] - drift, m_Props.Mass, 0, charge);
+			}
+}
+
+bool BatchRunner::LoadInput()
+{
+	StructureLoadResult structure = LoadStructure(m_Props.InputFile, &m_ThreadPool);
+	if (!structure)
+	{
+		const StructureLoadError& error = structure.error();
+		if (error.Line)
+			PY_CORE_ERROR("{0}:{1}: {2}", m_Props.InputFile, error.Line, error.Message);
+		else
+			PY_CORE_ERROR("{0}: {1}", m_Props.InputFile, error.Message);
+		return false;
+	}
+	if (!structure->HasBox)
+	{
+		PY_CORE_ERROR("{0} has no box: PDB files need a CRYST1 record, XYZ files a Lattice=\"...\" comment", m_Props.InputFile);
+		return false;
+	}
+
+	if (!structure->HasVelocities)
+		AssignVelocities(structure->Atoms, m_Props.Thermostat.Temperature, m_Props.Seed);
+	m_World.SetBox(structure->Box);
+	m_World.CreateAtoms(structure->Atoms);
+	m_TypeElements = std::move(structure->TypeElements);
+	return true;
+}
+
+bool BatchRunner::Decompose()
+{
+	if (m_TransportProps.RankCount <= 1 && m_TransportProps.Kind != TransportKind::Mpi)
+	{
+		if (m_Props.CheckRanks)
+			PY_CORE_WARN("--check-ranks does nothing without --ranks");
+		return true;
+	}
+
+	m_Transport = Transport::Create(m_TransportProps);
+	if (!m_Transport)
+		return false;
+
+	// Every rank built the same system, each keeps its own domain of it
+	m_FullSystem = m_World.GetAtoms();
+	m_FullSystem.SetPreciseState(false);
+	m_Domain = std::make_unique<DomainDecomposition>(*m_Transport);
+	if (!m_Domain->Attach(m_World))
+		return false;
+
+	if (IsRoot())
+	{
+		const glm::uvec3& grid = m_Domain->GetGrid();
+		PY_CORE_INFO("Domain decomposed over {0} ranks ({1}), {2}x{3}x{4} grid",
+			m_Transport->GetRankCount(), m_Transport->GetName(), grid.x, grid.y, grid.z);
+	}
+	return true;
+}
+
+bool BatchRunner::CheckAgainstOneRank(const char* stage)
+{
+	std::vector<glm::vec3> positions, forces;
+	m_Domain->GatherPositions(positions);
+	m_Domain->GatherForces(forces);
+	if (m_Domain->HasFailed())
+		return false;
+	if (!IsRoot())
+		return true;
+
+	// The same system at the gathered positions, on this rank alone
+	World reference;
+	reference.SetThreadPool(&m_ThreadPool);
+	reference.SetPrecision(m_Props.Precision);
+	reference.SetBox(m_World.GetBox());
+	reference.CreateAtoms(m_FullSystem);
+	AtomStore& atoms = reference.GetAtoms();
+	for (uint32_t i = 0; i < (uint32_t)positions.size(); i++)
+		atoms.SetPosition(i, positions[i]);
+	AddForces(reference);
+	reference.ComputeForces();
+
+	double forceError = 0.0, forceScale = 0.0;
+	for (uint32_t i = 0; i < (uint32_t)forces.size(); i++)
+	{
+		const glm::vec3 force = atoms.GetForce(i);
+		forceError = std::max(forceError, (double)glm::length(force - forces[i]));
+		forceScale = std::max(forceScale, (double)glm::length(force));
+	}
+	const double potential = m_World.GetPotentialEnergy(), expected = reference.GetPotentialEnergy();
+	const double energyError = std::abs(potential - expected);
+	const bool passed = forceError <= RankCheckTolerance * std::max(forceScale, 1.0)
+		&& energyError <= RankCheckTolerance * std::max(std::abs(expected), 1.0);
+
+	if (passed)
+		PY_CORE_INFO("{0} step matches a single rank: E_pot {1:.6f} vs {2:.6f}, largest force difference {3:.3e} of {4:.3e}", stage, potential, expected, forceError, forceScale);
+	else
+		PY_CORE_ERROR("{0} step differs from a single rank: E_pot {1:.6f} vs {2:.6f}, largest force difference {3:.3e} of {4:.3e}", stage, potential, expected, forceError, forceScale);
+	return passed;
+}
+
+bool BatchRunner::OpenOutputs()
+{
+	if (!m_Props.TrajectoryFile.empty() && !m_Trajectory.Open(m_Props.TrajectoryFile, m_World, m_Props.Trajectory))
+		return false;
+	if (m_Props.EnergyFile.empty() || !IsRoot())
+		return true;
+
+	m_Energies.open(m_Props.EnergyFile, std::ios::out | std::ios::trunc);
+	if (!m_Energies.is_open())
+	{
+		PY_CORE_ERROR("Could not open {0} for writing", m_Props.EnergyFile);
+		return false;
+	}
+	m_Energies.precision(10);
+	m_Energies << "step,time_ps,potential,kinetic,total,temperature_k,pressure_bar,volume_nm3\n";
+	return true;
+}
+
+void BatchRunner::WriteEnergies(uint64_t step)
+{
+	// Energies and observables are summed over the ranks already
+	if (!IsRoot())
+		return;
+
+	const EnsembleObservables& observables = m_Integrator->GetObservables();
+	const double potential = m_World.GetPotentialEnergy();
+	const double time = step * (double)m_Props.Timestep;
+
+	PY_CORE_INFO("step {0}: E_pot {1:.3f} E_kin {2:.3f} T {3:.2f} K P {4:.1f} bar",
+		step, potential, observables.KineticEnergy, observables.Temperature, observables.Pressure);
+
+	if (m_Energies.is_open())
+	{
+		m_Energies << step << ',' << time << ',' << potential << ',' << observables.KineticEnergy << ','
+			<< potential + observables.KineticEnergy << ',' << observables.Temperature << ','
+			<< observables.Pressure << ',' << m_World.GetBox().GetVolume() << '\n';
+	}
+}
+
+bool BatchRunner::WriteFinalFrame()
+{
+	if (m_Props.FinalFrameFile.empty())
+		return true;
+
+	// Decomposed runs write every atom from rank 0, in global id order
+	const AtomStore* atoms = &m_World.GetAtoms();
+	AtomStore gathered;
+	if (m_Domain)
+	{
+		std::vector<glm::vec3> positions;
+		m_Domain->GatherPositions(positions);
+		if (m_Domain->HasFailed())
+			return false;
+		if (!IsRoot())
+			return true;
+
+		gathered = m_FullSystem;
+		for (uint32_t i = 0; i < (uint32_t)positions.size(); i++)
+			gathered.SetPosition(i, positions[i]);
+		atoms = &gathered;
+	}
+
+	std::ofstream file(m_Props.FinalFrameFile, std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+	{
+		PY_CORE_ERROR("Could not open {0} for writing", m_Props.FinalFrameFile);
+		return false;
+	}
+
+	// Extended XYZ in Angstrom, the box in a form --input reads back
+	const glm::vec3 size = m_World.GetBox().Size * 10.0f;
+	const glm::vec3 tilt = m_World.GetBox().Tilt * 10.0f;
+	file << atoms->Size() << "\nLattice=\"" << size.x << " 0 0 " << tilt.x << ' ' << size.y << " 0 " << tilt.y << ' ' << tilt.z << ' ' << size.z << "\"\n";
+	for (size_t i = 0; i < atoms->Size(); i++)
+	{
+		const char* symbol = m_TypeElements.empty() ? "Ar" : GetElementSymbol(m_TypeElements[atoms->TypeId[i]]);
+		file << symbol << ' ' << atoms->PosX[i] * 10.0f << ' ' << atoms->PosY[i] * 10.0f << ' ' << atoms->PosZ[i] * 10.0f << '\n';
+	}
+	return true;
+}
+
+int BatchRunner::Run()
+{
+	if (!BuildSystem())
+		return 1;
+
+	// Minimum image only finds every pair when the list radius fits twice
+	// across the box in every direction, which for a tilted cell means
+	// between opposite faces rather than along the edges
+	const glm::vec3 widths = m_World.GetBox().GetPerpendicularWidths();
+	const float width = std::min({ widths.x, widths.y, widths.z });
+	const float listRadius = m_Props.Cutoff + m_World.GetNeighborList().GetSkin();
+	if (width < 2.0f * listRadius)
+	{
+		PY_CORE_ERROR("Box is {0:.3f} nm across at its narrowest, less than twice the {1:.3f} nm cutoff plus skin", width, listRadius);
+		return 1;
+	}
+	if (!Decompose() || !OpenOutputs())
+		return 1;
+
+	const uint64_t atomCount = m_Domain ? m_Domain->GetGlobalAtomCount() : m_World.GetAtomCount();
+	if (IsRoot())
+	{
+		PY_CORE_INFO("Batch run: {0} atoms, {1} steps of {2} ps, {3} threads, {4} precision, thermostat {5}, barostat {6}",
+			atomCount, m_Props.Steps, m_Props.Timestep, m_ThreadPool.GetThreadCount(), PrecisionToString(m_Props.Precision),
+			m_Props.UseThermostat ? ThermostatKindToString(m_Props.Thermostat.Kind) : "off", m_Props.UseBarostat ? "C-rescale" : "off");
+	}
+
+	// Setup (first neighbor list, PME tables) stays out of the timing
+	m_World.ComputeForces();
+	m_Trajectory.OnStep(m_World, 0, 0.0);
+	const bool checkRanks = m_Domain && m_Props.CheckRanks;
+	bool consistent = !checkRanks || CheckAgainstOneRank("First");
+
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point start = Clock::now();
+	double outputSeconds = 0.0;
+
+	const uint32_t interval = m_Props.OutputInterval;
+	for (uint64_t step = 1; step <= m_Props.Steps; step++)
+	{
+		// Only a decomposed run can fail a step, once a rank went away
+		if (!m_World.Step())
+			break;
+		m_Trajectory.OnStep(m_World, step, step * (double)m_Props.Timestep);
+
+		if ((interval && step % interval == 0) || step == m_Props.Steps)
+		{
+			const Clock::time_point outputStart = Clock::now();
+			WriteEnergies(step);
+			outputSeconds += std::chrono::duration<double>(Clock::now() - outputStart).count();
+		}
+	}
+
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	// Frames still in flight are not the simulation's time
+	m_Trajectory.Close();
+	// A failed step ends the loop early, a gather for the output fails the same way
+	if (m_Domain && m_Domain->HasFailed())
+	{
+		PY_CORE_ERROR("Rank {0} stopped after step {1} of {2}, the ranks lost each other",
+			m_Transport->GetRank(), m_World.GetStepCount(), m_Props.Steps);
+		m_Energies.flush();
+		return 1;
+	}
+	if (checkRanks)
+		consistent = CheckAgainstOneRank("Last") && consistent;
+	if (!IsRoot())
+		return (WriteFinalFrame() && consistent) ? 0 : 1;
+
+	const double simulated = m_Props.Steps * (double)m_Props.Timestep * 1e-3;
+	const double nsPerDay = seconds > 0.0 ? simulated / seconds * 86400.0 : 0.0;
+	const double stepsPerSecond = seconds > 0.0 ? m_Props.Steps / seconds : 0.0;
+
+	PY_CORE_INFO("{0} steps in {1:.3f} s ({2:.3f} s of it output): {3:.1f} steps/s, {4:.3f} ns/day, {5:.2f} us/step/katom",
+		m_Props.Steps, seconds, outputSeconds, stepsPerSecond, nsPerDay,
+		stepsPerSecond > 0.0 ? 1e9 / (stepsPerSecond * (double)atomCount) : 0.0);
+	PY_CORE_INFO("Neighbor list rebuilds: {0}", m_World.GetNeighborList().GetStats().Rebuilds);
+
+	return (WriteFinalFrame() && consistent) ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../io/trajectory_writer.h"
+#include "../simulation/world.h"
+#include "../simulation/domain/domain_decomposition.h"
+#include "../simulation/integrators/velocity_verlet.h"
+#include "../threading/thread_pool.h"
+
+
+struct BatchProps
+{
+	uint64_t Steps = 10000;
+	// ps
+	float Timestep = 0.002f;
+	PrecisionMode Precision = DefaultPrecision;
+
+	// Worker threads besides the main one, 0 uses every core
+	uint32_t WorkerCount = 0;
+	bool PinThreads = false;
+
+	// Domain decomposition over this many processes forked at startup. Ranks
+	// started from outside set PY_RANK and PY_RANK_COUNT instead
+	uint32_t Ranks = 1;
+	TransportKind Transport = TransportKind::SharedMemory;
+	// Rank 0 recomputes the first and last step's energy and forces on its own
+	// and fails the run if the decomposed ones differ
+	bool CheckRanks = false;
+
+	// Built-in system: a cubic lattice of LatticeSize^3 Lennard-Jones atoms
+	// (argon by default) at Density atoms / nm^3 with Maxwell-Boltzmann velocities.
+	// A nonzero Charge alternates +-Charge over the lattice and adds PME
+	uint32_t LatticeSize = 16;
+	float Density = 21.0f;
+	float Mass = 39.948f;
+	float Epsilon = 0.996f;
+	float Sigma = 0.3405f;
+	float Charge = 0.0f;
+	float Cutoff = 1.0f;
+	uint64_t Seed = 1;
+	// PDB, GRO or XYZ file run instead of the lattice. It needs a box; every
+	// pair of elements interacts through the Epsilon / Sigma pair and atoms are
+	// uncharged. Velocities are drawn like the lattice's unless the file has them
+	std::string InputFile;
+
+	bool UseThermostat = false;
+	ThermostatProps Thermostat = ThermostatProps(ThermostatKind::VelocityRescale, 120.0f);
+	bool UseBarostat = false;
+	BarostatProps Barostat = BarostatProps(1.0f, 2.0f, 4.5e-5f, 120.0f);
+
+	// Steps between energy lines and progress reports
+	uint32_t OutputInterval = 1000;
+	// CSV of the energies every OutputInterval steps, empty for none
+	std::string EnergyFile;
+	// XYZ of the last frame, empty for none
+	std::string FinalFrameFile;
+	// Compressed trajectory written in the background, empty for none
+	std::string TrajectoryFile;
+	TrajectoryWriterProps Trajectory;
+
+	bool ShowHelp = false;
+};
+
+// Fills props from the command line, false after logging what was wrong
+bool ParseBatchArgs(int argc, char** argv, BatchProps& props);
+void PrintBatchUsage();
+
+// Unattended runs without a window: builds the system, runs the steps on the
+// whole thread pool and reports the throughput. Links nothing of the renderer,
+// so it runs on nodes without a display or OpenGL.
+//
+// With more than one rank every process builds the same system and keeps its
+// own domain of it, rank 0 writes the outputs. Forking has to happen before
+// the runner starts its threads, see main.
+class BatchRunner
+{
+public:
+	BatchRunner(const BatchProps& props, const TransportProps& transport = TransportProps());
+	~BatchRunner();
+
+	// Returns the process exit code
+	int Run();
+
+	World& GetWorld() { return m_World; }
+
+private:
+	bool BuildSystem();
+	void BuildLattice();
+	bool LoadInput();
+	void AddForces(World& world) const;
+	bool Decompose();
+	// Collective: rank 0 compares the decomposed energy and forces with its own single rank evaluation
+	bool CheckAgainstOneRank(const char* stage);
+	bool IsRoot() const { return !m_Transport || m_Transport->GetRank() == 0; }
+	bool OpenOutputs();
+	void WriteEnergies(uint64_t step);
+	bool WriteFinalFrame();
+
+private:
+	BatchProps m_Props;
+	TransportProps m_TransportProps;
+	ThreadPool m_ThreadPool;
+	World m_World;
+	VelocityVerletIntegrator* m_Integrator = nullptr;
+	// Element of each atom type when the system came from a file
+	std::vector<uint8_t> m_TypeElements;
+
+	std::unique_ptr<Transport> m_Transport;
+	std::unique_ptr<DomainDecomposition> m_Domain;
+	// Every atom in global id order as built, kept while decomposed
+	AtomStore m_FullSystem;
+
+	std::ofstream m_Energies;
+	TrajectoryWriter m_Trajectory;
+};
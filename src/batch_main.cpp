@@ -0,0 +1,39 @@
+#include "batch/batch_runner.h"
+#include "logging/log.h"
+
+// Entry point of the headless target, see BatchRunner
+int main(int argc, char** argv)
+{
+    Log::Init();
+
+    BatchProps props;
+    if (!ParseBatchArgs(argc, argv, props))
+    {
+        PrintBatchUsage();
+        return 1;
+    }
+    if (props.ShowHelp)
+    {
+        PrintBatchUsage();
+        return 0;
+    }
+
+    // Ranks are forked before the runner starts any threads. Without --ranks
+    // the environment may still make this process one rank of a larger run
+    TransportProps transport = TransportProps::FromEnvironment();
+    if (props.Ranks > 1)
+    {
+        transport.Kind = props.Transport;
+        if (!ForkLocalRanks(transport, props.Ranks))
+            return 1;
+    }
+
+    int result = 0;
+    {
+        BatchRunner runner(props, transport);
+        result = runner.Run();
+    }
+    if (props.Ranks > 1 && transport.Rank == 0 && !WaitForLocalRanks())
+        result = 1;
+    return result;
+}
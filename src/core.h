@@ -3,3 +3,7 @@
 
 #define PY_CORE_ASSERT(x, ...) { if(!(x)) { PY_CORE_ERROR("Assertion Failed: {0}", __VA_ARGS__); __debugbreak(); } }
 
+// Runtime files such as shaders, the build points this at the source tree
+#ifndef PY_ASSET_DIR
+#define PY_ASSET_DIR "assets"
+#endif
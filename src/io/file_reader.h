@@ -1,51 +1,24 @@
 #pragma once
 
 #include <fstream>
-#include <iostream>
+#include <sstream>
 #include <string>
-#include <vector>
 
+#include "../logging/log.h"
 
-inline std::string ReadFile(std::string loc)
-{
-    std::string content;
-    std::ifstream fileStream(loc, std::ios::in);
-
-    if (!fileStream.is_open())
-    {
-        std::cout << "Failed to read %s! File doesn't exist at " << loc << std::endl;
-        return "";
-    }
-
-    std::string line = "";
-    while (!fileStream.eof())
-    {
-        std::getline(fileStream, line);
-        content.append(line + "\n");
-    }
-
-    fileStream.close();
-    return content;
-}
 
-inline std::vector<std::string> ReadFileLineByLine(std::string loc)
+// Whole text file in one string, empty after logging if it can't be read.
+// Structure files go through LoadStructure, which maps them instead
+inline std::string ReadFile(const std::string& loc)
 {
-    std::vector<std::string> content;
-    std::ifstream fileStream(loc, std::ios::in);
-
+    std::ifstream fileStream(loc, std::ios::in | std::ios::binary);
     if (!fileStream.is_open())
     {
-        std::cout << "Failed to read %s! File doesn't exist at " << loc << std::endl;
-        return std::vector<std::string>();
-    }
-
-    std::string line = "";
-    while (!fileStream.eof())
-    {
-        std::getline(fileStream, line);
-        content.push_back(line);
+        PY_CORE_ERROR("Failed to read {0}, the file doesn't exist", loc);
+        return "";
     }
 
-    fileStream.close();
-    return content;
+    std::ostringstream content;
+    content << fileStream.rdbuf();
+    return content.str();
 }
@@ -0,0 +1,129 @@
+#include "file_watcher.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#if defined(__linux__)
+	#include <sys/inotify.h>
+	#include <unistd.h>
+#endif
+
+#include "../logging/log.h"
+
+
+namespace
+{
+	long long GetWriteTime(const std::string& path)
+	{
+		std::error_code error;
+		auto time = std::filesystem::last_write_time(path, error);
+		return error ? 0 : (long long)time.time_since_epoch().count();
+	}
+}
+
+
+FileWatcher::~FileWatcher()
+{
+#if defined(__linux__)
+	if (m_Inotify != -1)
+		close(m_Inotify);
+#endif
+}
+
+std::string FileWatcher::NormalizePath(const std::string& path)
+{
+	return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
+bool FileWatcher::Watch(const std::string& path)
+{
+	const std::string file = NormalizePath(path);
+	if (m_Files.contains(file))
+		return true;
+
+#if defined(__linux__)
+	if (m_Inotify == -1)
+	{
+		m_Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_Inotify == -1)
+		{
+			PY_CORE_ERROR("Could not start watching files, inotify_init1 failed");
+			return false;
+		}
+	}
+
+	std::string directory = std::filesystem::path(file).parent_path().generic_string();
+	if (directory.empty())
+		directory = ".";
+
+	// One watch per directory, adding the same one again returns the same descriptor
+	int watch = inotify_add_watch(m_Inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (watch == -1)
+	{
+		PY_CORE_ERROR("Could not watch {0}", directory);
+		return false;
+	}
+	m_Directories[watch] = directory;
+#endif
+
+	m_Files[file] = GetWriteTime(file);
+	return true;
+}
+
+bool FileWatcher::IsWatching(const std::string& path) const
+{
+	return m_Files.contains(NormalizePath(path));
+}
+
+std::vector<std::string> FileWatcher::Poll()
+{
+	std::vector<std::string> changed;
+
+#if defined(__linux__)
+	if (m_Inotify == -1)
+		return changed;
+
+	alignas(inotify_event) char buffer[4096];
+	while (true)
+	{
+		ssize_t length = read(m_Inotify, buffer, sizeof(buffer));
+		if (length <= 0)
+			break;
+
+		for (char* at = buffer; at < buffer + length; )
+		{
+			const inotify_event* event = (const inotify_event*)at;
+			at += sizeof(inotify_event) + event->len;
+
+			auto directory = m_Directories.find(event->wd);
+			if (event->len == 0 || directory == m_Directories.end())
+				continue;
+
+			const std::string file = NormalizePath(directory->second + "/" + event->name);
+			if (m_Files.contains(file) && std::find(changed.begin(), changed.end(), file) == changed.end())
+				changed.push_back(file);
+		}
+	}
+
+	for (const std::string& file : changed)
+		m_Files[file] = GetWriteTime(file);
+#else
+	// Checking every frame would cost a stat per file per frame for nothing
+	auto now = std::chrono::steady_clock::now();
+	if (now - m_LastPoll < std::chrono::milliseconds(250))
+		return changed;
+	m_LastPoll = now;
+
+	for (auto& [file, writeTime] : m_Files)
+	{
+		long long time = GetWriteTime(file);
+		if (time != 0 && time != writeTime)
+		{
+			writeTime = time;
+			changed.push_back(file);
+		}
+	}
+#endif
+
+	return changed;
+}
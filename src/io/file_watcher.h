@@ -0,0 +1,43 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// Reports files that were written since the last Poll. On Linux the parent
+// directories are watched with inotify, which also catches editors that save
+// by writing a new file and renaming it over the old one. Elsewhere Poll
+// compares modification times, at most a few times a second. Poll never
+// blocks, so it can run every frame.
+class FileWatcher
+{
+public:
+	FileWatcher() {}
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	bool Watch(const std::string& path);
+	bool IsWatching(const std::string& path) const;
+
+	// Changed files, in the normalized form NormalizePath gives. A file
+	// written several times between polls shows up once
+	std::vector<std::string> Poll();
+
+	static std::string NormalizePath(const std::string& path);
+
+private:
+	// Normalized path -> last modification time seen, in ticks of the file clock
+	std::unordered_map<std::string, long long> m_Files;
+
+#if defined(__linux__)
+	int m_Inotify = -1;
+	// Watch descriptor -> directory
+	std::unordered_map<int, std::string> m_Directories;
+#else
+	std::chrono::steady_clock::time_point m_LastPoll;
+#endif
+};
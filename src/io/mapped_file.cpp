@@ -0,0 +1,155 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <utility>
+
+#if defined(_WIN32)
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include "../logging/log.h"
+
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		std::swap(m_Data, other.m_Data);
+		std::swap(m_Size, other.m_Size);
+		std::swap(m_Open, other.m_Open);
+#if defined(_WIN32)
+		std::swap(m_File, other.m_File);
+		std::swap(m_Mapping, other.m_Mapping);
+#endif
+	}
+	return *this;
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		PY_CORE_ERROR("Could not open {0}", path);
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		PY_CORE_ERROR("Could not read the size of {0}", path);
+		CloseHandle(file);
+		return false;
+	}
+	m_File = file;
+	m_Size = static_cast<size_t>(size.QuadPart);
+	m_Open = true;
+	if (m_Size == 0)
+		return true;
+
+	m_Mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_Mapping)
+		m_Data = static_cast<const uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	const int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		PY_CORE_ERROR("Could not open {0}", path);
+		return false;
+	}
+	struct stat info;
+	if (fstat(file, &info) != 0)
+	{
+		PY_CORE_ERROR("Could not read the size of {0}", path);
+		close(file);
+		return false;
+	}
+	m_Size = static_cast<size_t>(info.st_size);
+	m_Open = true;
+	if (m_Size == 0)
+	{
+		close(file);
+		return true;
+	}
+
+	// The mapping keeps the file referenced, the descriptor is not needed past this
+	void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (data != MAP_FAILED)
+		m_Data = static_cast<const uint8_t*>(data);
+#endif
+
+	if (!m_Data)
+	{
+		PY_CORE_ERROR("Could not map {0} ({1} bytes)", path, m_Size);
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+#if defined(_WIN32)
+	if (m_Data)
+		UnmapViewOfFile(m_Data);
+	if (m_Mapping)
+		CloseHandle(m_Mapping);
+	if (m_File)
+		CloseHandle(m_File);
+	m_Mapping = nullptr;
+	m_File = nullptr;
+#else
+	if (m_Data)
+		munmap(const_cast<uint8_t*>(m_Data), m_Size);
+#endif
+	m_Data = nullptr;
+	m_Size = 0;
+	m_Open = false;
+}
+
+void MappedFile::Prefetch(size_t offset, size_t size) const
+{
+	if (!m_Data || offset >= m_Size)
+		return;
+	size = std::min(size, m_Size - offset);
+
+#if defined(_WIN32)
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = const_cast<uint8_t*>(m_Data + offset);
+	range.NumberOfBytes = size;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	// madvise wants a page aligned start
+	const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t aligned = offset & ~(page - 1);
+	madvise(const_cast<uint8_t*>(m_Data + aligned), size + (offset - aligned), MADV_WILLNEED);
+#endif
+}
+
+void MappedFile::AdviseSequential() const
+{
+#if !defined(_WIN32)
+	if (m_Data)
+		madvise(const_cast<uint8_t*>(m_Data), m_Size, MADV_SEQUENTIAL);
+#endif
+}
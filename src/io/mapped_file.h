@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// Read-only view of a whole file in the address space. The OS pages it in on
+// first touch and may drop clean pages again under memory pressure, so even
+// files far larger than RAM can be mapped and read at random.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile();
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// False after logging why. Empty files open fine with a null Data()
+	bool Open(const std::string& path);
+	void Close();
+
+	bool IsOpen() const { return m_Open; }
+	const uint8_t* Data() const { return m_Data; }
+	size_t Size() const { return m_Size; }
+
+	// Hints that [offset, offset + size) is needed soon, the OS starts reading it in
+	void Prefetch(size_t offset, size_t size) const;
+	// Hints that the range is read front to back once
+	void AdviseSequential() const;
+
+private:
+	const uint8_t* m_Data = nullptr;
+	size_t m_Size = 0;
+	bool m_Open = false;
+#if defined(_WIN32)
+	void* m_File = nullptr;
+	void* m_Mapping = nullptr;
+#endif
+};
@@ -0,0 +1,684 @@
+#include "structure_loader.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <string_view>
+
+#include "mapped_file.h"
+#include "../logging/log.h"
+#include "../threading/thread_pool.h"
+
+
+namespace
+{
+	struct ElementInfo
+	{
+		const char* Symbol;
+		float Mass;
+	};
+
+	constexpr ElementInfo ElementTable[] = {
+		{ "X", 0.0f },
+		{ "H", 1.008f }, { "He", 4.0026f }, { "Li", 6.94f }, { "Be", 9.0122f }, { "B", 10.81f }, { "C", 12.011f },
+		{ "N", 14.007f }, { "O", 15.999f }, { "F", 18.998f }, { "Ne", 20.180f }, { "Na", 22.990f }, { "Mg", 24.305f },
+		{ "Al", 26.982f }, { "Si", 28.085f }, { "P", 30.974f }, { "S", 32.06f }, { "Cl", 35.45f }, { "Ar", 39.948f },
+		{ "K", 39.098f }, { "Ca", 40.078f }, { "Sc", 44.956f }, { "Ti", 47.867f }, { "V", 50.942f }, { "Cr", 51.996f },
+		{ "Mn", 54.938f }, { "Fe", 55.845f }, { "Co", 58.933f }, { "Ni", 58.693f }, { "Cu", 63.546f }, { "Zn", 65.38f },
+		{ "Ga", 69.723f }, { "Ge", 72.630f }, { "As", 74.922f }, { "Se", 78.971f }, { "Br", 79.904f }, { "Kr", 83.798f },
+		{ "Rb", 85.468f }, { "Sr", 87.62f }, { "Y", 88.906f }, { "Zr", 91.224f }, { "Nb", 92.906f }, { "Mo", 95.95f },
+		{ "Tc", 98.0f }, { "Ru", 101.07f }, { "Rh", 102.91f }, { "Pd", 106.42f }, { "Ag", 107.87f }, { "Cd", 112.41f },
+		{ "In", 114.82f }, { "Sn", 118.71f }, { "Sb", 121.76f }, { "Te", 127.60f }, { "I", 126.90f }, { "Xe", 131.29f },
+		{ "Cs", 132.91f }, { "Ba", 137.33f }
+	};
+	constexpr uint32_t ElementCount = sizeof(ElementTable) / sizeof(ElementTable[0]);
+
+	constexpr double NanometersPerAngstrom = 0.1;
+	// Chunks much smaller than this cost more to schedule than to parse
+	constexpr size_t MinChunkBytes = 1 << 20;
+
+	// Case-insensitive symbol lookup, 0 if it is not an element
+	uint8_t ElementFromSymbol(std::string_view symbol)
+	{
+		if (symbol.empty() || symbol.size() > 2)
+			return 0;
+		const char first = (char)std::toupper((unsigned char)symbol[0]);
+		const char second = symbol.size() > 1 ? (char)std::tolower((unsigned char)symbol[1]) : '\0';
+		for (uint32_t element = 1; element < ElementCount; element++)
+		{
+			const char* name = ElementTable[element].Symbol;
+			if (name[0] == first && name[1] == second)
+				return (uint8_t)element;
+		}
+		return 0;
+	}
+
+	std::string_view Trim(std::string_view text)
+	{
+		while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+			text.remove_prefix(1);
+		while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+			text.remove_suffix(1);
+		return text;
+	}
+
+	// Fixed-width field, cut short or empty where the line ends early
+	std::string_view Column(std::string_view line, size_t start, size_t width)
+	{
+		if (start >= line.size())
+			return {};
+		return line.substr(start, width);
+	}
+
+	// Whitespace separated fields, for the free format lines
+	std::string_view NextToken(std::string_view& text)
+	{
+		text = Trim(text);
+		size_t length = 0;
+		while (length < text.size() && text[length] != ' ' && text[length] != '\t')
+			length++;
+		std::string_view token = text.substr(0, length);
+		text.remove_prefix(length);
+		return token;
+	}
+
+	// The whole field has to be the number, blanks around it aside
+	template<typename T>
+	bool ParseNumber(std::string_view field, T& value)
+	{
+		field = Trim(field);
+		if (!field.empty() && field.front() == '+')
+			field.remove_prefix(1);
+		if (field.empty())
+			return false;
+		auto [end, error] = std::from_chars(field.data(), field.data() + field.size(), value);
+		return error == std::errc() && end == field.data() + field.size();
+	}
+
+	// Calls func(line) for every line in [begin, end) without the line break,
+	// stops early when func returns false
+	template<typename F>
+	void ForEachLine(const char* begin, const char* end, F&& func)
+	{
+		while (begin < end)
+		{
+			const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+			const char* lineEnd = newline ? newline : end;
+			std::string_view line(begin, lineEnd - begin);
+			if (!line.empty() && line.back() == '\r')
+				line.remove_suffix(1);
+			if (!func(line))
+				return;
+			begin = newline ? newline + 1 : end;
+		}
+	}
+
+	bool StartsWith(std::string_view line, std::string_view prefix)
+	{
+		return line.substr(0, prefix.size()) == prefix;
+	}
+
+	bool IsPdbAtom(std::string_view line)
+	{
+		return StartsWith(line, "ATOM  ") || StartsWith(line, "HETATM");
+	}
+
+	// The first model ends at ENDMDL or END, later models are not read
+	bool IsPdbEnd(std::string_view line)
+	{
+		return StartsWith(line, "ENDMDL") || (StartsWith(line, "END") && Trim(line.substr(3)).empty());
+	}
+
+	// Element columns 77-78 when present, otherwise guessed from the atom name
+	// in columns 13-16, where two letter elements start one column earlier
+	uint8_t PdbElement(std::string_view line)
+	{
+		if (uint8_t element = ElementFromSymbol(Trim(Column(line, 76, 2))))
+			return element;
+
+		std::string_view name = Column(line, 12, 4);
+		if (name.empty())
+			return 0;
+		const bool fourLetterHydrogen = name.size() == 4 && name[0] == 'H' && name[3] != ' ';
+		if (name[0] != ' ' && !std::isdigit((unsigned char)name[0]) && !fourLetterHydrogen)
+		{
+			if (uint8_t element = ElementFromSymbol(Trim(name.substr(0, 2))))
+				return element;
+		}
+		for (char c : name)
+		{
+			if (std::isalpha((unsigned char)c))
+				return ElementFromSymbol(std::string_view(&c, 1));
+		}
+		return 0;
+	}
+
+	// GRO names have no column convention. The first letter is the element,
+	// except for names that are just one of these ions
+	uint8_t GroElement(std::string_view name)
+	{
+		name = Trim(name);
+		while (!name.empty() && std::isdigit((unsigned char)name.front()))
+			name.remove_prefix(1);
+		size_t letters = 0;
+		while (letters < name.size() && std::isalpha((unsigned char)name[letters]))
+			letters++;
+		if (letters == 0)
+			return 0;
+
+		static constexpr std::array<std::string_view, 12> Ions = { "NA", "CL", "MG", "ZN", "FE", "LI", "BR", "CU", "MN", "CO", "RB", "CS" };
+		if (letters == 2)
+		{
+			const char upper[2] = { (char)std::toupper((unsigned char)name[0]), (char)std::toupper((unsigned char)name[1]) };
+			if (std::find(Ions.begin(), Ions.end(), std::string_view(upper, 2)) != Ions.end())
+				return ElementFromSymbol(name.substr(0, 2));
+		}
+		return ElementFromSymbol(name.substr(0, 1));
+	}
+
+	// Symbol, symbol with a label ("C12") or atomic number
+	uint8_t XyzElement(std::string_view token)
+	{
+		uint32_t number = 0;
+		if (ParseNumber(token, number))
+			return number < ElementCount ? (uint8_t)number : 0;
+
+		size_t letters = 0;
+		while (letters < token.size() && letters < 2 && std::isalpha((unsigned char)token[letters]))
+			letters++;
+		if (uint8_t element = ElementFromSymbol(token.substr(0, letters)))
+			return element;
+		return ElementFromSymbol(token.substr(0, 1));
+	}
+
+	// A run of whole lines parsed by one task
+	struct Chunk
+	{
+		const char* Begin;
+		const char* End;
+		// 0-based number of the chunk's first line
+		uint64_t FirstLine = 0;
+		uint64_t LineCount = 0;
+
+		// PDB only: atom records, where the first one goes, and whether the
+		// first model ends in this chunk
+		uint32_t Records = 0;
+		uint32_t FirstAtom = 0;
+		bool Ends = false;
+		const char* Cryst = nullptr;
+		const char* Title = nullptr;
+
+		// GRO only: the box line after the atoms
+		const char* BoxLine = nullptr;
+
+		bool Failed = false;
+		StructureLoadError Error;
+
+		Chunk(const char* begin, const char* end)
+			: Begin(begin), End(end) {
+		}
+
+		void Fail(uint64_t line, const std::string& message)
+		{
+			if (Failed)
+				return;
+			Failed = true;
+			Error.Line = line + 1;
+			Error.Message = message;
+		}
+	};
+
+	template<typename F>
+	void ForEachChunk(ThreadPool* pool, uint32_t count, F&& func)
+	{
+		if (!pool)
+		{
+			for (uint32_t c = 0; c < count; c++)
+				func(c);
+			return;
+		}
+		pool->ParallelFor(count, 1, [&func](uint32_t begin, uint32_t end, uint32_t)
+			{
+				for (uint32_t c = begin; c < end; c++)
+					func(c);
+			});
+	}
+
+	std::vector<Chunk> SplitLines(const char* data, size_t size, ThreadPool* pool)
+	{
+		const size_t threads = pool ? pool->GetThreadCount() : 1;
+		// A few chunks per thread so uneven ones even out
+		const size_t count = std::clamp<size_t>(size / MinChunkBytes, 1, threads * 4);
+
+		std::vector<Chunk> chunks;
+		const char* begin = data;
+		const char* end = data + size;
+		for (size_t c = 1; c <= count && begin < end; c++)
+		{
+			const char* split = c == count ? end : std::max(begin, data + size / count * c);
+			if (split < end)
+			{
+				const char* newline = static_cast<const char*>(std::memchr(split, '\n', end - split));
+				split = newline ? newline + 1 : end;
+			}
+			if (split > begin)
+				chunks.emplace_back(begin, split);
+			begin = split;
+		}
+		return chunks;
+	}
+
+	// Lines of one chunk by their 0-based file line number
+	template<typename F>
+	void ForEachChunkLine(const Chunk& chunk, F&& func)
+	{
+		uint64_t number = chunk.FirstLine;
+		ForEachLine(chunk.Begin, chunk.End, [&](std::string_view line) { return func(line, number++); });
+	}
+
+	std::string_view LineAt(const char* begin, const char* end)
+	{
+		std::string_view line;
+		ForEachLine(begin, end, [&line](std::string_view first) { line = first; return false; });
+		return line;
+	}
+
+	std::string_view ReadLine(std::string_view& text)
+	{
+		const size_t newline = text.find('\n');
+		std::string_view line = text.substr(0, newline);
+		text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+		if (!line.empty() && line.back() == '\r')
+			line.remove_suffix(1);
+		return line;
+	}
+
+	void SetAtom(AtomStore& atoms, uint32_t atom, const glm::dvec3& position)
+	{
+		atoms.PosX[atom] = (float)position.x;
+		atoms.PosY[atom] = (float)position.y;
+		atoms.PosZ[atom] = (float)position.z;
+	}
+
+	bool ParsePdb(Chunk& chunk, Structure& structure)
+	{
+		uint32_t atom = chunk.FirstAtom;
+		const uint32_t end = chunk.FirstAtom + chunk.Records;
+		ForEachChunkLine(chunk, [&](std::string_view line, uint64_t number)
+			{
+				if (atom == end)
+					return false;
+				if (!IsPdbAtom(line))
+					return true;
+
+				glm::dvec3 position;
+				if (!ParseNumber(Column(line, 30, 8), position.x) || !ParseNumber(Column(line, 38, 8), position.y) || !ParseNumber(Column(line, 46, 8), position.z))
+				{
+					chunk.Fail(number, "ATOM record without a readable position in columns 31-54");
+					return false;
+				}
+				SetAtom(structure.Atoms, atom, position * NanometersPerAngstrom);
+				structure.Elements[atom] = PdbElement(line);
+				atom++;
+				return true;
+			});
+		return !chunk.Failed;
+	}
+
+	bool ParseGro(Chunk& chunk, Structure& structure, size_t width)
+	{
+		const uint64_t atomCount = structure.Atoms.Size();
+		const bool velocities = structure.HasVelocities;
+		AtomStore& atoms = structure.Atoms;
+		ForEachChunkLine(chunk, [&](std::string_view line, uint64_t number)
+			{
+				if (number < 2)
+					return true;
+				if (number >= atomCount + 2)
+				{
+					if (number == atomCount + 2)
+						chunk.BoxLine = line.data();
+					return false;
+				}
+
+				const uint32_t atom = (uint32_t)(number - 2);
+				glm::dvec3 position;
+				if (!ParseNumber(Column(line, 20, width), position.x) || !ParseNumber(Column(line, 20 + width, width), position.y) || !ParseNumber(Column(line, 20 + 2 * width, width), position.z))
+				{
+					chunk.Fail(number, "atom line without a readable position");
+					return false;
+				}
+				SetAtom(atoms, atom, position);
+
+				if (velocities)
+				{
+					glm::dvec3 velocity;
+					if (!ParseNumber(Column(line, 20 + 3 * width, width), velocity.x) || !ParseNumber(Column(line, 20 + 4 * width, width), velocity.y) || !ParseNumber(Column(line, 20 + 5 * width, width), velocity.z))
+					{
+						chunk.Fail(number, "atom line without a readable velocity");
+						return false;
+					}
+					atoms.VelX[atom] = (float)velocity.x;
+					atoms.VelY[atom] = (float)velocity.y;
+					atoms.VelZ[atom] = (float)velocity.z;
+				}
+				structure.Elements[atom] = GroElement(Column(line, 10, 5));
+				return true;
+			});
+		return !chunk.Failed;
+	}
+
+	bool ParseXyz(Chunk& chunk, Structure& structure)
+	{
+		const uint64_t atomCount = structure.Atoms.Size();
+		ForEachChunkLine(chunk, [&](std::string_view line, uint64_t number)
+			{
+				if (number < 2)
+					return true;
+				if (number >= atomCount + 2)
+					return false;
+
+				const uint32_t atom = (uint32_t)(number - 2);
+				std::string_view rest = line;
+				const std::string_view symbol = NextToken(rest);
+				glm::dvec3 position;
+				if (!ParseNumber(NextToken(rest), position.x) || !ParseNumber(NextToken(rest), position.y) || !ParseNumber(NextToken(rest), position.z))
+				{
+					chunk.Fail(number, "atom line is not \"element x y z\"");
+					return false;
+				}
+				SetAtom(structure.Atoms, atom, position * NanometersPerAngstrom);
+				structure.Elements[atom] = XyzElement(symbol);
+				return true;
+			});
+		return !chunk.Failed;
+	}
+
+	// CRYST1 a b c alpha beta gamma, in A and degrees. The 1 A cube the PDB
+	// writes for structures without a cell means there is none
+	bool ParseCryst(std::string_view line, SimulationBox& box)
+	{
+		glm::dvec3 lengths;
+		double alpha, beta, gamma;
+		if (!ParseNumber(Column(line, 6, 9), lengths.x) || !ParseNumber(Column(line, 15, 9), lengths.y) || !ParseNumber(Column(line, 24, 9), lengths.z)
+			|| !ParseNumber(Column(line, 33, 7), alpha) || !ParseNumber(Column(line, 40, 7), beta) || !ParseNumber(Column(line, 47, 7), gamma))
+			return false;
+		if (lengths == glm::dvec3(1.0))
+			return false;
+
+		box = SimulationBox::FromLengthsAndAngles(glm::vec3(lengths * NanometersPerAngstrom), (float)alpha, (float)beta, (float)gamma);
+		return true;
+	}
+
+	// v1(x) v2(y) v3(z), then optionally v1(y) v1(z) v2(x) v2(z) v3(x) v3(y) for
+	// triclinic cells, which GROMACS keeps in the same lower triangular form
+	bool ParseGroBox(std::string_view line, SimulationBox& box)
+	{
+		double values[9] = {};
+		uint32_t count = 0;
+		for (std::string_view token = NextToken(line); !token.empty() && count < 9; token = NextToken(line))
+		{
+			if (!ParseNumber(token, values[count++]))
+				return false;
+		}
+		if (count != 3 && count != 9)
+			return false;
+
+		box = SimulationBox({ (float)values[0], (float)values[1], (float)values[2] }, { (float)values[5], (float)values[7], (float)values[8] });
+		return true;
+	}
+
+	// Extended XYZ: Lattice="ax ay az bx by bz cx cy cz" in the comment line, in A
+	bool ParseXyzLattice(std::string_view comment, SimulationBox& box)
+	{
+		const size_t start = comment.find("Lattice=\"");
+		if (start == std::string_view::npos)
+			return false;
+		std::string_view rest = comment.substr(start + 9);
+		rest = rest.substr(0, rest.find('"'));
+
+		double values[9];
+		for (double& value : values)
+		{
+			if (!ParseNumber(NextToken(rest), value))
+				return false;
+		}
+		if (values[1] != 0.0 || values[2] != 0.0 || values[5] != 0.0)
+		{
+			PY_CORE_WARN("XYZ lattice is not lower triangular, the box is ignored");
+			return false;
+		}
+
+		const double s = NanometersPerAngstrom;
+		box = SimulationBox({ (float)(values[0] * s), (float)(values[4] * s), (float)(values[8] * s) }, { (float)(values[3] * s), (float)(values[6] * s), (float)(values[7] * s) });
+		return true;
+	}
+
+	StructureLoadResult Fail(uint64_t line, std::string message)
+	{
+		return std::unexpected(StructureLoadError{ std::move(message), line });
+	}
+}
+
+const char* StructureFormatToString(StructureFormat format)
+{
+	switch (format)
+	{
+	case StructureFormat::Pdb: return "PDB";
+	case StructureFormat::Gro: return "GRO";
+	case StructureFormat::Xyz: return "XYZ";
+	case StructureFormat::Unknown: return "unknown";
+	}
+	return "unknown";
+}
+
+StructureFormat StructureFormatFromPath(const std::string& path)
+{
+	const size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos)
+		return StructureFormat::Unknown;
+
+	std::string extension = path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	if (extension == "pdb" || extension == "ent")
+		return StructureFormat::Pdb;
+	if (extension == "gro")
+		return StructureFormat::Gro;
+	if (extension == "xyz")
+		return StructureFormat::Xyz;
+	return StructureFormat::Unknown;
+}
+
+const char* GetElementSymbol(uint8_t element)
+{
+	return element < ElementCount ? ElementTable[element].Symbol : "X";
+}
+
+float GetElementMass(uint8_t element)
+{
+	return element < ElementCount ? ElementTable[element].Mass : 0.0f;
+}
+
+StructureLoadResult LoadStructure(const std::string& path, ThreadPool* pool, StructureFormat format)
+{
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point start = Clock::now();
+
+	if (format == StructureFormat::Unknown)
+		format = StructureFormatFromPath(path);
+	if (format == StructureFormat::Unknown)
+		return Fail(0, "unknown structure format, expected .pdb, .gro or .xyz");
+
+	MappedFile file;
+	if (!file.Open(path))
+		return Fail(0, "could not open " + path);
+	file.AdviseSequential();
+
+	const char* data = reinterpret_cast<const char*>(file.Data());
+	std::vector<Chunk> chunks = SplitLines(data, file.Size(), pool);
+
+	// Pass one counts lines, and for PDB the atom records, of every chunk
+	ForEachChunk(pool, (uint32_t)chunks.size(), [&chunks, format](uint32_t c)
+		{
+			Chunk& chunk = chunks[c];
+			chunk.LineCount = std::count(chunk.Begin, chunk.End, '\n');
+			if (format != StructureFormat::Pdb)
+				return;
+
+			ForEachLine(chunk.Begin, chunk.End, [&chunk](std::string_view line)
+				{
+					if (IsPdbAtom(line))
+						chunk.Records++;
+					else if (IsPdbEnd(line))
+					{
+						chunk.Ends = true;
+						return false;
+					}
+					else if (!chunk.Cryst && StartsWith(line, "CRYST1"))
+						chunk.Cryst = line.data();
+					else if (!chunk.Title && StartsWith(line, "TITLE"))
+						chunk.Title = line.data();
+					return true;
+				});
+		});
+
+	uint64_t lines = 0, records = 0;
+	bool ended = false;
+	for (Chunk& chunk : chunks)
+	{
+		chunk.FirstLine = lines;
+		lines += chunk.LineCount;
+		// Records past the end of the first model are not read
+		if (ended)
+			chunk.Records = 0;
+		chunk.FirstAtom = (uint32_t)std::min<uint64_t>(records, UINT32_MAX);
+		records += chunk.Records;
+		ended = ended || chunk.Ends;
+	}
+	// The last line usually has no line break
+	if (file.Size() > 0 && data[file.Size() - 1] != '\n')
+		lines++;
+
+	Structure structure;
+	structure.Format = format;
+
+	// Header lines and the atom count
+	uint64_t atomCount = 0;
+	size_t groWidth = 8;
+	std::string_view header(data, file.Size());
+	if (format == StructureFormat::Pdb)
+	{
+		atomCount = records;
+		if (atomCount == 0)
+			return Fail(0, "no ATOM or HETATM records");
+	}
+	else
+	{
+		const std::string_view first = ReadLine(header);
+		const std::string_view second = ReadLine(header);
+		const std::string_view countField = format == StructureFormat::Gro ? second : first;
+		if (!ParseNumber(countField, atomCount))
+			return Fail(format == StructureFormat::Gro ? 2 : 1, "expected the atom count");
+		const uint64_t needed = atomCount + (format == StructureFormat::Gro ? 3 : 2);
+		if (lines < needed)
+			return Fail(0, "file ends after " + std::to_string(lines) + " lines, the atom count needs " + std::to_string(needed));
+		structure.Title = std::string(Trim(format == StructureFormat::Gro ? first : second));
+
+		if (format == StructureFormat::Gro && atomCount > 0)
+		{
+			// Fields are as wide as the distance between the first two decimal points
+			const std::string_view line = ReadLine(header);
+			const size_t firstDot = line.find('.', 20);
+			const size_t secondDot = firstDot == std::string_view::npos ? firstDot : line.find('.', firstDot + 1);
+			if (secondDot != std::string_view::npos)
+				groWidth = secondDot - firstDot;
+			structure.HasVelocities = line.size() >= 20 + 6 * groWidth;
+		}
+		else if (format == StructureFormat::Xyz)
+		{
+			structure.HasBox = ParseXyzLattice(second, structure.Box);
+		}
+	}
+	if (atomCount > UINT32_MAX)
+		return Fail(0, "more atoms than fit a 32 bit index");
+
+	structure.Atoms.Resize(atomCount);
+	structure.Elements.resize(atomCount);
+
+	// Pass two parses every chunk straight into its range of the arrays
+	ForEachChunk(pool, (uint32_t)chunks.size(), [&](uint32_t c)
+		{
+			Chunk& chunk = chunks[c];
+			switch (format)
+			{
+			case StructureFormat::Pdb: ParsePdb(chunk, structure); break;
+			case StructureFormat::Gro: ParseGro(chunk, structure, groWidth); break;
+			case StructureFormat::Xyz: ParseXyz(chunk, structure); break;
+			case StructureFormat::Unknown: break;
+			}
+		});
+
+	for (const Chunk& chunk : chunks)
+	{
+		if (chunk.Failed)
+			return std::unexpected(chunk.Error);
+	}
+
+	if (format == StructureFormat::Pdb)
+	{
+		for (const Chunk& chunk : chunks)
+		{
+			if (chunk.Cryst && !structure.HasBox)
+				structure.HasBox = ParseCryst(LineAt(chunk.Cryst, data + file.Size()), structure.Box);
+			if (chunk.Title && structure.Title.empty())
+				structure.Title = std::string(Trim(Column(LineAt(chunk.Title, data + file.Size()), 10, std::string_view::npos)));
+		}
+	}
+	else if (format == StructureFormat::Gro)
+	{
+		const auto boxChunk = std::find_if(chunks.begin(), chunks.end(), [](const Chunk& chunk) { return chunk.BoxLine != nullptr; });
+		if (boxChunk == chunks.end() || !ParseGroBox(LineAt(boxChunk->BoxLine, data + file.Size()), structure.Box))
+			return Fail(atomCount + 3, "expected the box vectors");
+		structure.HasBox = true;
+	}
+
+	// Types number the elements in order of first appearance
+	int32_t typeOfElement[256];
+	std::fill(std::begin(typeOfElement), std::end(typeOfElement), -1);
+	uint64_t unknown = 0;
+	for (uint8_t element : structure.Elements)
+	{
+		if (typeOfElement[element] < 0)
+		{
+			typeOfElement[element] = (int32_t)structure.TypeElements.size();
+			structure.TypeElements.push_back(element);
+		}
+		unknown += element == 0;
+	}
+	if (unknown > 0)
+		PY_CORE_WARN("{0} atoms in {1} have no known element, they get no mass and do not move", unknown, path);
+
+	AtomStore& atoms = structure.Atoms;
+	auto fill = [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				const uint8_t element = structure.Elements[i];
+				const float mass = GetElementMass(element);
+				atoms.Mass[i] = mass;
+				atoms.InvMass[i] = mass > 0.0f ? 1.0f / mass : 0.0f;
+				atoms.TypeId[i] = (uint32_t)typeOfElement[element];
+			}
+		};
+	if (pool)
+		pool->ParallelFor((uint32_t)atomCount, 65536, [&fill](uint32_t begin, uint32_t end, uint32_t) { fill(begin, end); });
+	else
+		fill(0, (uint32_t)atomCount);
+
+	PY_CORE_INFO("Read {0} atoms of {1} elements from {2} ({3}) in {4:.3f} s", atomCount, structure.TypeElements.size(), path,
+		StructureFormatToString(format), std::chrono::duration<double>(Clock::now() - start).count());
+	return structure;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <string>
+#include <vector>
+
+#include "../simulation/atom_store.h"
+#include "../simulation/simulation_box.h"
+
+class ThreadPool;
+
+
+enum class StructureFormat
+{
+	Unknown = 0,
+	Pdb,
+	Gro,
+	Xyz
+};
+
+const char* StructureFormatToString(StructureFormat format);
+// From the extension, Unknown if it is none of .pdb, .gro and .xyz
+StructureFormat StructureFormatFromPath(const std::string& path);
+
+// Element symbol and standard atomic weight in g/mol of an atomic number,
+// "X" and 0 for 0 (unknown) and anything past the table
+const char* GetElementSymbol(uint8_t element);
+float GetElementMass(uint8_t element);
+
+// A system as read from a structure file, atoms in file order
+struct Structure
+{
+	StructureFormat Format = StructureFormat::Unknown;
+	std::string Title;
+
+	// Positions in nm and velocities in nm/ps (GRO only, zero otherwise).
+	// Masses come from the elements and type ids number the elements in order
+	// of first appearance. Charges are zero
+	AtomStore Atoms;
+	// Atomic number per atom, 0 where the element could not be told
+	std::vector<uint8_t> Elements;
+	// Element of each type id
+	std::vector<uint8_t> TypeElements;
+
+	SimulationBox Box;
+	// False when the file has no cell (PDB without CRYST1, plain XYZ)
+	bool HasBox = false;
+	bool HasVelocities = false;
+};
+
+struct StructureLoadError
+{
+	std::string Message;
+	// 1-based line the error is on, 0 if it is not about one line
+	uint64_t Line = 0;
+};
+
+using StructureLoadResult = std::expected<Structure, StructureLoadError>;
+
+// Reads the first model / frame of a PDB, GRO or XYZ file. The file is
+// memory mapped and cut into chunks at line boundaries; the chunks are
+// counted and then parsed in parallel on the pool (serially without one),
+// each writing straight into its range of the atom arrays.
+//
+// Format Unknown picks the format from the extension
+StructureLoadResult LoadStructure(const std::string& path, ThreadPool* pool = nullptr, StructureFormat format = StructureFormat::Unknown);
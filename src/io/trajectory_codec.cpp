@@ -0,0 +1,222 @@
+#include "trajectory_codec.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+
+namespace
+{
+	constexpr uint32_t BlockSize = 64;
+	// Quotients this long are stored raw instead, bounds the cost of outliers
+	constexpr uint32_t MaxUnary = 24;
+	// 2^61, keeps differences of two quantized values and their zigzag
+	// inside 64 bits
+	constexpr double MaxQuantized = 2305843009213693952.0;
+
+	class BitWriter
+	{
+	public:
+		BitWriter(std::vector<uint8_t>& out)
+			: m_Out(out) {
+		}
+
+		// Appends the low count bits of value, count <= 32
+		void Put(uint32_t value, uint32_t count)
+		{
+			m_Bits |= (uint64_t)value << m_Count;
+			m_Count += count;
+			if (m_Count >= 32)
+			{
+				const uint32_t word = (uint32_t)m_Bits;
+				m_Out.insert(m_Out.end(), { (uint8_t)word, (uint8_t)(word >> 8), (uint8_t)(word >> 16), (uint8_t)(word >> 24) });
+				m_Bits >>= 32;
+				m_Count -= 32;
+			}
+		}
+
+		void Flush()
+		{
+			for (; m_Count > 0; m_Count -= std::min(m_Count, 8u))
+			{
+				m_Out.push_back((uint8_t)m_Bits);
+				m_Bits >>= 8;
+			}
+		}
+
+	private:
+		std::vector<uint8_t>& m_Out;
+		uint64_t m_Bits = 0;
+		uint32_t m_Count = 0;
+	};
+
+	class BitReader
+	{
+	public:
+		BitReader(const uint8_t* data, size_t size)
+			: m_Data(data), m_End(data + size) {
+		}
+
+		// count <= 32
+		bool Get(uint32_t count, uint32_t& value)
+		{
+			if (!Fill(count))
+				return false;
+			value = count == 32 ? (uint32_t)m_Bits : (uint32_t)m_Bits & ((1u << count) - 1);
+			m_Bits >>= count;
+			m_Count -= count;
+			return true;
+		}
+
+		// Ones before the first zero, at most MaxUnary. The zero is consumed
+		// unless the run hit the limit
+		bool GetUnary(uint32_t& ones)
+		{
+			Fill(MaxUnary + 1);
+			ones = std::min<uint32_t>(std::countr_one(m_Bits), MaxUnary);
+			const uint32_t used = ones < MaxUnary ? ones + 1 : ones;
+			if (used > m_Count)
+				return false;
+			m_Bits >>= used;
+			m_Count -= used;
+			return true;
+		}
+
+	private:
+		bool Fill(uint32_t count)
+		{
+			while (m_Count <= 56 && m_Data < m_End)
+			{
+				m_Bits |= (uint64_t)*m_Data++ << m_Count;
+				m_Count += 8;
+			}
+			return m_Count >= count;
+		}
+
+	private:
+		const uint8_t* m_Data;
+		const uint8_t* m_End;
+		uint64_t m_Bits = 0;
+		uint32_t m_Count = 0;
+	};
+
+	// In 64 bits, an atom wrapped across a large box at a fine precision
+	// easily moves more than 2^31 steps
+	inline int64_t Quantize(float value, float precision)
+	{
+		const double scaled = (double)value * precision;
+		// NaN ends up as 0
+		return scaled == scaled ? (int64_t)std::llrint(std::clamp(scaled, -MaxQuantized, MaxQuantized)) : 0;
+	}
+
+	inline uint64_t ZigZag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+	inline int64_t UnZigZag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+	// Rice parameter for a block: about log2 of the mean, which is close to
+	// optimal for the geometric-looking distribution of the differences.
+	// Summed in double, 64 escaped values could overflow any integer
+	inline uint32_t PickParameter(const uint64_t* values, uint32_t count)
+	{
+		double sum = 0.0;
+		for (uint32_t i = 0; i < count; i++)
+			sum += (double)values[i];
+		const uint64_t mean = (uint64_t)(sum / count);
+		return mean > 0 ? std::min<uint32_t>(std::bit_width(mean) - 1, 31) : 0;
+	}
+}
+
+size_t CompressVectors(const glm::vec3* values, uint32_t count, float precision, std::vector<uint8_t>& out)
+{
+	const size_t start = out.size();
+	// Worst case about 90 bits a value, usually well under 16
+	out.reserve(start + (size_t)count * 12);
+	BitWriter writer(out);
+
+	const uint32_t total = count * 3;
+	uint64_t block[BlockSize];
+	int64_t previous[3] = { 0, 0, 0 };
+	uint32_t next = 0;
+
+	while (next < total)
+	{
+		const uint32_t length = std::min(BlockSize, total - next);
+		for (uint32_t j = 0; j < length; j++)
+		{
+			const uint32_t component = (next + j) % 3;
+			const int64_t quantized = Quantize(values[(next + j) / 3][component], precision);
+			block[j] = ZigZag(quantized - previous[component]);
+			previous[component] = quantized;
+		}
+
+		const uint32_t k = PickParameter(block, length);
+		writer.Put(k, 5);
+		const uint64_t mask = k ? (1ull << k) - 1 : 0;
+		for (uint32_t j = 0; j < length; j++)
+		{
+			const uint64_t quotient = block[j] >> k;
+			if (quotient < MaxUnary)
+			{
+				writer.Put((1u << quotient) - 1, (uint32_t)quotient + 1);
+				if (k)
+					writer.Put((uint32_t)(block[j] & mask), k);
+			}
+			else
+			{
+				writer.Put((1u << MaxUnary) - 1, MaxUnary);
+				writer.Put((uint32_t)block[j], 32);
+				writer.Put((uint32_t)(block[j] >> 32), 32);
+			}
+		}
+		next += length;
+	}
+
+	writer.Flush();
+	return out.size() - start;
+}
+
+bool DecompressVectors(const uint8_t* data, size_t size, uint32_t count, float precision, glm::vec3* values)
+{
+	BitReader reader(data, size);
+	const double scale = 1.0 / precision;
+
+	const uint32_t total = count * 3;
+	int64_t previous[3] = { 0, 0, 0 };
+	uint32_t next = 0;
+
+	while (next < total)
+	{
+		const uint32_t length = std::min(BlockSize, total - next);
+		uint32_t k;
+		if (!reader.Get(5, k))
+			return false;
+
+		for (uint32_t j = 0; j < length; j++)
+		{
+			uint32_t quotient;
+			uint64_t value;
+			if (!reader.GetUnary(quotient))
+				return false;
+			if (quotient < MaxUnary)
+			{
+				uint32_t remainder = 0;
+				if (k && !reader.Get(k, remainder))
+					return false;
+				value = ((uint64_t)quotient << k) | remainder;
+			}
+			else
+			{
+				uint32_t low, high;
+				if (!reader.Get(32, low) || !reader.Get(32, high))
+					return false;
+				value = ((uint64_t)high << 32) | low;
+			}
+
+			// Wraps instead of overflowing on corrupt data
+			const uint32_t component = (next + j) % 3;
+			previous[component] = (int64_t)((uint64_t)previous[component] + (uint64_t)UnZigZag(value));
+			values[(next + j) / 3][component] = (float)(previous[component] * scale);
+		}
+		next += length;
+	}
+	return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+
+// On-disk layout of .pytrj trajectories, all little-endian:
+//
+//   TrajectoryFileHeader
+//   frame 0: TrajectoryFrameHeader, positions, velocities, forces
+//   frame 1: ...
+//
+// The three sections of a frame are compressed with CompressVectors, an empty
+// section has a byte count of 0. Frames only reference themselves, so any
+// frame can be decoded from its offset alone.
+
+constexpr uint32_t TrajectoryFileMagic = 0x4a545950;   // "PYTJ"
+constexpr uint32_t TrajectoryFrameMagic = 0x4d415246;  // "FRAM"
+constexpr uint32_t TrajectoryVersion = 2;
+
+struct TrajectoryFileHeader
+{
+	uint32_t Magic = TrajectoryFileMagic;
+	uint32_t Version = TrajectoryVersion;
+	uint32_t AtomCount = 0;
+	uint32_t Reserved = 0;
+};
+
+struct TrajectoryFrameHeader
+{
+	uint32_t Magic = TrajectoryFrameMagic;
+	uint32_t AtomCount = 0;
+	uint64_t Step = 0;
+	double Time = 0.0;         // ps
+	float BoxSize[3] = {};     // nm, see SimulationBox
+	float BoxTilt[3] = {};
+	// Quantization steps per unit: per nm, per nm/ps and per kJ/mol/nm
+	float PositionPrecision = 0.0f;
+	float VelocityPrecision = 0.0f;
+	float ForcePrecision = 0.0f;
+	uint32_t PositionBytes = 0;
+	uint32_t VelocityBytes = 0;
+	uint32_t ForceBytes = 0;
+
+	uint64_t GetPayloadBytes() const { return (uint64_t)PositionBytes + VelocityBytes + ForceBytes; }
+};
+
+static_assert(sizeof(TrajectoryFileHeader) == 16, "trajectory file header layout changed");
+static_assert(sizeof(TrajectoryFrameHeader) == 72, "trajectory frame header layout changed");
+
+// Lossy, XTC-like compression of one vector per atom. Components are rounded
+// to multiples of 1 / precision, each atom is stored as the difference to the
+// one before it and the zigzagged 64 bit differences are Rice coded with a
+// parameter picked per block of 64 values. Neighbors in memory are neighbors
+// in space once the world sorts its atoms, which keeps the differences small.
+//
+// Appends to out and returns the number of bytes appended
+size_t CompressVectors(const glm::vec3* values, uint32_t count, float precision, std::vector<uint8_t>& out);
+// False if data ends early or is corrupt
+bool DecompressVectors(const uint8_t* data, size_t size, uint32_t count, float precision, glm::vec3* values);
@@ -0,0 +1,482 @@
+#include "trajectory_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+
+#include "../logging/log.h"
+
+
+namespace
+{
+	constexpr uint32_t IndexMagic = 0x49545950;  // "PYTI"
+	constexpr uint32_t IndexVersion = 1;
+	constexpr uint64_t NoFrame = std::numeric_limits<uint64_t>::max();
+
+	// Sidecar <trajectory>.idx: this header followed by FrameCount u64 offsets
+	struct IndexFileHeader
+	{
+		uint32_t Magic = IndexMagic;
+		uint32_t Version = IndexVersion;
+		// Trajectory size when the index was written, a smaller file means it was replaced
+		uint64_t SourceSize = 0;
+		uint64_t FrameCount = 0;
+		uint64_t IndexedBytes = 0;
+	};
+
+	std::string IndexPath(const std::string& path)
+	{
+		return path + ".idx";
+	}
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+	Close();
+}
+
+bool TrajectoryReader::Open(const std::string& path, const TrajectoryReaderProps& props)
+{
+	Close();
+
+	m_Props = props;
+	m_Path = path;
+	m_Props.CachedFrames = std::max(m_Props.CachedFrames, m_Props.PrefetchFrames + 2);
+
+	if (!m_File.Open(path))
+		return false;
+
+	TrajectoryFileHeader header;
+	if (m_File.Size() < sizeof(header))
+	{
+		PY_CORE_ERROR("{0} is too short to be a trajectory", path);
+		m_File.Close();
+		return false;
+	}
+	std::memcpy(&header, m_File.Data(), sizeof(header));
+	if (header.Magic != TrajectoryFileMagic || header.Version != TrajectoryVersion)
+	{
+		PY_CORE_ERROR("{0} is not a version {1} trajectory", path, TrajectoryVersion);
+		m_File.Close();
+		return false;
+	}
+	m_AtomCount = header.AtomCount;
+
+	m_IndexStale = false;
+	const bool cached = LoadIndex(path);
+	const uint64_t indexedFrames = m_Offsets.size();
+	if (m_IndexedBytes < m_File.Size())
+		ScanFrames(m_IndexedBytes);
+	if (m_Props.WriteIndex && (!cached || m_Offsets.size() != indexedFrames))
+		SaveIndex(path);
+
+	StartWorker();
+
+	PY_CORE_INFO("Opened trajectory {0}: {1} atoms, {2} frames{3}", path, m_AtomCount, m_Offsets.size(), cached ? " (cached index)" : "");
+	return true;
+}
+
+void TrajectoryReader::Close()
+{
+	StopWorker();
+
+	m_Offsets.clear();
+	m_AtomCount = 0;
+	m_IndexedBytes = 0;
+	m_File.Close();
+}
+
+void TrajectoryReader::StartWorker()
+{
+	m_Cache.assign(m_Props.CachedFrames, CacheEntry{ NoFrame, nullptr, 0, false });
+	m_Queue.clear();
+	m_UseCounter = 0;
+	m_LastRequested = 0;
+	m_Backwards = false;
+	m_Closing = false;
+	m_Worker = std::thread(&TrajectoryReader::WorkerLoop, this);
+}
+
+void TrajectoryReader::StopWorker()
+{
+	if (m_Worker.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Closing = true;
+		}
+		m_Condition.notify_all();
+		m_Worker.join();
+	}
+
+	// Frames handed out before stay valid, the cache only drops its references
+	m_Cache.clear();
+	m_Queue.clear();
+}
+
+bool TrajectoryReader::LoadIndex(const std::string& path)
+{
+	m_Offsets.clear();
+	m_IndexedBytes = sizeof(TrajectoryFileHeader);
+
+	std::ifstream file(IndexPath(path), std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	IndexFileHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.Magic != IndexMagic || header.Version != IndexVersion
+		|| header.SourceSize > m_File.Size() || header.IndexedBytes > m_File.Size()
+		|| header.IndexedBytes < sizeof(TrajectoryFileHeader)
+		|| header.FrameCount > (header.IndexedBytes - sizeof(TrajectoryFileHeader)) / sizeof(TrajectoryFrameHeader))
+		return false;
+
+	std::vector<uint64_t> offsets(header.FrameCount);
+	file.read(reinterpret_cast<char*>(offsets.data()), (std::streamsize)(offsets.size() * sizeof(uint64_t)));
+	if (!file)
+		return false;
+
+	if (!offsets.empty())
+	{
+		// Nothing is read through the offsets before they are known to be in order,
+		// a whole frame header apart and inside the indexed bytes
+		bool valid = offsets.front() == sizeof(TrajectoryFileHeader)
+			&& offsets.back() <= header.IndexedBytes - sizeof(TrajectoryFrameHeader);
+		for (size_t i = 1; valid && i < offsets.size(); i++)
+			valid = offsets[i] > offsets[i - 1] && offsets[i] - offsets[i - 1] >= sizeof(TrajectoryFrameHeader);
+
+		// A stale index from an overwritten file rarely survives this: the first and
+		// last frames have to be where it says and the last has to end at IndexedBytes.
+		// Frames in between are checked as they are decoded
+		if (valid)
+		{
+			m_Offsets.swap(offsets);
+			const TrajectoryFrameHeader first = GetFrameHeader(0), last = GetFrameHeader(m_Offsets.size() - 1);
+			valid = first.Magic == TrajectoryFrameMagic && first.AtomCount == m_AtomCount
+				&& last.Magic == TrajectoryFrameMagic && last.AtomCount == m_AtomCount
+				&& last.GetPayloadBytes() == header.IndexedBytes - m_Offsets.back() - sizeof(TrajectoryFrameHeader);
+		}
+		if (!valid)
+		{
+			PY_CORE_WARN("Frame index of {0} does not match the file, rebuilding it", path);
+			m_Offsets.clear();
+			return false;
+		}
+	}
+	else if (header.IndexedBytes != sizeof(TrajectoryFileHeader))
+	{
+		return false;
+	}
+
+	m_IndexedBytes = header.IndexedBytes;
+	return true;
+}
+
+void TrajectoryReader::ScanFrames(uint64_t offset)
+{
+	const uint8_t* data = m_File.Data();
+	const uint64_t size = m_File.Size();
+
+	while (offset + sizeof(TrajectoryFrameHeader) <= size)
+	{
+		TrajectoryFrameHeader header;
+		std::memcpy(&header, data + offset, sizeof(header));
+		const uint64_t end = offset + sizeof(header) + header.GetPayloadBytes();
+		if (header.Magic != TrajectoryFrameMagic || header.AtomCount != m_AtomCount || end > size)
+			break;
+
+		m_Offsets.push_back(offset);
+		offset = end;
+	}
+
+	m_IndexedBytes = offset;
+	// Usually a run that is still writing or was killed mid-frame
+	if (offset != size)
+		PY_CORE_WARN("Trajectory ends in {0} bytes that are not a complete frame, they are ignored", size - offset);
+}
+
+void TrajectoryReader::SaveIndex(const std::string& path) const
+{
+	const std::string target = IndexPath(path);
+	const std::string temporary = target + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			PY_CORE_WARN("Could not write the frame index {0}, the next open scans again", target);
+			return;
+		}
+
+		IndexFileHeader header;
+		header.SourceSize = m_File.Size();
+		header.FrameCount = m_Offsets.size();
+		header.IndexedBytes = m_IndexedBytes;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(m_Offsets.data()), (std::streamsize)(m_Offsets.size() * sizeof(uint64_t)));
+		if (!file)
+		{
+			PY_CORE_WARN("Could not write the frame index {0}, the next open scans again", target);
+			return;
+		}
+	}
+
+	// Readers opening the same file never see half an index
+	std::error_code error;
+	std::filesystem::rename(temporary, target, error);
+	if (error)
+	{
+		PY_CORE_WARN("Could not write the frame index {0}: {1}", target, error.message());
+		std::filesystem::remove(temporary, error);
+	}
+}
+
+void TrajectoryReader::Rescan()
+{
+	std::unique_lock<std::shared_mutex> indexLock(m_IndexMutex);
+	// Another caller may have rescanned while this one waited
+	if (!m_IndexStale)
+		return;
+	StopWorker();
+
+	m_IndexStale = false;
+	m_Offsets.clear();
+	ScanFrames(sizeof(TrajectoryFileHeader));
+	if (m_Props.WriteIndex)
+		SaveIndex(m_Path);
+	PY_CORE_INFO("Rescanned trajectory {0}: {1} frames", m_Path, m_Offsets.size());
+
+	StartWorker();
+}
+
+TrajectoryFrameHeader TrajectoryReader::GetFrameHeader(uint64_t index) const
+{
+	// Frames are not aligned in the file
+	TrajectoryFrameHeader header;
+	std::memcpy(&header, m_File.Data() + m_Offsets[index], sizeof(header));
+	return header;
+}
+
+bool TrajectoryReader::Decode(uint64_t index, TrajectoryFrame& frame) const
+{
+	frame.Index = index;
+	frame.Header = GetFrameHeader(index);
+	const TrajectoryFrameHeader& header = frame.Header;
+
+	// Frames are stored back to back, so a frame the index has right ends
+	// exactly where the next one starts
+	const uint64_t offset = m_Offsets[index];
+	const uint64_t end = index + 1 < m_Offsets.size() ? m_Offsets[index + 1] : m_IndexedBytes;
+	if (header.Magic != TrajectoryFrameMagic || header.AtomCount != m_AtomCount
+		|| header.GetPayloadBytes() != end - offset - sizeof(TrajectoryFrameHeader))
+	{
+		PY_CORE_WARN("Trajectory frame {0} is not where the index says, rescanning the file", index);
+		m_IndexStale = true;
+		return false;
+	}
+	const uint8_t* payload = m_File.Data() + offset + sizeof(TrajectoryFrameHeader);
+
+	frame.Positions.resize(header.AtomCount);
+	frame.Velocities.resize(header.VelocityPrecision > 0.0f ? header.AtomCount : 0);
+	frame.Forces.resize(header.ForcePrecision > 0.0f ? header.AtomCount : 0);
+
+	bool decoded = DecompressVectors(payload, header.PositionBytes, header.AtomCount, header.PositionPrecision, frame.Positions.data());
+	payload += header.PositionBytes;
+	if (decoded && !frame.Velocities.empty())
+		decoded = DecompressVectors(payload, header.VelocityBytes, header.AtomCount, header.VelocityPrecision, frame.Velocities.data());
+	payload += header.VelocityBytes;
+	if (decoded && !frame.Forces.empty())
+		decoded = DecompressVectors(payload, header.ForceBytes, header.AtomCount, header.ForcePrecision, frame.Forces.data());
+
+	if (!decoded)
+		PY_CORE_ERROR("Trajectory frame {0} (step {1}) is corrupt", index, header.Step);
+	return decoded;
+}
+
+TrajectoryReader::CacheEntry* TrajectoryReader::FindEntry(uint64_t index)
+{
+	for (CacheEntry& entry : m_Cache)
+	{
+		if (entry.Index == index)
+			return &entry;
+	}
+	return nullptr;
+}
+
+std::shared_ptr<TrajectoryFrame> TrajectoryReader::ClaimEntry(uint64_t index)
+{
+	// A free slot, otherwise the least recently used frame that is not being decoded
+	CacheEntry* victim = nullptr;
+	for (CacheEntry& entry : m_Cache)
+	{
+		if (entry.Index == NoFrame)
+		{
+			victim = &entry;
+			break;
+		}
+		if (entry.Ready && (!victim || entry.LastUse < victim->LastUse))
+			victim = &entry;
+	}
+	if (!victim)
+		return nullptr;
+
+	// Frames nobody holds anymore are decoded into again, their vectors keep their capacity
+	if (!victim->Frame || victim->Frame.use_count() > 1)
+		victim->Frame = std::make_shared<TrajectoryFrame>();
+	victim->Index = index;
+	victim->LastUse = ++m_UseCounter;
+	victim->Ready = false;
+	return victim->Frame;
+}
+
+void TrajectoryReader::QueuePrefetch(uint64_t index, bool includeIndex)
+{
+	if (index != m_LastRequested)
+		m_Backwards = index < m_LastRequested;
+	m_LastRequested = index;
+
+	// Whatever was queued for an earlier position is no use anymore
+	m_Queue.clear();
+	if (includeIndex)
+		m_Queue.push_back(index);
+
+	const uint64_t count = m_Offsets.size();
+	uint64_t first = NoFrame, last = 0;
+	for (uint64_t k = 1; k <= m_Props.PrefetchFrames; k++)
+	{
+		if (m_Backwards ? index < k : index + k >= count)
+			break;
+		const uint64_t next = m_Backwards ? index - k : index + k;
+		if (FindEntry(next))
+			continue;
+
+		m_Queue.push_back(next);
+		first = std::min(first, next);
+		last = std::max(last, next);
+	}
+
+	// Starts the disk on all of them while the worker decodes the first
+	if (first != NoFrame)
+	{
+		const uint64_t end = m_Offsets[last] + sizeof(TrajectoryFrameHeader) + GetFrameHeader(last).GetPayloadBytes();
+		m_File.Prefetch(m_Offsets[first], end - m_Offsets[first]);
+	}
+}
+
+void TrajectoryReader::FinishEntry(uint64_t index, bool decoded)
+{
+	for (CacheEntry& entry : m_Cache)
+	{
+		if (entry.Index != index || entry.Ready)
+			continue;
+		if (decoded)
+			entry.Ready = true;
+		else
+			entry.Index = NoFrame;
+		break;
+	}
+	m_Condition.notify_all();
+}
+
+std::shared_ptr<const TrajectoryFrame> TrajectoryReader::GetFrame(uint64_t index)
+{
+	if (m_IndexStale)
+		Rescan();
+
+	// A frame the index had wrong is looked up once more in the rebuilt index
+	std::shared_ptr<const TrajectoryFrame> frame;
+	{
+		std::shared_lock<std::shared_mutex> indexLock(m_IndexMutex);
+		frame = FetchFrame(index);
+	}
+	if (!frame && m_IndexStale)
+	{
+		Rescan();
+		std::shared_lock<std::shared_mutex> indexLock(m_IndexMutex);
+		frame = FetchFrame(index);
+	}
+	return frame;
+}
+
+std::shared_ptr<const TrajectoryFrame> TrajectoryReader::FetchFrame(uint64_t index)
+{
+	if (index >= m_Offsets.size())
+		return nullptr;
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	QueuePrefetch(index, false);
+	m_Condition.notify_all();
+
+	// Waits out a decode already under way, the worker may be on this very frame
+	CacheEntry* entry = nullptr;
+	m_Condition.wait(lock, [&]()
+		{
+			entry = FindEntry(index);
+			return !entry || entry->Ready;
+		});
+	if (entry)
+	{
+		entry->LastUse = ++m_UseCounter;
+		return entry->Frame;
+	}
+
+	std::shared_ptr<TrajectoryFrame> frame = ClaimEntry(index);
+	lock.unlock();
+
+	// Every slot is being decoded into, this one frame goes around the cache
+	if (!frame)
+	{
+		frame = std::make_shared<TrajectoryFrame>();
+		return Decode(index, *frame) ? frame : nullptr;
+	}
+
+	const bool decoded = Decode(index, *frame);
+	lock.lock();
+	FinishEntry(index, decoded);
+	return decoded ? frame : nullptr;
+}
+
+std::shared_ptr<const TrajectoryFrame> TrajectoryReader::TryGetFrame(uint64_t index)
+{
+	if (m_IndexStale)
+		Rescan();
+
+	std::shared_lock<std::shared_mutex> indexLock(m_IndexMutex);
+	if (index >= m_Offsets.size())
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	CacheEntry* entry = FindEntry(index);
+	QueuePrefetch(index, !entry);
+	m_Condition.notify_all();
+
+	if (!entry || !entry->Ready)
+		return nullptr;
+	entry->LastUse = ++m_UseCounter;
+	return entry->Frame;
+}
+
+void TrajectoryReader::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		m_Condition.wait(lock, [this]() { return m_Closing || !m_Queue.empty(); });
+		if (m_Closing)
+			break;
+
+		const uint64_t index = m_Queue.front();
+		m_Queue.pop_front();
+		if (FindEntry(index))
+			continue;
+		std::shared_ptr<TrajectoryFrame> frame = ClaimEntry(index);
+		if (!frame)
+			continue;
+
+		lock.unlock();
+		const bool decoded = Decode(index, *frame);
+		lock.lock();
+		FinishEntry(index, decoded);
+	}
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "mapped_file.h"
+#include "trajectory_codec.h"
+#include "../simulation/simulation_box.h"
+
+
+struct TrajectoryReaderProps
+{
+	// Frames decoded ahead of the last one asked for, in the direction of travel
+	uint32_t PrefetchFrames;
+	// Decoded frames kept around, bounds the memory used next to the mapping
+	uint32_t CachedFrames;
+	// Keep the frame index in <path>.idx, so the next open skips the scan
+	bool WriteIndex;
+
+	TrajectoryReaderProps(uint32_t prefetchFrames = 4, uint32_t cachedFrames = 8, bool writeIndex = true)
+		: PrefetchFrames(prefetchFrames), CachedFrames(cachedFrames), WriteIndex(writeIndex) {
+	}
+};
+
+struct TrajectoryFrame
+{
+	uint64_t Index = 0;
+	TrajectoryFrameHeader Header;
+	std::vector<glm::vec3> Positions;
+	// Empty unless the file has them
+	std::vector<glm::vec3> Velocities;
+	std::vector<glm::vec3> Forces;
+
+	SimulationBox GetBox() const
+	{
+		return SimulationBox({ Header.BoxSize[0], Header.BoxSize[1], Header.BoxSize[2] }, { Header.BoxTilt[0], Header.BoxTilt[1], Header.BoxTilt[2] });
+	}
+};
+
+// Random access to .pytrj files written by TrajectoryWriter. The file is
+// memory mapped and only an index of frame offsets is held, so opening and
+// seeking cost the same for any file size. The index comes from a scan over
+// the frame headers and is cached next to the file; a file that has grown
+// since is only scanned from where the cached index ends. A cached index
+// has to be in order and inside the file before anything is read through it,
+// and a frame whose header doesn't match the index when it is decoded makes
+// the reader drop the index and scan the whole file again.
+//
+// Frames are decoded on demand into a small cache. A worker thread decodes
+// the frames after the last one asked for, or before it when stepping
+// backwards, so playback finds them ready.
+class TrajectoryReader
+{
+public:
+	TrajectoryReader() {}
+	~TrajectoryReader();
+
+	TrajectoryReader(const TrajectoryReader&) = delete;
+	TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+	bool Open(const std::string& path, const TrajectoryReaderProps& props = TrajectoryReaderProps());
+	void Close();
+	bool IsOpen() const { return m_File.IsOpen(); }
+
+	uint32_t GetAtomCount() const { return m_AtomCount; }
+	// Can change when a rescan finds the index was wrong
+	uint64_t GetFrameCount() const { return m_Offsets.size(); }
+	// Straight from the mapping, nothing is decoded
+	TrajectoryFrameHeader GetFrameHeader(uint64_t index) const;
+
+	// Decoded frame, waits for it if needed. nullptr if the frame is corrupt
+	std::shared_ptr<const TrajectoryFrame> GetFrame(uint64_t index);
+	// Never waits: the frame if it is decoded already, otherwise nullptr and
+	// the frame is queued for the worker
+	std::shared_ptr<const TrajectoryFrame> TryGetFrame(uint64_t index);
+
+private:
+	struct CacheEntry
+	{
+		uint64_t Index;
+		std::shared_ptr<TrajectoryFrame> Frame;
+		uint64_t LastUse;
+		bool Ready;
+	};
+
+	bool LoadIndex(const std::string& path);
+	void ScanFrames(uint64_t offset);
+	void SaveIndex(const std::string& path) const;
+	// Rebuilds the index from the frames themselves, with the worker stopped.
+	// Waits for callers still reading through the old index
+	void Rescan();
+
+	// False and m_IndexStale set if the frame isn't where the index says
+	bool Decode(uint64_t index, TrajectoryFrame& frame) const;
+	std::shared_ptr<const TrajectoryFrame> FetchFrame(uint64_t index);
+
+	// Everything below runs with m_Mutex held
+	CacheEntry* FindEntry(uint64_t index);
+	// Claims a cache slot for index, marked not ready, and returns its frame
+	std::shared_ptr<TrajectoryFrame> ClaimEntry(uint64_t index);
+	void QueuePrefetch(uint64_t index, bool includeIndex);
+
+	void FinishEntry(uint64_t index, bool decoded);
+	void StartWorker();
+	void StopWorker();
+	void WorkerLoop();
+
+private:
+	TrajectoryReaderProps m_Props;
+	std::string m_Path;
+	MappedFile m_File;
+	std::vector<uint64_t> m_Offsets;
+	uint32_t m_AtomCount = 0;
+	// End of the last complete frame
+	uint64_t m_IndexedBytes = 0;
+	// Set by whichever thread decodes a frame the index got wrong
+	mutable std::atomic<bool> m_IndexStale = false;
+	// Held shared by the frame getters, exclusively while rescanning
+	std::shared_mutex m_IndexMutex;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	std::vector<CacheEntry> m_Cache;
+	std::deque<uint64_t> m_Queue;
+	uint64_t m_UseCounter = 0;
+	uint64_t m_LastRequested = 0;
+	bool m_Backwards = false;
+	bool m_Closing = false;
+	std::thread m_Worker;
+};
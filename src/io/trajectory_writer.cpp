@@ -0,0 +1,259 @@
+#include "trajectory_writer.h"
+
+#include <chrono>
+
+#include "../logging/log.h"
+#include "../simulation/world.h"
+#include "../simulation/domain/domain_decomposition.h"
+
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double SecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+	Close();
+}
+
+bool TrajectoryWriter::Open(const std::string& path, const World& world, const TrajectoryWriterProps& props)
+{
+	Close();
+
+	m_Props = props;
+	m_Stats = TrajectoryWriterStats();
+	m_CountWarned = false;
+	m_NextFill = 0;
+
+	DomainDecomposition* domain = world.GetDomain();
+	m_Root = !domain || domain->GetTransport().GetRank() == 0;
+	m_AtomCount = domain ? (uint32_t)domain->GetGlobalAtomCount() : (uint32_t)world.GetAtomCount();
+
+	// Decomposed worlds gather in global id order, which already is the order at attach time
+	m_SlotOfEntity.clear();
+	if (!domain)
+	{
+		for (uint32_t i = 0; i < m_AtomCount; i++)
+		{
+			const uint32_t entity = (uint32_t)entt::to_entity(world.GetAtomEntity(i));
+			if (entity >= m_SlotOfEntity.size())
+				m_SlotOfEntity.resize(entity + 1, 0);
+			m_SlotOfEntity[entity] = i;
+		}
+	}
+
+	if (m_Root)
+	{
+		m_File.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!m_File.is_open())
+		{
+			PY_CORE_ERROR("Could not open trajectory {0} for writing", path);
+			return false;
+		}
+
+		TrajectoryFileHeader header;
+		header.AtomCount = m_AtomCount;
+		m_File.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		// Everything a frame needs is allocated now, capturing never allocates
+		for (FrameBuffer& frame : m_Buffers)
+		{
+			frame.Full = false;
+			frame.Positions.resize(m_AtomCount);
+			frame.Velocities.resize(m_Props.VelocityPrecision > 0.0f ? m_AtomCount : 0);
+			frame.Forces.resize(m_Props.ForcePrecision > 0.0f ? m_AtomCount : 0);
+		}
+		m_Scratch.reserve((size_t)m_AtomCount * 3 * sizeof(uint32_t));
+
+		m_Closing = false;
+		m_Thread = std::thread(&TrajectoryWriter::WriterLoop, this);
+	}
+
+	m_Open = true;
+	PY_CORE_INFO("Writing trajectory {0}: {1} atoms every {2} steps", path, m_AtomCount, m_Props.Interval);
+	return true;
+}
+
+void TrajectoryWriter::Close()
+{
+	if (!m_Open)
+		return;
+
+	if (m_Thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Closing = true;
+		}
+		m_Condition.notify_all();
+		m_Thread.join();
+	}
+	if (m_File.is_open())
+		m_File.close();
+	m_Open = false;
+
+	if (m_Root && m_Stats.Frames > 0)
+	{
+		PY_CORE_INFO("Trajectory closed: {0} frames, {1:.1f} MB written of {2:.1f} MB raw, {3:.3f} s capturing, {4:.3f} s waiting for the disk",
+			m_Stats.Frames, m_Stats.WrittenBytes / 1048576.0, m_Stats.RawBytes / 1048576.0, m_Stats.CaptureSeconds, m_Stats.StallSeconds);
+	}
+}
+
+void TrajectoryWriter::OnStep(World& world, uint64_t step, double time)
+{
+	if (m_Open && m_Props.Interval && step % m_Props.Interval == 0)
+		Capture(world, step, time);
+}
+
+bool TrajectoryWriter::Capture(World& world, uint64_t step, double time)
+{
+	if (!m_Open)
+		return false;
+
+	DomainDecomposition* domain = world.GetDomain();
+	const uint64_t count = domain ? domain->GetGlobalAtomCount() : world.GetAtomCount();
+	if (count != m_AtomCount)
+	{
+		if (!m_CountWarned)
+			PY_CORE_WARN("Trajectory expects {0} atoms but the world has {1}, frames are skipped", m_AtomCount, count);
+		m_CountWarned = true;
+		return false;
+	}
+
+	const Clock::time_point start = Clock::now();
+	FrameBuffer& frame = m_Buffers[m_NextFill];
+	if (m_Root)
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		if (frame.Full)
+		{
+			m_Condition.wait(lock, [&frame]() { return !frame.Full; });
+			m_Stats.StallSeconds += SecondsSince(start);
+		}
+	}
+
+	frame.Header = TrajectoryFrameHeader();
+	frame.Header.AtomCount = m_AtomCount;
+	frame.Header.Step = step;
+	frame.Header.Time = time;
+	Fill(frame, world);
+
+	// A gather that lost a rank leaves the frame incomplete
+	if (domain && domain->HasFailed())
+		return false;
+
+	if (m_Root)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			frame.Full = true;
+			m_Stats.CaptureSeconds += SecondsSince(start);
+		}
+		m_Condition.notify_all();
+		m_NextFill ^= 1;
+	}
+	return true;
+}
+
+void TrajectoryWriter::Fill(FrameBuffer& frame, World& world)
+{
+	const SimulationBox& box = world.GetBox();
+	TrajectoryFrameHeader& header = frame.Header;
+	for (int c = 0; c < 3; c++)
+	{
+		header.BoxSize[c] = box.Size[c];
+		header.BoxTilt[c] = box.Tilt[c];
+	}
+	header.PositionPrecision = m_Props.PositionPrecision;
+	header.VelocityPrecision = m_Props.VelocityPrecision;
+	header.ForcePrecision = m_Props.ForcePrecision;
+
+	if (DomainDecomposition* domain = world.GetDomain())
+	{
+		// Collective, every rank takes part and rank 0 ends up with the frame
+		domain->GatherUnwrappedPositions(frame.Positions);
+		if (m_Props.VelocityPrecision > 0.0f)
+			domain->GatherVelocities(frame.Velocities);
+		if (m_Props.ForcePrecision > 0.0f)
+			domain->GatherForces(frame.Forces);
+		return;
+	}
+
+	const AtomStore& atoms = world.GetAtoms();
+	const bool velocities = !frame.Velocities.empty(), forces = !frame.Forces.empty();
+	world.ParallelForAtoms([&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				const uint32_t slot = m_SlotOfEntity[(uint32_t)entt::to_entity(world.GetAtomEntity(i))];
+				frame.Positions[slot] = atoms.GetUnwrappedPosition(i, box);
+				if (velocities)
+					frame.Velocities[slot] = atoms.GetVelocity(i);
+				if (forces)
+					frame.Forces[slot] = atoms.GetForce(i);
+			}
+		});
+}
+
+void TrajectoryWriter::WriterLoop()
+{
+	uint32_t next = 0;
+	bool failed = false;
+
+	while (true)
+	{
+		FrameBuffer& frame = m_Buffers[next];
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [&]() { return frame.Full || m_Closing; });
+			// Frames are filled in turn, so once this one is empty nothing is left
+			if (!frame.Full)
+				break;
+		}
+
+		TrajectoryFrameHeader& header = frame.Header;
+		m_Scratch.clear();
+		header.PositionBytes = (uint32_t)CompressVectors(frame.Positions.data(), m_AtomCount, header.PositionPrecision, m_Scratch);
+		if (!frame.Velocities.empty())
+			header.VelocityBytes = (uint32_t)CompressVectors(frame.Velocities.data(), m_AtomCount, header.VelocityPrecision, m_Scratch);
+		else
+			header.VelocityPrecision = 0.0f;
+		if (!frame.Forces.empty())
+			header.ForceBytes = (uint32_t)CompressVectors(frame.Forces.data(), m_AtomCount, header.ForcePrecision, m_Scratch);
+		else
+			header.ForcePrecision = 0.0f;
+
+		m_File.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		m_File.write(reinterpret_cast<const char*>(m_Scratch.data()), (std::streamsize)m_Scratch.size());
+		if (!m_File && !failed)
+		{
+			PY_CORE_ERROR("Writing the trajectory failed at step {0}", header.Step);
+			failed = true;
+		}
+
+		const uint64_t sections = 1 + !frame.Velocities.empty() + !frame.Forces.empty();
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			frame.Full = false;
+			m_Stats.Frames++;
+			m_Stats.RawBytes += sizeof(header) + sections * m_AtomCount * sizeof(glm::vec3);
+			m_Stats.WrittenBytes += sizeof(header) + m_Scratch.size();
+		}
+		m_Condition.notify_all();
+		next ^= 1;
+	}
+
+	m_File.flush();
+}
+
+TrajectoryWriterStats TrajectoryWriter::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Stats;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "trajectory_codec.h"
+
+class World;
+
+
+struct TrajectoryWriterProps
+{
+	// Steps between frames
+	uint32_t Interval;
+	// Quantization steps per nm, 1000 keeps positions to 0.001 nm like XTC
+	float PositionPrecision;
+	// 0 leaves velocities / forces out, otherwise steps per nm/ps and per kJ/mol/nm
+	float VelocityPrecision;
+	float ForcePrecision;
+
+	TrajectoryWriterProps(uint32_t interval = 1000, float positionPrecision = 1000.0f, float velocityPrecision = 0.0f, float forcePrecision = 0.0f)
+		: Interval(interval), PositionPrecision(positionPrecision), VelocityPrecision(velocityPrecision), ForcePrecision(forcePrecision) {
+	}
+};
+
+struct TrajectoryWriterStats
+{
+	uint64_t Frames = 0;
+	uint64_t RawBytes = 0;
+	uint64_t WrittenBytes = 0;
+	// Time the simulation spent copying frames out and waiting for a free buffer
+	double CaptureSeconds = 0.0;
+	double StallSeconds = 0.0;
+};
+
+// Writes unwrapped positions, and optionally velocities and forces, to a
+// .pytrj file (see trajectory_codec.h) without making the simulation wait
+// on the disk. A capture only copies the atoms into one of two buffers
+// allocated up front; a background thread compresses the full buffer and
+// writes it while the simulation fills the other one. The simulation waits
+// only if the disk falls more than a frame behind.
+//
+// Atoms are written in the order they had when the file was opened, however
+// the world reorders them afterwards. Under domain decomposition every rank
+// captures and the frame is gathered onto rank 0, which alone writes.
+class TrajectoryWriter
+{
+public:
+	TrajectoryWriter() {}
+	~TrajectoryWriter();
+
+	TrajectoryWriter(const TrajectoryWriter&) = delete;
+	TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+	bool Open(const std::string& path, const World& world, const TrajectoryWriterProps& props = TrajectoryWriterProps());
+	// Waits for the queued frames to reach the file
+	void Close();
+	bool IsOpen() const { return m_Open; }
+
+	// Captures a frame if step is a multiple of the interval
+	void OnStep(World& world, uint64_t step, double time);
+	// Captures a frame now. False if the atom count changed since Open
+	bool Capture(World& world, uint64_t step, double time);
+
+	const TrajectoryWriterProps& GetProps() const { return m_Props; }
+	// Read by the simulation thread; WrittenBytes lags by the frames in flight
+	TrajectoryWriterStats GetStats();
+
+private:
+	struct FrameBuffer
+	{
+		TrajectoryFrameHeader Header;
+		std::vector<glm::vec3> Positions;
+		std::vector<glm::vec3> Velocities;
+		std::vector<glm::vec3> Forces;
+		bool Full = false;
+	};
+
+	void Fill(FrameBuffer& frame, World& world);
+	void WriterLoop();
+
+private:
+	TrajectoryWriterProps m_Props;
+	std::ofstream m_File;
+	uint32_t m_AtomCount = 0;
+	bool m_Open = false;
+	bool m_Root = true;
+	bool m_CountWarned = false;
+	// Frame slot of each atom entity, by entity index
+	std::vector<uint32_t> m_SlotOfEntity;
+
+	FrameBuffer m_Buffers[2];
+	uint32_t m_NextFill = 0;
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	bool m_Closing = false;
+	std::thread m_Thread;
+
+	TrajectoryWriterStats m_Stats;
+	std::vector<uint8_t> m_Scratch;
+};
@@ -0,0 +1,169 @@
+#include "atom_renderer.h"
+
+#include <algorithm>
+
+#include "../core.h"
+#include "../logging/log.h"
+#include "../simulation/world.h"
+#include "../threading/thread_pool.h"
+
+
+AtomRenderer::~AtomRenderer()
+{
+	Shutdown();
+}
+
+bool AtomRenderer::Init(ThreadPool* pool)
+{
+	m_ThreadPool = pool;
+
+	Shader::CreateShader(PY_ASSET_DIR "/shaders/atom_impostor.vert", PY_ASSET_DIR "/shaders/atom_impostor.frag", "AtomImpostor");
+	m_Shader = Shader::GetShader("AtomImpostor");
+	m_ShaderGeneration = UINT32_MAX;
+	m_CameraUniforms.Create(CameraBlockBinding);
+
+	// Core profile draws need a vertex array even though every input comes from the buffers
+	glCreateVertexArrays(1, &m_VertexArray);
+
+	// Kept even when broken, a hot reload that fixes the sources brings the atoms back
+	if (!m_Shader || !m_Shader->IsValid())
+	{
+		PY_CORE_ERROR("Atom impostor shader failed to build, atoms are not drawn");
+		return false;
+	}
+	return true;
+}
+
+void AtomRenderer::FetchUniforms()
+{
+	m_ShaderGeneration = m_Shader->GetGeneration();
+
+	// The C++ side of the block has to match what the compiler laid out
+	const UniformBlockInfo* cameraBlock = m_Shader->GetUniformBlock("Camera");
+	if (!cameraBlock || cameraBlock->DataSize != (GLint)sizeof(CameraUniforms) || cameraBlock->Binding != CameraBlockBinding)
+		PY_CORE_WARN("Atom impostor shader's Camera block doesn't match CameraUniforms");
+
+	m_RadiusScaleUniform = m_Shader->GetUniform<float>("u_RadiusScale");
+}
+
+void AtomRenderer::Shutdown()
+{
+	if (m_VertexArray)
+		glDeleteVertexArrays(1, &m_VertexArray);
+	m_PositionBuffer.Destroy();
+	m_ColorBuffer.Destroy();
+	m_CameraUniforms.Destroy();
+
+	m_VertexArray = 0;
+	m_Count = 0;
+	m_Shader = nullptr;
+}
+
+void AtomRenderer::SetTypeStyle(uint32_t type, const AtomStyle& style)
+{
+	if (type >= m_TypeStyles.size())
+		m_TypeStyles.resize(type + 1, m_DefaultStyle);
+	m_TypeStyles[type] = style;
+}
+
+uint32_t AtomRenderer::PackColor(const glm::vec4& color)
+{
+	// Matches unpackUnorm4x8 in the shader, red in the low byte
+	auto toByte = [](float channel) { return (uint32_t)(std::clamp(channel, 0.0f, 1.0f) * 255.0f + 0.5f); };
+	return toByte(color.x) | (toByte(color.y) << 8) | (toByte(color.z) << 16) | (toByte(color.w) << 24);
+}
+
+void AtomRenderer::SubmitAtoms(World& world)
+{
+	const AtomStore& atoms = world.GetAtoms();
+	glm::vec4* positionRadius;
+	uint32_t* colors;
+	if (!BeginWrite((uint32_t)atoms.Size(), positionRadius, colors))
+		return;
+
+	std::vector<uint32_t> typeColors(m_TypeStyles.size());
+	for (size_t type = 0; type < m_TypeStyles.size(); type++)
+		typeColors[type] = PackColor(m_TypeStyles[type].Color);
+	const uint32_t defaultColor = PackColor(m_DefaultStyle.Color);
+	const uint32_t styledTypes = (uint32_t)m_TypeStyles.size();
+
+	world.ParallelForAtoms([&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				const uint32_t type = atoms.TypeId[i];
+				const bool styled = type < styledTypes;
+				positionRadius[i] = glm::vec4(atoms.PosX[i], atoms.PosY[i], atoms.PosZ[i], styled ? m_TypeStyles[type].Radius : m_DefaultStyle.Radius);
+				colors[i] = styled ? typeColors[type] : defaultColor;
+			}
+		});
+}
+
+void AtomRenderer::SubmitPositions(const glm::vec3* positions, uint32_t count)
+{
+	glm::vec4* positionRadius;
+	uint32_t* colors;
+	if (!BeginWrite(count, positionRadius, colors))
+		return;
+
+	const float radius = m_DefaultStyle.Radius;
+	const uint32_t color = PackColor(m_DefaultStyle.Color);
+	auto fill = [&](uint32_t begin, uint32_t end, uint32_t)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				positionRadius[i] = glm::vec4(positions[i], radius);
+				colors[i] = color;
+			}
+		};
+	if (m_ThreadPool)
+		m_ThreadPool->ParallelFor(count, 16384, fill);
+	else
+		fill(0, count, 0);
+}
+
+bool AtomRenderer::BeginWrite(uint32_t count, glm::vec4*& positionRadius, uint32_t*& colors)
+{
+	m_Count = 0;
+	if (!m_Shader || count == 0)
+		return false;
+
+	if (!m_PositionBuffer.Reserve((GLsizeiptr)count * sizeof(glm::vec4)) || !m_ColorBuffer.Reserve((GLsizeiptr)count * sizeof(uint32_t)))
+		return false;
+
+	// Only waits when the GPU is still reading the region from three frames ago
+	positionRadius = (glm::vec4*)m_PositionBuffer.BeginWrite();
+	colors = (uint32_t*)m_ColorBuffer.BeginWrite();
+	m_Count = count;
+	return true;
+}
+
+void AtomRenderer::Draw(const Camera& camera)
+{
+	if (!m_Shader || !m_Shader->IsValid() || m_Count == 0)
+		return;
+	// Locations can move when the shader is reloaded
+	if (m_ShaderGeneration != m_Shader->GetGeneration())
+		FetchUniforms();
+
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+
+	// A camera that didn't move uploads nothing
+	m_CameraUniforms.Set(CameraUniforms::FromCamera(camera));
+	m_CameraUniforms.Bind();
+	m_Shader->SetUniform(m_RadiusScaleUniform, m_RadiusScale);
+	m_Shader->Bind();
+
+	glBindVertexArray(m_VertexArray);
+	m_PositionBuffer.BindRange(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)m_Count * sizeof(glm::vec4));
+	m_ColorBuffer.BindRange(GL_SHADER_STORAGE_BUFFER, 1, (GLsizeiptr)m_Count * sizeof(uint32_t));
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)m_Count);
+	glBindVertexArray(0);
+
+	// The regions just drawn from can be written again once this draw is done
+	m_PositionBuffer.Fence();
+	m_ColorBuffer.Fence();
+
+	m_Shader->Unbind();
+}
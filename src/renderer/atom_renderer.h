@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "stream_buffer.h"
+#include "uniform_blocks.h"
+#include "uniform_buffer.h"
+#include "camera/camera.h"
+
+class ThreadPool;
+class World;
+
+
+struct AtomStyle
+{
+	// nm
+	float Radius;
+	glm::vec4 Color;
+
+	AtomStyle(float radius = 0.15f, const glm::vec4& color = glm::vec4(0.7f, 0.75f, 0.8f, 1.0f))
+		: Radius(radius), Color(color) {
+	}
+};
+
+// Draws every atom as a ray cast sphere impostor: the instance data sits in
+// two shader storage buffers and one instanced draw of four vertices per atom
+// covers them all. Submitting writes the instance data straight into
+// persistently mapped stream buffers, without a staging copy. Each fragment
+// intersects its sphere and writes the true depth, so spheres cut into each
+// other correctly at a fraction of the cost of tessellated meshes.
+class AtomRenderer
+{
+public:
+	AtomRenderer() {}
+	~AtomRenderer();
+
+	AtomRenderer(const AtomRenderer&) = delete;
+	AtomRenderer& operator=(const AtomRenderer&) = delete;
+
+	// Needs a current GL context. The pool, if any, fills the instance data
+	bool Init(ThreadPool* pool = nullptr);
+	void Shutdown();
+
+	// Styles by atom type, types past the table get the default style
+	void SetTypeStyle(uint32_t type, const AtomStyle& style);
+	void SetDefaultStyle(const AtomStyle& style) { m_DefaultStyle = style; }
+	// Multiplies every radius at draw time, no resubmit needed
+	void SetRadiusScale(float scale) { m_RadiusScale = scale; }
+
+	// Copies the world's positions and type styles into the buffers. At most
+	// once per frame, a frame without a submit draws the last one again
+	void SubmitAtoms(World& world);
+	// Positions only, every atom in the default style
+	void SubmitPositions(const glm::vec3* positions, uint32_t count);
+
+	void Draw(const Camera& camera);
+
+	uint32_t GetAtomCount() const { return m_Count; }
+
+private:
+	// Mapped regions for count atoms, false leaves nothing to draw
+	bool BeginWrite(uint32_t count, glm::vec4*& positionRadius, uint32_t*& colors);
+	static uint32_t PackColor(const glm::vec4& color);
+	void FetchUniforms();
+
+private:
+	Shader* m_Shader = nullptr;
+	// Shader generation the uniform handles were fetched for
+	uint32_t m_ShaderGeneration = UINT32_MAX;
+	ThreadPool* m_ThreadPool = nullptr;
+	GLuint m_VertexArray = 0;
+	UniformBuffer<CameraUniforms> m_CameraUniforms;
+	UniformHandle<float> m_RadiusScaleUniform;
+	float m_RadiusScale = 1.0f;
+	StreamBuffer m_PositionBuffer;
+	StreamBuffer m_ColorBuffer;
+	uint32_t m_Count = 0;
+
+	AtomStyle m_DefaultStyle;
+	std::vector<AtomStyle> m_TypeStyles;
+};
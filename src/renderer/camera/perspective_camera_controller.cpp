@@ -1,5 +1,5 @@
-#include "PerspectiveCameraController.h"
-#include "Events/Input.h"
+#include "perspective_camera_controller.h"
+#include "../../events/input.h"
 
 PerspectiveCameraController::PerspectiveCameraController(float fov, float aspect, float nearClip, float farClip)
 	: m_Camera(fov, aspect, nearClip, farClip)
@@ -1,6 +1,65 @@
 #include "shader.h"
 
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <utility>
+#include <vector>
+
+#include "../io/file_watcher.h"
+
 std::unordered_map<std::string, Shader> Shader::s_LoadedShaders;
+std::string Shader::s_CacheDirectory;
+uint64_t Shader::s_DriverHash = 0;
+bool Shader::s_BinaryCacheEnabled = false;
+bool Shader::s_ParallelCompile = false;
+std::unique_ptr<FileWatcher> Shader::s_Watcher;
+uint64_t Shader::s_ReloadFrame = 0;
+
+namespace
+{
+    // FNV-1a, 64 bit since cache files are named by it
+    uint64_t HashBytes(std::string_view bytes, uint64_t hash = 14695981039346656037ull)
+    {
+        for (char c : bytes)
+        {
+            hash ^= (uint8_t)c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    using SourcePair = std::pair<std::string, std::string>;
+
+    // Reads both sources on a thread of its own, frames never wait on the disk for a reload
+    std::future<SourcePair> ReadSourcesAsync(const std::string& vertSrcFile, const std::string& fragSrcFile)
+    {
+        return std::async(std::launch::async, [vertSrcFile, fragSrcFile]() { return SourcePair(ReadFile(vertSrcFile), ReadFile(fragSrcFile)); });
+    }
+
+    struct ProgramBinaryHeader
+    {
+        char Magic[4] = {};
+        GLenum Format = 0;
+        uint64_t Key = 0;
+        uint32_t Length = 0;
+        uint32_t Reserved = 0;
+    };
+}
+
+struct Shader::PendingReload
+{
+    // Valid while the sources are still being read
+    std::future<SourcePair> Sources;
+    // A save that came in during the read, which then starts over
+    bool ReadAgain = false;
+    Shader Replacement;
+    // Frame the compile was issued in
+    uint64_t StartFrame = 0;
+};
+
+std::unordered_map<std::string, Shader::PendingReload> Shader::s_Reloading;
 
 Shader::Shader(const std::string& vertSrcFile, const std::string& fragSrcFile)
     : m_ShaderID(0), m_Bound(false)
@@ -10,141 +69,373 @@ Shader::Shader(const std::string& vertSrcFile, const std::string& fragSrcFile)
 
 Shader::~Shader()
 {
-    glDeleteProgram(m_ShaderID);
+    Release();
 }
 
 Shader::Shader(Shader&& other)
 {
-    m_ShaderID = other.m_ShaderID;
-    m_Bound = other.m_Bound;
-
-    other.m_ShaderID = 0;
+    *this = std::move(other);
 }
 
 Shader& Shader::operator=(Shader&& other)
 {
+    if (this == &other)
+        return *this;
+
+    Release();
+
     m_ShaderID = other.m_ShaderID;
     m_Bound = other.m_Bound;
-
-    other.m_ShaderID = 0;
+    m_VertexShader = other.m_VertexShader;
+    m_FragmentShader = other.m_FragmentShader;
+    m_CompilePending = other.m_CompilePending;
+    m_CacheKey = other.m_CacheKey;
+    m_VertSrcFile = std::move(other.m_VertSrcFile);
+    m_FragSrcFile = std::move(other.m_FragSrcFile);
+    m_Generation = other.m_Generation;
+    m_Uniforms = std::move(other.m_Uniforms);
+    m_UniformBlocks = std::move(other.m_UniformBlocks);
+
+    other.m_ShaderID = other.m_VertexShader = other.m_FragmentShader = 0;
+    other.m_CompilePending = false;
 
     return *this;
 }
 
 bool Shader::Compile(const std::string& vertSrcFile, const std::string& fragSrcFile)
 {
-    // Create an empty vertex shader handle
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-
-    // Send the vertex shader source code to GL
-    // Note that std::string's .c_str is NULL character terminated.
-    std::string code = ReadFile(vertSrcFile);
-    const GLchar* source = code.c_str();
-    glShaderSource(vertexShader, 1, &source, 0);
-
-    // Compile the vertex shader
-    glCompileShader(vertexShader);
-
-    GLint isCompiled = 0;
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &isCompiled);
-    if (isCompiled == GL_FALSE)
-    {
-        GLint maxLength = 0;
-        glGetShaderiv(vertexShader, GL_INFO_LOG_LENGTH, &maxLength);
-
-        // The maxLength includes the NULL character
-        std::vector<GLchar> infoLog(maxLength);
-        glGetShaderInfoLog(vertexShader, maxLength, &maxLength, &infoLog[0]);
-
-        // We don't need the shader anymore.
-        glDeleteShader(vertexShader);
-
-        std::cout << infoLog.data() << std::endl;
-        std::cout << "Vertex shader compilation failure!" << std::endl;
+    if (!BeginCompile(vertSrcFile, fragSrcFile))
         return false;
-    }
+    return FinishCompile();
+}
 
-    // Create an empty fragment shader handle
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+bool Shader::BeginCompile(const std::string& vertSrcFile, const std::string& fragSrcFile)
+{
+    return BeginCompileSources(vertSrcFile, fragSrcFile, ReadFile(vertSrcFile), ReadFile(fragSrcFile));
+}
 
-    // Send the fragment shader source code to GL
-    // Note that std::string's .c_str is NULL character terminated
-    code = ReadFile(fragSrcFile);
-    source = code.c_str();
-    glShaderSource(fragmentShader, 1, &source, 0);
+bool Shader::BeginCompileSources(const std::string& vertSrcFile, const std::string& fragSrcFile, const std::string& vertCode, const std::string& fragCode)
+{
+    Release();
+    m_VertSrcFile = vertSrcFile;
+    m_FragSrcFile = fragSrcFile;
 
-    // Compile the fragment shader
-    glCompileShader(fragmentShader);
+    if (vertCode.empty() || fragCode.empty())
+        return false;
 
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &isCompiled);
-    if (isCompiled == GL_FALSE)
+    // A cached binary for these exact sources skips compiling and linking altogether
+    m_CacheKey = HashBytes(fragCode, HashBytes(vertCode, s_DriverHash));
+    if (LoadBinary())
     {
-        GLint maxLength = 0;
-        glGetShaderiv(fragmentShader, GL_INFO_LOG_LENGTH, &maxLength);
-
-        // The maxLength includes the NULL character
-        std::vector<GLchar> infoLog(maxLength);
-        glGetShaderInfoLog(fragmentShader, maxLength, &maxLength, &infoLog[0]);
+        Reflect();
+        return true;
+    }
 
-        // We don't need the shader anymore.
-        glDeleteShader(fragmentShader);
-        // Either of them. Don't leak shaders.
-        glDeleteShader(vertexShader);
+    // Compile and link without asking for the results: the status queries are
+    // what wait on the driver, so a batch of shaders only waits once in FinishCompile
+    const GLchar* source = vertCode.c_str();
+    m_VertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(m_VertexShader, 1, &source, 0);
+    glCompileShader(m_VertexShader);
 
-        std::cout << infoLog.data() << std::endl;
-        std::cout << "Fragment shader compilation failure!" << std::endl;
-        return false;
-    }
+    source = fragCode.c_str();
+    m_FragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(m_FragmentShader, 1, &source, 0);
+    glCompileShader(m_FragmentShader);
 
-    // Vertex and fragment shaders are successfully compiled.
-    // Now time to link them together into a program.
-    // Get a program object.
     m_ShaderID = glCreateProgram();
+    if (s_BinaryCacheEnabled)
+        glProgramParameteri(m_ShaderID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
     // Attach our shaders to our program
-    glAttachShader(m_ShaderID, vertexShader);
-    glAttachShader(m_ShaderID, fragmentShader);
+    glAttachShader(m_ShaderID, m_VertexShader);
+    glAttachShader(m_ShaderID, m_FragmentShader);
 
     // Link our program
     glLinkProgram(m_ShaderID);
 
+    m_CompilePending = true;
+    return true;
+}
+
+bool Shader::IsCompileComplete() const
+{
+    if (!m_CompilePending || !s_ParallelCompile)
+        return true;
+
+    GLint complete = GL_TRUE;
+    glGetProgramiv(m_ShaderID, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
+}
+
+bool Shader::FinishCompile()
+{
+    if (!m_CompilePending)
+        return IsValid();
+    m_CompilePending = false;
+
     // Note the different functions here: glGetProgram* instead of glGetShader*.
     GLint isLinked = 0;
     glGetProgramiv(m_ShaderID, GL_LINK_STATUS, (int*)&isLinked);
     if (isLinked == GL_FALSE)
     {
+        // A shader that didn't compile explains the failed link better than the link log
+        if (!CheckCompiled(m_VertexShader, m_VertSrcFile) || !CheckCompiled(m_FragmentShader, m_FragSrcFile))
+        {
+            Release();
+            return false;
+        }
+
         GLint maxLength = 0;
         glGetProgramiv(m_ShaderID, GL_INFO_LOG_LENGTH, &maxLength);
 
         // The maxLength includes the NULL character
-        std::vector<GLchar> infoLog(maxLength);
+        std::vector<GLchar> infoLog(maxLength + 1);
         glGetProgramInfoLog(m_ShaderID, maxLength, &maxLength, &infoLog[0]);
 
-        // We don't need the program anymore.
-        glDeleteProgram(m_ShaderID);
-        // Don't leak shaders either.
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
+        // We don't need the program anymore, nor the shaders.
+        Release();
 
-        std::cout << infoLog.data() << std::endl;
-        std::cout << "Shader Link Error" << std::endl;
+        PY_CORE_ERROR("Failed to link {0} with {1}:\n{2}", m_VertSrcFile, m_FragSrcFile, infoLog.data());
         return false;
     }
 
     // Always detach shaders after a successful link.
-    glDetachShader(m_ShaderID, vertexShader);
-    glDetachShader(m_ShaderID, fragmentShader);
+    glDetachShader(m_ShaderID, m_VertexShader);
+    glDetachShader(m_ShaderID, m_FragmentShader);
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    glDeleteShader(m_VertexShader);
+    glDeleteShader(m_FragmentShader);
+    m_VertexShader = m_FragmentShader = 0;
 
+    SaveBinary();
+    Reflect();
     return true;
 }
 
+bool Shader::CheckCompiled(GLuint shader, const std::string& srcFile)
+{
+    GLint isCompiled = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+    if (isCompiled == GL_TRUE)
+        return true;
+
+    GLint maxLength = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &maxLength);
+
+    // The maxLength includes the NULL character
+    std::vector<GLchar> infoLog(maxLength + 1);
+    glGetShaderInfoLog(shader, maxLength, &maxLength, &infoLog[0]);
+
+    PY_CORE_ERROR("Failed to compile {0}:\n{1}", srcFile, infoLog.data());
+    return false;
+}
+
+void Shader::Release()
+{
+    if (m_VertexShader)
+        glDeleteShader(m_VertexShader);
+    if (m_FragmentShader)
+        glDeleteShader(m_FragmentShader);
+    glDeleteProgram(m_ShaderID);
+
+    m_VertexShader = m_FragmentShader = 0;
+    m_ShaderID = 0;
+    m_CompilePending = false;
+    m_Uniforms.clear();
+    m_UniformBlocks.clear();
+}
+
+void Shader::SwapProgram(Shader& other)
+{
+    std::swap(m_ShaderID, other.m_ShaderID);
+    std::swap(m_CacheKey, other.m_CacheKey);
+    std::swap(m_Uniforms, other.m_Uniforms);
+    std::swap(m_UniformBlocks, other.m_UniformBlocks);
+    m_Generation++;
 
+    other.Release();
+}
 
-void Shader::Init()
+std::string Shader::GetBinaryPath() const
 {
+    return fmt::format("{0}/{1:016x}.bin", s_CacheDirectory, m_CacheKey);
+}
+
+bool Shader::LoadBinary()
+{
+    if (!s_BinaryCacheEnabled)
+        return false;
+
+    const std::string path = GetBinaryPath();
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+    {
+        PY_CORE_TRACE("No cached binary for {0} with {1}, compiling", m_VertSrcFile, m_FragSrcFile);
+        return false;
+    }
+
+    ProgramBinaryHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || std::memcmp(header.Magic, "PYSB", 4) != 0 || header.Key != m_CacheKey)
+    {
+        PY_CORE_WARN("Cached shader binary {0} has a bad header, recompiling", path);
+        return false;
+    }
+
+    std::vector<char> binary(header.Length);
+    if (!file.read(binary.data(), binary.size()))
+    {
+        PY_CORE_WARN("Cached shader binary {0} is truncated, recompiling", path);
+        return false;
+    }
+
+    m_ShaderID = glCreateProgram();
+    glProgramBinary(m_ShaderID, header.Format, binary.data(), (GLsizei)binary.size());
+
+    // Drivers reject binaries from other builds of themselves, the sources are compiled instead
+    GLint isLinked = 0;
+    glGetProgramiv(m_ShaderID, GL_LINK_STATUS, &isLinked);
+    if (isLinked == GL_FALSE)
+    {
+        PY_CORE_WARN("Driver rejected cached shader binary {0}, recompiling", path);
+        glDeleteProgram(m_ShaderID);
+        m_ShaderID = 0;
+        return false;
+    }
+    return true;
+}
+
+void Shader::SaveBinary() const
+{
+    if (!s_BinaryCacheEnabled)
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(m_ShaderID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    ProgramBinaryHeader header;
+    std::memcpy(header.Magic, "PYSB", 4);
+    header.Key = m_CacheKey;
+    std::vector<char> binary(length);
+    glGetProgramBinary(m_ShaderID, length, &length, &header.Format, binary.data());
+    header.Length = (uint32_t)length;
+
+    // Written aside and renamed into place, so another instance never reads half a file
+    std::error_code error;
+    std::filesystem::create_directories(s_CacheDirectory, error);
+    const std::string path = GetBinaryPath();
+    const std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.write((const char*)&header, sizeof(header)) || !file.write(binary.data(), length))
+        {
+            PY_CORE_WARN("Failed to write shader binary {0}", tempPath);
+            return;
+        }
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error)
+        PY_CORE_WARN("Failed to write shader binary {0}: {1}", path, error.message());
+}
+
+void Shader::Reflect()
+{
+    m_Uniforms.clear();
+    m_UniformBlocks.clear();
+
+    std::string name;
+
+    GLint uniformCount = 0;
+    glGetProgramInterfaceiv(m_ShaderID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+    for (GLint i = 0; i < uniformCount; i++)
+    {
+        const GLenum props[] = { GL_NAME_LENGTH, GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE, GL_BLOCK_INDEX };
+        GLint values[5] = {};
+        glGetProgramResourceiv(m_ShaderID, GL_UNIFORM, i, 5, props, 5, nullptr, values);
+
+        // Block members are set through their buffer, not by location
+        if (values[4] != -1 || values[2] == -1)
+            continue;
+
+        name.resize(values[0]);
+        glGetProgramResourceName(m_ShaderID, GL_UNIFORM, i, values[0], nullptr, name.data());
+        name.resize(values[0] - 1);
+
+        // Arrays are reported as "name[0]", callers use the bare name
+        if (name.ends_with("[0]"))
+            name.resize(name.size() - 3);
+
+        UniformInfo info{ name, values[2], (GLenum)values[1], values[3] };
+        auto [it, inserted] = m_Uniforms.try_emplace(HashUniformName(name), std::move(info));
+        if (!inserted)
+            PY_CORE_ERROR("Uniforms {0} and {1} hash the same, {1} can't be set", it->second.Name, name);
+    }
+
+    GLint blockCount = 0;
+    glGetProgramInterfaceiv(m_ShaderID, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES, &blockCount);
+    for (GLint i = 0; i < blockCount; i++)
+    {
+        const GLenum props[] = { GL_NAME_LENGTH, GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+        GLint values[3] = {};
+        glGetProgramResourceiv(m_ShaderID, GL_UNIFORM_BLOCK, i, 3, props, 3, nullptr, values);
+
+        name.resize(values[0]);
+        glGetProgramResourceName(m_ShaderID, GL_UNIFORM_BLOCK, i, values[0], nullptr, name.data());
+        name.resize(values[0] - 1);
+
+        UniformBlockInfo info{ name, (GLuint)values[1], values[2] };
+        auto [it, inserted] = m_UniformBlocks.try_emplace(HashUniformName(name), std::move(info));
+        if (!inserted)
+            PY_CORE_ERROR("Uniform blocks {0} and {1} hash the same, {1} can't be found", it->second.Name, name);
+    }
+}
+
+const UniformInfo* Shader::FindUniform(const std::string& name) const
+{
+    auto it = m_Uniforms.find(HashUniformName(name));
+    if (it == m_Uniforms.end())
+    {
+        PY_TRACE("Uniform location not found: {}", name);
+        return nullptr;
+    }
+    return &it->second;
+}
+
+const UniformBlockInfo* Shader::GetUniformBlock(std::string_view name) const
+{
+    auto it = m_UniformBlocks.find(HashUniformName(name));
+    return it == m_UniformBlocks.end() ? nullptr : &it->second;
+}
+
+
+
+void Shader::Init(const std::string& cacheDirectory)
+{
+    // Binaries only load into the driver build that made them
+    std::string driver;
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION })
+    {
+        if (const GLubyte* value = glGetString(name))
+            driver += (const char*)value;
+        driver += '\n';
+    }
+    s_DriverHash = HashBytes(driver);
+
+    GLint binaryFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    s_CacheDirectory = cacheDirectory;
+    s_BinaryCacheEnabled = binaryFormats > 0 && !cacheDirectory.empty();
+
+#if defined(GL_KHR_parallel_shader_compile)
+    // Lets the driver compile on as many threads as it likes
+    s_ParallelCompile = GLAD_GL_KHR_parallel_shader_compile;
+    if (s_ParallelCompile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+#endif
+
+    PY_CORE_INFO("Shader binary cache {0}, parallel compilation {1}", s_BinaryCacheEnabled ? s_CacheDirectory : "off", s_ParallelCompile ? "on" : "off");
 }
 
 
@@ -161,318 +452,195 @@ void Shader::Unbind()
 }
 
 void Shader::UploadUniformFloat(const std::string& name, float val) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform1f(location, val);
-    if (unbind) Unbind();
+    glProgramUniform1f(m_ShaderID, uniform->Location, val);
 }
 
 void Shader::UploadUniformFloat2(const std::string& name, const glm::vec2& vec) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform2fv(location, 1, glm::value_ptr(vec));
-    if (unbind) Unbind();
+    glProgramUniform2fv(m_ShaderID, uniform->Location, 1, glm::value_ptr(vec));
 }
 
 void Shader::UploadUniformFloat3(const std::string& name, const glm::vec3& vec) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform3fv(location, 1, glm::value_ptr(vec));
-    if (unbind) Unbind();
+    glProgramUniform3fv(m_ShaderID, uniform->Location, 1, glm::value_ptr(vec));
 }
 
 void Shader::UploadUniformFloat4(const std::string& name, const glm::vec4& vec) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform4fv(location, 1, glm::value_ptr(vec));
-    if (unbind) Unbind();
+    glProgramUniform4fv(m_ShaderID, uniform->Location, 1, glm::value_ptr(vec));
 }
 
 void Shader::UploadUniformMat3(const std::string& name, const glm::mat3& matrix) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(matrix));
-    if (unbind) Unbind();
+    glProgramUniformMatrix3fv(m_ShaderID, uniform->Location, 1, GL_FALSE, glm::value_ptr(matrix));
 }
 
 void Shader::UploadUniformMat4(const std::string& name, const glm::mat4& matrix) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(matrix));
-    if (unbind) Unbind();
+    glProgramUniformMatrix4fv(m_ShaderID, uniform->Location, 1, GL_FALSE, glm::value_ptr(matrix));
 }
 
 void Shader::UploadUniformInt(const std::string& name, int val) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform1i(location, val);
-    if (unbind) Unbind();
+    glProgramUniform1i(m_ShaderID, uniform->Location, val);
 }
 
 void Shader::UploadUniformUInt(const std::string& name, unsigned int val) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform1ui(location, val);
-    if (unbind) Unbind();
+    glProgramUniform1ui(m_ShaderID, uniform->Location, val);
 }
 
 void Shader::UploadUniformInt2(const std::string& name, const glm::ivec2& vec) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform2iv(location, 1, glm::value_ptr(vec));
-    if (unbind) Unbind();
+    glProgramUniform2iv(m_ShaderID, uniform->Location, 1, glm::value_ptr(vec));
 }
 
 void Shader::UploadUniformInt3(const std::string& name, const glm::ivec3& vec) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform3iv(location, 1, glm::value_ptr(vec));
-    if (unbind) Unbind();
+    glProgramUniform3iv(m_ShaderID, uniform->Location, 1, glm::value_ptr(vec));
 }
 
 void Shader::UploadUniformInt4(const std::string& name, const glm::ivec4& vec) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform4iv(location, 1, glm::value_ptr(vec));
-    if (unbind) Unbind();
+    glProgramUniform4iv(m_ShaderID, uniform->Location, 1, glm::value_ptr(vec));
 }
 
 void Shader::UploadUniformBool(const std::string& name, bool val) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform1i(location, val);
-    if (unbind) Unbind();
+    glProgramUniform1i(m_ShaderID, uniform->Location, val);
 }
 
 void Shader::UploadUniformFloatArray(const std::string& name, float* val, int count) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform1fv(location, count, val);
-    if (unbind) Unbind();
+    glProgramUniform1fv(m_ShaderID, uniform->Location, count, val);
 }
 
 void Shader::UploadUniformFloat2Array(const std::string& name, float* vec, int count) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform2fv(location, count, vec);
-    if (unbind) Unbind();
+    glProgramUniform2fv(m_ShaderID, uniform->Location, count, vec);
 }
 
 void Shader::UploadUniformFloat3Array(const std::string& name, float* vec, int count) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform3fv(location, count, vec);
-    if (unbind) Unbind();
+    glProgramUniform3fv(m_ShaderID, uniform->Location, count, vec);
 }
 
 void Shader::UploadUniformFloat4Array(const std::string& name, float* vec, int count) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform4fv(location, count, vec);
-    if (unbind) Unbind();
+    glProgramUniform4fv(m_ShaderID, uniform->Location, count, vec);
 }
 
 void Shader::UploadUniformMat3Array(const std::string& name, float* matrix, int count) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniformMatrix3fv(location, count, GL_FALSE, matrix);
-    if (unbind) Unbind();
+    glProgramUniformMatrix3fv(m_ShaderID, uniform->Location, count, GL_FALSE, matrix);
 }
 
 void Shader::UploadUniformMat4Array(const std::string& name, float* matrix, int count) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniformMatrix4fv(location, count, GL_FALSE, matrix);
-    if (unbind) Unbind();
+    glProgramUniformMatrix4fv(m_ShaderID, uniform->Location, count, GL_FALSE, matrix);
 }
 
 void Shader::UploadUniformIntArray(const std::string& name, int* val, int count) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform1iv(location, count, val);
-    if (unbind) Unbind();
+    glProgramUniform1iv(m_ShaderID, uniform->Location, count, val);
 }
 
 void Shader::UploadUniformInt2Array(const std::string& name, int* vec, int count) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform2iv(location, count, vec);
-    if (unbind) Unbind();
+    glProgramUniform2iv(m_ShaderID, uniform->Location, count, vec);
 }
 
 void Shader::UploadUniformInt3Array(const std::string& name, int* vec, int count) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform3iv(location, count, vec);
-    if (unbind) Unbind();
+    glProgramUniform3iv(m_ShaderID, uniform->Location, count, vec);
 }
 
 void Shader::UploadUniformInt4Array(const std::string& name, int* vec, int count) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform4iv(location, count, vec);
-    if (unbind) Unbind();
+    glProgramUniform4iv(m_ShaderID, uniform->Location, count, vec);
 }
 
 void Shader::UploadUniformBoolArray(const std::string& name, bool* val, int count) {
-    bool unbind = !m_Bound;
-    Bind();
-    GLint location = glGetUniformLocation(m_ShaderID, name.c_str());
-    if (location == -1) {
-        PY_TRACE("Uniform location not found: {}", name);
-        if (unbind) Unbind();
+    const UniformInfo* uniform = FindUniform(name);
+    if (!uniform)
         return;
-    }
-    glUniform1iv(location, count, reinterpret_cast<int*>(val));
-    if (unbind) Unbind();
+    // bool is a byte, GL wants ints
+    std::vector<int> ints(val, val + count);
+    glProgramUniform1iv(m_ShaderID, uniform->Location, count, ints.data());
 }
 
 
 void Shader::CreateShader(const std::string& vertFilePath, const std::string& fragFilePath, const std::string& shaderName)
 {
-    auto [it, inserted] = s_LoadedShaders.try_emplace(shaderName, Shader(vertFilePath, fragFilePath, true));
+    // Only started here, GetShader or FinishPendingShaders collects the result
+    auto [it, inserted] = s_LoadedShaders.try_emplace(shaderName);
     if (inserted)
+    {
+        it->second.BeginCompile(vertFilePath, fragFilePath);
+        if (s_Watcher)
+        {
+            s_Watcher->Watch(vertFilePath);
+            s_Watcher->Watch(fragFilePath);
+        }
         PY_TRACE("Created Shader: {}", shaderName);
+    }
     else
         PY_TRACE("Shader Already Exists: {}", shaderName);
 }
 
 Shader* Shader::GetShader(const std::string& name)
 {
-    if (s_LoadedShaders.contains(name))
-        return &s_LoadedShaders[name];
+    auto it = s_LoadedShaders.find(name);
+    if (it != s_LoadedShaders.end())
+    {
+        it->second.FinishCompile();
+        return &it->second;
+    }
     else
     {
         PY_TRACE("Shader Doesn't Exist: {}", name);
@@ -480,3 +648,110 @@ Shader* Shader::GetShader(const std::string& name)
     }
 }
 
+void Shader::FinishPendingShaders()
+{
+    for (auto& [name, shader] : s_LoadedShaders)
+        shader.FinishCompile();
+}
+
+void Shader::EnableHotReload()
+{
+    if (s_Watcher)
+        return;
+
+    s_Watcher = std::make_unique<FileWatcher>();
+    for (auto& [name, shader] : s_LoadedShaders)
+    {
+        s_Watcher->Watch(shader.m_VertSrcFile);
+        s_Watcher->Watch(shader.m_FragSrcFile);
+    }
+    PY_CORE_INFO("Shader hot reload on, {0} programs watched", s_LoadedShaders.size());
+}
+
+void Shader::UpdateHotReload()
+{
+    if (!s_Watcher)
+        return;
+    s_ReloadFrame++;
+
+    std::vector<std::string> changed = s_Watcher->Poll();
+    for (auto& [name, shader] : s_LoadedShaders)
+    {
+        const std::string vert = FileWatcher::NormalizePath(shader.m_VertSrcFile);
+        const std::string frag = FileWatcher::NormalizePath(shader.m_FragSrcFile);
+        if (std::find(changed.begin(), changed.end(), vert) == changed.end() && std::find(changed.begin(), changed.end(), frag) == changed.end())
+            continue;
+
+        // A save during a reload restarts it, dropping the half built program.
+        // A read still in flight is left to finish and then read again
+        PY_CORE_INFO("Reloading shader {0}", name);
+        PendingReload& reload = s_Reloading[name];
+        if (reload.Sources.valid())
+        {
+            reload.ReadAgain = true;
+            continue;
+        }
+        reload.Replacement.Release();
+        reload.Sources = ReadSourcesAsync(shader.m_VertSrcFile, shader.m_FragSrcFile);
+    }
+
+    // Each reload takes a frame for reading, one for issuing the compile and
+    // at least one more before its link status is asked for. With parallel
+    // compilation the driver tells when the program is done; without it the
+    // status query waits for whatever is left, and the frame in between gives
+    // a driver compiling on threads of its own the time to finish first
+    for (auto it = s_Reloading.begin(); it != s_Reloading.end(); )
+    {
+        PendingReload& reload = it->second;
+        auto live = s_LoadedShaders.find(it->first);
+        if (live == s_LoadedShaders.end())
+        {
+            it = s_Reloading.erase(it);
+            continue;
+        }
+
+        if (reload.Sources.valid())
+        {
+            if (reload.Sources.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                ++it;
+                continue;
+            }
+
+            SourcePair sources = reload.Sources.get();
+            if (reload.ReadAgain)
+            {
+                reload.ReadAgain = false;
+                reload.Sources = ReadSourcesAsync(live->second.m_VertSrcFile, live->second.m_FragSrcFile);
+                ++it;
+                continue;
+            }
+
+            if (!reload.Replacement.BeginCompileSources(live->second.m_VertSrcFile, live->second.m_FragSrcFile, sources.first, sources.second))
+            {
+                PY_CORE_ERROR("Shader {0} failed to reload, keeping the old program", it->first);
+                it = s_Reloading.erase(it);
+                continue;
+            }
+            reload.StartFrame = s_ReloadFrame;
+            ++it;
+            continue;
+        }
+
+        if (reload.StartFrame == s_ReloadFrame || !reload.Replacement.IsCompileComplete())
+        {
+            ++it;
+            continue;
+        }
+
+        if (!reload.Replacement.FinishCompile())
+            PY_CORE_ERROR("Shader {0} failed to reload, keeping the old program", it->first);
+        else
+        {
+            live->second.FinishCompile();
+            live->second.SwapProgram(reload.Replacement);
+            PY_CORE_INFO("Reloaded shader {0}", it->first);
+        }
+        it = s_Reloading.erase(it);
+    }
+}
@@ -5,6 +5,9 @@
 #include "../io/file_reader.h"
 #include <unordered_map>
 #include <string>
+#include <string_view>
+#include <algorithm>
+#include <memory>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -12,6 +15,27 @@
 
 #include "../core.h"
 #include "../logging/log.h"
+#include "uniform.h"
+
+
+struct UniformInfo
+{
+	std::string Name;
+	GLint Location;
+	GLenum Type;
+	GLint Count;
+};
+
+struct UniformBlockInfo
+{
+	std::string Name;
+	GLuint Binding;
+	// Bytes the block takes, for checking it against the C++ struct behind it
+	GLint DataSize;
+};
+
+
+class FileWatcher;
 
 
 class Shader
@@ -24,16 +48,54 @@ public:
 	Shader(Shader&& other);
 	Shader& operator=(Shader&& other);
 
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+
 	bool Compile(const std::string& vertSrcFile, const std::string& fragSrcFile);
 
+	// Compile split in two. BeginCompile only issues the work, or loads a cached
+	// binary, and FinishCompile waits for the link and reports errors. Starting
+	// every shader before finishing any lets the driver overlap them
+	bool BeginCompile(const std::string& vertSrcFile, const std::string& fragSrcFile);
+	bool FinishCompile();
+	// Whether FinishCompile would return without waiting, always true
+	// without GL_KHR_parallel_shader_compile
+	bool IsCompileComplete() const;
+
+	// False when the sources failed to compile or link
+	bool IsValid() const { return m_ShaderID != 0; }
+	// Bumped whenever a hot reload swaps the program, uniform handles taken
+	// before then may point at the wrong locations and need fetching again
+	uint32_t GetGeneration() const { return m_Generation; }
+
 public:
-	static void Init();
+	// Call once the context exists. Linked programs are cached in
+	// cacheDirectory keyed by their sources and the driver; empty disables it
+	static void Init(const std::string& cacheDirectory = "shader_cache");
 
 public:
 
 	void Bind();
 	void Unbind();
 
+	// Uniforms are looked up in the table built at link time and set with
+	// glProgramUniform*, so none of this needs the program bound. Fetch
+	// handles once and keep them; a handle of the wrong type comes back invalid
+	template<typename T>
+	UniformHandle<T> GetUniform(uint32_t nameHash) const;
+	template<typename T>
+	UniformHandle<T> GetUniform(std::string_view name) const { return GetUniform<T>(HashUniformName(name)); }
+
+	template<typename T>
+	void SetUniform(UniformHandle<T> handle, const T& value) { SetUniformArray(handle, &value, 1); }
+	template<typename T>
+	void SetUniformArray(UniformHandle<T> handle, const T* values, int count);
+
+	// Null when the program has no such block
+	const UniformBlockInfo* GetUniformBlock(std::string_view name) const;
+
+	// By name: a hash lookup instead of glGetUniformLocation, but handles skip even that
+
 	void UploadUniformFloat(const std::string& name, float val);
 	void UploadUniformFloat2(const std::string& name, const glm::vec2& vec);
 	void UploadUniformFloat3(const std::string& name, const glm::vec3& vec);
@@ -70,12 +132,98 @@ public:
 public:
 	static void CreateShader(const std::string& vertFilePath, const std::string& fragFilePath, const std::string& shaderName);
 	static Shader* GetShader(const std::string& name);
+	// Waits for every shader CreateShader started
+	static void FinishPendingShaders();
 
+	// Watches the sources of every registered shader. UpdateHotReload, once
+	// per frame, has the changed sources read on a worker thread, starts
+	// compiling them on a later frame and swaps each new program in on a
+	// later one still, once it linked; an edit that doesn't build leaves the
+	// old program running
+	static void EnableHotReload();
+	static void UpdateHotReload();
+
+
+private:
+	// Fills the uniform and block tables from the linked program
+	void Reflect();
+	const UniformInfo* FindUniform(const std::string& name) const;
+
+	// BeginCompile for sources already read from the two files
+	bool BeginCompileSources(const std::string& vertSrcFile, const std::string& fragSrcFile, const std::string& vertCode, const std::string& fragCode);
+	static bool CheckCompiled(GLuint shader, const std::string& srcFile);
+	// Deletes the program and any shaders still attached
+	void Release();
+	// Takes over the other shader's program, which it then deletes
+	void SwapProgram(Shader& other);
+
+	std::string GetBinaryPath() const;
+	bool LoadBinary();
+	void SaveBinary() const;
 
 private:
-	GLuint m_ShaderID;
-	bool m_Bound;
+	// The keys are already hashes
+	struct NameHash
+	{
+		size_t operator()(uint32_t hash) const { return hash; }
+	};
+
+	GLuint m_ShaderID = 0;
+	bool m_Bound = false;
+
+	// Alive between BeginCompile and FinishCompile
+	GLuint m_VertexShader = 0;
+	GLuint m_FragmentShader = 0;
+	bool m_CompilePending = false;
+	uint64_t m_CacheKey = 0;
+
+	std::string m_VertSrcFile;
+	std::string m_FragSrcFile;
+	uint32_t m_Generation = 0;
+
+	std::unordered_map<uint32_t, UniformInfo, NameHash> m_Uniforms;
+	std::unordered_map<uint32_t, UniformBlockInfo, NameHash> m_UniformBlocks;
 
 private:
 	static std::unordered_map<std::string, Shader> s_LoadedShaders;
-};
\ No newline at end of file
+
+	static std::string s_CacheDirectory;
+	static uint64_t s_DriverHash;
+	static bool s_BinaryCacheEnabled;
+	static bool s_ParallelCompile;
+
+	static std::unique_ptr<FileWatcher> s_Watcher;
+	// Replacements still being read or compiled, by registered name
+	struct PendingReload;
+	static std::unordered_map<std::string, PendingReload> s_Reloading;
+	// Counts UpdateHotReload calls, i.e. frames
+	static uint64_t s_ReloadFrame;
+};
+
+
+template<typename T>
+UniformHandle<T> Shader::GetUniform(uint32_t nameHash) const
+{
+	auto it = m_Uniforms.find(nameHash);
+	if (it == m_Uniforms.end())
+		return {};
+
+	const UniformInfo& info = it->second;
+	if (!UniformTraits<T>::Accepts(info.Type))
+	{
+		PY_CORE_WARN("Uniform {0} is declared with GL type {1:#x}, which the requested handle type can't set", info.Name, info.Type);
+		return {};
+	}
+
+	UniformHandle<T> handle;
+	handle.Location = info.Location;
+	handle.Count = info.Count;
+	return handle;
+}
+
+template<typename T>
+void Shader::SetUniformArray(UniformHandle<T> handle, const T* values, int count)
+{
+	if (handle.IsValid() && count > 0)
+		UniformTraits<T>::Upload(m_ShaderID, handle.Location, std::min(count, handle.Count), values);
+}
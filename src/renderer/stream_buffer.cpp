@@ -0,0 +1,126 @@
+#include "stream_buffer.h"
+
+#include <algorithm>
+
+#include "../logging/log.h"
+
+
+namespace
+{
+	// Regions start on offsets any buffer binding point accepts
+	GLsizeiptr GetBindAlignment()
+	{
+		GLint storageAlignment = 16, uniformAlignment = 16;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+		return std::max<GLsizeiptr>({ 16, storageAlignment, uniformAlignment });
+	}
+}
+
+
+StreamBuffer::~StreamBuffer()
+{
+	Destroy();
+}
+
+bool StreamBuffer::Reserve(GLsizeiptr size)
+{
+	if (size <= m_RegionSize)
+		return true;
+
+	// Deleting a buffer the GPU still reads is safe, the driver holds on to it until the draws finish
+	Destroy();
+
+	const GLsizeiptr alignment = GetBindAlignment();
+	GLsizeiptr regionSize = std::max(size, m_RegionSize + m_RegionSize / 2);
+	regionSize = (regionSize + alignment - 1) / alignment * alignment;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &m_Buffer);
+	glNamedBufferStorage(m_Buffer, regionSize * RegionCount, nullptr, flags);
+	m_Mapping = (uint8_t*)glMapNamedBufferRange(m_Buffer, 0, regionSize * RegionCount, flags);
+	if (!m_Mapping)
+	{
+		PY_CORE_ERROR("Failed to map a {0} byte stream buffer", regionSize * RegionCount);
+		Destroy();
+		return false;
+	}
+
+	m_RegionSize = regionSize;
+	return true;
+}
+
+void StreamBuffer::Destroy()
+{
+	for (GLsync& fence : m_Fences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	if (m_Buffer)
+	{
+		glUnmapNamedBuffer(m_Buffer);
+		glDeleteBuffers(1, &m_Buffer);
+	}
+
+	m_Buffer = 0;
+	m_Mapping = nullptr;
+	m_Region = RegionCount;
+	// The size is kept so the next Reserve grows from it
+}
+
+void* StreamBuffer::BeginWrite()
+{
+	if (!m_Mapping)
+		return nullptr;
+
+	m_Region = (m_Region + 1) % RegionCount;
+	WaitRegion(m_Region);
+	return m_Mapping + m_Region * m_RegionSize;
+}
+
+void StreamBuffer::BindRange(GLenum target, GLuint index, GLsizeiptr size) const
+{
+	if (m_Region < RegionCount)
+		glBindBufferRange(target, index, m_Buffer, m_Region * m_RegionSize, std::min(size, m_RegionSize));
+}
+
+void StreamBuffer::Fence()
+{
+	if (m_Region >= RegionCount)
+		return;
+
+	// A region drawn again without a new write gets a later fence in place of the old one
+	GLsync& fence = m_Fences[m_Region];
+	if (fence)
+		glDeleteSync(fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void StreamBuffer::WaitRegion(uint32_t region)
+{
+	GLsync& fence = m_Fences[region];
+	if (!fence)
+		return;
+
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		m_StallCount++;
+
+		// Flushing once makes sure the fence is actually submitted and can signal
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		do
+		{
+			result = glClientWaitSync(fence, flags, 1000000);
+			flags = 0;
+		} while (result == GL_TIMEOUT_EXPIRED);
+	}
+	if (result == GL_WAIT_FAILED)
+		PY_CORE_WARN("Waiting on a stream buffer fence failed");
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <glad/glad.h>
+
+
+// Per-frame upload ring on one persistently mapped buffer. The storage is
+// split into RegionCount regions; each frame writes the next one straight
+// through the coherent mapping while the GPU may still be reading the ones
+// before it. A fence placed after the draws that read a region tells the CPU
+// when it may be written again, so with three regions the writer only waits
+// when it runs more than two frames ahead of the GPU. Nothing is reallocated
+// or copied by the driver per frame.
+class StreamBuffer
+{
+public:
+	static constexpr uint32_t RegionCount = 3;
+
+public:
+	StreamBuffer() {}
+	~StreamBuffer();
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	// Makes every region at least size bytes. Growing replaces the buffer,
+	// earlier contents are not kept
+	bool Reserve(GLsizeiptr size);
+	void Destroy();
+
+	// Waits until the GPU is done with the next region and returns its
+	// mapping, which stays valid until the next BeginWrite or Reserve
+	void* BeginWrite();
+	// Binds the first size bytes of the region last written
+	void BindRange(GLenum target, GLuint index, GLsizeiptr size) const;
+	// Call after the draws reading the last written region have been issued
+	void Fence();
+
+	GLuint GetID() const { return m_Buffer; }
+	GLsizeiptr GetRegionSize() const { return m_RegionSize; }
+	// Times BeginWrite had to wait on the GPU
+	uint64_t GetStallCount() const { return m_StallCount; }
+
+private:
+	void WaitRegion(uint32_t region);
+
+private:
+	GLuint m_Buffer = 0;
+	uint8_t* m_Mapping = nullptr;
+	GLsizeiptr m_RegionSize = 0;
+
+	// Region BeginWrite handed out last, RegionCount before the first write
+	uint32_t m_Region = RegionCount;
+	GLsync m_Fences[RegionCount] = {};
+	uint64_t m_StallCount = 0;
+};
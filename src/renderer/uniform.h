@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+
+// FNV-1a of a uniform or block name. Shaders key their location tables by
+// it, and being constexpr the hash of a literal name costs nothing at runtime
+constexpr uint32_t HashUniformName(std::string_view name)
+{
+	uint32_t hash = 2166136261u;
+	for (char c : name)
+	{
+		hash ^= (uint8_t)c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Location of a uniform whose GLSL type was checked against T when the
+// handle was made. An invalid handle makes SetUniform do nothing
+template<typename T>
+struct UniformHandle
+{
+	GLint Location = -1;
+	// Array length, 1 for plain uniforms
+	GLint Count = 0;
+
+	bool IsValid() const { return Location != -1; }
+};
+
+// GLSL type each C++ type stands for and the call that uploads it
+template<typename T>
+struct UniformTraits;
+
+template<>
+struct UniformTraits<float>
+{
+	static bool Accepts(GLenum type) { return type == GL_FLOAT; }
+	static void Upload(GLuint program, GLint location, GLsizei count, const float* value) { glProgramUniform1fv(program, location, count, value); }
+};
+
+template<>
+struct UniformTraits<glm::vec2>
+{
+	static bool Accepts(GLenum type) { return type == GL_FLOAT_VEC2; }
+	static void Upload(GLuint program, GLint location, GLsizei count, const glm::vec2* value) { glProgramUniform2fv(program, location, count, glm::value_ptr(*value)); }
+};
+
+template<>
+struct UniformTraits<glm::vec3>
+{
+	static bool Accepts(GLenum type) { return type == GL_FLOAT_VEC3; }
+	static void Upload(GLuint program, GLint location, GLsizei count, const glm::vec3* value) { glProgramUniform3fv(program, location, count, glm::value_ptr(*value)); }
+};
+
+template<>
+struct UniformTraits<glm::vec4>
+{
+	static bool Accepts(GLenum type) { return type == GL_FLOAT_VEC4; }
+	static void Upload(GLuint program, GLint location, GLsizei count, const glm::vec4* value) { glProgramUniform4fv(program, location, count, glm::value_ptr(*value)); }
+};
+
+template<>
+struct UniformTraits<glm::mat3>
+{
+	static bool Accepts(GLenum type) { return type == GL_FLOAT_MAT3; }
+	static void Upload(GLuint program, GLint location, GLsizei count, const glm::mat3* value) { glProgramUniformMatrix3fv(program, location, count, GL_FALSE, glm::value_ptr(*value)); }
+};
+
+template<>
+struct UniformTraits<glm::mat4>
+{
+	static bool Accepts(GLenum type) { return type == GL_FLOAT_MAT4; }
+	static void Upload(GLuint program, GLint location, GLsizei count, const glm::mat4* value) { glProgramUniformMatrix4fv(program, location, count, GL_FALSE, glm::value_ptr(*value)); }
+};
+
+// Ints also set bools and sampler units
+template<>
+struct UniformTraits<int>
+{
+	static bool Accepts(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_INT: case GL_BOOL:
+		case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+		case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_BUFFER:
+			return true;
+		default:
+			return false;
+		}
+	}
+	static void Upload(GLuint program, GLint location, GLsizei count, const int* value) { glProgramUniform1iv(program, location, count, value); }
+};
+
+template<>
+struct UniformTraits<glm::ivec2>
+{
+	static bool Accepts(GLenum type) { return type == GL_INT_VEC2; }
+	static void Upload(GLuint program, GLint location, GLsizei count, const glm::ivec2* value) { glProgramUniform2iv(program, location, count, glm::value_ptr(*value)); }
+};
+
+template<>
+struct UniformTraits<glm::ivec3>
+{
+	static bool Accepts(GLenum type) { return type == GL_INT_VEC3; }
+	static void Upload(GLuint program, GLint location, GLsizei count, const glm::ivec3* value) { glProgramUniform3iv(program, location, count, glm::value_ptr(*value)); }
+};
+
+template<>
+struct UniformTraits<glm::ivec4>
+{
+	static bool Accepts(GLenum type) { return type == GL_INT_VEC4; }
+	static void Upload(GLuint program, GLint location, GLsizei count, const glm::ivec4* value) { glProgramUniform4iv(program, location, count, glm::value_ptr(*value)); }
+};
+
+template<>
+struct UniformTraits<unsigned int>
+{
+	static bool Accepts(GLenum type) { return type == GL_UNSIGNED_INT; }
+	static void Upload(GLuint program, GLint location, GLsizei count, const unsigned int* value) { glProgramUniform1uiv(program, location, count, value); }
+};
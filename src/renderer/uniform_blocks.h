@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "camera/camera.h"
+
+
+// Binding points of the uniform blocks shared between shaders, matching the
+// layout(binding = N) they are declared with in the GLSL
+enum UniformBlockBinding : GLuint
+{
+	CameraBlockBinding = 0,
+};
+
+// layout(std140, binding = 0) uniform Camera
+struct CameraUniforms
+{
+	glm::mat4 View;
+	glm::mat4 Projection;
+	glm::mat4 ViewProjection;
+	// xyz, w unused
+	glm::vec4 Position;
+
+	static CameraUniforms FromCamera(const Camera& camera)
+	{
+		CameraUniforms uniforms;
+		uniforms.View = camera.GetViewMatrix();
+		uniforms.Projection = camera.GetProjectionMatrix();
+		uniforms.ViewProjection = camera.GetViewProjectionMatrix();
+		uniforms.Position = glm::vec4(camera.GetPosition(), 1.0f);
+		return uniforms;
+	}
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <glad/glad.h>
+
+
+// A std140 uniform block: the host copy of T plus the buffer it is uploaded
+// to. Set compares against the copy, so a block whose values did not change
+// since the last frame is never uploaded again. T has to match the GLSL
+// block member for member, which std140 makes easy with only vec4 and mat4
+// members, and must not have padding bytes the compare would trip over.
+template<typename T>
+class UniformBuffer
+{
+	static_assert(std::is_trivially_copyable_v<T>, "uniform blocks are copied bytewise");
+	static_assert(sizeof(T) % 16 == 0, "std140 blocks are a whole number of vec4s");
+
+public:
+	UniformBuffer() {}
+	~UniformBuffer() { Destroy(); }
+
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	// Binding is the layout(binding = N) of the block in the shaders
+	void Create(GLuint binding)
+	{
+		Destroy();
+		m_Binding = binding;
+		glCreateBuffers(1, &m_Buffer);
+		glNamedBufferStorage(m_Buffer, sizeof(T), &m_Data, GL_DYNAMIC_STORAGE_BIT);
+		m_Dirty = true;
+	}
+
+	void Destroy()
+	{
+		if (m_Buffer)
+			glDeleteBuffers(1, &m_Buffer);
+		m_Buffer = 0;
+	}
+
+	const T& Get() const { return m_Data; }
+
+	void Set(const T& data)
+	{
+		if (std::memcmp(&data, &m_Data, sizeof(T)) == 0)
+			return;
+		m_Data = data;
+		m_Dirty = true;
+	}
+
+	// Uploads the block if it changed and binds it for the next draws
+	void Bind()
+	{
+		if (m_Dirty)
+		{
+			glNamedBufferSubData(m_Buffer, 0, sizeof(T), &m_Data);
+			m_Dirty = false;
+			m_UploadCount++;
+		}
+		glBindBufferBase(GL_UNIFORM_BUFFER, m_Binding, m_Buffer);
+	}
+
+	bool IsDirty() const { return m_Dirty; }
+	GLuint GetBinding() const { return m_Binding; }
+	uint64_t GetUploadCount() const { return m_UploadCount; }
+
+private:
+	T m_Data = {};
+	GLuint m_Buffer = 0;
+	GLuint m_Binding = 0;
+	bool m_Dirty = true;
+	uint64_t m_UploadCount = 0;
+};
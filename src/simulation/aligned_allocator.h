@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+
+// Allocator handing out storage aligned to a cache line, so every per-atom
+// stream starts on a 64-byte boundary and can be read with aligned SIMD loads.
+template<typename T, std::size_t Alignment = 64>
+class AlignedAllocator
+{
+public:
+	using value_type = T;
+
+	template<typename U>
+	struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+	AlignedAllocator() noexcept {}
+
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+	T* allocate(std::size_t count)
+	{
+		return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(Alignment)));
+	}
+
+	void deallocate(T* ptr, std::size_t)
+	{
+		::operator delete(ptr, std::align_val_t(Alignment));
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
@@ -0,0 +1,281 @@
+#include "atom_store.h"
+
+#include <algorithm>
+
+
+void AtomStore::Reserve(size_t count)
+{
+	PosX.reserve(count); PosY.reserve(count); PosZ.reserve(count);
+	VelX.reserve(count); VelY.reserve(count); VelZ.reserve(count);
+	ForceX.reserve(count); ForceY.reserve(count); ForceZ.reserve(count);
+	Mass.reserve(count);
+	InvMass.reserve(count);
+	Charge.reserve(count);
+	TypeId.reserve(count);
+	ImageX.reserve(count); ImageY.reserve(count); ImageZ.reserve(count);
+
+	if (m_Precise)
+	{
+		PrecisePosX.reserve(count); PrecisePosY.reserve(count); PrecisePosZ.reserve(count);
+		PreciseVelX.reserve(count); PreciseVelY.reserve(count); PreciseVelZ.reserve(count);
+	}
+	if (m_PreciseForces)
+	{
+		PreciseForceX.reserve(count); PreciseForceY.reserve(count); PreciseForceZ.reserve(count);
+	}
+}
+
+void AtomStore::Resize(size_t count)
+{
+	PosX.resize(count); PosY.resize(count); PosZ.resize(count);
+	VelX.resize(count); VelY.resize(count); VelZ.resize(count);
+	ForceX.resize(count); ForceY.resize(count); ForceZ.resize(count);
+	Mass.resize(count);
+	InvMass.resize(count);
+	Charge.resize(count);
+	TypeId.resize(count);
+	ImageX.resize(count); ImageY.resize(count); ImageZ.resize(count);
+
+	if (m_Precise)
+	{
+		PrecisePosX.resize(count); PrecisePosY.resize(count); PrecisePosZ.resize(count);
+		PreciseVelX.resize(count); PreciseVelY.resize(count); PreciseVelZ.resize(count);
+	}
+	if (m_PreciseForces)
+	{
+		PreciseForceX.resize(count); PreciseForceY.resize(count); PreciseForceZ.resize(count);
+	}
+}
+
+void AtomStore::Clear()
+{
+	PosX.clear(); PosY.clear(); PosZ.clear();
+	VelX.clear(); VelY.clear(); VelZ.clear();
+	ForceX.clear(); ForceY.clear(); ForceZ.clear();
+	Mass.clear();
+	InvMass.clear();
+	Charge.clear();
+	TypeId.clear();
+	ImageX.clear(); ImageY.clear(); ImageZ.clear();
+
+	PrecisePosX.clear(); PrecisePosY.clear(); PrecisePosZ.clear();
+	PreciseVelX.clear(); PreciseVelY.clear(); PreciseVelZ.clear();
+	PreciseForceX.clear(); PreciseForceY.clear(); PreciseForceZ.clear();
+}
+
+void AtomStore::SetPreciseState(bool enabled)
+{
+	if (enabled == m_Precise)
+		return;
+
+	m_Precise = enabled;
+	if (enabled)
+	{
+		PrecisePosX.assign(PosX.begin(), PosX.end()); PrecisePosY.assign(PosY.begin(), PosY.end()); PrecisePosZ.assign(PosZ.begin(), PosZ.end());
+		PreciseVelX.assign(VelX.begin(), VelX.end()); PreciseVelY.assign(VelY.begin(), VelY.end()); PreciseVelZ.assign(VelZ.begin(), VelZ.end());
+	}
+	else
+	{
+		PrecisePosX = {}; PrecisePosY = {}; PrecisePosZ = {};
+		PreciseVelX = {}; PreciseVelY = {}; PreciseVelZ = {};
+	}
+}
+
+void AtomStore::SetPreciseForces(bool enabled)
+{
+	if (enabled == m_PreciseForces)
+		return;
+
+	m_PreciseForces = enabled;
+	if (enabled)
+	{
+		PreciseForceX.assign(ForceX.begin(), ForceX.end()); PreciseForceY.assign(ForceY.begin(), ForceY.end()); PreciseForceZ.assign(ForceZ.begin(), ForceZ.end());
+	}
+	else
+	{
+		PreciseForceX = {}; PreciseForceY = {}; PreciseForceZ = {};
+	}
+}
+
+uint32_t AtomStore::Push(const glm::vec3& position, const glm::vec3& velocity, float mass, uint32_t typeId, float charge)
+{
+	uint32_t index = static_cast<uint32_t>(Size());
+
+	PosX.push_back(position.x); PosY.push_back(position.y); PosZ.push_back(position.z);
+	VelX.push_back(velocity.x); VelY.push_back(velocity.y); VelZ.push_back(velocity.z);
+	ForceX.push_back(0.0f); ForceY.push_back(0.0f); ForceZ.push_back(0.0f);
+	Mass.push_back(mass);
+	InvMass.push_back(mass > 0.0f ? 1.0f / mass : 0.0f);
+	Charge.push_back(charge);
+	TypeId.push_back(typeId);
+	ImageX.push_back(0); ImageY.push_back(0); ImageZ.push_back(0);
+
+	if (m_Precise)
+	{
+		PrecisePosX.push_back(position.x); PrecisePosY.push_back(position.y); PrecisePosZ.push_back(position.z);
+		PreciseVelX.push_back(velocity.x); PreciseVelY.push_back(velocity.y); PreciseVelZ.push_back(velocity.z);
+	}
+	if (m_PreciseForces)
+	{
+		PreciseForceX.push_back(0.0); PreciseForceY.push_back(0.0); PreciseForceZ.push_back(0.0);
+	}
+
+	return index;
+}
+
+template<typename T>
+static void AppendStream(AlignedVector<T>& dest, const AlignedVector<T>& source)
+{
+	dest.insert(dest.end(), source.begin(), source.end());
+}
+
+uint32_t AtomStore::Append(const AtomStore& source)
+{
+	uint32_t index = static_cast<uint32_t>(Size());
+
+	AppendStream(PosX, source.PosX); AppendStream(PosY, source.PosY); AppendStream(PosZ, source.PosZ);
+	AppendStream(VelX, source.VelX); AppendStream(VelY, source.VelY); AppendStream(VelZ, source.VelZ);
+	AppendStream(ForceX, source.ForceX); AppendStream(ForceY, source.ForceY); AppendStream(ForceZ, source.ForceZ);
+	AppendStream(Mass, source.Mass);
+	AppendStream(InvMass, source.InvMass);
+	AppendStream(Charge, source.Charge);
+	AppendStream(TypeId, source.TypeId);
+	AppendStream(ImageX, source.ImageX); AppendStream(ImageY, source.ImageY); AppendStream(ImageZ, source.ImageZ);
+
+	if (m_Precise)
+	{
+		PrecisePosX.insert(PrecisePosX.end(), source.PosX.begin(), source.PosX.end());
+		PrecisePosY.insert(PrecisePosY.end(), source.PosY.begin(), source.PosY.end());
+		PrecisePosZ.insert(PrecisePosZ.end(), source.PosZ.begin(), source.PosZ.end());
+		PreciseVelX.insert(PreciseVelX.end(), source.VelX.begin(), source.VelX.end());
+		PreciseVelY.insert(PreciseVelY.end(), source.VelY.begin(), source.VelY.end());
+		PreciseVelZ.insert(PreciseVelZ.end(), source.VelZ.begin(), source.VelZ.end());
+	}
+	if (m_PreciseForces)
+	{
+		PreciseForceX.insert(PreciseForceX.end(), source.ForceX.begin(), source.ForceX.end());
+		PreciseForceY.insert(PreciseForceY.end(), source.ForceY.begin(), source.ForceY.end());
+		PreciseForceZ.insert(PreciseForceZ.end(), source.ForceZ.begin(), source.ForceZ.end());
+	}
+
+	return index;
+}
+
+template<typename T>
+static void SwapRemoveStream(AlignedVector<T>& stream, uint32_t index)
+{
+	stream[index] = stream.back();
+	stream.pop_back();
+}
+
+void AtomStore::SwapRemove(uint32_t index)
+{
+	SwapRemoveStream(PosX, index); SwapRemoveStream(PosY, index); SwapRemoveStream(PosZ, index);
+	SwapRemoveStream(VelX, index); SwapRemoveStream(VelY, index); SwapRemoveStream(VelZ, index);
+	SwapRemoveStream(ForceX, index); SwapRemoveStream(ForceY, index); SwapRemoveStream(ForceZ, index);
+	SwapRemoveStream(Mass, index);
+	SwapRemoveStream(InvMass, index);
+	SwapRemoveStream(Charge, index);
+	SwapRemoveStream(TypeId, index);
+	SwapRemoveStream(ImageX, index); SwapRemoveStream(ImageY, index); SwapRemoveStream(ImageZ, index);
+
+	if (m_Precise)
+	{
+		SwapRemoveStream(PrecisePosX, index); SwapRemoveStream(PrecisePosY, index); SwapRemoveStream(PrecisePosZ, index);
+		SwapRemoveStream(PreciseVelX, index); SwapRemoveStream(PreciseVelY, index); SwapRemoveStream(PreciseVelZ, index);
+	}
+	if (m_PreciseForces)
+	{
+		SwapRemoveStream(PreciseForceX, index); SwapRemoveStream(PreciseForceY, index); SwapRemoveStream(PreciseForceZ, index);
+	}
+}
+
+template<typename T>
+static void GatherStream(AlignedVector<T>& dest, const AlignedVector<T>& source, const uint32_t* order, uint32_t begin, uint32_t end)
+{
+	for (uint32_t i = begin; i < end; i++)
+		dest[i] = source[order[i]];
+}
+
+void AtomStore::Gather(const AtomStore& source, const uint32_t* order, uint32_t begin, uint32_t end)
+{
+	GatherStream(PosX, source.PosX, order, begin, end); GatherStream(PosY, source.PosY, order, begin, end); GatherStream(PosZ, source.PosZ, order, begin, end);
+	GatherStream(VelX, source.VelX, order, begin, end); GatherStream(VelY, source.VelY, order, begin, end); GatherStream(VelZ, source.VelZ, order, begin, end);
+	GatherStream(ForceX, source.ForceX, order, begin, end); GatherStream(ForceY, source.ForceY, order, begin, end); GatherStream(ForceZ, source.ForceZ, order, begin, end);
+	GatherStream(Mass, source.Mass, order, begin, end);
+	GatherStream(InvMass, source.InvMass, order, begin, end);
+	GatherStream(Charge, source.Charge, order, begin, end);
+	GatherStream(TypeId, source.TypeId, order, begin, end);
+	GatherStream(ImageX, source.ImageX, order, begin, end); GatherStream(ImageY, source.ImageY, order, begin, end); GatherStream(ImageZ, source.ImageZ, order, begin, end);
+
+	if (m_Precise)
+	{
+		GatherStream(PrecisePosX, source.PrecisePosX, order, begin, end); GatherStream(PrecisePosY, source.PrecisePosY, order, begin, end); GatherStream(PrecisePosZ, source.PrecisePosZ, order, begin, end);
+		GatherStream(PreciseVelX, source.PreciseVelX, order, begin, end); GatherStream(PreciseVelY, source.PreciseVelY, order, begin, end); GatherStream(PreciseVelZ, source.PreciseVelZ, order, begin, end);
+	}
+	if (m_PreciseForces)
+	{
+		GatherStream(PreciseForceX, source.PreciseForceX, order, begin, end); GatherStream(PreciseForceY, source.PreciseForceY, order, begin, end); GatherStream(PreciseForceZ, source.PreciseForceZ, order, begin, end);
+	}
+}
+
+void AtomStore::ClearForces()
+{
+	std::fill(ForceX.begin(), ForceX.end(), 0.0f);
+	std::fill(ForceY.begin(), ForceY.end(), 0.0f);
+	std::fill(ForceZ.begin(), ForceZ.end(), 0.0f);
+
+	std::fill(PreciseForceX.begin(), PreciseForceX.end(), 0.0);
+	std::fill(PreciseForceY.begin(), PreciseForceY.end(), 0.0);
+	std::fill(PreciseForceZ.begin(), PreciseForceZ.end(), 0.0);
+}
+
+void AtomStore::RoundPreciseForces(uint32_t begin, uint32_t end)
+{
+	for (uint32_t i = begin; i < end; i++)
+	{
+		ForceX[i] = (float)PreciseForceX[i]; ForceY[i] = (float)PreciseForceY[i]; ForceZ[i] = (float)PreciseForceZ[i];
+	}
+}
+
+void AtomStore::WrapPositions(const SimulationBox& box, uint32_t begin, uint32_t end)
+{
+	for (uint32_t i = begin; i < end; i++)
+	{
+		glm::vec3 crossed = glm::floor(box.ToFractional(GetPosition(i)));
+		if (crossed.x == 0.0f && crossed.y == 0.0f && crossed.z == 0.0f)
+			continue;
+
+		glm::vec3 shift = box.ToCartesian(crossed);
+		if (m_Precise)
+		{
+			PrecisePosX[i] -= shift.x; PrecisePosY[i] -= shift.y; PrecisePosZ[i] -= shift.z;
+			PosX[i] = (float)PrecisePosX[i]; PosY[i] = (float)PrecisePosY[i]; PosZ[i] = (float)PrecisePosZ[i];
+		}
+		else
+		{
+			PosX[i] -= shift.x; PosY[i] -= shift.y; PosZ[i] -= shift.z;
+		}
+
+		ImageX[i] += (int32_t)crossed.x; ImageY[i] += (int32_t)crossed.y; ImageZ[i] += (int32_t)crossed.z;
+	}
+}
+
+void AtomStore::SetPosition(uint32_t index, const glm::vec3& pos)
+{
+	PosX[index] = pos.x; PosY[index] = pos.y; PosZ[index] = pos.z;
+	ImageX[index] = 0; ImageY[index] = 0; ImageZ[index] = 0;
+	if (m_Precise)
+	{
+		PrecisePosX[index] = pos.x; PrecisePosY[index] = pos.y; PrecisePosZ[index] = pos.z;
+	}
+}
+
+void AtomStore::SetVelocity(uint32_t index, const glm::vec3& vel)
+{
+	VelX[index] = vel.x; VelY[index] = vel.y; VelZ[index] = vel.z;
+	if (m_Precise)
+	{
+		PreciseVelX[index] = vel.x; PreciseVelY[index] = vel.y; PreciseVelZ[index] = vel.z;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "aligned_allocator.h"
+#include "simulation_box.h"
+
+
+// Hot per-atom state laid out as structure-of-arrays. Every stream is indexed
+// by the same dense index, and kernels should walk them directly instead of
+// going through the registry.
+struct AtomStore
+{
+	AlignedVector<float> PosX, PosY, PosZ;
+	AlignedVector<float> VelX, VelY, VelZ;
+	AlignedVector<float> ForceX, ForceY, ForceZ;
+	AlignedVector<float> Mass;
+	AlignedVector<float> InvMass;
+	AlignedVector<float> Charge;
+	AlignedVector<uint32_t> TypeId;
+	// Box vectors each atom was moved by when wrapped back into a periodic box
+	AlignedVector<int32_t> ImageX, ImageY, ImageZ;
+
+	// Authoritative positions and velocities in mixed / double precision. The
+	// float streams above are rounded copies the force kernels read. Empty
+	// while precise state is off
+	AlignedVector<double> PrecisePosX, PrecisePosY, PrecisePosZ;
+	AlignedVector<double> PreciseVelX, PreciseVelY, PreciseVelZ;
+	// Forces in double precision, where every force term accumulates while
+	// precise forces are on. The float force streams then hold rounded copies
+	// for readers outside the integrators
+	AlignedVector<double> PreciseForceX, PreciseForceY, PreciseForceZ;
+
+	size_t Size() const { return PosX.size(); }
+
+	// Turning it on seeds the precise streams from the float ones
+	void SetPreciseState(bool enabled);
+	bool HasPreciseState() const { return m_Precise; }
+	void SetPreciseForces(bool enabled);
+	bool HasPreciseForces() const { return m_PreciseForces; }
+
+	void Reserve(size_t count);
+	void Resize(size_t count);
+	void Clear();
+
+	// Appends an atom and returns its dense index
+	uint32_t Push(const glm::vec3& position, const glm::vec3& velocity, float mass, uint32_t typeId, float charge = 0.0f);
+	// Appends every atom of source, which needs no precise streams, and returns the index of the first
+	uint32_t Append(const AtomStore& source);
+	// Moves the last atom into index and shrinks the arrays by one
+	void SwapRemove(uint32_t index);
+	// Fills slots [begin, end) with source atom order[slot], both stores already sized
+	void Gather(const AtomStore& source, const uint32_t* order, uint32_t begin, uint32_t end);
+
+	void ClearForces();
+	// Copies the precise forces into the float streams
+	void RoundPreciseForces(uint32_t begin, uint32_t end);
+
+	// Moves atoms [begin, end) into the box, updating their image flags. The
+	// precise streams move by the same box vectors
+	void WrapPositions(const SimulationBox& box, uint32_t begin, uint32_t end);
+
+	glm::vec3 GetPosition(uint32_t index) const { return { PosX[index], PosY[index], PosZ[index] }; }
+	glm::vec3 GetVelocity(uint32_t index) const { return { VelX[index], VelY[index], VelZ[index] }; }
+	glm::vec3 GetForce(uint32_t index) const { return { ForceX[index], ForceY[index], ForceZ[index] }; }
+	glm::ivec3 GetImage(uint32_t index) const { return { ImageX[index], ImageY[index], ImageZ[index] }; }
+	// Position as if the atom had never been wrapped, for trajectories and diffusion
+	glm::vec3 GetUnwrappedPosition(uint32_t index, const SimulationBox& box) const { return GetPosition(index) + box.GetShiftVector(GetImage(index)); }
+
+	// Resets the image flags, pos is taken as the new unwrapped position
+	void SetPosition(uint32_t index, const glm::vec3& pos);
+	void SetVelocity(uint32_t index, const glm::vec3& vel);
+
+private:
+	bool m_Precise = false;
+	bool m_PreciseForces = false;
+};
@@ -0,0 +1,127 @@
+#include "cell_list.h"
+
+#include <algorithm>
+
+
+static const int s_HalfShellOffsets[CellList::HalfShellSize][3] =
+{
+	{  1,  0,  0 },
+	{ -1,  1,  0 }, {  0,  1,  0 }, {  1,  1,  0 },
+	{ -1, -1,  1 }, {  0, -1,  1 }, {  1, -1,  1 },
+	{ -1,  0,  1 }, {  0,  0,  1 }, {  1,  0,  1 },
+	{ -1,  1,  1 }, {  0,  1,  1 }, {  1,  1,  1 }
+};
+
+static int CellCoord(float s, int dim)
+{
+	int c = static_cast<int>(s * dim);
+	return std::clamp(c, 0, dim - 1);
+}
+
+void CellList::Build(const AtomStore& atoms, const SimulationBox& box, float cutoff)
+{
+	const glm::vec3 widths = box.GetPerpendicularWidths();
+	glm::ivec3 dims(
+		std::max(1, static_cast<int>(widths.x / cutoff)),
+		std::max(1, static_cast<int>(widths.y / cutoff)),
+		std::max(1, static_cast<int>(widths.z / cutoff)));
+
+	if (dims.x != m_Dimensions.x || dims.y != m_Dimensions.y || dims.z != m_Dimensions.z || box.Periodic != m_Periodic)
+	{
+		m_Dimensions = dims;
+		m_Periodic = box.Periodic;
+		uint32_t cellCount = static_cast<uint32_t>(dims.x * dims.y * dims.z);
+		m_CellStart.assign(cellCount + 1, 0);
+		m_CellCursor.assign(cellCount, 0);
+		BuildHalfShell(box.Periodic);
+	}
+
+	m_Usable = !box.Periodic || (dims.x >= 3 && dims.y >= 3 && dims.z >= 3);
+
+	const uint32_t count = static_cast<uint32_t>(atoms.Size());
+	const uint32_t cellCount = GetCellCount();
+	m_AtomCell.resize(count);
+	m_CellAtoms.resize(count);
+	m_AtomSlot.resize(count);
+
+	// Pass 1: cell of every atom and per-cell histogram
+	std::fill(m_CellStart.begin(), m_CellStart.end(), 0);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		// Rounding can leave a wrapped atom a hair outside, the clamp keeps it in the edge cell
+		glm::vec3 s = box.ToFractional(atoms.GetPosition(i));
+		uint32_t cell = GetCellIndex(CellCoord(s.x, dims.x), CellCoord(s.y, dims.y), CellCoord(s.z, dims.z));
+
+		m_AtomCell[i] = cell;
+		m_CellStart[cell + 1]++;
+	}
+
+	// Pass 2: exclusive prefix sum turns counts into offsets
+	for (uint32_t c = 0; c < cellCount; c++)
+		m_CellStart[c + 1] += m_CellStart[c];
+
+	// Pass 3: scatter atoms into their cell's slot range
+	std::copy(m_CellStart.begin(), m_CellStart.end() - 1, m_CellCursor.begin());
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t slot = m_CellCursor[m_AtomCell[i]]++;
+		m_CellAtoms[slot] = i;
+		m_AtomSlot[i] = slot;
+	}
+}
+
+void CellList::BuildHalfShell(bool periodic)
+{
+	const glm::ivec3& dims = m_Dimensions;
+	m_HalfShell.assign(GetCellCount() * HalfShellSize, InvalidCell);
+	m_HalfShellShift.assign(GetCellCount() * HalfShellSize, CenterShift);
+
+	for (int z = 0; z < dims.z; z++)
+	for (int y = 0; y < dims.y; y++)
+	for (int x = 0; x < dims.x; x++)
+	{
+		struct Entry
+		{
+			uint32_t Cell;
+			uint8_t Shift;
+		};
+		Entry entries[HalfShellSize];
+		uint32_t entryCount = 0;
+
+		for (uint32_t n = 0; n < HalfShellSize; n++)
+		{
+			int nx = x + s_HalfShellOffsets[n][0];
+			int ny = y + s_HalfShellOffsets[n][1];
+			int nz = z + s_HalfShellOffsets[n][2];
+
+			// Stepping over a periodic face means meeting the image one box
+			// vector away, the same as moving this cell's atoms the other way
+			int sx = 0, sy = 0, sz = 0;
+			if (periodic)
+			{
+				sx = nx < 0 ? 1 : (nx >= dims.x ? -1 : 0);
+				sy = ny < 0 ? 1 : (ny >= dims.y ? -1 : 0);
+				sz = nz < 0 ? 1 : (nz >= dims.z ? -1 : 0);
+				nx = (nx + dims.x) % dims.x;
+				ny = (ny + dims.y) % dims.y;
+				nz = (nz + dims.z) % dims.z;
+			}
+			else if (nx < 0 || ny < 0 || nz < 0 || nx >= dims.x || ny >= dims.y || nz >= dims.z)
+			{
+				continue;
+			}
+
+			entries[entryCount++] = { GetCellIndex(nx, ny, nz), static_cast<uint8_t>((sx + 1) + 3 * (sy + 1) + 9 * (sz + 1)) };
+		}
+
+		auto order = [](uint8_t shift) { return shift == CenterShift ? -1 : static_cast<int>(shift); };
+		std::stable_sort(entries, entries + entryCount, [&](const Entry& a, const Entry& b) { return order(a.Shift) < order(b.Shift); });
+
+		const uint32_t base = GetCellIndex(x, y, z) * HalfShellSize;
+		for (uint32_t n = 0; n < entryCount; n++)
+		{
+			m_HalfShell[base + n] = entries[n].Cell;
+			m_HalfShellShift[base + n] = entries[n].Shift;
+		}
+	}
+}
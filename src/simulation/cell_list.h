@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "atom_store.h"
+#include "simulation_box.h"
+
+
+// Uniform linked-cell binning of the simulation box. Cells are a grid in
+// fractional coordinates, so in a triclinic box they are sheared along with
+// it. Each is at least one cutoff wide between opposite faces, so every
+// interacting pair lives in the same cell or in one of the 13 "forward"
+// neighbor cells of the half shell.
+class CellList
+{
+public:
+	static constexpr uint32_t HalfShellSize = 13;
+	static constexpr uint32_t InvalidCell = 0xffffffffu;
+
+	// Periodic shifts are whole box vectors (sx, sy, sz) in [-1, 1]^3, packed
+	// as (sx + 1) + 3 (sy + 1) + 9 (sz + 1)
+	static constexpr uint32_t ShiftCount = 27;
+	static constexpr uint8_t CenterShift = 13;
+	static glm::ivec3 UnpackShift(uint8_t shift) { return { shift % 3 - 1, shift / 3 % 3 - 1, shift / 9 - 1 }; }
+
+	CellList() {}
+
+	// Bins all atoms with a counting sort, O(N + cells). Periodic boxes expect
+	// wrapped positions, otherwise the half shell's shifts are meaningless
+	void Build(const AtomStore& atoms, const SimulationBox& box, float cutoff);
+
+	// Less than three cells along a periodic axis means the half shell would
+	// visit the same neighbor twice, callers should fall back to all-pairs
+	bool IsUsable() const { return m_Usable; }
+
+	uint32_t GetCellCount() const { return static_cast<uint32_t>(m_CellStart.size() - 1); }
+	const glm::ivec3& GetDimensions() const { return m_Dimensions; }
+
+	uint32_t GetCellIndex(int x, int y, int z) const { return (uint32_t)((z * m_Dimensions.y + y) * m_Dimensions.x + x); }
+	uint32_t GetAtomCell(uint32_t atom) const { return m_AtomCell[atom]; }
+	// Position of an atom inside GetSortedAtoms()
+	uint32_t GetAtomSlot(uint32_t atom) const { return m_AtomSlot[atom]; }
+
+	// Atoms of a cell are stored contiguously in [CellBegin, CellEnd)
+	uint32_t CellBegin(uint32_t cell) const { return m_CellStart[cell]; }
+	uint32_t CellEnd(uint32_t cell) const { return m_CellStart[cell + 1]; }
+	const uint32_t* GetSortedAtoms() const { return m_CellAtoms.data(); }
+
+	// Forward neighbors of a cell, InvalidCell past a non-periodic wall. Sorted
+	// by shift, unshifted neighbors first, so a row's shifts come in few runs
+	const uint32_t* GetHalfShell(uint32_t cell) const { return &m_HalfShell[cell * HalfShellSize]; }
+	// Shift to add to positions in the cell to meet each half shell neighbor
+	const uint8_t* GetHalfShellShifts(uint32_t cell) const { return &m_HalfShellShift[cell * HalfShellSize]; }
+
+private:
+	void BuildHalfShell(bool periodic);
+
+private:
+	glm::ivec3 m_Dimensions = glm::ivec3(0);
+	bool m_Usable = false;
+	bool m_Periodic = true;
+
+	std::vector<uint32_t> m_CellStart;
+	std::vector<uint32_t> m_CellCursor;
+	std::vector<uint32_t> m_CellAtoms;
+	std::vector<uint32_t> m_AtomCell;
+	std::vector<uint32_t> m_AtomSlot;
+	std::vector<uint32_t> m_HalfShell;
+	std::vector<uint8_t> m_HalfShellShift;
+};
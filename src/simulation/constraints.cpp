@@ -0,0 +1,640 @@
+#include "constraints.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+
+#include "cpu_features.h"
+#include "../logging/log.h"
+#include "../threading/thread_pool.h"
+
+#if PY_SIMD_X86
+#include <emmintrin.h>
+#endif
+
+
+namespace
+{
+	template<typename F>
+	void ParallelRange(ThreadPool* pool, uint32_t count, uint32_t grain, const F& body)
+	{
+		if (pool)
+			pool->ParallelFor(count, grain, [&body](uint32_t begin, uint32_t end, uint32_t) { body(begin, end); });
+		else
+			body(0, count);
+	}
+
+	struct PeriodicFrame
+	{
+		bool Periodic;
+		float Box[3];
+		float InvBox[3];
+		float Tilt[3];
+
+		PeriodicFrame(const SimulationBox& box)
+			: Periodic(box.Periodic)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				Box[c] = box.Size[c];
+				InvBox[c] = 1.0f / box.Size[c];
+				Tilt[c] = box.Tilt[c];
+			}
+		}
+
+		// Minimum-image (x, y, z)[a] - (x, y, z)[b]
+		void Delta(const float* x, const float* y, const float* z, uint32_t a, uint32_t b, float d[3]) const
+		{
+			d[0] = x[a] - x[b];
+			d[1] = y[a] - y[b];
+			d[2] = z[a] - z[b];
+			if (Periodic)
+			{
+				float sz = std::nearbyint(d[2] * InvBox[2]);
+				d[0] -= sz * Tilt[1]; d[1] -= sz * Tilt[2]; d[2] -= sz * Box[2];
+				float sy = std::nearbyint(d[1] * InvBox[1]);
+				d[0] -= sy * Tilt[0]; d[1] -= sy * Box[1];
+				d[0] -= Box[0] * std::nearbyint(d[0] * InvBox[0]);
+			}
+		}
+	};
+
+	inline float Sqrt(float x) { return std::sqrt(x); }
+	inline float Min(float a, float b) { return std::min(a, b); }
+	inline float Max(float a, float b) { return std::max(a, b); }
+
+	// Lane l of a batch is values[l] of a per-water array, or vectors[l][d] of
+	// an array of per-water vectors. A float is a batch of one
+	template<typename T> T LoadLanes(const float* values);
+	template<typename T> T GatherLanes(const float (*vectors)[3], int d);
+
+	template<> inline float LoadLanes<float>(const float* values) { return values[0]; }
+	template<> inline float GatherLanes<float>(const float (*vectors)[3], int d) { return vectors[0][d]; }
+	inline void ScatterLanes(float (*vectors)[3], int d, float x) { vectors[0][d] = x; }
+
+#if PY_SIMD_X86
+	// Four waters side by side in an SSE register. SSE2 is part of x86-64, so
+	// unlike the nonbonded kernels this needs neither CPU dispatch nor extra
+	// compiler flags. Only the operations SETTLE uses
+	struct Float4
+	{
+		__m128 V;
+
+		Float4() : V(_mm_setzero_ps()) {}
+		Float4(float x) : V(_mm_set1_ps(x)) {}
+		Float4(__m128 v) : V(v) {}
+	};
+
+	inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.V, b.V); }
+	inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.V, b.V); }
+	inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.V, b.V); }
+	inline Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.V, b.V); }
+	inline Float4 operator-(Float4 a) { return _mm_sub_ps(_mm_setzero_ps(), a.V); }
+	inline Float4 Sqrt(Float4 x) { return _mm_sqrt_ps(x.V); }
+	inline Float4 Min(Float4 a, Float4 b) { return _mm_min_ps(a.V, b.V); }
+	inline Float4 Max(Float4 a, Float4 b) { return _mm_max_ps(a.V, b.V); }
+
+	template<> inline Float4 LoadLanes<Float4>(const float* values) { return _mm_loadu_ps(values); }
+	template<> inline Float4 GatherLanes<Float4>(const float (*vectors)[3], int d)
+	{
+		return _mm_setr_ps(vectors[0][d], vectors[1][d], vectors[2][d], vectors[3][d]);
+	}
+	inline void ScatterLanes(float (*vectors)[3], int d, Float4 x)
+	{
+		alignas(16) float lanes[4];
+		_mm_store_ps(lanes, x.V);
+		for (int l = 0; l < 4; l++)
+			vectors[l][d] = lanes[l];
+	}
+#endif
+
+	template<typename T>
+	inline T Clamp(T x, T lo, T hi) { return Min(Max(x, lo), hi); }
+
+	template<typename T>
+	inline T Dot(const T a[3], const T b[3]) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+	template<typename T>
+	inline void Cross(const T a[3], const T b[3], T out[3])
+	{
+		out[0] = a[1] * b[2] - a[2] * b[1];
+		out[1] = a[2] * b[0] - a[0] * b[2];
+		out[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	template<typename T>
+	inline T Normalize(T v[3])
+	{
+		T length = Sqrt(Dot(v, v));
+		T s = 1.0f / length;
+		v[0] = v[0] * s; v[1] = v[1] * s; v[2] = v[2] * s;
+		return length;
+	}
+
+	inline void Displace(float* x, float* y, float* z, uint32_t atom, const float d[3], float scale)
+	{
+		x[atom] += scale * d[0]; y[atom] += scale * d[1]; z[atom] += scale * d[2];
+	}
+
+	// SETTLE (Miyamoto & Kollman 1992) on one water, or on one water per lane:
+	// places the new triangle analytically in the frame spanned by the old
+	// molecular plane. b0 / c0 are the O-H1 / O-H2 vectors at the start of the
+	// step, doh1 / doh2 after the drift; da, db and dc come back as the
+	// displacements of O, H1 and H2
+	template<typename T>
+	void SettlePositions(T massO, T massH, T ohDistance, T hhDistance, const T b0[3], const T c0[3], const T doh1[3], const T doh2[3],
+		T da[3], T db[3], T dc[3])
+	{
+		const T wh = massH / (massO + 2.0f * massH);
+		const T rc = 0.5f * hhDistance;
+		const T height = Sqrt(ohDistance * ohDistance - rc * rc);
+		const T ra = 2.0f * wh * height;
+		const T rb = height - ra;
+
+		// New sites relative to their centre of mass
+		T a1[3], b1[3], c1[3];
+		for (int d = 0; d < 3; d++)
+		{
+			a1[d] = -wh * (doh1[d] + doh2[d]);
+			b1[d] = doh1[d] + a1[d];
+			c1[d] = doh2[d] + a1[d];
+		}
+
+		// z' normal to the old plane, x' perpendicular to it and to a1
+		T ez[3], ex[3], ey[3];
+		Cross(b0, c0, ez);
+		Cross(a1, ez, ex);
+		Cross(ez, ex, ey);
+		Normalize(ex); Normalize(ey); Normalize(ez);
+
+		const T xb0 = Dot(b0, ex), yb0 = Dot(b0, ey);
+		const T xc0 = Dot(c0, ex), yc0 = Dot(c0, ey);
+		const T za1 = Dot(a1, ez);
+		const T xb1 = Dot(b1, ex), yb1 = Dot(b1, ey), zb1 = Dot(b1, ez);
+		const T xc1 = Dot(c1, ex), yc1 = Dot(c1, ey), zc1 = Dot(c1, ez);
+
+		const T sinPhi = Clamp<T>(za1 / ra, -1.0f, 1.0f);
+		const T cosPhi = Sqrt(1.0f - sinPhi * sinPhi);
+		const T sinPsi = Clamp<T>((zb1 - zc1) / (2.0f * rc * cosPhi), -1.0f, 1.0f);
+		const T cosPsi = Sqrt(1.0f - sinPsi * sinPsi);
+
+		const T ya2 = ra * cosPhi;
+		const T xb2 = -rc * cosPsi;
+		const T t1 = -rb * cosPhi, t2 = rc * sinPsi * sinPhi;
+		const T yb2 = t1 - t2, yc2 = t1 + t2;
+
+		// Rotation about z' that brings the canonical triangle onto the new positions
+		const T alpha = xb2 * (xb0 - xc0) + yb0 * yb2 + yc0 * yc2;
+		const T beta = xb2 * (yc0 - yb0) + xb0 * yb2 + xc0 * yc2;
+		const T gamma = xb0 * yb1 - xb1 * yb0 + xc0 * yc1 - xc1 * yc0;
+		const T ab2 = alpha * alpha + beta * beta;
+		const T sinTheta = (alpha * gamma - beta * Sqrt(Max(ab2 - gamma * gamma, 0.0f))) / ab2;
+		const T cosTheta = Sqrt(Max(1.0f - sinTheta * sinTheta, 0.0f));
+
+		const T a3[3] = { -ya2 * sinTheta, ya2 * cosTheta, za1 };
+		const T b3[3] = { xb2 * cosTheta - yb2 * sinTheta, xb2 * sinTheta + yb2 * cosTheta, zb1 };
+		const T c3[3] = { -xb2 * cosTheta - yc2 * sinTheta, -xb2 * sinTheta + yc2 * cosTheta, zc1 };
+
+		for (int d = 0; d < 3; d++)
+		{
+			da[d] = a3[0] * ex[d] + a3[1] * ey[d] + a3[2] * ez[d] - a1[d];
+			db[d] = b3[0] * ex[d] + b3[1] * ey[d] + b3[2] * ez[d] - b1[d];
+			dc[d] = c3[0] * ex[d] + c3[1] * ey[d] + c3[2] * ez[d] - c1[d];
+		}
+	}
+
+	// Velocity SETTLE on one water or one per lane: the three bond impulses
+	// that zero every relative velocity along the bonds solve a 3x3 linear
+	// system, done with Cramer's rule. e0, e1 and e2 are the O-H1, O-H2 and
+	// H1-H2 vectors and come back normalized, their lengths in length
+	template<typename T>
+	void SettleVelocities(T invMassO, T invMassH, T e0[3], T e1[3], T e2[3], const T vO[3], const T vH1[3], const T vH2[3],
+		T length[3], T tau[3])
+	{
+		length[0] = Normalize(e0); length[1] = Normalize(e1); length[2] = Normalize(e2);
+
+		T dv0[3], dv1[3], dv2[3];
+		for (int d = 0; d < 3; d++)
+		{
+			dv0[d] = vO[d] - vH1[d];
+			dv1[d] = vO[d] - vH2[d];
+			dv2[d] = vH1[d] - vH2[d];
+		}
+
+		const T c01 = Dot(e0, e1), c02 = Dot(e0, e2), c12 = Dot(e1, e2);
+		const T m00 = invMassO + invMassH, m01 = c01 * invMassO, m02 = -c02 * invMassH;
+		const T m10 = c01 * invMassO, m11 = invMassO + invMassH, m12 = c12 * invMassH;
+		const T m20 = -c02 * invMassH, m21 = c12 * invMassH, m22 = 2.0f * invMassH;
+		const T r0 = -Dot(dv0, e0), r1 = -Dot(dv1, e1), r2 = -Dot(dv2, e2);
+
+		const T det = m00 * (m11 * m22 - m12 * m21) - m01 * (m10 * m22 - m12 * m20) + m02 * (m10 * m21 - m11 * m20);
+		const T invDet = 1.0f / det;
+		tau[0] = invDet * (r0 * (m11 * m22 - m12 * m21) - m01 * (r1 * m22 - m12 * r2) + m02 * (r1 * m21 - m11 * r2));
+		tau[1] = invDet * (m00 * (r1 * m22 - m12 * r2) - r0 * (m10 * m22 - m12 * m20) + m02 * (m10 * r2 - r1 * m20));
+		tau[2] = invDet * (m00 * (m11 * r2 - r1 * m21) - m01 * (m10 * r2 - r1 * m20) + r0 * (m10 * m21 - m11 * m20));
+	}
+
+	uint32_t FindRoot(std::vector<uint32_t>& parent, uint32_t a)
+	{
+		while (parent[a] != a)
+		{
+			parent[a] = parent[parent[a]];
+			a = parent[a];
+		}
+		return a;
+	}
+
+	void AtomicMax(std::atomic<uint32_t>& target, uint32_t value)
+	{
+		uint32_t current = target.load(std::memory_order_relaxed);
+		while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+	}
+}
+
+void ConstraintSolver::Compile(uint32_t atomCount)
+{
+	const auto& constraints = m_Topology.GetConstraints();
+	const auto& waters = m_Topology.GetRigidWaters();
+
+	// Constraints sharing an atom are coupled and must be iterated together,
+	// union-find over their atoms gives the independent clusters
+	std::vector<uint32_t> valid;
+	valid.reserve(constraints.size());
+	for (uint32_t c = 0; c < constraints.size(); c++)
+	{
+		if (constraints[c].Atoms[0] < atomCount && constraints[c].Atoms[1] < atomCount)
+			valid.push_back(c);
+	}
+	if (valid.size() != constraints.size())
+		PY_CORE_ERROR("Skipping {} constraints that reference missing atoms", constraints.size() - valid.size());
+
+	std::vector<uint32_t> parent(atomCount);
+	std::iota(parent.begin(), parent.end(), 0u);
+	for (uint32_t c : valid)
+	{
+		uint32_t a = FindRoot(parent, constraints[c].Atoms[0]);
+		uint32_t b = FindRoot(parent, constraints[c].Atoms[1]);
+		if (a != b)
+			parent[std::max(a, b)] = std::min(a, b);
+	}
+
+	std::stable_sort(valid.begin(), valid.end(), [&](uint32_t a, uint32_t b)
+		{
+			return FindRoot(parent, constraints[a].Atoms[0]) < FindRoot(parent, constraints[b].Atoms[0]);
+		});
+
+	m_ConstraintI.resize(valid.size());
+	m_ConstraintJ.resize(valid.size());
+	m_ConstraintDistSq.resize(valid.size());
+	m_ClusterOffsets.clear();
+
+	uint32_t lastRoot = ~0u;
+	for (uint32_t n = 0; n < valid.size(); n++)
+	{
+		const DistanceConstraint& constraint = constraints[valid[n]];
+		uint32_t root = FindRoot(parent, constraint.Atoms[0]);
+		if (root != lastRoot)
+		{
+			m_ClusterOffsets.push_back(n);
+			lastRoot = root;
+		}
+		m_ConstraintI[n] = constraint.Atoms[0];
+		m_ConstraintJ[n] = constraint.Atoms[1];
+		m_ConstraintDistSq[n] = constraint.Distance * constraint.Distance;
+	}
+	m_ClusterOffsets.push_back(static_cast<uint32_t>(valid.size()));
+
+	m_WaterO.clear(); m_WaterH1.clear(); m_WaterH2.clear();
+	m_WaterOH.clear(); m_WaterHH.clear();
+	for (const RigidWater& water : waters)
+	{
+		if (*std::max_element(water.Atoms, water.Atoms + 3) >= atomCount)
+		{
+			PY_CORE_ERROR("Skipping rigid water that references missing atoms");
+			continue;
+		}
+		m_WaterO.push_back(water.Atoms[0]);
+		m_WaterH1.push_back(water.Atoms[1]);
+		m_WaterH2.push_back(water.Atoms[2]);
+		m_WaterOH.push_back(water.OHDistance);
+		m_WaterHH.push_back(water.HHDistance);
+	}
+
+	m_CompiledRevision = m_Topology.GetRevision();
+	m_CompiledAtomCount = atomCount;
+}
+
+void ConstraintSolver::SaveReference(const AtomStore& atoms, ThreadPool* pool)
+{
+	const uint32_t count = static_cast<uint32_t>(atoms.Size());
+	if (m_Topology.GetRevision() != m_CompiledRevision || count != m_CompiledAtomCount)
+		Compile(count);
+
+	m_RefX.resize(count);
+	m_RefY.resize(count);
+	m_RefZ.resize(count);
+
+	ParallelRange(pool, count, 4096, [&](uint32_t begin, uint32_t end)
+		{
+			std::copy(atoms.PosX.begin() + begin, atoms.PosX.begin() + end, m_RefX.begin() + begin);
+			std::copy(atoms.PosY.begin() + begin, atoms.PosY.begin() + end, m_RefY.begin() + begin);
+			std::copy(atoms.PosZ.begin() + begin, atoms.PosZ.begin() + end, m_RefZ.begin() + begin);
+		});
+}
+
+void ConstraintSolver::ConstrainPositions(AtomStore& atoms, const SimulationBox& box, float dt, ThreadPool* pool)
+{
+	const PeriodicFrame frame(box);
+	const float invDt = 1.0f / dt;
+	const float tolerance2 = 2.0f * m_Tolerance;
+
+	float* px = atoms.PosX.data(); float* py = atoms.PosY.data(); float* pz = atoms.PosZ.data();
+	float* vx = atoms.VelX.data(); float* vy = atoms.VelY.data(); float* vz = atoms.VelZ.data();
+	const float* invMass = atoms.InvMass.data();
+
+	std::atomic<uint32_t> maxIterations = 0;
+	std::atomic<bool> failed = false;
+	std::atomic<double> virial = 0.0;
+
+	// SHAKE: each sweep corrects every constraint in the cluster along its
+	// reference direction until all squared lengths are within tolerance
+	const uint32_t clusters = static_cast<uint32_t>(m_ClusterOffsets.size() - 1);
+	ParallelRange(pool, clusters, 64, [&](uint32_t begin, uint32_t end)
+		{
+			uint32_t localMax = 0;
+			double localVirial = 0.0;
+			for (uint32_t cluster = begin; cluster < end; cluster++)
+			{
+				const uint32_t first = m_ClusterOffsets[cluster], last = m_ClusterOffsets[cluster + 1];
+
+				uint32_t iteration = 0;
+				bool converged = false;
+				while (!converged && iteration < m_MaxIterations)
+				{
+					converged = true;
+					for (uint32_t c = first; c < last; c++)
+					{
+						const uint32_t i = m_ConstraintI[c], j = m_ConstraintJ[c];
+						const float d2 = m_ConstraintDistSq[c];
+
+						float r[3];
+						frame.Delta(px, py, pz, i, j, r);
+						float diff = d2 - Dot(r, r);
+						if (std::abs(diff) <= tolerance2 * d2)
+							continue;
+						converged = false;
+
+						float ref[3];
+						frame.Delta(m_RefX.data(), m_RefY.data(), m_RefZ.data(), i, j, ref);
+						float g = diff / (2.0f * std::max(Dot(r, ref), 1e-6f * d2) * (invMass[i] + invMass[j]));
+
+						Displace(px, py, pz, i, ref, g * invMass[i]);
+						Displace(px, py, pz, j, ref, -g * invMass[j]);
+						Displace(vx, vy, vz, i, ref, g * invMass[i] * invDt);
+						Displace(vx, vy, vz, j, ref, -g * invMass[j] * invDt);
+						// Impulse g / dt along ref on i
+						localVirial += g * invDt * Dot(ref, ref);
+					}
+					iteration++;
+				}
+
+				if (!converged)
+					failed = true;
+				localMax = std::max(localMax, iteration);
+			}
+			AtomicMax(maxIterations, localMax);
+			virial.fetch_add(localVirial, std::memory_order_relaxed);
+		});
+
+	// SETTLE works on displacements relative to the oxygen, so molecules split
+	// by the box edge are fine. Each lane of a batch gathers its own minimum
+	// image vectors and scatters its own displacements, the solve in between
+	// runs on the whole batch at once
+	auto settleBatch = [&](auto lanes, uint32_t first)
+	{
+		using T = decltype(lanes);
+		constexpr uint32_t Lanes = sizeof(T) / sizeof(float);
+
+		alignas(16) float massO[Lanes], massH[Lanes];
+		float b0[Lanes][3], c0[Lanes][3], doh1[Lanes][3], doh2[Lanes][3];
+		for (uint32_t l = 0; l < Lanes; l++)
+		{
+			const uint32_t w = first + l, o = m_WaterO[w], h1 = m_WaterH1[w], h2 = m_WaterH2[w];
+			massO[l] = atoms.Mass[o];
+			massH[l] = atoms.Mass[h1];
+			frame.Delta(m_RefX.data(), m_RefY.data(), m_RefZ.data(), h1, o, b0[l]);
+			frame.Delta(m_RefX.data(), m_RefY.data(), m_RefZ.data(), h2, o, c0[l]);
+			frame.Delta(px, py, pz, h1, o, doh1[l]);
+			frame.Delta(px, py, pz, h2, o, doh2[l]);
+		}
+
+		T b0Lanes[3], c0Lanes[3], doh1Lanes[3], doh2Lanes[3], da[3], db[3], dc[3];
+		for (int d = 0; d < 3; d++)
+		{
+			b0Lanes[d] = GatherLanes<T>(b0, d);
+			c0Lanes[d] = GatherLanes<T>(c0, d);
+			doh1Lanes[d] = GatherLanes<T>(doh1, d);
+			doh2Lanes[d] = GatherLanes<T>(doh2, d);
+		}
+		SettlePositions<T>(LoadLanes<T>(massO), LoadLanes<T>(massH), LoadLanes<T>(m_WaterOH.data() + first), LoadLanes<T>(m_WaterHH.data() + first),
+			b0Lanes, c0Lanes, doh1Lanes, doh2Lanes, da, db, dc);
+
+		float moveO[Lanes][3], moveH1[Lanes][3], moveH2[Lanes][3];
+		for (int d = 0; d < 3; d++)
+		{
+			ScatterLanes(moveO, d, da[d]);
+			ScatterLanes(moveH1, d, db[d]);
+			ScatterLanes(moveH2, d, dc[d]);
+		}
+
+		double batchVirial = 0.0;
+		for (uint32_t l = 0; l < Lanes; l++)
+		{
+			const uint32_t w = first + l, o = m_WaterO[w], h1 = m_WaterH1[w], h2 = m_WaterH2[w];
+			Displace(px, py, pz, o, moveO[l], 1.0f);
+			Displace(px, py, pz, h1, moveH1[l], 1.0f);
+			Displace(px, py, pz, h2, moveH2[l], 1.0f);
+			Displace(vx, vy, vz, o, moveO[l], invDt);
+			Displace(vx, vy, vz, h1, moveH1[l], invDt);
+			Displace(vx, vy, vz, h2, moveH2[l], invDt);
+
+			// The impulses m d / dt sum to zero, so positions can be taken relative to the oxygen
+			batchVirial += massH[l] * invDt * (Dot(moveH1[l], b0[l]) + Dot(moveH2[l], c0[l]));
+		}
+		return batchVirial;
+	};
+
+	const uint32_t waterCount = static_cast<uint32_t>(m_WaterO.size());
+	ParallelRange(pool, waterCount, 256, [&](uint32_t begin, uint32_t end)
+		{
+			double localVirial = 0.0;
+			uint32_t w = begin;
+#if PY_SIMD_X86
+			for (; w + 4 <= end; w += 4)
+				localVirial += settleBatch(Float4(), w);
+#endif
+			for (; w < end; w++)
+				localVirial += settleBatch(0.0f, w);
+			virial.fetch_add(localVirial, std::memory_order_relaxed);
+		});
+
+	m_LastIterations = maxIterations;
+	m_LastTimestep = dt;
+	m_PositionVirial = virial;
+	if (failed)
+		PY_CORE_WARN("SHAKE did not converge in {} iterations", m_MaxIterations);
+}
+
+void ConstraintSolver::ConstrainVelocities(AtomStore& atoms, const SimulationBox& box, ThreadPool* pool)
+{
+	const PeriodicFrame frame(box);
+
+	const float* px = atoms.PosX.data(); const float* py = atoms.PosY.data(); const float* pz = atoms.PosZ.data();
+	float* vx = atoms.VelX.data(); float* vy = atoms.VelY.data(); float* vz = atoms.VelZ.data();
+	const float* invMass = atoms.InvMass.data();
+
+	std::atomic<uint32_t> maxIterations = 0;
+	std::atomic<bool> failed = false;
+	std::atomic<double> virial = 0.0, kinetic = 0.0;
+
+	// RATTLE: removes the relative velocity along each constraint until
+	// d(r^2)/dt vanishes for the whole cluster
+	const uint32_t clusters = static_cast<uint32_t>(m_ClusterOffsets.size() - 1);
+	ParallelRange(pool, clusters, 64, [&](uint32_t begin, uint32_t end)
+		{
+			uint32_t localMax = 0;
+			double localVirial = 0.0, localKinetic = 0.0;
+			for (uint32_t cluster = begin; cluster < end; cluster++)
+			{
+				const uint32_t first = m_ClusterOffsets[cluster], last = m_ClusterOffsets[cluster + 1];
+
+				uint32_t iteration = 0;
+				bool converged = false;
+				while (!converged && iteration < m_MaxIterations)
+				{
+					converged = true;
+					for (uint32_t c = first; c < last; c++)
+					{
+						const uint32_t i = m_ConstraintI[c], j = m_ConstraintJ[c];
+						const float d2 = m_ConstraintDistSq[c];
+
+						float r[3], v[3];
+						frame.Delta(px, py, pz, i, j, r);
+						v[0] = vx[i] - vx[j]; v[1] = vy[i] - vy[j]; v[2] = vz[i] - vz[j];
+
+						float rv = Dot(r, v);
+						if (std::abs(rv) <= m_Tolerance * d2)
+							continue;
+						converged = false;
+
+						float k = -rv / (d2 * (invMass[i] + invMass[j]));
+						Displace(vx, vy, vz, i, r, k * invMass[i]);
+						Displace(vx, vy, vz, j, r, -k * invMass[j]);
+
+						// Impulse k r on i; m v . dv + m dv^2 / 2 summed over both atoms
+						const float r2 = Dot(r, r);
+						localVirial += k * r2;
+						localKinetic += k * rv + 0.5f * k * k * (invMass[i] + invMass[j]) * r2;
+					}
+					iteration++;
+				}
+
+				if (!converged)
+					failed = true;
+				localMax = std::max(localMax, iteration);
+			}
+			AtomicMax(maxIterations, localMax);
+			virial.fetch_add(localVirial, std::memory_order_relaxed);
+			kinetic.fetch_add(localKinetic, std::memory_order_relaxed);
+		});
+
+	// Velocity SETTLE in batches like the position pass
+	auto settleBatch = [&](auto lanes, uint32_t first, double& batchVirial, double& batchKinetic)
+	{
+		using T = decltype(lanes);
+		constexpr uint32_t Lanes = sizeof(T) / sizeof(float);
+
+		alignas(16) float invMassO[Lanes], invMassH[Lanes];
+		float e0[Lanes][3], e1[Lanes][3], e2[Lanes][3], vO[Lanes][3], vH1[Lanes][3], vH2[Lanes][3];
+		for (uint32_t l = 0; l < Lanes; l++)
+		{
+			const uint32_t w = first + l, o = m_WaterO[w], h1 = m_WaterH1[w], h2 = m_WaterH2[w];
+			invMassO[l] = invMass[o];
+			invMassH[l] = invMass[h1];
+			frame.Delta(px, py, pz, o, h1, e0[l]);
+			frame.Delta(px, py, pz, o, h2, e1[l]);
+			frame.Delta(px, py, pz, h1, h2, e2[l]);
+			vO[l][0] = vx[o]; vO[l][1] = vy[o]; vO[l][2] = vz[o];
+			vH1[l][0] = vx[h1]; vH1[l][1] = vy[h1]; vH1[l][2] = vz[h1];
+			vH2[l][0] = vx[h2]; vH2[l][1] = vy[h2]; vH2[l][2] = vz[h2];
+		}
+
+		T e0Lanes[3], e1Lanes[3], e2Lanes[3], vOLanes[3], vH1Lanes[3], vH2Lanes[3], length[3], tau[3];
+		for (int d = 0; d < 3; d++)
+		{
+			e0Lanes[d] = GatherLanes<T>(e0, d);
+			e1Lanes[d] = GatherLanes<T>(e1, d);
+			e2Lanes[d] = GatherLanes<T>(e2, d);
+			vOLanes[d] = GatherLanes<T>(vO, d);
+			vH1Lanes[d] = GatherLanes<T>(vH1, d);
+			vH2Lanes[d] = GatherLanes<T>(vH2, d);
+		}
+		SettleVelocities<T>(LoadLanes<T>(invMassO), LoadLanes<T>(invMassH), e0Lanes, e1Lanes, e2Lanes, vOLanes, vH1Lanes, vH2Lanes, length, tau);
+
+		// Lane l's normalized bond vectors, then its impulses and bond lengths
+		float solved[Lanes][3], lengths[Lanes][3];
+		for (int d = 0; d < 3; d++)
+		{
+			ScatterLanes(e0, d, e0Lanes[d]);
+			ScatterLanes(e1, d, e1Lanes[d]);
+			ScatterLanes(e2, d, e2Lanes[d]);
+			ScatterLanes(solved, d, tau[d]);
+			ScatterLanes(lengths, d, length[d]);
+		}
+
+		for (uint32_t l = 0; l < Lanes; l++)
+		{
+			const uint32_t w = first + l, o = m_WaterO[w], h1 = m_WaterH1[w], h2 = m_WaterH2[w];
+			const float imO = invMassO[l], imH = invMassH[l];
+			const float* t = solved[l];
+
+			for (int d = 0; d < 3; d++)
+			{
+				float impulseO = t[0] * e0[l][d] + t[1] * e1[l][d];
+				float impulseH1 = -t[0] * e0[l][d] + t[2] * e2[l][d];
+				float impulseH2 = -t[1] * e1[l][d] - t[2] * e2[l][d];
+				(d == 0 ? vx : d == 1 ? vy : vz)[o] += impulseO * imO;
+				(d == 0 ? vx : d == 1 ? vy : vz)[h1] += impulseH1 * imH;
+				(d == 0 ? vx : d == 1 ? vy : vz)[h2] += impulseH2 * imH;
+
+				batchKinetic += impulseO * (vO[l][d] + 0.5f * impulseO * imO) + impulseH1 * (vH1[l][d] + 0.5f * impulseH1 * imH)
+					+ impulseH2 * (vH2[l][d] + 0.5f * impulseH2 * imH);
+			}
+			// Each bond impulse times its length
+			batchVirial += t[0] * lengths[l][0] + t[1] * lengths[l][1] + t[2] * lengths[l][2];
+		}
+	};
+
+	const uint32_t waterCount = static_cast<uint32_t>(m_WaterO.size());
+	ParallelRange(pool, waterCount, 256, [&](uint32_t begin, uint32_t end)
+		{
+			double localVirial = 0.0, localKinetic = 0.0;
+			uint32_t w = begin;
+#if PY_SIMD_X86
+			for (; w + 4 <= end; w += 4)
+				settleBatch(Float4(), w, localVirial, localKinetic);
+#endif
+			for (; w < end; w++)
+				settleBatch(0.0f, w, localVirial, localKinetic);
+			virial.fetch_add(localVirial, std::memory_order_relaxed);
+			kinetic.fetch_add(localKinetic, std::memory_order_relaxed);
+		});
+
+	m_VelocityVirial = virial;
+	m_KineticEnergyChange = kinetic;
+
+	m_LastIterations = std::max(m_LastIterations, maxIterations.load());
+	if (failed)
+		PY_CORE_WARN("RATTLE did not converge in {} iterations", m_MaxIterations);
+}
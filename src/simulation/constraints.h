@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "aligned_allocator.h"
+#include "atom_store.h"
+#include "simulation_box.h"
+#include "topology.h"
+
+class ThreadPool;
+
+
+// Holonomic constraints from a Topology: iterative SHAKE / RATTLE for
+// distance constraints and analytic SETTLE for rigid waters. Coupled
+// distance constraints are grouped into clusters that are solved
+// independently, waters go through one structure-of-arrays pass. Both run
+// on the pool when one is given.
+//
+// Per step: SaveReference before the drift, ConstrainPositions after it
+// (which also folds the correction into the velocities), and
+// ConstrainVelocities after the closing kick.
+class ConstraintSolver
+{
+public:
+	ConstraintSolver(const Topology& topology)
+		: m_Topology(topology) {
+	}
+
+	bool IsEmpty() const { return m_Topology.GetConstrainedDegrees() == 0; }
+
+	// Relative tolerance on constrained distances, and on d(r^2)/dt relative to d^2
+	void SetTolerance(float tolerance) { m_Tolerance = tolerance; }
+	void SetMaxIterations(uint32_t iterations) { m_MaxIterations = iterations; }
+	float GetTolerance() const { return m_Tolerance; }
+
+	void SaveReference(const AtomStore& atoms, ThreadPool* pool);
+	void ConstrainPositions(AtomStore& atoms, const SimulationBox& box, float dt, ThreadPool* pool);
+	void ConstrainVelocities(AtomStore& atoms, const SimulationBox& box, ThreadPool* pool);
+
+	// Most SHAKE / RATTLE sweeps any cluster needed in the last call
+	uint32_t GetLastIterations() const { return m_LastIterations; }
+
+	// By-products of the last ConstrainPositions / ConstrainVelocities pair for
+	// thermostats and barostats: the virial of the constraint forces over the
+	// step, from the impulses both applied, and the kinetic energy the velocity
+	// pass removed, a negative change
+	double GetVirial() const { return (m_PositionVirial + m_VelocityVirial) / m_LastTimestep; }
+	double GetKineticEnergyChange() const { return m_KineticEnergyChange; }
+
+private:
+	void Compile(uint32_t atomCount);
+
+private:
+	const Topology& m_Topology;
+	uint64_t m_CompiledRevision = ~0ull;
+	uint32_t m_CompiledAtomCount = 0;
+
+	float m_Tolerance = 1e-5f;
+	uint32_t m_MaxIterations = 500;
+	uint32_t m_LastIterations = 0;
+	float m_LastTimestep = 1.0f;
+	// Sums of r . impulse over the constraints
+	double m_PositionVirial = 0.0;
+	double m_VelocityVirial = 0.0;
+	double m_KineticEnergyChange = 0.0;
+
+	// Distance constraints ordered by cluster, cluster c is [ClusterOffsets[c], ClusterOffsets[c + 1])
+	std::vector<uint32_t> m_ClusterOffsets;
+	AlignedVector<uint32_t> m_ConstraintI, m_ConstraintJ;
+	AlignedVector<float> m_ConstraintDistSq;
+
+	// Rigid waters, one stream per site and parameter
+	AlignedVector<uint32_t> m_WaterO, m_WaterH1, m_WaterH2;
+	AlignedVector<float> m_WaterOH, m_WaterHH;
+
+	// Positions at the start of the step, SHAKE projects along them
+	AlignedVector<float> m_RefX, m_RefY, m_RefZ;
+};
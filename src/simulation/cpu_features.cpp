@@ -0,0 +1,103 @@
+#include "cpu_features.h"
+
+#if PY_SIMD_X86
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+
+#if PY_SIMD_X86
+static void Cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#if defined(_MSC_VER)
+	int r[4];
+	__cpuidex(r, (int)leaf, (int)subleaf);
+	for (int i = 0; i < 4; i++)
+		regs[i] = (uint32_t)r[i];
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t Xgetbv(uint32_t index)
+{
+#if defined(_MSC_VER)
+	return _xgetbv(index);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static CpuFeatures Detect()
+{
+	CpuFeatures features;
+
+	uint32_t regs[4];
+	Cpuid(0, 0, regs);
+	uint32_t maxLeaf = regs[0];
+
+	Cpuid(1, 0, regs);
+	features.SSE42 = (regs[2] >> 20) & 1;
+	features.FMA = (regs[2] >> 12) & 1;
+
+	bool osxsave = (regs[2] >> 27) & 1;
+	bool avx = (regs[2] >> 28) & 1;
+	if (!osxsave)
+		return features;
+
+	// XCR0: bits 1-2 are SSE/AVX state, 5-7 the AVX-512 opmask and upper zmm state
+	uint64_t xcr0 = Xgetbv(0);
+	bool osAvx = (xcr0 & 0x6) == 0x6;
+	bool osAvx512 = (xcr0 & 0xe6) == 0xe6;
+
+	features.AVX = avx && osAvx;
+	features.FMA = features.FMA && features.AVX;
+
+	if (maxLeaf >= 7)
+	{
+		Cpuid(7, 0, regs);
+		features.AVX2 = features.AVX && ((regs[1] >> 5) & 1);
+		features.AVX512F = osAvx512 && ((regs[1] >> 16) & 1);
+	}
+
+	return features;
+}
+#endif
+
+const CpuFeatures& CpuFeatures::Get()
+{
+#if PY_SIMD_X86
+	static const CpuFeatures s_Features = Detect();
+#else
+	static const CpuFeatures s_Features;
+#endif
+	return s_Features;
+}
+
+SimdLevel CpuFeatures::GetBestSimdLevel() const
+{
+	if (AVX512F && AVX2 && FMA)
+		return SimdLevel::AVX512;
+	if (AVX2 && FMA)
+		return SimdLevel::AVX2;
+	if (SSE42)
+		return SimdLevel::SSE42;
+	return SimdLevel::Scalar;
+}
+
+const char* SimdLevelToString(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::Scalar: return "Scalar";
+	case SimdLevel::SSE42:  return "SSE4.2";
+	case SimdLevel::AVX2:   return "AVX2";
+	case SimdLevel::AVX512: return "AVX-512";
+	}
+	return "Unknown";
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__)
+	#define PY_SIMD_X86 1
+#else
+	#define PY_SIMD_X86 0
+#endif
+
+
+enum class SimdLevel
+{
+	Scalar = 0,
+	SSE42,
+	AVX2,
+	AVX512
+};
+
+struct CpuFeatures
+{
+	bool SSE42 = false;
+	bool AVX = false;
+	bool AVX2 = false;
+	bool FMA = false;
+	bool AVX512F = false;
+
+	// Queried once through CPUID/XGETBV, also checks the OS saves the wide registers
+	static const CpuFeatures& Get();
+
+	// Widest instruction set both the CPU and this build can run
+	SimdLevel GetBestSimdLevel() const;
+};
+
+const char* SimdLevelToString(SimdLevel level);
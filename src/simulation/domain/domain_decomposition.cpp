@@ -0,0 +1,767 @@
+#include "domain_decomposition.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include "../../logging/log.h"
+#include "../world.h"
+
+
+namespace
+{
+	template<typename T>
+	void Put(std::vector<uint8_t>& buffer, const T& value)
+	{
+		const size_t at = buffer.size();
+		buffer.resize(at + sizeof(T));
+		std::memcpy(buffer.data() + at, &value, sizeof(T));
+	}
+
+	struct Reader
+	{
+		const uint8_t* At;
+		const uint8_t* End;
+
+		Reader(const std::vector<uint8_t>& buffer)
+			: At(buffer.data()), End(buffer.data() + buffer.size()) {
+		}
+
+		bool IsDone() const { return At >= End; }
+
+		template<typename T>
+		T Get()
+		{
+			T value;
+			std::memcpy(&value, At, sizeof(T));
+			At += sizeof(T);
+			return value;
+		}
+	};
+}
+
+DomainDecomposition::DomainDecomposition(Transport& transport, const DomainProps& props)
+	: m_Transport(transport), m_Props(props)
+{
+}
+
+DomainDecomposition::~DomainDecomposition()
+{
+	Detach();
+}
+
+bool DomainDecomposition::Attach(World& world)
+{
+	Detach();
+
+	const SimulationBox& box = world.GetBox();
+	if (!box.Periodic)
+	{
+		PY_CORE_ERROR("Domain decomposition needs a periodic box");
+		return false;
+	}
+
+	// Checked before anything is changed, a refused world stays as it was
+	if (!world.AttachDomain(this))
+		return false;
+
+	m_ListCutoff = world.GetListCutoff();
+	if (m_ListCutoff <= 0.0f)
+	{
+		PY_CORE_ERROR("Domain decomposition needs a force on the neighbor list to size the halo");
+		world.m_Domain = nullptr;
+		return false;
+	}
+
+	NeighborList& list = world.GetNeighborList();
+	if (list.GetCutoff() != m_ListCutoff)
+		list.SetCutoff(m_ListCutoff);
+	m_Box = box;
+	m_HaloWidth = list.GetListRadius() + 0.5f * list.GetSkin();
+	if (!ChooseGrid())
+	{
+		world.m_Domain = nullptr;
+		return false;
+	}
+
+	m_World = &world;
+
+	// Keep only the atoms inside this domain, by global id
+	AtomStore& atoms = world.GetAtoms();
+	const uint32_t count = static_cast<uint32_t>(atoms.Size());
+	atoms.WrapPositions(box, 0, count);
+
+	m_GlobalIds.resize(count);
+	std::iota(m_GlobalIds.begin(), m_GlobalIds.end(), 0u);
+	for (uint32_t i = count; i-- > 0;)
+	{
+		if (GetOwningRank(box.ToFractional(atoms.GetPosition(i))) == m_Transport.GetRank())
+			continue;
+
+		world.DestroyAtom(world.GetAtomEntity(i));
+		m_GlobalIds[i] = m_GlobalIds.back();
+		m_GlobalIds.pop_back();
+	}
+	m_OwnedCount = static_cast<uint32_t>(m_GlobalIds.size());
+
+	double total = m_OwnedCount;
+	m_Transport.AllReduceSum(&total, 1);
+	m_GlobalAtomCount = static_cast<uint64_t>(total);
+	if (m_GlobalAtomCount != count)
+		PY_CORE_WARN("Ranks passed different systems to the domain decomposition, {} atoms here, {} owned in total", count, m_GlobalAtomCount);
+
+	PY_CORE_INFO("Rank {} owns domain ({}, {}, {}) of a {}x{}x{} grid with {} atoms",
+		m_Transport.GetRank(), m_Coords.x, m_Coords.y, m_Coords.z, m_Grid.x, m_Grid.y, m_Grid.z, m_OwnedCount);
+
+	m_LastReorderStep = world.GetStepCount();
+	Repartition();
+	return true;
+}
+
+void DomainDecomposition::Detach()
+{
+	if (!m_World)
+		return;
+
+	RemoveGhosts();
+	m_World->GetNeighborList().ClearGhosts();
+	m_World->m_Domain = nullptr;
+	m_World = nullptr;
+}
+
+bool DomainDecomposition::ChooseGrid()
+{
+	const uint32_t ranks = m_Transport.GetRankCount();
+	const glm::vec3 widths = m_Box.GetPerpendicularWidths();
+
+	// Each domain must be at least a halo thick, so halos only reach adjacent domains
+	auto fits = [&](const glm::uvec3& grid)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			if (grid[a] > 1 && m_HaloWidth * grid[a] > widths[a])
+				return false;
+		}
+		return true;
+	};
+
+	if (m_Props.Grid != glm::uvec3(0))
+	{
+		if (m_Props.Grid.x * m_Props.Grid.y * m_Props.Grid.z != ranks || !fits(m_Props.Grid))
+		{
+			PY_CORE_ERROR("Domain grid {}x{}x{} does not fit {} ranks with a halo of {}",
+				m_Props.Grid.x, m_Props.Grid.y, m_Props.Grid.z, ranks, m_HaloWidth);
+			return false;
+		}
+		m_Grid = m_Props.Grid;
+	}
+	else
+	{
+		// Halo volume per domain grows with the number of cut faces times their
+		// area, which goes as grid[a] / widths[a] along each cut axis
+		float bestCost = INFINITY;
+		for (uint32_t x = 1; x <= ranks; x++)
+		{
+			if (ranks % x)
+				continue;
+			for (uint32_t y = 1; y <= ranks / x; y++)
+			{
+				if ((ranks / x) % y)
+					continue;
+
+				glm::uvec3 grid(x, y, ranks / x / y);
+				if (!fits(grid))
+					continue;
+
+				float cost = 0.0f;
+				for (int a = 0; a < 3; a++)
+					cost += grid[a] > 1 ? grid[a] / widths[a] : 0.0f;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					m_Grid = grid;
+				}
+			}
+		}
+		if (bestCost == INFINITY)
+		{
+			PY_CORE_ERROR("No grid of {} domains is thicker than the halo of {} in this box", ranks, m_HaloWidth);
+			return false;
+		}
+	}
+
+	const uint32_t rank = m_Transport.GetRank();
+	m_Coords = { rank % m_Grid.x, (rank / m_Grid.x) % m_Grid.y, rank / (m_Grid.x * m_Grid.y) };
+	m_Low = glm::vec3(m_Coords) / glm::vec3(m_Grid);
+	m_High = glm::vec3(m_Coords + 1u) / glm::vec3(m_Grid);
+	m_HaloMargin = m_HaloWidth / widths;
+
+	// The 26 surrounding domains, fewer distinct ranks when the grid is thin
+	m_Neighbors.clear();
+	m_NeighborLow.clear();
+	m_NeighborHigh.clear();
+	for (int dz = -1; dz <= 1; dz++)
+	{
+		for (int dy = -1; dy <= 1; dy++)
+		{
+			for (int dx = -1; dx <= 1; dx++)
+			{
+				glm::ivec3 coords = glm::ivec3(m_Coords) + glm::ivec3(dx, dy, dz);
+				coords = (coords + glm::ivec3(m_Grid)) % glm::ivec3(m_Grid);
+
+				uint32_t neighbor = GetDomainRank(coords);
+				if (neighbor == rank || std::find(m_Neighbors.begin(), m_Neighbors.end(), neighbor) != m_Neighbors.end())
+					continue;
+
+				m_Neighbors.push_back(neighbor);
+				m_NeighborLow.push_back(glm::vec3(coords) / glm::vec3(m_Grid));
+				m_NeighborHigh.push_back(glm::vec3(coords + 1) / glm::vec3(m_Grid));
+			}
+		}
+	}
+
+	const size_t neighbors = m_Neighbors.size();
+	m_SendIndices.assign(neighbors, {});
+	m_SendBuffers.assign(neighbors, {});
+	m_GhostBegin.assign(neighbors, 0);
+	m_GhostEnd.assign(neighbors, 0);
+	return true;
+}
+
+void DomainDecomposition::UpdateHaloWidth()
+{
+	const NeighborList& list = m_World->GetNeighborList();
+	const glm::vec3 widths = m_Box.GetPerpendicularWidths();
+
+	// Half a skin more than the list radius: the list is rebuilt one drift
+	// after the halo is chosen in the worst case
+	m_HaloWidth = list.GetListRadius() + 0.5f * list.GetSkin();
+	m_HaloMargin = m_HaloWidth / widths;
+
+	for (int a = 0; a < 3; a++)
+	{
+		if (m_Grid[a] > 1 && m_HaloMargin[a] * m_Grid[a] > 1.0f)
+			PY_CORE_ERROR("Halo of {} is now thicker than the domains along box vector {}, pairs will be missed", m_HaloWidth, a);
+	}
+}
+
+uint32_t DomainDecomposition::GetDomainRank(const glm::ivec3& coords) const
+{
+	return static_cast<uint32_t>(coords.x) + m_Grid.x * (static_cast<uint32_t>(coords.y) + m_Grid.y * static_cast<uint32_t>(coords.z));
+}
+
+uint32_t DomainDecomposition::GetOwningRank(const glm::vec3& fractional) const
+{
+	glm::ivec3 coords;
+	for (int a = 0; a < 3; a++)
+		coords[a] = std::clamp(static_cast<int>(std::floor(fractional[a] * m_Grid[a])), 0, static_cast<int>(m_Grid[a]) - 1);
+	return GetDomainRank(coords);
+}
+
+bool DomainDecomposition::IsInHalo(const glm::vec3& fractional, uint32_t neighbor) const
+{
+	// A point closer than h to a domain is closer than h / width along every
+	// fractional axis, so this is a superset of the atoms within h
+	for (int a = 0; a < 3; a++)
+	{
+		if (m_Grid[a] == 1)
+			continue;
+
+		const float s = fractional[a];
+		const float low = m_NeighborLow[neighbor][a];
+		const float high = m_NeighborHigh[neighbor][a];
+		if (s >= low && s < high)
+			continue;
+
+		const float gap = std::min(SimulationBox::Wrap(low - s, 1.0f), SimulationBox::Wrap(s - high, 1.0f));
+		if (gap >= m_HaloMargin[a])
+			return false;
+	}
+	return true;
+}
+
+bool DomainDecomposition::Update()
+{
+	if (!m_World)
+		return true;
+
+	// Every rank changes the box and the forces the same way, no need to agree on these
+	if (!HasFailed() && (m_RebuildPending || m_World->GetBox() != m_Box || m_World->GetListCutoff() != m_ListCutoff))
+		Repartition();
+	return !HasFailed();
+}
+
+void DomainDecomposition::Repartition()
+{
+	World& world = *m_World;
+	AtomStore& atoms = world.GetAtoms();
+	NeighborList& list = world.GetNeighborList();
+
+	// Atoms keep the forces they had, only their indices and ranks change
+	const bool forcesCurrent = world.m_ForcesCurrent;
+
+	m_Box = world.GetBox();
+	m_ListCutoff = world.GetListCutoff();
+	if (list.GetCutoff() != m_ListCutoff)
+		list.SetCutoff(m_ListCutoff);
+	UpdateHaloWidth();
+
+	RemoveGhosts();
+	atoms.WrapPositions(m_Box, 0, m_OwnedCount);
+	MigrateAtoms();
+	if (HasFailed())
+		return;
+
+	if (world.m_ReorderInterval && world.GetStepCount() - m_LastReorderStep >= world.m_ReorderInterval)
+	{
+		world.ReorderAtoms();
+		std::vector<uint32_t> ids(m_OwnedCount);
+		for (uint32_t i = 0; i < m_OwnedCount; i++)
+			ids[world.m_NewIndex[i]] = m_GlobalIds[i];
+		m_GlobalIds.swap(ids);
+		m_LastReorderStep = world.GetStepCount();
+	}
+
+	ExchangeHalo();
+	if (HasFailed())
+		return;
+
+	list.SetGhosts(m_OwnedCount, m_GlobalIds.data());
+	list.Build(atoms, m_Box);
+
+	// Integrators keeping their own per-atom force copies refresh them
+	world.m_ForcesCurrent = forcesCurrent;
+	world.m_Revision++;
+	m_RebuildPending = false;
+
+	m_Stats.Repartitions++;
+	m_Stats.OwnedAtoms = m_OwnedCount;
+	m_Stats.GhostAtoms = GetGhostCount();
+}
+
+void DomainDecomposition::RemoveGhosts()
+{
+	World& world = *m_World;
+	for (uint32_t i = static_cast<uint32_t>(world.GetAtomCount()); i-- > m_OwnedCount;)
+		world.DestroyAtom(world.GetAtomEntity(i));
+	m_GlobalIds.resize(m_OwnedCount);
+}
+
+void DomainDecomposition::MigrateAtoms()
+{
+	World& world = *m_World;
+	AtomStore& atoms = world.GetAtoms();
+	const bool precise = atoms.HasPreciseState();
+	const bool preciseForces = atoms.HasPreciseForces();
+	const uint32_t rank = m_Transport.GetRank();
+
+	for (auto& buffer : m_SendBuffers)
+		buffer.clear();
+
+	for (uint32_t i = m_OwnedCount; i-- > 0;)
+	{
+		const uint32_t owner = GetOwningRank(m_Box.ToFractional(atoms.GetPosition(i)));
+		if (owner == rank)
+			continue;
+
+		auto it = std::find(m_Neighbors.begin(), m_Neighbors.end(), owner);
+		if (it == m_Neighbors.end())
+		{
+			PY_CORE_ERROR("Atom {} moved past the next domain between two repartitions", m_GlobalIds[i]);
+			continue;
+		}
+
+		// Full state, the atom continues on the other rank as if nothing happened
+		std::vector<uint8_t>& buffer = m_SendBuffers[it - m_Neighbors.begin()];
+		Put(buffer, m_GlobalIds[i]);
+		Put(buffer, atoms.TypeId[i]);
+		Put(buffer, atoms.Mass[i]);
+		Put(buffer, atoms.InvMass[i]);
+		Put(buffer, atoms.Charge[i]);
+		Put(buffer, atoms.GetPosition(i));
+		Put(buffer, atoms.GetVelocity(i));
+		Put(buffer, atoms.GetForce(i));
+		Put(buffer, atoms.GetImage(i));
+		if (precise)
+		{
+			Put(buffer, glm::dvec3(atoms.PrecisePosX[i], atoms.PrecisePosY[i], atoms.PrecisePosZ[i]));
+			Put(buffer, glm::dvec3(atoms.PreciseVelX[i], atoms.PreciseVelY[i], atoms.PreciseVelZ[i]));
+		}
+		if (preciseForces)
+			Put(buffer, glm::dvec3(atoms.PreciseForceX[i], atoms.PreciseForceY[i], atoms.PreciseForceZ[i]));
+
+		world.DestroyAtom(world.GetAtomEntity(i));
+		m_GlobalIds[i] = m_GlobalIds.back();
+		m_GlobalIds.pop_back();
+		m_OwnedCount--;
+		m_Stats.MigratedAtoms++;
+	}
+
+	for (size_t n = 0; n < m_Neighbors.size(); n++)
+		m_Transport.Send(m_Neighbors[n], m_SendBuffers[n].data(), m_SendBuffers[n].size());
+
+	for (uint32_t neighbor : m_Neighbors)
+	{
+		if (!m_Transport.Receive(neighbor, m_ReceiveBuffer))
+		{
+			PY_CORE_ERROR("Rank {} got no migrating atoms from rank {}", m_Transport.GetRank(), neighbor);
+			m_Failed = true;
+			return;
+		}
+
+		Reader reader(m_ReceiveBuffer);
+		while (!reader.IsDone())
+		{
+			const uint32_t id = reader.Get<uint32_t>();
+			const uint32_t type = reader.Get<uint32_t>();
+			const float mass = reader.Get<float>();
+			const float invMass = reader.Get<float>();
+			const float charge = reader.Get<float>();
+			const glm::vec3 position = reader.Get<glm::vec3>();
+			const glm::vec3 velocity = reader.Get<glm::vec3>();
+			const glm::vec3 force = reader.Get<glm::vec3>();
+			const glm::ivec3 image = reader.Get<glm::ivec3>();
+
+			const uint32_t i = world.GetAtomIndex(world.CreateAtom(position, velocity, mass, type, charge));
+			atoms.InvMass[i] = invMass;
+			atoms.ForceX[i] = force.x; atoms.ForceY[i] = force.y; atoms.ForceZ[i] = force.z;
+			atoms.ImageX[i] = image.x; atoms.ImageY[i] = image.y; atoms.ImageZ[i] = image.z;
+			if (precise)
+			{
+				const glm::dvec3 precisePosition = reader.Get<glm::dvec3>();
+				const glm::dvec3 preciseVelocity = reader.Get<glm::dvec3>();
+				atoms.PrecisePosX[i] = precisePosition.x; atoms.PrecisePosY[i] = precisePosition.y; atoms.PrecisePosZ[i] = precisePosition.z;
+				atoms.PreciseVelX[i] = preciseVelocity.x; atoms.PreciseVelY[i] = preciseVelocity.y; atoms.PreciseVelZ[i] = preciseVelocity.z;
+			}
+			if (preciseForces)
+			{
+				const glm::dvec3 preciseForce = reader.Get<glm::dvec3>();
+				atoms.PreciseForceX[i] = preciseForce.x; atoms.PreciseForceY[i] = preciseForce.y; atoms.PreciseForceZ[i] = preciseForce.z;
+			}
+
+			m_GlobalIds.push_back(id);
+			m_OwnedCount++;
+		}
+	}
+}
+
+void DomainDecomposition::ExchangeHalo()
+{
+	World& world = *m_World;
+	AtomStore& atoms = world.GetAtoms();
+	const bool precise = atoms.HasPreciseState();
+	const size_t neighbors = m_Neighbors.size();
+
+	for (auto& indices : m_SendIndices)
+		indices.clear();
+
+	for (uint32_t i = 0; i < m_OwnedCount; i++)
+	{
+		const glm::vec3 s = m_Box.ToFractional(atoms.GetPosition(i));
+
+		// Most atoms sit deeper inside the domain than the halo reaches
+		bool interior = true;
+		for (int a = 0; a < 3; a++)
+			interior &= m_Grid[a] == 1 || (s[a] - m_Low[a] >= m_HaloMargin[a] && m_High[a] - s[a] >= m_HaloMargin[a]);
+		if (interior)
+			continue;
+
+		for (size_t n = 0; n < neighbors; n++)
+		{
+			if (IsInHalo(s, static_cast<uint32_t>(n)))
+				m_SendIndices[n].push_back(i);
+		}
+	}
+
+	for (size_t n = 0; n < neighbors; n++)
+	{
+		std::vector<uint8_t>& buffer = m_SendBuffers[n];
+		buffer.clear();
+		for (uint32_t i : m_SendIndices[n])
+		{
+			Put(buffer, m_GlobalIds[i]);
+			Put(buffer, atoms.TypeId[i]);
+			Put(buffer, atoms.Mass[i]);
+			Put(buffer, atoms.Charge[i]);
+			if (precise)
+				Put(buffer, glm::dvec3(atoms.PrecisePosX[i], atoms.PrecisePosY[i], atoms.PrecisePosZ[i]));
+			else
+				Put(buffer, atoms.GetPosition(i));
+		}
+		m_Transport.Send(m_Neighbors[n], buffer.data(), buffer.size());
+	}
+
+	for (size_t n = 0; n < neighbors; n++)
+	{
+		m_GhostBegin[n] = static_cast<uint32_t>(atoms.Size());
+		if (!m_Transport.Receive(m_Neighbors[n], m_ReceiveBuffer))
+		{
+			PY_CORE_ERROR("Rank {} got no halo from rank {}", m_Transport.GetRank(), m_Neighbors[n]);
+			m_Failed = true;
+			return;
+		}
+
+		Reader reader(m_ReceiveBuffer);
+		while (!reader.IsDone())
+		{
+			const uint32_t id = reader.Get<uint32_t>();
+			const uint32_t type = reader.Get<uint32_t>();
+			const float mass = reader.Get<float>();
+			const float charge = reader.Get<float>();
+			const glm::dvec3 position = precise ? reader.Get<glm::dvec3>() : glm::dvec3(reader.Get<glm::vec3>());
+
+			// Ghosts never move on their own, their owner's positions are copied in
+			const uint32_t i = world.GetAtomIndex(world.CreateAtom(glm::vec3(position), glm::vec3(0.0f), mass, type, charge));
+			atoms.InvMass[i] = 0.0f;
+			if (precise)
+			{
+				atoms.PrecisePosX[i] = position.x; atoms.PrecisePosY[i] = position.y; atoms.PrecisePosZ[i] = position.z;
+			}
+			m_GlobalIds.push_back(id);
+		}
+		m_GhostEnd[n] = static_cast<uint32_t>(atoms.Size());
+	}
+}
+
+void DomainDecomposition::UpdateGhostPositions()
+{
+	if (HasFailed())
+		return;
+
+	AtomStore& atoms = m_World->GetAtoms();
+	const bool precise = atoms.HasPreciseState();
+	const size_t neighbors = m_Neighbors.size();
+
+	for (size_t n = 0; n < neighbors; n++)
+	{
+		const std::vector<uint32_t>& indices = m_SendIndices[n];
+		std::vector<uint8_t>& buffer = m_SendBuffers[n];
+		if (precise)
+		{
+			buffer.resize(indices.size() * 3 * sizeof(double));
+			double* out = reinterpret_cast<double*>(buffer.data());
+			for (uint32_t i : indices)
+			{
+				*out++ = atoms.PrecisePosX[i]; *out++ = atoms.PrecisePosY[i]; *out++ = atoms.PrecisePosZ[i];
+			}
+		}
+		else
+		{
+			buffer.resize(indices.size() * 3 * sizeof(float));
+			float* out = reinterpret_cast<float*>(buffer.data());
+			for (uint32_t i : indices)
+			{
+				*out++ = atoms.PosX[i]; *out++ = atoms.PosY[i]; *out++ = atoms.PosZ[i];
+			}
+		}
+		m_Transport.Send(m_Neighbors[n], buffer.data(), buffer.size());
+	}
+
+	for (size_t n = 0; n < neighbors; n++)
+	{
+		const uint32_t begin = m_GhostBegin[n], end = m_GhostEnd[n];
+		const size_t expected = size_t(end - begin) * 3 * (precise ? sizeof(double) : sizeof(float));
+		if (!m_Transport.Receive(m_Neighbors[n], m_ReceiveBuffer) || m_ReceiveBuffer.size() != expected)
+		{
+			PY_CORE_ERROR("Rank {} got a bad halo update from rank {}", m_Transport.GetRank(), m_Neighbors[n]);
+			m_Failed = true;
+			return;
+		}
+
+		if (precise)
+		{
+			const double* in = reinterpret_cast<const double*>(m_ReceiveBuffer.data());
+			for (uint32_t i = begin; i < end; i++, in += 3)
+			{
+				atoms.PrecisePosX[i] = in[0]; atoms.PrecisePosY[i] = in[1]; atoms.PrecisePosZ[i] = in[2];
+				atoms.PosX[i] = (float)in[0]; atoms.PosY[i] = (float)in[1]; atoms.PosZ[i] = (float)in[2];
+			}
+		}
+		else
+		{
+			const float* in = reinterpret_cast<const float*>(m_ReceiveBuffer.data());
+			for (uint32_t i = begin; i < end; i++, in += 3)
+			{
+				atoms.PosX[i] = in[0]; atoms.PosY[i] = in[1]; atoms.PosZ[i] = in[2];
+			}
+		}
+	}
+}
+
+void DomainDecomposition::OnBoxScaled()
+{
+	if (m_World)
+		m_Box = m_World->GetBox();
+}
+
+template<typename T>
+void DomainDecomposition::ReturnGhostForces(AlignedVector<T>& forceX, AlignedVector<T>& forceY, AlignedVector<T>& forceZ)
+{
+	const size_t neighbors = m_Neighbors.size();
+
+	for (size_t n = 0; n < neighbors; n++)
+	{
+		const uint32_t begin = m_GhostBegin[n], end = m_GhostEnd[n];
+		std::vector<uint8_t>& buffer = m_SendBuffers[n];
+		buffer.resize(size_t(end - begin) * 3 * sizeof(T));
+		T* out = reinterpret_cast<T*>(buffer.data());
+		for (uint32_t i = begin; i < end; i++)
+		{
+			*out++ = forceX[i]; *out++ = forceY[i]; *out++ = forceZ[i];
+		}
+		m_Transport.Send(m_Neighbors[n], buffer.data(), buffer.size());
+	}
+
+	for (size_t n = 0; n < neighbors; n++)
+	{
+		const std::vector<uint32_t>& indices = m_SendIndices[n];
+		if (!m_Transport.Receive(m_Neighbors[n], m_ReceiveBuffer) || m_ReceiveBuffer.size() != indices.size() * 3 * sizeof(T))
+		{
+			PY_CORE_ERROR("Rank {} got bad ghost forces from rank {}", m_Transport.GetRank(), m_Neighbors[n]);
+			m_Failed = true;
+			return;
+		}
+
+		const T* in = reinterpret_cast<const T*>(m_ReceiveBuffer.data());
+		for (uint32_t i : indices)
+		{
+			forceX[i] += in[0]; forceY[i] += in[1]; forceZ[i] += in[2];
+			in += 3;
+		}
+	}
+
+	const size_t count = forceX.size();
+	std::fill(forceX.begin() + m_OwnedCount, forceX.begin() + count, T(0));
+	std::fill(forceY.begin() + m_OwnedCount, forceY.begin() + count, T(0));
+	std::fill(forceZ.begin() + m_OwnedCount, forceZ.begin() + count, T(0));
+}
+
+void DomainDecomposition::ReduceForces(double* groupEnergy, double* groupVirial, uint32_t groupMask)
+{
+	if (HasFailed())
+		return;
+
+	World& world = *m_World;
+	AtomStore& atoms = world.GetAtoms();
+
+	// With precise forces World rounds the float copies after this
+	if (atoms.HasPreciseForces())
+		ReturnGhostForces(atoms.PreciseForceX, atoms.PreciseForceY, atoms.PreciseForceZ);
+	else
+		ReturnGhostForces(atoms.ForceX, atoms.ForceY, atoms.ForceZ);
+	if (HasFailed())
+		return;
+
+	// The positions now are the ones the next step starts from. Repartition
+	// then if an atom is past half the skin already or could get there in one
+	// more step, so no rank ever runs on a list that misses pairs
+	NeighborList& list = world.GetNeighborList();
+	bool rebuild = list.NeedsRebuild(atoms, world.GetBox());
+	if (!rebuild)
+	{
+		float maxSpeed2 = 0.0f;
+		for (uint32_t i = 0; i < m_OwnedCount; i++)
+			maxSpeed2 = std::max(maxSpeed2, atoms.VelX[i] * atoms.VelX[i] + atoms.VelY[i] * atoms.VelY[i] + atoms.VelZ[i] * atoms.VelZ[i]);
+
+		const float stepDisplacement = std::sqrt(maxSpeed2) * static_cast<float>(world.GetIntegrator().GetTimestep());
+		rebuild = list.GetStats().LastMaxDisplacement + stepDisplacement > 0.5f * list.GetSkin();
+	}
+
+	// Energies, virials and the rebuild vote travel in one reduction
+	m_ReduceScratch.clear();
+	for (uint32_t group = 0; group < MaxForceGroups; group++)
+	{
+		if (groupMask & ForceGroupBit(group))
+		{
+			m_ReduceScratch.push_back(groupEnergy[group]);
+			m_ReduceScratch.push_back(groupVirial[group]);
+		}
+	}
+	m_ReduceScratch.push_back(rebuild ? 1.0 : 0.0);
+	m_Transport.AllReduceSum(m_ReduceScratch.data(), static_cast<uint32_t>(m_ReduceScratch.size()));
+
+	size_t slot = 0;
+	for (uint32_t group = 0; group < MaxForceGroups; group++)
+	{
+		if (groupMask & ForceGroupBit(group))
+		{
+			groupEnergy[group] = m_ReduceScratch[slot++];
+			groupVirial[group] = m_ReduceScratch[slot++];
+		}
+	}
+	m_RebuildPending = m_ReduceScratch.back() > 0.0;
+}
+
+template<typename Getter>
+void DomainDecomposition::Gather(std::vector<glm::vec3>& out, uint32_t root, Getter&& get)
+{
+	std::vector<uint8_t> buffer;
+	buffer.reserve(m_OwnedCount * (sizeof(uint32_t) + sizeof(glm::vec3)));
+	for (uint32_t i = 0; i < m_OwnedCount; i++)
+	{
+		Put(buffer, m_GlobalIds[i]);
+		Put(buffer, get(i));
+	}
+
+	out.clear();
+	if (HasFailed())
+		return;
+	if (m_Transport.GetRank() != root)
+	{
+		m_Transport.Send(root, buffer.data(), buffer.size());
+		return;
+	}
+
+	out.assign(m_GlobalAtomCount, glm::vec3(0.0f));
+	auto unpack = [&out](const std::vector<uint8_t>& data)
+	{
+		Reader reader(data);
+		while (!reader.IsDone())
+		{
+			const uint32_t id = reader.Get<uint32_t>();
+			const glm::vec3 value = reader.Get<glm::vec3>();
+			if (id < out.size())
+				out[id] = value;
+		}
+	};
+
+	unpack(buffer);
+	for (uint32_t rank = 0; rank < m_Transport.GetRankCount(); rank++)
+	{
+		if (rank == root)
+			continue;
+		if (!m_Transport.Receive(rank, buffer))
+		{
+			PY_CORE_ERROR("Rank {} got no atoms to gather from rank {}", root, rank);
+			m_Failed = true;
+			return;
+		}
+		unpack(buffer);
+	}
+}
+
+void DomainDecomposition::GatherPositions(std::vector<glm::vec3>& out, uint32_t root)
+{
+	const AtomStore& atoms = m_World->GetAtoms();
+	Gather(out, root, [&](uint32_t i) { return atoms.GetPosition(i); });
+}
+
+void DomainDecomposition::GatherUnwrappedPositions(std::vector<glm::vec3>& out, uint32_t root)
+{
+	const AtomStore& atoms = m_World->GetAtoms();
+	const SimulationBox& box = m_World->GetBox();
+	Gather(out, root, [&](uint32_t i) { return atoms.GetUnwrappedPosition(i, box); });
+}
+
+void DomainDecomposition::GatherVelocities(std::vector<glm::vec3>& out, uint32_t root)
+{
+	const AtomStore& atoms = m_World->GetAtoms();
+	Gather(out, root, [&](uint32_t i) { return atoms.GetVelocity(i); });
+}
+
+void DomainDecomposition::GatherForces(std::vector<glm::vec3>& out, uint32_t root)
+{
+	const AtomStore& atoms = m_World->GetAtoms();
+	Gather(out, root, [&](uint32_t i) { return atoms.GetForce(i); });
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "../aligned_allocator.h"
+#include "../simulation_box.h"
+#include "transport.h"
+
+class World;
+
+
+struct DomainProps
+{
+	// Domains along the box vectors A, B and C. Zero picks the grid with the
+	// smallest halo surface for the rank count
+	glm::uvec3 Grid;
+
+	DomainProps(const glm::uvec3& grid = glm::uvec3(0))
+		: Grid(grid) {
+	}
+};
+
+struct DomainStats
+{
+	uint64_t Repartitions = 0;
+	uint64_t MigratedAtoms = 0;
+	uint32_t OwnedAtoms = 0;
+	uint32_t GhostAtoms = 0;
+};
+
+// Splits a World over ranks by a grid of domains in fractional coordinates,
+// so slabs of a triclinic cell work the same as boxes. Each rank's World keeps
+// the atoms it owns at dense indices [0, owned) and ghost copies of the other
+// ranks' atoms within the list radius of its domain after them. Ghosts carry
+// no velocity and zero inverse mass, so integrators move only owned atoms.
+//
+// Every force evaluation sends owned positions out to the ghost copies first
+// and ghost forces back to their owners afterwards. Whenever the neighbor list
+// of any rank is due for a rebuild, all ranks repartition together at the
+// start of the next step: atoms that left their domain migrate with their
+// full state, the halo is exchanged anew and the list is rebuilt right away.
+//
+// Only the pair forces of the shared neighbor list are decomposed. Bonded
+// terms, constraints and PME would need their atoms on one rank and are not
+// supported yet; Attach fails while the world has any of them.
+class DomainDecomposition
+{
+public:
+	DomainDecomposition(Transport& transport, const DomainProps& props = DomainProps());
+	~DomainDecomposition();
+
+	// Every rank passes the same full system. Each keeps the atoms in its own
+	// domain, numbered by their index in the full system. Detach, or destroy
+	// the decomposition, before the world goes away
+	bool Attach(World& world);
+	// Leaves the owned atoms in the world and drops the ghosts
+	void Detach();
+	bool IsAttached() const { return m_World != nullptr; }
+
+	// Called by World: repartitions at the start of a step if a list rebuild
+	// is due. False once the decomposition has failed
+	bool Update();
+	void UpdateGhostPositions();
+	// Returns ghost forces to their owners and sums the energies and virials of the groups in groupMask over all ranks
+	void ReduceForces(double* groupEnergy, double* groupVirial, uint32_t groupMask);
+	// Called by World after a barostat scaled the box. Domains are fractional,
+	// so they keep their atoms and nothing has to move
+	void OnBoxScaled();
+
+	uint32_t GetOwnedCount() const { return m_OwnedCount; }
+	uint32_t GetGhostCount() const { return static_cast<uint32_t>(m_GlobalIds.size()) - m_OwnedCount; }
+	uint64_t GetGlobalAtomCount() const { return m_GlobalAtomCount; }
+	// Index of local atom i in the full system
+	uint32_t GetGlobalId(uint32_t index) const { return m_GlobalIds[index]; }
+
+	const glm::uvec3& GetGrid() const { return m_Grid; }
+	const glm::uvec3& GetDomainCoords() const { return m_Coords; }
+	Transport& GetTransport() { return m_Transport; }
+	const DomainStats& GetStats() const { return m_Stats; }
+
+	// Set once an exchange came back missing or malformed, or the transport
+	// lost a peer. The ranks no longer hold one consistent system, every
+	// exchange returns at once from then on and World::Step fails
+	bool HasFailed() const { return m_Failed || m_Transport.HasFailed(); }
+
+	// Positions, unwrapped positions, velocities or forces of every atom in
+	// global id order, on rank root only. Collective, every rank must call it
+	void GatherPositions(std::vector<glm::vec3>& out, uint32_t root = 0);
+	void GatherUnwrappedPositions(std::vector<glm::vec3>& out, uint32_t root = 0);
+	void GatherVelocities(std::vector<glm::vec3>& out, uint32_t root = 0);
+	void GatherForces(std::vector<glm::vec3>& out, uint32_t root = 0);
+
+private:
+	bool ChooseGrid();
+	void UpdateHaloWidth();
+	uint32_t GetDomainRank(const glm::ivec3& coords) const;
+	uint32_t GetOwningRank(const glm::vec3& fractional) const;
+	bool IsInHalo(const glm::vec3& fractional, uint32_t neighbor) const;
+
+	void Repartition();
+	void RemoveGhosts();
+	void MigrateAtoms();
+	void ExchangeHalo();
+	// Sends the ghosts' forces to their owners and clears them, T is float or
+	// double for precise forces
+	template<typename T>
+	void ReturnGhostForces(AlignedVector<T>& forceX, AlignedVector<T>& forceY, AlignedVector<T>& forceZ);
+
+	template<typename Getter>
+	void Gather(std::vector<glm::vec3>& out, uint32_t root, Getter&& get);
+
+private:
+	Transport& m_Transport;
+	DomainProps m_Props;
+	World* m_World = nullptr;
+
+	glm::uvec3 m_Grid = glm::uvec3(1);
+	glm::uvec3 m_Coords = glm::uvec3(0);
+	// Halo width as a fraction of each box vector, plus the rank's own bounds
+	glm::vec3 m_HaloMargin = glm::vec3(0.0f);
+	glm::vec3 m_Low = glm::vec3(0.0f), m_High = glm::vec3(1.0f);
+	float m_HaloWidth = 0.0f;
+
+	// Ranks whose domains touch this one, including across periodic boundaries,
+	// with their fractional bounds. Exchanges always go to all of them in this order
+	std::vector<uint32_t> m_Neighbors;
+	std::vector<glm::vec3> m_NeighborLow, m_NeighborHigh;
+
+	uint32_t m_OwnedCount = 0;
+	uint64_t m_GlobalAtomCount = 0;
+	std::vector<uint32_t> m_GlobalIds;
+	// Per neighbor: owned atoms sent as its ghosts, and the local range its ghosts landed in
+	std::vector<std::vector<uint32_t>> m_SendIndices;
+	std::vector<uint32_t> m_GhostBegin, m_GhostEnd;
+
+	// Box and list cutoff the halo was last built for
+	SimulationBox m_Box;
+	float m_ListCutoff = 0.0f;
+	bool m_RebuildPending = false;
+	uint64_t m_LastReorderStep = 0;
+	bool m_Failed = false;
+
+	std::vector<std::vector<uint8_t>> m_SendBuffers;
+	std::vector<uint8_t> m_ReceiveBuffer;
+	std::vector<double> m_ReduceScratch;
+
+	DomainStats m_Stats;
+};
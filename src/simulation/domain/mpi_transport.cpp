@@ -0,0 +1,110 @@
+#include "mpi_transport.h"
+
+#if PY_WITH_MPI
+
+#include <climits>
+
+#include "../../logging/log.h"
+
+
+namespace
+{
+	constexpr int MessageTag = 0x5059;
+}
+
+MpiTransport::MpiTransport(uint32_t rank, uint32_t rankCount, bool ownsMpi)
+	: Transport(rank, rankCount), m_OwnsMpi(ownsMpi)
+{
+}
+
+MpiTransport::~MpiTransport()
+{
+	for (PendingSend& send : m_Pending)
+		MPI_Wait(&send.Request, MPI_STATUS_IGNORE);
+	m_Pending.clear();
+
+	if (m_OwnsMpi)
+		MPI_Finalize();
+}
+
+std::unique_ptr<Transport> MpiTransport::Connect(const TransportProps&)
+{
+	int initialized = 0;
+	MPI_Initialized(&initialized);
+	if (!initialized && MPI_Init(nullptr, nullptr) != MPI_SUCCESS)
+	{
+		PY_CORE_ERROR("MPI_Init failed");
+		return nullptr;
+	}
+
+	int rank = 0, size = 1;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &size);
+	return std::unique_ptr<Transport>(new MpiTransport(static_cast<uint32_t>(rank), static_cast<uint32_t>(size), !initialized));
+}
+
+void MpiTransport::ReleaseCompleted()
+{
+	for (auto it = m_Pending.begin(); it != m_Pending.end();)
+	{
+		int done = 0;
+		MPI_Test(&it->Request, &done, MPI_STATUS_IGNORE);
+		it = done ? m_Pending.erase(it) : std::next(it);
+	}
+}
+
+void MpiTransport::Send(uint32_t rank, const void* data, size_t size)
+{
+	if (size > INT_MAX)
+	{
+		PY_CORE_ERROR("Message of {} bytes is too large for a single MPI send", size);
+		m_Failed = true;
+		return;
+	}
+
+	ReleaseCompleted();
+
+	PendingSend& send = m_Pending.emplace_back();
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	send.Data.assign(bytes, bytes + size);
+	MPI_Isend(send.Data.data(), static_cast<int>(size), MPI_BYTE, static_cast<int>(rank), MessageTag, MPI_COMM_WORLD, &send.Request);
+}
+
+bool MpiTransport::Receive(uint32_t rank, std::vector<uint8_t>& data)
+{
+	MPI_Status status;
+	if (MPI_Probe(static_cast<int>(rank), MessageTag, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+	{
+		m_Failed = true;
+		return false;
+	}
+
+	int size = 0;
+	MPI_Get_count(&status, MPI_BYTE, &size);
+	data.resize(static_cast<size_t>(size));
+	bool ok = MPI_Recv(data.data(), size, MPI_BYTE, static_cast<int>(rank), MessageTag, MPI_COMM_WORLD, MPI_STATUS_IGNORE) == MPI_SUCCESS;
+
+	ReleaseCompleted();
+	m_Failed |= !ok;
+	return ok;
+}
+
+void MpiTransport::AllReduceSum(double* values, uint32_t count)
+{
+	if (!m_Failed && MPI_Allreduce(MPI_IN_PLACE, values, static_cast<int>(count), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD) != MPI_SUCCESS)
+		m_Failed = true;
+}
+
+void MpiTransport::AllReduceMax(double* values, uint32_t count)
+{
+	if (!m_Failed && MPI_Allreduce(MPI_IN_PLACE, values, static_cast<int>(count), MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD) != MPI_SUCCESS)
+		m_Failed = true;
+}
+
+void MpiTransport::Barrier()
+{
+	if (!m_Failed && MPI_Barrier(MPI_COMM_WORLD) != MPI_SUCCESS)
+		m_Failed = true;
+}
+
+#endif
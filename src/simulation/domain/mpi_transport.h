@@ -0,0 +1,48 @@
+#pragma once
+
+#if PY_WITH_MPI
+
+#include <list>
+#include <memory>
+#include <mpi.h>
+
+#include "transport.h"
+
+
+// Thin layer over MPI_COMM_WORLD for runs spanning several machines. Rank and
+// rank count come from MPI, not from the props. Sends are MPI_Isend on a
+// private copy, released once MPI reports them complete, and the collectives
+// map onto MPI's own.
+class MpiTransport : public Transport
+{
+public:
+	~MpiTransport();
+
+	static std::unique_ptr<Transport> Connect(const TransportProps& props);
+
+	virtual const char* GetName() const override { return "MPI"; }
+
+	virtual void Send(uint32_t rank, const void* data, size_t size) override;
+	virtual bool Receive(uint32_t rank, std::vector<uint8_t>& data) override;
+
+	virtual void AllReduceSum(double* values, uint32_t count) override;
+	virtual void AllReduceMax(double* values, uint32_t count) override;
+	virtual void Barrier() override;
+
+private:
+	MpiTransport(uint32_t rank, uint32_t rankCount, bool ownsMpi);
+
+	// Frees the buffers of sends MPI is done with
+	void ReleaseCompleted();
+
+private:
+	struct PendingSend
+	{
+		std::vector<uint8_t> Data;
+		MPI_Request Request;
+	};
+	std::list<PendingSend> m_Pending;
+	bool m_OwnsMpi;
+};
+
+#endif
@@ -0,0 +1,406 @@
+#include "shared_memory_transport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#if defined(_WIN32)
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <cerrno>
+	#include <csignal>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/wait.h>
+	#include <unistd.h>
+#endif
+
+#include "../../logging/log.h"
+
+
+namespace
+{
+	constexpr uint32_t SegmentReady = 0x50594d53; // "PYMS"
+	constexpr auto ConnectTimeout = std::chrono::seconds(30);
+	// Marks a rank slot whose process shut down normally
+	constexpr uint64_t RankLeft = ~0ull;
+	// Receives look at whether the peer still exists this often while waiting
+	constexpr auto LivenessInterval = std::chrono::milliseconds(50);
+
+	uint64_t GetProcessId()
+	{
+#if defined(_WIN32)
+		return GetCurrentProcessId();
+#else
+		return static_cast<uint64_t>(getpid());
+#endif
+	}
+
+	bool IsProcessAlive(uint64_t id)
+	{
+#if defined(_WIN32)
+		HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(id));
+		if (!process)
+			return false;
+		const bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+		CloseHandle(process);
+		return alive;
+#else
+		const pid_t pid = static_cast<pid_t>(id);
+		if (kill(pid, 0) != 0 && errno == ESRCH)
+			return false;
+		// Ranks forked by this process stay around as zombies until they are
+		// reaped, peek at whether they exited without reaping them
+		siginfo_t info = {};
+		if (waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == pid)
+			return false;
+		return true;
+#endif
+	}
+
+	// Busy-waits a little before giving the core away, ranks are often
+	// oversubscribed with their own worker threads
+	void Backoff(uint32_t& spins)
+	{
+		if (++spins < 64)
+			return;
+		std::this_thread::yield();
+	}
+}
+
+// The segment starts with this header, then one RankSlot per rank, then one
+// RingHeader per ordered rank pair, then the ring buffers themselves
+struct alignas(64) SharedMemoryTransport::SegmentHeader
+{
+	std::atomic<uint32_t> Ready;
+	std::atomic<uint32_t> Attached;
+	uint32_t RankCount;
+	uint64_t RingCapacity;
+};
+
+// Process id of the rank once it has attached, RankLeft after it shut down
+struct alignas(64) SharedMemoryTransport::RankSlot
+{
+	std::atomic<uint64_t> ProcessId;
+};
+
+// Total bytes ever written and read, the producer only moves Head and the
+// consumer only Tail. Kept on separate cache lines
+struct SharedMemoryTransport::RingHeader
+{
+	alignas(64) std::atomic<uint64_t> Head;
+	alignas(64) std::atomic<uint64_t> Tail;
+};
+
+SharedMemoryTransport::SharedMemoryTransport(uint32_t rank, uint32_t rankCount)
+	: Transport(rank, rankCount), m_Peers(rankCount)
+{
+}
+
+SharedMemoryTransport::~SharedMemoryTransport()
+{
+	// Give peers a moment to take the last queued messages
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	auto pending = [this]()
+	{
+		for (const PeerStream& peer : m_Peers)
+		{
+			if (peer.GetPendingBytes())
+				return true;
+		}
+		return false;
+	};
+	uint32_t spins = 0;
+	while (m_Segment && pending() && std::chrono::steady_clock::now() < deadline)
+	{
+		if (!Progress())
+			Backoff(spins);
+	}
+	if (m_Segment && pending())
+		PY_CORE_WARN("Rank {} dropped undelivered messages on shutdown", m_Rank);
+	// Peers still waiting on this rank stop once they have drained its ring
+	if (m_Segment)
+		GetRankSlot(m_Rank).ProcessId.store(RankLeft, std::memory_order_release);
+
+#if defined(_WIN32)
+	if (m_Segment)
+		UnmapViewOfFile(m_Segment);
+	if (m_Mapping)
+		CloseHandle(m_Mapping);
+#else
+	if (m_Segment)
+		munmap(m_Segment, m_SegmentSize);
+#endif
+}
+
+std::unique_ptr<Transport> SharedMemoryTransport::Connect(const TransportProps& props)
+{
+	std::unique_ptr<SharedMemoryTransport> transport(new SharedMemoryTransport(props.Rank, props.RankCount));
+	if (!transport->Map(props))
+		return nullptr;
+	return transport;
+}
+
+bool SharedMemoryTransport::Map(const TransportProps& props)
+{
+	const uint64_t pairs = uint64_t(m_RankCount) * m_RankCount;
+	m_SegmentSize = sizeof(SegmentHeader) + m_RankCount * sizeof(RankSlot) + pairs * (sizeof(RingHeader) + RingCapacity);
+	const bool creator = m_Rank == 0;
+	const auto deadline = std::chrono::steady_clock::now() + ConnectTimeout;
+
+#if defined(_WIN32)
+	const std::string name = "Local\\" + props.Name;
+	if (creator)
+	{
+		m_Mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+			static_cast<DWORD>(m_SegmentSize >> 32), static_cast<DWORD>(m_SegmentSize), name.c_str());
+	}
+	else
+	{
+		while (!(m_Mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str())) && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	if (!m_Mapping)
+	{
+		PY_CORE_ERROR("Rank {} could not open shared memory segment {}", m_Rank, name);
+		return false;
+	}
+	m_Segment = static_cast<uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_ALL_ACCESS, 0, 0, m_SegmentSize));
+	if (!m_Segment)
+	{
+		PY_CORE_ERROR("Rank {} could not map shared memory segment {}", m_Rank, name);
+		return false;
+	}
+#else
+	const std::string name = "/" + props.Name;
+	int fd = -1;
+	if (creator)
+	{
+		shm_unlink(name.c_str());
+		fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd >= 0 && ftruncate(fd, static_cast<off_t>(m_SegmentSize)) != 0)
+		{
+			close(fd);
+			shm_unlink(name.c_str());
+			fd = -1;
+		}
+	}
+	else
+	{
+		// Rank 0 may not have created or sized the segment yet
+		while (std::chrono::steady_clock::now() < deadline)
+		{
+			fd = shm_open(name.c_str(), O_RDWR, 0600);
+			struct stat info;
+			if (fd >= 0 && fstat(fd, &info) == 0 && static_cast<uint64_t>(info.st_size) >= m_SegmentSize)
+				break;
+			if (fd >= 0)
+				close(fd);
+			fd = -1;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	if (fd < 0)
+	{
+		PY_CORE_ERROR("Rank {} could not open shared memory segment {}", m_Rank, name);
+		return false;
+	}
+
+	void* mapped = mmap(nullptr, m_SegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+	{
+		PY_CORE_ERROR("Rank {} could not map shared memory segment {}", m_Rank, name);
+		return false;
+	}
+	m_Segment = static_cast<uint8_t*>(mapped);
+#endif
+
+	// Fresh segments are zero filled, which is a valid state for every counter
+	SegmentHeader& header = *reinterpret_cast<SegmentHeader*>(m_Segment);
+	if (creator)
+	{
+		header.RankCount = m_RankCount;
+		header.RingCapacity = RingCapacity;
+		header.Ready.store(SegmentReady, std::memory_order_release);
+	}
+	else
+	{
+		while (header.Ready.load(std::memory_order_acquire) != SegmentReady)
+		{
+			if (std::chrono::steady_clock::now() >= deadline)
+			{
+				PY_CORE_ERROR("Rank {} timed out waiting for rank 0 to set up the shared memory segment", m_Rank);
+				return false;
+			}
+			std::this_thread::yield();
+		}
+		if (header.RankCount != m_RankCount || header.RingCapacity != RingCapacity)
+		{
+			PY_CORE_ERROR("Rank {} joined a shared memory segment made for {} ranks, expected {}", m_Rank, header.RankCount, m_RankCount);
+			return false;
+		}
+	}
+
+	GetRankSlot(m_Rank).ProcessId.store(GetProcessId(), std::memory_order_release);
+	header.Attached.fetch_add(1, std::memory_order_acq_rel);
+	if (creator)
+	{
+		while (header.Attached.load(std::memory_order_acquire) < m_RankCount)
+		{
+			if (std::chrono::steady_clock::now() >= deadline)
+			{
+				PY_CORE_ERROR("Only {} of {} ranks attached to the shared memory segment", header.Attached.load(), m_RankCount);
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+#if !defined(_WIN32)
+		shm_unlink(name.c_str());
+#endif
+		if (header.Attached.load(std::memory_order_acquire) < m_RankCount)
+			return false;
+	}
+	return true;
+}
+
+SharedMemoryTransport::RankSlot& SharedMemoryTransport::GetRankSlot(uint32_t rank) const
+{
+	RankSlot* slots = reinterpret_cast<RankSlot*>(m_Segment + sizeof(SegmentHeader));
+	return slots[rank];
+}
+
+SharedMemoryTransport::RingHeader& SharedMemoryTransport::GetRing(uint32_t from, uint32_t to) const
+{
+	RingHeader* rings = reinterpret_cast<RingHeader*>(m_Segment + sizeof(SegmentHeader) + m_RankCount * sizeof(RankSlot));
+	return rings[size_t(from) * m_RankCount + to];
+}
+
+uint8_t* SharedMemoryTransport::GetRingData(uint32_t from, uint32_t to) const
+{
+	const uint64_t pairs = uint64_t(m_RankCount) * m_RankCount;
+	uint8_t* data = m_Segment + sizeof(SegmentHeader) + m_RankCount * sizeof(RankSlot) + pairs * sizeof(RingHeader);
+	return data + (size_t(from) * m_RankCount + to) * RingCapacity;
+}
+
+bool SharedMemoryTransport::Flush(uint32_t rank)
+{
+	PeerStream& peer = m_Peers[rank];
+	const size_t pending = peer.GetPendingBytes();
+	if (!pending)
+		return false;
+
+	RingHeader& ring = GetRing(m_Rank, rank);
+	const uint64_t head = ring.Head.load(std::memory_order_relaxed);
+	const uint64_t tail = ring.Tail.load(std::memory_order_acquire);
+	const size_t bytes = std::min<size_t>(pending, RingCapacity - (head - tail));
+	if (!bytes)
+		return false;
+
+	uint8_t* data = GetRingData(m_Rank, rank);
+	const uint8_t* source = peer.Outgoing.data() + peer.OutgoingOffset;
+	const size_t at = head % RingCapacity;
+	const size_t first = std::min<size_t>(bytes, RingCapacity - at);
+	std::memcpy(data + at, source, first);
+	std::memcpy(data, source + first, bytes - first);
+
+	ring.Head.store(head + bytes, std::memory_order_release);
+	peer.Consume(bytes);
+	return true;
+}
+
+bool SharedMemoryTransport::Drain(uint32_t rank)
+{
+	RingHeader& ring = GetRing(rank, m_Rank);
+	const uint64_t tail = ring.Tail.load(std::memory_order_relaxed);
+	const uint64_t head = ring.Head.load(std::memory_order_acquire);
+	const size_t bytes = static_cast<size_t>(head - tail);
+	if (!bytes)
+		return false;
+
+	PeerStream& peer = m_Peers[rank];
+	const uint8_t* data = GetRingData(rank, m_Rank);
+	const size_t at = tail % RingCapacity;
+	const size_t first = std::min<size_t>(bytes, RingCapacity - at);
+	peer.Incoming.insert(peer.Incoming.end(), data + at, data + at + first);
+	peer.Incoming.insert(peer.Incoming.end(), data, data + (bytes - first));
+
+	ring.Tail.store(tail + bytes, std::memory_order_release);
+	return true;
+}
+
+bool SharedMemoryTransport::IsPeerAlive(uint32_t rank) const
+{
+	const uint64_t id = GetRankSlot(rank).ProcessId.load(std::memory_order_acquire);
+	if (id == RankLeft)
+		return false;
+	// Not attached yet, Map gives up on ranks that never do
+	if (id == 0)
+		return true;
+	return IsProcessAlive(id);
+}
+
+bool SharedMemoryTransport::Progress()
+{
+	bool moved = false;
+	for (uint32_t rank = 0; rank < m_RankCount; rank++)
+	{
+		if (rank == m_Rank)
+			continue;
+		moved |= Flush(rank);
+		moved |= Drain(rank);
+	}
+	return moved;
+}
+
+void SharedMemoryTransport::Send(uint32_t rank, const void* data, size_t size)
+{
+	PeerStream& peer = m_Peers[rank];
+	peer.QueueFrame(data, size);
+
+	if (rank == m_Rank)
+	{
+		peer.Incoming.insert(peer.Incoming.end(), peer.Outgoing.begin() + peer.OutgoingOffset, peer.Outgoing.end());
+		peer.Consume(peer.GetPendingBytes());
+		return;
+	}
+	Flush(rank);
+}
+
+bool SharedMemoryTransport::Receive(uint32_t rank, std::vector<uint8_t>& data)
+{
+	PeerStream& peer = m_Peers[rank];
+	uint32_t spins = 0;
+	auto nextCheck = std::chrono::steady_clock::now() + LivenessInterval;
+	while (!peer.PopFrame(data))
+	{
+		if (peer.Closed)
+			return false;
+		if (Progress())
+		{
+			spins = 0;
+			continue;
+		}
+		Backoff(spins);
+
+		if (rank == m_Rank || std::chrono::steady_clock::now() < nextCheck)
+			continue;
+		nextCheck = std::chrono::steady_clock::now() + LivenessInterval;
+		if (IsPeerAlive(rank))
+			continue;
+
+		// Whatever it sent before going away is still in the ring
+		Drain(rank);
+		if (peer.PopFrame(data))
+			return true;
+		PY_CORE_ERROR("Rank {} is gone, rank {} stops waiting for its messages", rank, m_Rank);
+		peer.Closed = true;
+		m_Failed = true;
+		return false;
+	}
+	return true;
+}
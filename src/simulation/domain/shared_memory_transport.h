@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+
+#include "transport.h"
+
+
+// Ranks on one machine talking through a single shared memory segment. Every
+// ordered pair of ranks has its own single-producer single-consumer byte ring,
+// so sends and receives only touch two atomic counters and copy the payload.
+// Rank 0 creates the segment and unlinks its name once everyone has mapped
+// it, nothing is left behind if a rank dies. Every rank also records its
+// process id there, so a receive waiting on a peer that exited or crashed
+// gives up instead of spinning forever.
+class SharedMemoryTransport : public Transport
+{
+public:
+	~SharedMemoryTransport();
+
+	static std::unique_ptr<Transport> Connect(const TransportProps& props);
+
+	virtual const char* GetName() const override { return "shared memory"; }
+
+	virtual void Send(uint32_t rank, const void* data, size_t size) override;
+	virtual bool Receive(uint32_t rank, std::vector<uint8_t>& data) override;
+
+	// Capacity of each ring, messages larger than this stream through in parts
+	static constexpr uint64_t RingCapacity = 1ull << 20;
+
+private:
+	SharedMemoryTransport(uint32_t rank, uint32_t rankCount);
+
+	struct SegmentHeader;
+	struct RankSlot;
+	struct RingHeader;
+
+	bool Map(const TransportProps& props);
+	RankSlot& GetRankSlot(uint32_t rank) const;
+	RingHeader& GetRing(uint32_t from, uint32_t to) const;
+	uint8_t* GetRingData(uint32_t from, uint32_t to) const;
+
+	// Moves queued bytes into the outgoing rings and incoming rings into the
+	// peer streams, true if anything moved
+	bool Progress();
+	bool Flush(uint32_t rank);
+	bool Drain(uint32_t rank);
+	// False once the rank's process has shut down or died
+	bool IsPeerAlive(uint32_t rank) const;
+
+private:
+	uint8_t* m_Segment = nullptr;
+	size_t m_SegmentSize = 0;
+	std::vector<PeerStream> m_Peers;
+
+#if defined(_WIN32)
+	void* m_Mapping = nullptr;
+#endif
+};
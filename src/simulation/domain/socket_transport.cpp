@@ -0,0 +1,320 @@
+#include "socket_transport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#if defined(_WIN32)
+	#define NOMINMAX
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+#else
+	#include <arpa/inet.h>
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <poll.h>
+	#include <sys/socket.h>
+	#include <unistd.h>
+#endif
+
+#include "../../logging/log.h"
+
+
+namespace
+{
+	constexpr auto ConnectTimeout = std::chrono::seconds(30);
+
+#if defined(_WIN32)
+	using NativeSocket = SOCKET;
+	constexpr intptr_t NoSocket = static_cast<intptr_t>(INVALID_SOCKET);
+
+	void CloseSocket(intptr_t s) { closesocket(static_cast<SOCKET>(s)); }
+	bool WouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+	int PollSockets(pollfd* fds, size_t count, int timeoutMs) { return WSAPoll(fds, static_cast<ULONG>(count), timeoutMs); }
+	void SetNonBlocking(intptr_t s) { u_long on = 1; ioctlsocket(static_cast<SOCKET>(s), FIONBIO, &on); }
+	constexpr int SendFlags = 0;
+
+	struct WinsockInit
+	{
+		WinsockInit() { WSADATA data; WSAStartup(MAKEWORD(2, 2), &data); }
+		~WinsockInit() { WSACleanup(); }
+	};
+#else
+	using NativeSocket = int;
+	constexpr intptr_t NoSocket = -1;
+
+	void CloseSocket(intptr_t s) { close(static_cast<int>(s)); }
+	bool WouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR; }
+	int PollSockets(pollfd* fds, size_t count, int timeoutMs) { return poll(fds, count, timeoutMs); }
+	void SetNonBlocking(intptr_t s) { fcntl(static_cast<int>(s), F_SETFL, fcntl(static_cast<int>(s), F_GETFL) | O_NONBLOCK); }
+	#if defined(MSG_NOSIGNAL)
+	constexpr int SendFlags = MSG_NOSIGNAL;
+	#else
+	constexpr int SendFlags = 0;
+	#endif
+#endif
+
+	sockaddr_in LoopbackAddress(uint16_t port)
+	{
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		return address;
+	}
+
+	// Blocking exact-size transfers for the handshake, before the sockets go non-blocking
+	bool SendAll(intptr_t s, const void* data, size_t size)
+	{
+		const char* bytes = static_cast<const char*>(data);
+		while (size)
+		{
+			auto sent = send(static_cast<NativeSocket>(s), bytes, static_cast<int>(size), SendFlags);
+			if (sent <= 0)
+				return false;
+			bytes += sent;
+			size -= static_cast<size_t>(sent);
+		}
+		return true;
+	}
+
+	bool ReceiveAll(intptr_t s, void* data, size_t size)
+	{
+		char* bytes = static_cast<char*>(data);
+		while (size)
+		{
+			auto received = recv(static_cast<NativeSocket>(s), bytes, static_cast<int>(size), 0);
+			if (received <= 0)
+				return false;
+			bytes += received;
+			size -= static_cast<size_t>(received);
+		}
+		return true;
+	}
+}
+
+SocketTransport::SocketTransport(uint32_t rank, uint32_t rankCount)
+	: Transport(rank, rankCount), m_Sockets(rankCount, NoSocket), m_Peers(rankCount), m_ReadScratch(1 << 16)
+{
+}
+
+SocketTransport::~SocketTransport()
+{
+	// Give peers a moment to take the last queued messages
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	auto pending = [this]()
+	{
+		for (uint32_t rank = 0; rank < m_RankCount; rank++)
+		{
+			if (m_Sockets[rank] != NoSocket && !m_Peers[rank].Closed && m_Peers[rank].GetPendingBytes())
+				return true;
+		}
+		return false;
+	};
+	while (pending() && std::chrono::steady_clock::now() < deadline)
+		Progress(10);
+
+	for (intptr_t s : m_Sockets)
+	{
+		if (s != NoSocket)
+			CloseSocket(s);
+	}
+}
+
+std::unique_ptr<Transport> SocketTransport::Connect(const TransportProps& props)
+{
+#if defined(_WIN32)
+	static WinsockInit winsock;
+#endif
+
+	std::unique_ptr<SocketTransport> transport(new SocketTransport(props.Rank, props.RankCount));
+	if (!transport->Open(props))
+		return nullptr;
+	return transport;
+}
+
+bool SocketTransport::Open(const TransportProps& props)
+{
+	const auto deadline = std::chrono::steady_clock::now() + ConnectTimeout;
+
+	// Everyone listens, connects to the ranks below and accepts the ones above
+	intptr_t listener = static_cast<intptr_t>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (listener == NoSocket)
+	{
+		PY_CORE_ERROR("Rank {} could not create a socket", m_Rank);
+		return false;
+	}
+
+	int on = 1;
+	setsockopt(static_cast<NativeSocket>(listener), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+	sockaddr_in address = LoopbackAddress(static_cast<uint16_t>(props.BasePort + m_Rank));
+	if (bind(static_cast<NativeSocket>(listener), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+		listen(static_cast<NativeSocket>(listener), static_cast<int>(m_RankCount)) != 0)
+	{
+		PY_CORE_ERROR("Rank {} could not listen on port {}", m_Rank, props.BasePort + m_Rank);
+		CloseSocket(listener);
+		return false;
+	}
+
+	for (uint32_t rank = 0; rank < m_Rank; rank++)
+	{
+		sockaddr_in peer = LoopbackAddress(static_cast<uint16_t>(props.BasePort + rank));
+		while (true)
+		{
+			intptr_t s = static_cast<intptr_t>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+			if (s != NoSocket && connect(static_cast<NativeSocket>(s), reinterpret_cast<const sockaddr*>(&peer), sizeof(peer)) == 0)
+			{
+				m_Sockets[rank] = s;
+				break;
+			}
+			if (s != NoSocket)
+				CloseSocket(s);
+			if (std::chrono::steady_clock::now() >= deadline)
+			{
+				PY_CORE_ERROR("Rank {} could not connect to rank {} on port {}", m_Rank, rank, props.BasePort + rank);
+				CloseSocket(listener);
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+
+		if (!SendAll(m_Sockets[rank], &m_Rank, sizeof(m_Rank)))
+		{
+			PY_CORE_ERROR("Rank {} lost rank {} during the handshake", m_Rank, rank);
+			CloseSocket(listener);
+			return false;
+		}
+	}
+
+	for (uint32_t accepted = m_Rank + 1; accepted < m_RankCount; accepted++)
+	{
+		intptr_t s = static_cast<intptr_t>(accept(static_cast<NativeSocket>(listener), nullptr, nullptr));
+		uint32_t rank = 0;
+		if (s == NoSocket || !ReceiveAll(s, &rank, sizeof(rank)) || rank <= m_Rank || rank >= m_RankCount || m_Sockets[rank] != NoSocket)
+		{
+			PY_CORE_ERROR("Rank {} got a bad connection while waiting for its peers", m_Rank);
+			if (s != NoSocket)
+				CloseSocket(s);
+			CloseSocket(listener);
+			return false;
+		}
+		m_Sockets[rank] = s;
+	}
+	CloseSocket(listener);
+
+	for (intptr_t s : m_Sockets)
+	{
+		if (s == NoSocket)
+			continue;
+		setsockopt(static_cast<NativeSocket>(s), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+		SetNonBlocking(s);
+	}
+	return true;
+}
+
+bool SocketTransport::Flush(uint32_t rank)
+{
+	PeerStream& peer = m_Peers[rank];
+	bool moved = false;
+	while (peer.GetPendingBytes() && !peer.Closed)
+	{
+		const size_t chunk = std::min<size_t>(peer.GetPendingBytes(), 1 << 30);
+		auto sent = send(static_cast<NativeSocket>(m_Sockets[rank]), reinterpret_cast<const char*>(peer.Outgoing.data() + peer.OutgoingOffset), static_cast<int>(chunk), SendFlags);
+		if (sent > 0)
+		{
+			peer.Consume(static_cast<size_t>(sent));
+			moved = true;
+			continue;
+		}
+		if (sent < 0 && WouldBlock())
+			break;
+
+		PY_CORE_ERROR("Rank {} lost its connection to rank {}", m_Rank, rank);
+		peer.Closed = true;
+		m_Failed = true;
+	}
+	return moved;
+}
+
+bool SocketTransport::Drain(uint32_t rank)
+{
+	PeerStream& peer = m_Peers[rank];
+	bool moved = false;
+	while (!peer.Closed)
+	{
+		auto received = recv(static_cast<NativeSocket>(m_Sockets[rank]), reinterpret_cast<char*>(m_ReadScratch.data()), static_cast<int>(m_ReadScratch.size()), 0);
+		if (received > 0)
+		{
+			peer.Incoming.insert(peer.Incoming.end(), m_ReadScratch.data(), m_ReadScratch.data() + received);
+			moved = true;
+			continue;
+		}
+		if (received < 0 && WouldBlock())
+			break;
+
+		peer.Closed = true;
+	}
+	return moved;
+}
+
+void SocketTransport::Progress(int timeoutMs)
+{
+	bool moved = false;
+	for (uint32_t rank = 0; rank < m_RankCount; rank++)
+	{
+		if (m_Sockets[rank] == NoSocket)
+			continue;
+		moved |= Flush(rank);
+		moved |= Drain(rank);
+	}
+	if (moved)
+		return;
+
+	// Nothing moved, sleep until some peer is readable or can take more bytes
+	pollfd fds[256];
+	size_t count = 0;
+	for (uint32_t rank = 0; rank < m_RankCount && count < 256; rank++)
+	{
+		if (m_Sockets[rank] == NoSocket || m_Peers[rank].Closed)
+			continue;
+		fds[count].fd = static_cast<NativeSocket>(m_Sockets[rank]);
+		fds[count].events = POLLIN | (m_Peers[rank].GetPendingBytes() ? POLLOUT : 0);
+		fds[count].revents = 0;
+		count++;
+	}
+	if (count)
+		PollSockets(fds, count, timeoutMs);
+}
+
+void SocketTransport::Send(uint32_t rank, const void* data, size_t size)
+{
+	PeerStream& peer = m_Peers[rank];
+	peer.QueueFrame(data, size);
+
+	if (rank == m_Rank)
+	{
+		peer.Incoming.insert(peer.Incoming.end(), peer.Outgoing.begin() + peer.OutgoingOffset, peer.Outgoing.end());
+		peer.Consume(peer.GetPendingBytes());
+		return;
+	}
+	Flush(rank);
+}
+
+bool SocketTransport::Receive(uint32_t rank, std::vector<uint8_t>& data)
+{
+	PeerStream& peer = m_Peers[rank];
+	while (!peer.PopFrame(data))
+	{
+		if (peer.Closed)
+		{
+			PY_CORE_ERROR("Rank {} waited for a message from rank {}, which disconnected", m_Rank, rank);
+			m_Failed = true;
+			return false;
+		}
+		Progress(100);
+	}
+	return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "transport.h"
+
+
+// Ranks connected pairwise over loopback TCP. Slower than shared memory but
+// the same wire code as a multi-machine run, and the sockets are non-blocking
+// so a wait polls every peer for both directions at once.
+class SocketTransport : public Transport
+{
+public:
+	~SocketTransport();
+
+	static std::unique_ptr<Transport> Connect(const TransportProps& props);
+
+	virtual const char* GetName() const override { return "socket"; }
+
+	virtual void Send(uint32_t rank, const void* data, size_t size) override;
+	virtual bool Receive(uint32_t rank, std::vector<uint8_t>& data) override;
+
+private:
+	SocketTransport(uint32_t rank, uint32_t rankCount);
+
+	bool Open(const TransportProps& props);
+	bool Flush(uint32_t rank);
+	bool Drain(uint32_t rank);
+	// Flushes and drains every peer, waiting up to timeoutMs for a socket to be ready
+	void Progress(int timeoutMs);
+
+private:
+	// Native handles, SOCKET on Windows and file descriptors elsewhere
+	std::vector<intptr_t> m_Sockets;
+	std::vector<PeerStream> m_Peers;
+	std::vector<uint8_t> m_ReadScratch;
+};
@@ -0,0 +1,258 @@
+#include "transport.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+#if defined(__linux__) || defined(__APPLE__)
+	#include <sys/types.h>
+	#include <sys/wait.h>
+	#include <unistd.h>
+#endif
+
+#include "../../logging/log.h"
+#include "shared_memory_transport.h"
+#include "socket_transport.h"
+#if PY_WITH_MPI
+	#include "mpi_transport.h"
+#endif
+
+
+namespace
+{
+#if defined(__linux__) || defined(__APPLE__)
+	std::vector<pid_t> s_LocalRanks;
+#endif
+}
+
+const char* TransportKindToString(TransportKind kind)
+{
+	switch (kind)
+	{
+	case TransportKind::SharedMemory: return "shared memory";
+	case TransportKind::Socket:       return "socket";
+	case TransportKind::Mpi:          return "MPI";
+	}
+	return "unknown";
+}
+
+TransportProps TransportProps::FromEnvironment()
+{
+	TransportProps props;
+
+	if (const char* kind = std::getenv("PY_TRANSPORT"))
+	{
+		std::string_view name = kind;
+		if (name == "socket")
+			props.Kind = TransportKind::Socket;
+		else if (name == "mpi")
+			props.Kind = TransportKind::Mpi;
+		else if (name == "shm")
+			props.Kind = TransportKind::SharedMemory;
+		else
+			PY_CORE_WARN("Unknown PY_TRANSPORT '{}', using shared memory", name);
+	}
+	if (const char* rank = std::getenv("PY_RANK"))
+		props.Rank = static_cast<uint32_t>(std::strtoul(rank, nullptr, 10));
+	if (const char* count = std::getenv("PY_RANK_COUNT"))
+		props.RankCount = std::max(1u, static_cast<uint32_t>(std::strtoul(count, nullptr, 10)));
+	if (const char* name = std::getenv("PY_TRANSPORT_NAME"))
+		props.Name = name;
+	if (const char* port = std::getenv("PY_TRANSPORT_PORT"))
+		props.BasePort = static_cast<uint16_t>(std::strtoul(port, nullptr, 10));
+
+	return props;
+}
+
+std::unique_ptr<Transport> Transport::Create(const TransportProps& props)
+{
+	if (props.Kind != TransportKind::Mpi && props.Rank >= props.RankCount)
+	{
+		PY_CORE_ERROR("Rank {} out of range for {} ranks", props.Rank, props.RankCount);
+		return nullptr;
+	}
+
+	std::unique_ptr<Transport> transport;
+	switch (props.Kind)
+	{
+	case TransportKind::SharedMemory:
+		transport = SharedMemoryTransport::Connect(props);
+		break;
+	case TransportKind::Socket:
+		transport = SocketTransport::Connect(props);
+		break;
+	case TransportKind::Mpi:
+#if PY_WITH_MPI
+		transport = MpiTransport::Connect(props);
+#else
+		PY_CORE_ERROR("MPI transport requested but the build has PY_WITH_MPI off");
+#endif
+		break;
+	}
+
+	if (transport)
+		PY_CORE_INFO("Rank {} of {} connected over {}", transport->GetRank(), transport->GetRankCount(), transport->GetName());
+	return transport;
+}
+
+template<typename Combine>
+void Transport::AllReduce(double* values, uint32_t count, Combine&& combine)
+{
+	if (m_RankCount == 1 || m_Failed)
+		return;
+
+	const size_t bytes = count * sizeof(double);
+	if (m_Rank != 0)
+	{
+		Send(0, values, bytes);
+		if (!Receive(0, m_ReduceScratch) || m_ReduceScratch.size() != bytes)
+		{
+			PY_CORE_ERROR("Rank {} got no reduction result from rank 0", m_Rank);
+			m_Failed = true;
+			return;
+		}
+		if (bytes)
+			std::memcpy(values, m_ReduceScratch.data(), bytes);
+		return;
+	}
+
+	for (uint32_t rank = 1; rank < m_RankCount; rank++)
+	{
+		if (!Receive(rank, m_ReduceScratch) || m_ReduceScratch.size() != bytes)
+		{
+			PY_CORE_ERROR("Rank 0 got no reduction input from rank {}", rank);
+			m_Failed = true;
+			return;
+		}
+
+		const double* other = reinterpret_cast<const double*>(m_ReduceScratch.data());
+		for (uint32_t i = 0; i < count; i++)
+			values[i] = combine(values[i], other[i]);
+	}
+	for (uint32_t rank = 1; rank < m_RankCount; rank++)
+		Send(rank, values, bytes);
+}
+
+void Transport::AllReduceSum(double* values, uint32_t count)
+{
+	AllReduce(values, count, [](double a, double b) { return a + b; });
+}
+
+void Transport::AllReduceMax(double* values, uint32_t count)
+{
+	AllReduce(values, count, [](double a, double b) { return std::max(a, b); });
+}
+
+void Transport::Barrier()
+{
+	AllReduce(nullptr, 0, [](double a, double) { return a; });
+}
+
+void Transport::PeerStream::QueueFrame(const void* data, size_t size)
+{
+	// Drop what was already written out before the buffer grows again
+	if (OutgoingOffset > 0 && OutgoingOffset * 2 >= Outgoing.size())
+	{
+		Outgoing.erase(Outgoing.begin(), Outgoing.begin() + OutgoingOffset);
+		OutgoingOffset = 0;
+	}
+
+	const uint64_t length = size;
+	const size_t at = Outgoing.size();
+	Outgoing.resize(at + sizeof(length) + size);
+	std::memcpy(Outgoing.data() + at, &length, sizeof(length));
+	if (size)
+		std::memcpy(Outgoing.data() + at + sizeof(length), data, size);
+}
+
+void Transport::PeerStream::Consume(size_t bytes)
+{
+	OutgoingOffset += bytes;
+	if (OutgoingOffset == Outgoing.size())
+	{
+		Outgoing.clear();
+		OutgoingOffset = 0;
+	}
+}
+
+bool Transport::PeerStream::PopFrame(std::vector<uint8_t>& data)
+{
+	uint64_t length;
+	const size_t available = Incoming.size() - IncomingOffset;
+	if (available < sizeof(length))
+		return false;
+
+	std::memcpy(&length, Incoming.data() + IncomingOffset, sizeof(length));
+	if (available - sizeof(length) < length)
+		return false;
+
+	const uint8_t* payload = Incoming.data() + IncomingOffset + sizeof(length);
+	data.assign(payload, payload + length);
+	IncomingOffset += sizeof(length) + length;
+
+	if (IncomingOffset == Incoming.size())
+	{
+		Incoming.clear();
+		IncomingOffset = 0;
+	}
+	else if (IncomingOffset * 2 >= Incoming.size())
+	{
+		Incoming.erase(Incoming.begin(), Incoming.begin() + IncomingOffset);
+		IncomingOffset = 0;
+	}
+	return true;
+}
+
+bool ForkLocalRanks(TransportProps& props, uint32_t count)
+{
+	props.Rank = 0;
+	props.RankCount = std::max(1u, count);
+
+#if defined(__linux__) || defined(__APPLE__)
+	props.Name += "-" + std::to_string(getpid());
+
+	for (uint32_t rank = 1; rank < props.RankCount; rank++)
+	{
+		pid_t pid = fork();
+		if (pid < 0)
+		{
+			PY_CORE_ERROR("Could not fork rank {}", rank);
+			return false;
+		}
+		if (pid == 0)
+		{
+			s_LocalRanks.clear();
+			props.Rank = rank;
+			return true;
+		}
+		s_LocalRanks.push_back(pid);
+	}
+	return true;
+#else
+	if (props.RankCount > 1)
+	{
+		PY_CORE_ERROR("Forking local ranks is not supported on this platform, start each rank with PY_RANK set instead");
+		return false;
+	}
+	return true;
+#endif
+}
+
+bool WaitForLocalRanks()
+{
+	bool ok = true;
+#if defined(__linux__) || defined(__APPLE__)
+	for (pid_t pid : s_LocalRanks)
+	{
+		int status = 0;
+		if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		{
+			PY_CORE_ERROR("Local rank process {} failed", pid);
+			ok = false;
+		}
+	}
+	s_LocalRanks.clear();
+#endif
+	return ok;
+}
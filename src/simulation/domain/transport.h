@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+enum class TransportKind
+{
+	SharedMemory,
+	Socket,
+	Mpi
+};
+
+const char* TransportKindToString(TransportKind kind);
+
+struct TransportProps
+{
+	TransportKind Kind;
+	uint32_t Rank;
+	uint32_t RankCount;
+	// Shared memory segment name, every rank of one run passes the same
+	std::string Name;
+	// Socket transport: rank r listens on 127.0.0.1 port BasePort + r
+	uint16_t BasePort;
+
+	TransportProps(TransportKind kind = TransportKind::SharedMemory,
+		uint32_t rank = 0,
+		uint32_t rankCount = 1,
+		const std::string& name = "PhysicsEngine",
+		uint16_t basePort = 47000)
+		: Kind(kind), Rank(rank), RankCount(rankCount), Name(name), BasePort(basePort) {
+	}
+
+	// Reads PY_TRANSPORT (shm, socket or mpi), PY_RANK, PY_RANK_COUNT,
+	// PY_TRANSPORT_NAME and PY_TRANSPORT_PORT, unset ones keep the defaults
+	static TransportProps FromEnvironment();
+};
+
+// Message passing between the ranks of one simulation. Sends are queued and
+// return at once, receives block; every wait keeps pushing the queued sends
+// out, so ranks can all send first and receive afterwards without deadlocking.
+// Messages between two ranks arrive in the order they were sent.
+class Transport
+{
+public:
+	virtual ~Transport() {}
+
+	uint32_t GetRank() const { return m_Rank; }
+	uint32_t GetRankCount() const { return m_RankCount; }
+	virtual const char* GetName() const = 0;
+
+	virtual void Send(uint32_t rank, const void* data, size_t size) = 0;
+	// Replaces data with the next message from rank, false if the rank is gone
+	virtual bool Receive(uint32_t rank, std::vector<uint8_t>& data) = 0;
+
+	// Set once a peer went away or a message to or from one was lost. The
+	// ranks are out of step from then on, so the run has to stop; collectives
+	// return at once, leaving their values as they were
+	bool HasFailed() const { return m_Failed; }
+
+	// Element-wise over every rank, all of them end up with the result. The
+	// defaults gather on rank 0 and send the result back
+	virtual void AllReduceSum(double* values, uint32_t count);
+	virtual void AllReduceMax(double* values, uint32_t count);
+	virtual void Barrier();
+
+	// nullptr if the transport could not connect all ranks
+	static std::unique_ptr<Transport> Create(const TransportProps& props);
+
+protected:
+	Transport(uint32_t rank, uint32_t rankCount)
+		: m_Rank(rank), m_RankCount(rankCount) {
+	}
+
+	template<typename Combine>
+	void AllReduce(double* values, uint32_t count, Combine&& combine);
+
+	// Byte streams to and from one peer, messages framed by a 64-bit length.
+	// Shared by the transports that move raw bytes
+	struct PeerStream
+	{
+		std::vector<uint8_t> Outgoing;
+		size_t OutgoingOffset = 0;
+		std::vector<uint8_t> Incoming;
+		size_t IncomingOffset = 0;
+		bool Closed = false;
+
+		size_t GetPendingBytes() const { return Outgoing.size() - OutgoingOffset; }
+		void QueueFrame(const void* data, size_t size);
+		void Consume(size_t bytes);
+		bool PopFrame(std::vector<uint8_t>& data);
+	};
+
+protected:
+	uint32_t m_Rank;
+	uint32_t m_RankCount;
+	bool m_Failed = false;
+
+private:
+	std::vector<uint8_t> m_ReduceScratch;
+};
+
+// Forks the calling process into count ranks on this machine. Each process
+// returns with its own props.Rank, and the segment name is made unique to the
+// run. Only rank 0 should call WaitForLocalRanks, which reaps the others and
+// returns false if one of them failed
+bool ForkLocalRanks(TransportProps& props, uint32_t count);
+bool WaitForLocalRanks();
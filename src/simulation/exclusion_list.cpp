@@ -0,0 +1,140 @@
+#include "exclusion_list.h"
+
+#include <algorithm>
+#include <utility>
+
+
+bool ExclusionList::Update(const Topology& topology, uint32_t atomCount)
+{
+	if (topology.GetRevision() == m_BuiltRevision && atomCount == m_AtomCount)
+		return false;
+
+	// Systems without bonds stay empty, no reason to rebuild the neighbor list for them
+	const bool wasEmpty = IsEmpty();
+	Build(topology, atomCount);
+	return !(wasEmpty && IsEmpty());
+}
+
+void ExclusionList::Clear()
+{
+	m_BuiltRevision = ~0ull;
+	m_AtomCount = 0;
+	m_Offsets.clear();
+	m_Partners.clear();
+	m_Pair14I.clear();
+	m_Pair14J.clear();
+}
+
+bool ExclusionList::Contains(uint32_t i, uint32_t j) const
+{
+	if (i > j)
+		std::swap(i, j);
+	if (j >= m_AtomCount)
+		return false;
+
+	return std::binary_search(m_Partners.begin() + m_Offsets[i], m_Partners.begin() + m_Offsets[i + 1], j);
+}
+
+void ExclusionList::Build(const Topology& topology, uint32_t atomCount)
+{
+	m_BuiltRevision = topology.GetRevision();
+	m_AtomCount = atomCount;
+	m_Offsets.assign(atomCount + 1, 0);
+	m_Partners.clear();
+	m_Pair14I.clear();
+	m_Pair14J.clear();
+
+	// Bond graph in CSR form, every bond in both rows. A constrained pair is as
+	// rigid as a bond, and a water's H-H pair is 1-3 through its oxygen
+	std::vector<std::pair<uint32_t, uint32_t>> edges;
+	auto addEdge = [&](uint32_t a, uint32_t b)
+	{
+		if (a != b && a < atomCount && b < atomCount)
+			edges.push_back({ a, b });
+	};
+	for (const HarmonicBond& bond : topology.GetBonds())
+		addEdge(bond.Atoms[0], bond.Atoms[1]);
+	for (const DistanceConstraint& constraint : topology.GetConstraints())
+		addEdge(constraint.Atoms[0], constraint.Atoms[1]);
+	for (const RigidWater& water : topology.GetRigidWaters())
+	{
+		addEdge(water.Atoms[0], water.Atoms[1]);
+		addEdge(water.Atoms[0], water.Atoms[2]);
+	}
+	if (edges.empty())
+		return;
+
+	std::vector<uint32_t> graphOffsets(atomCount + 1, 0);
+	for (const auto& [a, b] : edges)
+	{
+		graphOffsets[a + 1]++;
+		graphOffsets[b + 1]++;
+	}
+	for (uint32_t i = 0; i < atomCount; i++)
+		graphOffsets[i + 1] += graphOffsets[i];
+
+	std::vector<uint32_t> graph(graphOffsets[atomCount]);
+	std::vector<uint32_t> fill(graphOffsets.begin(), graphOffsets.end() - 1);
+	for (const auto& [a, b] : edges)
+	{
+		graph[fill[a]++] = b;
+		graph[fill[b]++] = a;
+	}
+
+	auto bonded = [&](uint32_t atom) { return std::make_pair(graph.begin() + graphOffsets[atom], graph.begin() + graphOffsets[atom + 1]); };
+
+	// Walks out three bonds from every atom. A pair reachable both ways, as in
+	// rings of five or six, counts as the closer of the two. Bonds a constraint
+	// repeats show up twice, the sort below drops the duplicates
+	std::vector<uint32_t> excluded, pairs14;
+	for (uint32_t i = 0; i < atomCount; i++)
+	{
+		excluded.clear();
+		pairs14.clear();
+
+		auto [begin1, end1] = bonded(i);
+		for (auto b = begin1; b != end1; ++b)
+		{
+			excluded.push_back(*b);
+
+			auto [begin2, end2] = bonded(*b);
+			for (auto c = begin2; c != end2; ++c)
+			{
+				if (*c == i)
+					continue;
+				excluded.push_back(*c);
+
+				auto [begin3, end3] = bonded(*c);
+				for (auto d = begin3; d != end3; ++d)
+				{
+					if (*d != i && *d != *b)
+						pairs14.push_back(*d);
+				}
+			}
+		}
+
+		// Each pair lives in the row of its lower index
+		auto keepHigher = [i](std::vector<uint32_t>& atoms)
+		{
+			atoms.erase(std::remove_if(atoms.begin(), atoms.end(), [i](uint32_t j) { return j <= i; }), atoms.end());
+			std::sort(atoms.begin(), atoms.end());
+			atoms.erase(std::unique(atoms.begin(), atoms.end()), atoms.end());
+		};
+		keepHigher(excluded);
+		keepHigher(pairs14);
+		pairs14.erase(std::remove_if(pairs14.begin(), pairs14.end(),
+			[&excluded](uint32_t j) { return std::binary_search(excluded.begin(), excluded.end(), j); }), pairs14.end());
+
+		for (uint32_t j : pairs14)
+		{
+			m_Pair14I.push_back(i);
+			m_Pair14J.push_back(j);
+		}
+
+		const size_t rowBegin = m_Partners.size();
+		m_Partners.insert(m_Partners.end(), excluded.begin(), excluded.end());
+		m_Partners.insert(m_Partners.end(), pairs14.begin(), pairs14.end());
+		std::inplace_merge(m_Partners.begin() + rowBegin, m_Partners.begin() + rowBegin + excluded.size(), m_Partners.end());
+		m_Offsets[i + 1] = static_cast<uint32_t>(m_Partners.size());
+	}
+}
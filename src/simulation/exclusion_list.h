@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "aligned_allocator.h"
+#include "topology.h"
+
+
+// Nonbonded pairs the bonded terms already account for, derived from the bond
+// graph of a Topology. Distance constraints and the O-H pairs of rigid waters
+// count as bonds. Atoms one or two bonds apart (1-2, 1-3) do not interact
+// through the pair potentials at all; atoms three bonds apart (1-4) interact
+// with scaled down Lennard-Jones and Coulomb terms in a pass of their own.
+// Both kinds are kept off the neighbor list.
+//
+// Every pair is stored once, in the row of its lower index: the partners of
+// atom i are Partners[Offsets[i] .. Offsets[i + 1]), sorted. The 1-4 pairs
+// are repeated as flat i / j streams for the scaled pass.
+class ExclusionList
+{
+public:
+	ExclusionList() {}
+
+	// Rebuilds when the topology's revision or the atom count changed. Returns
+	// true if the pairs may differ from before, so the neighbor list has to
+	// be rebuilt
+	bool Update(const Topology& topology, uint32_t atomCount);
+	void Clear();
+
+	bool IsEmpty() const { return m_Partners.empty(); }
+	// Whether the pair is left off the neighbor list, i and j in any order
+	bool Contains(uint32_t i, uint32_t j) const;
+
+	uint32_t GetAtomCount() const { return m_AtomCount; }
+	uint32_t GetPairCount() const { return static_cast<uint32_t>(m_Partners.size()); }
+	const uint32_t* GetOffsets() const { return m_Offsets.data(); }
+	const uint32_t* GetPartners() const { return m_Partners.data(); }
+
+	uint32_t GetPair14Count() const { return static_cast<uint32_t>(m_Pair14I.size()); }
+	const uint32_t* GetPair14I() const { return m_Pair14I.data(); }
+	const uint32_t* GetPair14J() const { return m_Pair14J.data(); }
+
+private:
+	void Build(const Topology& topology, uint32_t atomCount);
+
+private:
+	uint64_t m_BuiltRevision = ~0ull;
+	uint32_t m_AtomCount = 0;
+
+	std::vector<uint32_t> m_Offsets;
+	std::vector<uint32_t> m_Partners;
+	AlignedVector<uint32_t> m_Pair14I, m_Pair14J;
+};
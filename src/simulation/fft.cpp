@@ -0,0 +1,275 @@
+#include "fft.h"
+
+#include <cmath>
+
+#include "../threading/thread_pool.h"
+
+
+namespace
+{
+	template<typename F>
+	void ForSlabs(ThreadPool* pool, uint32_t count, const F& body)
+	{
+		if (pool)
+			pool->ParallelFor(count, 1, [&body](uint32_t begin, uint32_t end, uint32_t) { body(begin, end); });
+		else
+			body(0, count);
+	}
+}
+
+void FFTPlan::Init(uint32_t length)
+{
+	m_Length = length;
+
+	// Radix 4 first since its butterfly is the cheapest per point
+	m_Factors.clear();
+	uint32_t n = length;
+	while (n % 4 == 0) { m_Factors.push_back(4); n /= 4; }
+	for (uint32_t p = 2; n > 1; p++)
+	{
+		while (n % p == 0) { m_Factors.push_back(p); n /= p; }
+	}
+
+	m_Twiddles.resize(length);
+	for (uint32_t k = 0; k < length; k++)
+	{
+		double angle = -2.0 * 3.14159265358979323846 * k / length;
+		m_Twiddles[k] = Complex((float)std::cos(angle), (float)std::sin(angle));
+	}
+}
+
+void FFTPlan::Forward(const Complex* in, Complex* out, uint32_t inStride) const
+{
+	Transform(in, out, m_Length, inStride, 0, false);
+}
+
+void FFTPlan::Inverse(const Complex* in, Complex* out, uint32_t inStride) const
+{
+	Transform(in, out, m_Length, inStride, 0, true);
+}
+
+// Decimation in time: the p interleaved subsequences are transformed into
+// consecutive blocks of out, then combined in place with one butterfly per k
+void FFTPlan::Transform(const Complex* in, Complex* out, uint32_t n, uint32_t stride, uint32_t factor, bool inverse) const
+{
+	if (n == 1)
+	{
+		out[0] = in[0];
+		return;
+	}
+
+	const uint32_t p = m_Factors[factor];
+	const uint32_t m = n / p;
+	for (uint32_t r = 0; r < p; r++)
+		Transform(in + r * stride, out + r * m, m, stride * p, factor + 1, inverse);
+
+	// Twiddles for length n are every (N / n)-th entry of the full table
+	const uint32_t step = m_Length / n;
+
+	if (p == 2)
+	{
+		for (uint32_t k = 0; k < m; k++)
+		{
+			Complex t = out[k + m] * Twiddle(k * step, inverse);
+			out[k + m] = out[k] - t;
+			out[k] += t;
+		}
+	}
+	else if (p == 4)
+	{
+		// Multiplying by -i (forward) or +i (inverse) is a swap and a sign flip
+		const float rot = inverse ? 1.0f : -1.0f;
+		for (uint32_t k = 0; k < m; k++)
+		{
+			Complex a0 = out[k];
+			Complex a1 = out[k + m] * Twiddle(k * step, inverse);
+			Complex a2 = out[k + 2 * m] * Twiddle(2 * k * step, inverse);
+			Complex a3 = out[k + 3 * m] * Twiddle(3 * k * step, inverse);
+
+			Complex b0 = a0 + a2, b1 = a0 - a2;
+			Complex b2 = a1 + a3, d = a1 - a3;
+			Complex b3(-rot * d.imag(), rot * d.real());
+
+			out[k] = b0 + b2;
+			out[k + m] = b1 + b3;
+			out[k + 2 * m] = b0 - b2;
+			out[k + 3 * m] = b1 - b3;
+		}
+	}
+	else
+	{
+		const uint32_t rootStep = m_Length / p;
+		std::vector<Complex> t(p);
+		for (uint32_t k = 0; k < m; k++)
+		{
+			for (uint32_t r = 0; r < p; r++)
+				t[r] = out[k + r * m] * Twiddle(r * k * step, inverse);
+
+			for (uint32_t q = 0; q < p; q++)
+			{
+				Complex sum = t[0];
+				for (uint32_t r = 1; r < p; r++)
+					sum += t[r] * Twiddle((r * q % p) * rootStep, inverse);
+				out[k + q * m] = sum;
+			}
+		}
+	}
+}
+
+bool FFTPlan::IsFastLength(uint32_t n)
+{
+	if (n == 0)
+		return false;
+	for (uint32_t p : { 2u, 3u, 5u })
+	{
+		while (n % p == 0)
+			n /= p;
+	}
+	return n == 1;
+}
+
+uint32_t FFTPlan::NextFastLength(uint32_t n)
+{
+	while (!IsFastLength(n))
+		n++;
+	return n;
+}
+
+void RealFFT3D::Init(uint32_t nx, uint32_t ny, uint32_t nz)
+{
+	m_PlanX.Init(nx);
+	m_PlanY.Init(ny);
+	m_PlanZ.Init(nz);
+}
+
+void RealFFT3D::Forward(const float* real, Complex* spectrum, ThreadPool* pool) const
+{
+	// z and y passes stay inside one x plane, the x pass inside one y row
+	ForSlabs(pool, GetSizeX(), [&](uint32_t begin, uint32_t end)
+		{
+			ForwardZ(real, spectrum, begin, end);
+			TransformY(spectrum, begin, end, false);
+		});
+	ForSlabs(pool, GetSizeY(), [&](uint32_t begin, uint32_t end) { TransformX(spectrum, begin, end, false); });
+}
+
+void RealFFT3D::Inverse(Complex* spectrum, float* real, ThreadPool* pool) const
+{
+	ForSlabs(pool, GetSizeY(), [&](uint32_t begin, uint32_t end) { TransformX(spectrum, begin, end, true); });
+	ForSlabs(pool, GetSizeX(), [&](uint32_t begin, uint32_t end)
+		{
+			TransformY(spectrum, begin, end, true);
+			InverseZ(spectrum, real, begin, end);
+		});
+}
+
+// Two real rows a and b go through one complex FFT as a + ib, their spectra
+// are split apart again using the conjugate symmetry of real input
+void RealFFT3D::ForwardZ(const float* real, Complex* spectrum, uint32_t xBegin, uint32_t xEnd) const
+{
+	const uint32_t ny = GetSizeY(), nz = GetSizeZ(), nzc = GetComplexSizeZ();
+	std::vector<Complex> packed(nz), transformed(nz);
+
+	for (uint32_t x = xBegin; x < xEnd; x++)
+	{
+		for (uint32_t y = 0; y < ny; y += 2)
+		{
+			const bool pair = y + 1 < ny;
+			const float* a = real + ((size_t)x * ny + y) * nz;
+			const float* b = a + nz;
+			for (uint32_t z = 0; z < nz; z++)
+				packed[z] = Complex(a[z], pair ? b[z] : 0.0f);
+
+			m_PlanZ.Forward(packed.data(), transformed.data());
+
+			Complex* outA = spectrum + ((size_t)x * ny + y) * nzc;
+			Complex* outB = outA + nzc;
+			for (uint32_t k = 0; k < nzc; k++)
+			{
+				Complex zk = transformed[k];
+				Complex zc = std::conj(transformed[(nz - k) % nz]);
+				outA[k] = 0.5f * (zk + zc);
+				if (pair)
+					outB[k] = Complex(0.0f, -0.5f) * (zk - zc);
+			}
+		}
+	}
+}
+
+void RealFFT3D::InverseZ(const Complex* spectrum, float* real, uint32_t xBegin, uint32_t xEnd) const
+{
+	const uint32_t ny = GetSizeY(), nz = GetSizeZ(), nzc = GetComplexSizeZ();
+	std::vector<Complex> packed(nz), transformed(nz);
+
+	for (uint32_t x = xBegin; x < xEnd; x++)
+	{
+		for (uint32_t y = 0; y < ny; y += 2)
+		{
+			const bool pair = y + 1 < ny;
+			const Complex* inA = spectrum + ((size_t)x * ny + y) * nzc;
+			const Complex* inB = inA + nzc;
+
+			// Rebuild both full Hermitian spectra and pack them as A + iB
+			for (uint32_t k = 0; k < nz; k++)
+			{
+				Complex a = k < nzc ? inA[k] : std::conj(inA[nz - k]);
+				Complex b = !pair ? Complex(0.0f) : (k < nzc ? inB[k] : std::conj(inB[nz - k]));
+				packed[k] = a + Complex(-b.imag(), b.real());
+			}
+
+			m_PlanZ.Inverse(packed.data(), transformed.data());
+
+			float* outA = real + ((size_t)x * ny + y) * nz;
+			float* outB = outA + nz;
+			for (uint32_t z = 0; z < nz; z++)
+			{
+				outA[z] = transformed[z].real();
+				if (pair)
+					outB[z] = transformed[z].imag();
+			}
+		}
+	}
+}
+
+void RealFFT3D::TransformY(Complex* spectrum, uint32_t xBegin, uint32_t xEnd, bool inverse) const
+{
+	const uint32_t ny = GetSizeY(), nzc = GetComplexSizeZ();
+	std::vector<Complex> column(ny);
+
+	for (uint32_t x = xBegin; x < xEnd; x++)
+	{
+		Complex* plane = spectrum + (size_t)x * ny * nzc;
+		for (uint32_t kz = 0; kz < nzc; kz++)
+		{
+			if (inverse)
+				m_PlanY.Inverse(plane + kz, column.data(), nzc);
+			else
+				m_PlanY.Forward(plane + kz, column.data(), nzc);
+
+			for (uint32_t y = 0; y < ny; y++)
+				plane[(size_t)y * nzc + kz] = column[y];
+		}
+	}
+}
+
+void RealFFT3D::TransformX(Complex* spectrum, uint32_t yBegin, uint32_t yEnd, bool inverse) const
+{
+	const uint32_t nx = GetSizeX(), ny = GetSizeY(), nzc = GetComplexSizeZ();
+	const uint32_t planeStride = ny * nzc;
+	std::vector<Complex> column(nx);
+
+	for (uint32_t y = yBegin; y < yEnd; y++)
+	{
+		Complex* row = spectrum + (size_t)y * nzc;
+		for (uint32_t kz = 0; kz < nzc; kz++)
+		{
+			if (inverse)
+				m_PlanX.Inverse(row + kz, column.data(), planeStride);
+			else
+				m_PlanX.Forward(row + kz, column.data(), planeStride);
+
+			for (uint32_t x = 0; x < nx; x++)
+				row[(size_t)x * planeStride + kz] = column[x];
+		}
+	}
+}
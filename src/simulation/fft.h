@@ -0,0 +1,76 @@
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+
+// Mixed-radix complex FFT of one fixed length, unnormalized in both
+// directions. Radix 4 and 2 have dedicated butterflies, any other factor goes
+// through a generic O(p^2) butterfly, so every length works but lengths made
+// of 2, 3 and 5 are the fast ones.
+class FFTPlan
+{
+public:
+	using Complex = std::complex<float>;
+
+	FFTPlan() {}
+	FFTPlan(uint32_t length) { Init(length); }
+
+	void Init(uint32_t length);
+	uint32_t GetLength() const { return m_Length; }
+
+	// out[k] = sum_n in[n * stride] e^(-2 pi i n k / N), in and out must not overlap
+	void Forward(const Complex* in, Complex* out, uint32_t inStride = 1) const;
+	// Same with e^(+2 pi i n k / N), the 1 / N is left to the caller
+	void Inverse(const Complex* in, Complex* out, uint32_t inStride = 1) const;
+
+	// True when n has no prime factors other than 2, 3 and 5
+	static bool IsFastLength(uint32_t n);
+	// Smallest fast length >= n
+	static uint32_t NextFastLength(uint32_t n);
+
+private:
+	void Transform(const Complex* in, Complex* out, uint32_t n, uint32_t stride, uint32_t factor, bool inverse) const;
+	Complex Twiddle(uint32_t k, bool inverse) const { return inverse ? std::conj(m_Twiddles[k]) : m_Twiddles[k]; }
+
+private:
+	uint32_t m_Length = 0;
+	std::vector<uint32_t> m_Factors;
+	std::vector<Complex> m_Twiddles;   // e^(-2 pi i k / N)
+};
+
+// Real-to-complex 3D transform of an nx * ny * nz grid stored z fastest. The
+// spectrum keeps the non-redundant half, nx * ny * (nz / 2 + 1) values, also
+// z fastest. Each 1D pass is split over slabs of the grid on the pool.
+class RealFFT3D
+{
+public:
+	using Complex = FFTPlan::Complex;
+
+	RealFFT3D() {}
+
+	void Init(uint32_t nx, uint32_t ny, uint32_t nz);
+
+	uint32_t GetSizeX() const { return m_PlanX.GetLength(); }
+	uint32_t GetSizeY() const { return m_PlanY.GetLength(); }
+	uint32_t GetSizeZ() const { return m_PlanZ.GetLength(); }
+	uint32_t GetComplexSizeZ() const { return m_PlanZ.GetLength() / 2 + 1; }
+	size_t GetRealCount() const { return (size_t)GetSizeX() * GetSizeY() * GetSizeZ(); }
+	size_t GetComplexCount() const { return (size_t)GetSizeX() * GetSizeY() * GetComplexSizeZ(); }
+
+	void Forward(const float* real, Complex* spectrum, ThreadPool* pool) const;
+	// Unnormalized like the 1D plans, the spectrum is used as scratch and overwritten
+	void Inverse(Complex* spectrum, float* real, ThreadPool* pool) const;
+
+private:
+	void ForwardZ(const float* real, Complex* spectrum, uint32_t xBegin, uint32_t xEnd) const;
+	void InverseZ(const Complex* spectrum, float* real, uint32_t xBegin, uint32_t xEnd) const;
+	void TransformY(Complex* spectrum, uint32_t xBegin, uint32_t xEnd, bool inverse) const;
+	void TransformX(Complex* spectrum, uint32_t yBegin, uint32_t yEnd, bool inverse) const;
+
+private:
+	FFTPlan m_PlanX, m_PlanY, m_PlanZ;
+};
@@ -0,0 +1,500 @@
+#include "bonded_force.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <type_traits>
+
+#include "../../logging/log.h"
+
+
+namespace
+{
+	constexpr double Pi = 3.14159265358979323846;
+
+	// Terms per block. The first pass over a block only gathers positions and
+	// does arithmetic, so it can vectorize; the second scatters the forces.
+	constexpr uint32_t BlockSize = 64;
+	// Minimum terms per chunk, below that scheduling costs more than it saves
+	constexpr uint32_t MinChunkSize = 256;
+
+	// Positions, forces and the arithmetic of the kernels are in Real: float,
+	// or double when the atom store has precise forces
+	template<typename Real>
+	struct Frame
+	{
+		const Real* PosX;
+		const Real* PosY;
+		const Real* PosZ;
+		Real* ForceX;
+		Real* ForceY;
+		Real* ForceZ;
+		Real Box[3];
+		Real InvBox[3];
+		Real Tilt[3];
+	};
+
+	// Minimum-image a - b
+	template<bool Periodic, typename Real>
+	inline void Delta(const Frame<Real>& f, uint32_t a, uint32_t b, Real d[3])
+	{
+		d[0] = f.PosX[a] - f.PosX[b];
+		d[1] = f.PosY[a] - f.PosY[b];
+		d[2] = f.PosZ[a] - f.PosZ[b];
+
+		// z, y, x so the tilted box vectors come off before the axes they lean into
+		if constexpr (Periodic)
+		{
+			Real sz = std::nearbyint(d[2] * f.InvBox[2]);
+			d[0] -= sz * f.Tilt[1]; d[1] -= sz * f.Tilt[2]; d[2] -= sz * f.Box[2];
+			Real sy = std::nearbyint(d[1] * f.InvBox[1]);
+			d[0] -= sy * f.Tilt[0]; d[1] -= sy * f.Box[1];
+			d[0] -= f.Box[0] * std::nearbyint(d[0] * f.InvBox[0]);
+		}
+	}
+
+	template<typename Real>
+	inline Real Dot(const Real a[3], const Real b[3]) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+	template<typename Real>
+	inline void Cross(const Real a[3], const Real b[3], Real out[3])
+	{
+		out[0] = a[1] * b[2] - a[2] * b[1];
+		out[1] = a[2] * b[0] - a[0] * b[2];
+		out[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	template<typename Real>
+	inline void AddForce(const Frame<Real>& f, uint32_t atom, Real x, Real y, Real z)
+	{
+		f.ForceX[atom] += x; f.ForceY[atom] += y; f.ForceZ[atom] += z;
+	}
+
+	template<bool Periodic, typename Real>
+	double BondKernel(const Frame<Real>& f, const BondedForce::BondBatch& batch, uint32_t begin, uint32_t end, double& virial)
+	{
+		const uint32_t* ai = batch.Atoms[0].data();
+		const uint32_t* aj = batch.Atoms[1].data();
+		const float* k = batch.Params[0].data();
+		const float* length = batch.Params[1].data();
+
+		Real fx[BlockSize], fy[BlockSize], fz[BlockSize];
+		double energy = 0.0;
+
+		for (uint32_t base = begin; base < end; base += BlockSize)
+		{
+			const uint32_t count = std::min(BlockSize, end - base);
+
+			Real blockEnergy = 0, blockVirial = 0;
+			for (uint32_t t = 0; t < count; t++)
+			{
+				const uint32_t b = base + t;
+				Real d[3];
+				Delta<Periodic>(f, ai[b], aj[b], d);
+
+				Real r = std::sqrt(Dot(d, d));
+				Real dr = r - length[b];
+				Real scale = -k[b] * dr / std::max(r, Real(1e-12));
+
+				fx[t] = scale * d[0]; fy[t] = scale * d[1]; fz[t] = scale * d[2];
+				blockEnergy += Real(0.5) * k[b] * dr * dr;
+				blockVirial += scale * r * r;
+			}
+
+			for (uint32_t t = 0; t < count; t++)
+			{
+				AddForce(f, ai[base + t], fx[t], fy[t], fz[t]);
+				AddForce(f, aj[base + t], -fx[t], -fy[t], -fz[t]);
+			}
+			energy += blockEnergy;
+			virial += blockVirial;
+		}
+		return energy;
+	}
+
+	template<bool Periodic, typename Real>
+	double AngleKernel(const Frame<Real>& f, const BondedForce::AngleBatch& batch, uint32_t begin, uint32_t end, double& virial)
+	{
+		const uint32_t* ai = batch.Atoms[0].data();
+		const uint32_t* aj = batch.Atoms[1].data();
+		const uint32_t* ak = batch.Atoms[2].data();
+		const float* stiffness = batch.Params[0].data();
+		const float* angle = batch.Params[1].data();
+
+		Real fi[3][BlockSize], fk[3][BlockSize];
+		double energy = 0.0;
+
+		for (uint32_t base = begin; base < end; base += BlockSize)
+		{
+			const uint32_t count = std::min(BlockSize, end - base);
+
+			Real blockEnergy = 0, blockVirial = 0;
+			for (uint32_t t = 0; t < count; t++)
+			{
+				const uint32_t b = base + t;
+				Real ra[3], rb[3];
+				Delta<Periodic>(f, ai[b], aj[b], ra);
+				Delta<Periodic>(f, ak[b], aj[b], rb);
+
+				Real raa = Dot(ra, ra), rbb = Dot(rb, rb);
+				Real invAB = Real(1) / std::sqrt(raa * rbb);
+				Real cosTheta = std::clamp(Dot(ra, rb) * invAB, Real(-1), Real(1));
+				Real sinTheta = std::sqrt(std::max(Real(1) - cosTheta * cosTheta, Real(1e-12)));
+
+				Real dTheta = std::acos(cosTheta) - angle[b];
+				// dU/dtheta / sin(theta), times d cos(theta) / dr per end atom
+				Real coef = stiffness[b] * dTheta / sinTheta;
+				Real ca = cosTheta / raa, cb = cosTheta / rbb;
+
+				for (int c = 0; c < 3; c++)
+				{
+					fi[c][t] = coef * (rb[c] * invAB - ca * ra[c]);
+					fk[c][t] = coef * (ra[c] * invAB - cb * rb[c]);
+				}
+				blockEnergy += Real(0.5) * stiffness[b] * dTheta * dTheta;
+				// Positions relative to the vertex, the forces sum to zero
+				blockVirial += ra[0] * fi[0][t] + ra[1] * fi[1][t] + ra[2] * fi[2][t] + rb[0] * fk[0][t] + rb[1] * fk[1][t] + rb[2] * fk[2][t];
+			}
+
+			for (uint32_t t = 0; t < count; t++)
+			{
+				const uint32_t b = base + t;
+				AddForce(f, ai[b], fi[0][t], fi[1][t], fi[2][t]);
+				AddForce(f, ak[b], fk[0][t], fk[1][t], fk[2][t]);
+				AddForce(f, aj[b], -fi[0][t] - fk[0][t], -fi[1][t] - fk[1][t], -fi[2][t] - fk[2][t]);
+			}
+			energy += blockEnergy;
+			virial += blockVirial;
+		}
+		return energy;
+	}
+
+	// Potential of one dihedral kind as a function of the angle phi in (-pi, pi]
+	struct PeriodicTorsionTerm
+	{
+		template<typename Real>
+		static void Evaluate(const BondedForce::TorsionBatch& batch, uint32_t b, Real phi, Real& energy, Real& dUdPhi)
+		{
+			Real k = batch.Params[0][b], phase = batch.Params[1][b], n = batch.Params[2][b];
+			Real arg = n * phi - phase;
+			energy = k * (Real(1) + std::cos(arg));
+			dUdPhi = -k * n * std::sin(arg);
+		}
+	};
+
+	struct RBTorsionTerm
+	{
+		template<typename Real>
+		static void Evaluate(const BondedForce::RBTorsionBatch& batch, uint32_t b, Real phi, Real& energy, Real& dUdPhi)
+		{
+			// psi = phi - 180 deg, so cos(psi) = -cos(phi) and sin(psi) = -sin(phi)
+			const Real cosPsi = -std::cos(phi);
+			Real power = 1, derivative = 0;
+			energy = batch.Params[0][b];
+			for (uint32_t n = 1; n < 6; n++)
+			{
+				// power is cos^(n - 1) here
+				derivative += n * batch.Params[n][b] * power;
+				power *= cosPsi;
+				energy += batch.Params[n][b] * power;
+			}
+			dUdPhi = std::sin(phi) * derivative;
+		}
+	};
+
+	struct ImproperTerm
+	{
+		template<typename Real>
+		static void Evaluate(const BondedForce::ImproperBatch& batch, uint32_t b, Real phi, Real& energy, Real& dUdPhi)
+		{
+			const Real twoPi = Real(2 * Pi);
+			Real k = batch.Params[0][b];
+			Real d = phi - batch.Params[1][b];
+			d -= twoPi * std::nearbyint(d / twoPi);
+			energy = Real(0.5) * k * d * d;
+			dUdPhi = k * d;
+		}
+	};
+
+	// Shared dihedral geometry, forces follow Bekker's decomposition
+	template<bool Periodic, typename Term, typename Batch, typename Real>
+	double DihedralKernel(const Frame<Real>& f, const Batch& batch, uint32_t begin, uint32_t end, double& virial)
+	{
+		const uint32_t* ai = batch.Atoms[0].data();
+		const uint32_t* aj = batch.Atoms[1].data();
+		const uint32_t* ak = batch.Atoms[2].data();
+		const uint32_t* al = batch.Atoms[3].data();
+
+		Real fi[3][BlockSize], fj[3][BlockSize], fk[3][BlockSize], fl[3][BlockSize];
+		double energy = 0.0;
+
+		for (uint32_t base = begin; base < end; base += BlockSize)
+		{
+			const uint32_t count = std::min(BlockSize, end - base);
+
+			Real blockEnergy = 0, blockVirial = 0;
+			for (uint32_t t = 0; t < count; t++)
+			{
+				const uint32_t b = base + t;
+				Real rij[3], rkj[3], rkl[3];
+				Delta<Periodic>(f, ai[b], aj[b], rij);
+				Delta<Periodic>(f, ak[b], aj[b], rkj);
+				Delta<Periodic>(f, ak[b], al[b], rkl);
+
+				Real m[3], n[3];
+				Cross(rij, rkj, m);
+				Cross(rkj, rkl, n);
+
+				Real mm = std::max(Dot(m, m), Real(1e-20)), nn = std::max(Dot(n, n), Real(1e-20));
+				Real rkj2 = Dot(rkj, rkj);
+				Real rkjLength = std::sqrt(rkj2);
+
+				// |m x n| = |rkj| |rij . n|, which also carries the sign of phi
+				Real phi = std::atan2(rkjLength * Dot(rij, n), Dot(m, n));
+
+				Real termEnergy, dUdPhi;
+				Term::Evaluate(batch, b, phi, termEnergy, dUdPhi);
+				blockEnergy += termEnergy;
+
+				Real a = -dUdPhi * rkjLength / mm;
+				Real c = dUdPhi * rkjLength / nn;
+				Real p = Dot(rij, rkj) / rkj2;
+				Real q = Dot(rkl, rkj) / rkj2;
+
+				for (int d = 0; d < 3; d++)
+				{
+					Real forceI = a * m[d];
+					Real forceL = c * n[d];
+					Real s = p * forceI - q * forceL;
+
+					fi[d][t] = forceI;
+					fj[d][t] = s - forceI;
+					fk[d][t] = -forceL - s;
+					fl[d][t] = forceL;
+
+					// Relative to atom j: x_l - x_j = rkj - rkl
+					blockVirial += rij[d] * forceI + rkj[d] * fk[d][t] + (rkj[d] - rkl[d]) * forceL;
+				}
+			}
+
+			for (uint32_t t = 0; t < count; t++)
+			{
+				const uint32_t b = base + t;
+				AddForce(f, ai[b], fi[0][t], fi[1][t], fi[2][t]);
+				AddForce(f, aj[b], fj[0][t], fj[1][t], fj[2][t]);
+				AddForce(f, ak[b], fk[0][t], fk[1][t], fk[2][t]);
+				AddForce(f, al[b], fl[0][t], fl[1][t], fl[2][t]);
+			}
+			energy += blockEnergy;
+			virial += blockVirial;
+		}
+		return energy;
+	}
+
+	// Sorts terms by their lowest atom so chunks touch narrow, mostly disjoint
+	// atom ranges, and drops any that reference atoms that do not exist
+	template<typename Term, uint32_t AtomCount, uint32_t ParamCount, typename ParamFn>
+	void CompileBatch(const std::vector<Term>& terms, uint32_t atomCount, const char* name,
+		BondedForce::TermBatch<AtomCount, ParamCount>& batch, ParamFn params)
+	{
+		std::vector<uint32_t> order;
+		order.reserve(terms.size());
+		for (uint32_t t = 0; t < terms.size(); t++)
+		{
+			if (*std::max_element(terms[t].Atoms, terms[t].Atoms + AtomCount) < atomCount)
+				order.push_back(t);
+		}
+		if (order.size() != terms.size())
+			PY_CORE_ERROR("Skipping {} {} terms that reference missing atoms", terms.size() - order.size(), name);
+
+		auto lowest = [&terms](uint32_t t) { return *std::min_element(terms[t].Atoms, terms[t].Atoms + AtomCount); };
+		std::stable_sort(order.begin(), order.end(), [&lowest](uint32_t a, uint32_t b) { return lowest(a) < lowest(b); });
+
+		for (uint32_t a = 0; a < AtomCount; a++)
+			batch.Atoms[a].resize(order.size());
+		for (uint32_t p = 0; p < ParamCount; p++)
+			batch.Params[p].resize(order.size());
+
+		float values[ParamCount];
+		for (uint32_t i = 0; i < order.size(); i++)
+		{
+			const Term& term = terms[order[i]];
+			for (uint32_t a = 0; a < AtomCount; a++)
+				batch.Atoms[a][i] = term.Atoms[a];
+
+			params(term, values);
+			for (uint32_t p = 0; p < ParamCount; p++)
+				batch.Params[p][i] = values[p];
+		}
+	}
+
+	template<uint32_t AtomCount, uint32_t ParamCount>
+	void TouchedRange(const BondedForce::TermBatch<AtomCount, ParamCount>& batch, uint32_t begin, uint32_t end,
+		uint32_t& lo, uint32_t& hi)
+	{
+		lo = 0xffffffffu;
+		hi = 0;
+		for (uint32_t a = 0; a < AtomCount; a++)
+		{
+			for (uint32_t t = begin; t < end; t++)
+			{
+				lo = std::min(lo, batch.Atoms[a][t]);
+				hi = std::max(hi, batch.Atoms[a][t] + 1);
+			}
+		}
+	}
+}
+
+BondedForce::BondedForce(const Topology& topology)
+	: Force(ForceGroupBonded), m_Topology(topology)
+{
+}
+
+void BondedForce::Compile(uint32_t atomCount)
+{
+	CompileBatch(m_Topology.GetBonds(), atomCount, "bond", m_Bonds,
+		[](const HarmonicBond& t, float* p) { p[0] = t.K; p[1] = t.Length; });
+	CompileBatch(m_Topology.GetAngles(), atomCount, "angle", m_Angles,
+		[](const HarmonicAngle& t, float* p) { p[0] = t.K; p[1] = t.Angle; });
+	CompileBatch(m_Topology.GetTorsions(), atomCount, "torsion", m_Torsions,
+		[](const PeriodicTorsion& t, float* p) { p[0] = t.K; p[1] = t.Phase; p[2] = (float)t.Multiplicity; });
+	CompileBatch(m_Topology.GetRBTorsions(), atomCount, "RB torsion", m_RBTorsions,
+		[](const RBTorsion& t, float* p) { std::copy(t.C, t.C + 6, p); });
+	CompileBatch(m_Topology.GetImpropers(), atomCount, "improper", m_Impropers,
+		[](const ImproperTorsion& t, float* p) { p[0] = t.K; p[1] = t.Angle; });
+
+	m_CompiledRevision = m_Topology.GetRevision();
+	m_CompiledAtomCount = atomCount;
+	m_PartitionThreads = 0;
+}
+
+void BondedForce::Partition(uint32_t threadCount)
+{
+	const uint32_t sizes[] = { m_Bonds.Size(), m_Angles.Size(), m_Torsions.Size(), m_RBTorsions.Size(), m_Impropers.Size() };
+	const uint32_t total = std::accumulate(std::begin(sizes), std::end(sizes), 0u);
+
+	// A few chunks per thread across all kinds together, so kinds with few terms share threads
+	const uint32_t chunkSize = std::max(MinChunkSize, (total + threadCount * 4 - 1) / (threadCount * 4));
+
+	m_Chunks.clear();
+	for (uint32_t kind = KindBond; kind <= KindImproper; kind++)
+	{
+		for (uint32_t begin = 0; begin < sizes[kind]; begin += chunkSize)
+		{
+			Chunk chunk;
+			chunk.Kind = (TermKind)kind;
+			chunk.Begin = begin;
+			chunk.End = std::min(begin + chunkSize, sizes[kind]);
+
+			switch (chunk.Kind)
+			{
+			case KindBond: TouchedRange(m_Bonds, chunk.Begin, chunk.End, chunk.TouchedBegin, chunk.TouchedEnd); break;
+			case KindAngle: TouchedRange(m_Angles, chunk.Begin, chunk.End, chunk.TouchedBegin, chunk.TouchedEnd); break;
+			case KindTorsion: TouchedRange(m_Torsions, chunk.Begin, chunk.End, chunk.TouchedBegin, chunk.TouchedEnd); break;
+			case KindRBTorsion: TouchedRange(m_RBTorsions, chunk.Begin, chunk.End, chunk.TouchedBegin, chunk.TouchedEnd); break;
+			case KindImproper: TouchedRange(m_Impropers, chunk.Begin, chunk.End, chunk.TouchedBegin, chunk.TouchedEnd); break;
+			}
+			m_Chunks.push_back(chunk);
+		}
+	}
+
+	m_PartitionThreads = threadCount;
+}
+
+template<typename Real>
+BondedEnergy BondedForce::RunChunk(const Chunk& chunk, const AtomStore& atoms, const SimulationBox& box,
+	Real* forceX, Real* forceY, Real* forceZ) const
+{
+	Frame<Real> frame;
+	if constexpr (std::is_same_v<Real, double>)
+	{
+		frame.PosX = atoms.PrecisePosX.data(); frame.PosY = atoms.PrecisePosY.data(); frame.PosZ = atoms.PrecisePosZ.data();
+	}
+	else
+	{
+		frame.PosX = atoms.PosX.data(); frame.PosY = atoms.PosY.data(); frame.PosZ = atoms.PosZ.data();
+	}
+	frame.ForceX = forceX; frame.ForceY = forceY; frame.ForceZ = forceZ;
+	for (int c = 0; c < 3; c++)
+	{
+		frame.Box[c] = box.Size[c];
+		frame.InvBox[c] = Real(1) / box.Size[c];
+		frame.Tilt[c] = box.Tilt[c];
+	}
+
+	BondedEnergy energy;
+	const bool periodic = box.Periodic;
+	switch (chunk.Kind)
+	{
+	case KindBond:
+		energy.Bonds = periodic ? BondKernel<true>(frame, m_Bonds, chunk.Begin, chunk.End, energy.Virial)
+			: BondKernel<false>(frame, m_Bonds, chunk.Begin, chunk.End, energy.Virial);
+		break;
+	case KindAngle:
+		energy.Angles = periodic ? AngleKernel<true>(frame, m_Angles, chunk.Begin, chunk.End, energy.Virial)
+			: AngleKernel<false>(frame, m_Angles, chunk.Begin, chunk.End, energy.Virial);
+		break;
+	case KindTorsion:
+		energy.Torsions = periodic ? DihedralKernel<true, PeriodicTorsionTerm>(frame, m_Torsions, chunk.Begin, chunk.End, energy.Virial)
+			: DihedralKernel<false, PeriodicTorsionTerm>(frame, m_Torsions, chunk.Begin, chunk.End, energy.Virial);
+		break;
+	case KindRBTorsion:
+		energy.Torsions = periodic ? DihedralKernel<true, RBTorsionTerm>(frame, m_RBTorsions, chunk.Begin, chunk.End, energy.Virial)
+			: DihedralKernel<false, RBTorsionTerm>(frame, m_RBTorsions, chunk.Begin, chunk.End, energy.Virial);
+		break;
+	case KindImproper:
+		energy.Impropers = periodic ? DihedralKernel<true, ImproperTerm>(frame, m_Impropers, chunk.Begin, chunk.End, energy.Virial)
+			: DihedralKernel<false, ImproperTerm>(frame, m_Impropers, chunk.Begin, chunk.End, energy.Virial);
+		break;
+	}
+	return energy;
+}
+
+double BondedForce::Compute(ForceContext& ctx)
+{
+	return ctx.IsPrecise() ? ComputeWith<double>(ctx) : ComputeWith<float>(ctx);
+}
+
+template<typename Real>
+double BondedForce::ComputeWith(ForceContext& ctx)
+{
+	AtomStore& atoms = ctx.Atoms;
+	const uint32_t atomCount = static_cast<uint32_t>(atoms.Size());
+
+	if (m_Topology.GetRevision() != m_CompiledRevision || atomCount != m_CompiledAtomCount)
+		Compile(atomCount);
+
+	const uint32_t threads = ctx.Pool ? ctx.Pool->GetThreadCount() : 1;
+	if (threads != m_PartitionThreads)
+		Partition(threads);
+
+	m_LastEnergy = BondedEnergy();
+	if (m_Chunks.empty())
+		return 0.0;
+
+	if (!ctx.Pool)
+	{
+		const ForceArrays<Real> forces = ctx.GetForces<Real>(0);
+		for (const Chunk& chunk : m_Chunks)
+			m_LastEnergy += RunChunk(chunk, atoms, ctx.Box, forces.X, forces.Y, forces.Z);
+		ctx.Virial += m_LastEnergy.Virial;
+		return m_LastEnergy.GetTotal();
+	}
+
+	m_ThreadEnergy.assign(threads, ThreadEnergy());
+	ctx.Pool->ParallelFor(static_cast<uint32_t>(m_Chunks.size()), 1, [&](uint32_t begin, uint32_t end, uint32_t thread)
+		{
+			const ForceArrays<Real> forces = ctx.GetForces<Real>(thread);
+			for (uint32_t c = begin; c < end; c++)
+			{
+				const Chunk& chunk = m_Chunks[c];
+				m_ThreadEnergy[thread].Energy += RunChunk(chunk, atoms, ctx.Box, forces.X, forces.Y, forces.Z);
+				ctx.Buffers.MarkTouched(thread, chunk.TouchedBegin, chunk.TouchedEnd);
+			}
+		});
+
+	for (const auto& e : m_ThreadEnergy)
+		m_LastEnergy += e.Energy;
+	ctx.Virial += m_LastEnergy.Virial;
+	return m_LastEnergy.GetTotal();
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "../aligned_allocator.h"
+#include "../topology.h"
+#include "force.h"
+
+
+struct BondedEnergy
+{
+	double Bonds = 0.0;
+	double Angles = 0.0;
+	double Torsions = 0.0;    // periodic and Ryckaert-Bellemans
+	double Impropers = 0.0;
+	// Sum of r . F over the atoms of every term, taken relative to one of them
+	double Virial = 0.0;
+
+	double GetTotal() const { return Bonds + Angles + Torsions + Impropers; }
+
+	BondedEnergy& operator+=(const BondedEnergy& other)
+	{
+		Bonds += other.Bonds; Angles += other.Angles; Torsions += other.Torsions; Impropers += other.Impropers;
+		Virial += other.Virial;
+		return *this;
+	}
+};
+
+// Bonds, angles, torsions and impropers from a Topology. Each kind of term is
+// compiled into one flat structure-of-arrays batch sorted by lowest atom
+// index, so every kind runs as a single loop with no per-term dispatch. The
+// batches are cut into chunks; a chunk accumulates into the force buffer of
+// the thread running it and the usual reduction combines them. Terms run in
+// double when the atom store has precise forces.
+class BondedForce : public Force
+{
+public:
+	BondedForce(const Topology& topology);
+
+	virtual double Compute(ForceContext& ctx) override;
+	virtual const char* GetName() const override { return "Bonded"; }
+
+	// Per-kind split of the last evaluation
+	const BondedEnergy& GetLastEnergy() const { return m_LastEnergy; }
+
+	template<uint32_t AtomCount, uint32_t ParamCount>
+	struct TermBatch
+	{
+		AlignedVector<uint32_t> Atoms[AtomCount];
+		AlignedVector<float> Params[ParamCount];
+
+		uint32_t Size() const { return static_cast<uint32_t>(Atoms[0].size()); }
+	};
+
+	using BondBatch = TermBatch<2, 2>;       // K, Length
+	using AngleBatch = TermBatch<3, 2>;      // K, Angle
+	using TorsionBatch = TermBatch<4, 3>;    // K, Phase, Multiplicity
+	using RBTorsionBatch = TermBatch<4, 6>;  // C0..C5
+	using ImproperBatch = TermBatch<4, 2>;   // K, Angle
+
+private:
+	enum TermKind : uint32_t
+	{
+		KindBond,
+		KindAngle,
+		KindTorsion,
+		KindRBTorsion,
+		KindImproper
+	};
+
+	struct Chunk
+	{
+		TermKind Kind;
+		uint32_t Begin, End;
+		// Atom range the chunk writes, what the thread marks in its buffer
+		uint32_t TouchedBegin, TouchedEnd;
+	};
+
+	void Compile(uint32_t atomCount);
+	void Partition(uint32_t threadCount);
+	template<typename Real>
+	double ComputeWith(ForceContext& ctx);
+	// Real is float, or double with precise forces
+	template<typename Real>
+	BondedEnergy RunChunk(const Chunk& chunk, const AtomStore& atoms, const SimulationBox& box,
+		Real* forceX, Real* forceY, Real* forceZ) const;
+
+private:
+	const Topology& m_Topology;
+
+	BondBatch m_Bonds;
+	AngleBatch m_Angles;
+	TorsionBatch m_Torsions;
+	RBTorsionBatch m_RBTorsions;
+	ImproperBatch m_Impropers;
+
+	uint64_t m_CompiledRevision = ~0ull;
+	uint32_t m_CompiledAtomCount = 0;
+
+	std::vector<Chunk> m_Chunks;
+	uint32_t m_PartitionThreads = 0;
+
+	struct alignas(64) ThreadEnergy
+	{
+		BondedEnergy Energy;
+	};
+	std::vector<ThreadEnergy> m_ThreadEnergy;
+
+	BondedEnergy m_LastEnergy;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include "../atom_store.h"
+#include "../neighbor_list.h"
+#include "../precision.h"
+#include "../simulation_box.h"
+#include "../thread_force_buffers.h"
+#include "../../threading/thread_pool.h"
+
+
+// Conventional force groups. Multiple-time-step integrators evaluate each
+// group at its own interval, cheap stiff terms every step and the expensive
+// ones less often.
+enum ForceGroup : uint32_t
+{
+	ForceGroupBonded = 0,
+	ForceGroupNonbonded = 1,
+	ForceGroupLongRange = 2,
+
+	MaxForceGroups = 32
+};
+
+constexpr uint32_t AllForceGroups = 0xffffffffu;
+constexpr uint32_t ForceGroupBit(uint32_t group) { return 1u << group; }
+
+// Force arrays one evaluation adds into, float or double
+template<typename T>
+struct ForceArrays
+{
+	T* X;
+	T* Y;
+	T* Z;
+};
+
+struct ForceContext
+{
+	AtomStore& Atoms;
+	const SimulationBox& Box;
+	const NeighborList& Neighbors;
+
+	// With a pool, forces accumulate into Buffers slot of the running thread
+	// and World reduces once after every force ran. Without one they write
+	// straight into the atom store.
+	ThreadPool* Pool;
+	ThreadForceBuffers& Buffers;
+
+	// What the integrators run in. Mixed and Double both sum forces in double,
+	// only Double evaluates the pairs in double too
+	PrecisionMode Precision = PrecisionMode::Single;
+
+	// Forces add the virial sum_i r_i . F_i of their terms here, worked out
+	// inside their own loops; World keeps it per group for the pressure
+	double Virial = 0.0;
+
+	// Forces in double precision go to the precise streams and buffers
+	bool IsPrecise() const { return Atoms.HasPreciseForces(); }
+
+	// Where the pool thread adds its forces, T being double when IsPrecise()
+	template<typename T>
+	ForceArrays<T> GetForces(uint32_t thread) const
+	{
+		if (Pool)
+			return { Buffers.GetX<T>(thread), Buffers.GetY<T>(thread), Buffers.GetZ<T>(thread) };
+		if constexpr (std::is_same_v<T, double>)
+			return { Atoms.PreciseForceX.data(), Atoms.PreciseForceY.data(), Atoms.PreciseForceZ.data() };
+		else
+			return { Atoms.ForceX.data(), Atoms.ForceY.data(), Atoms.ForceZ.data() };
+	}
+};
+
+class Force
+{
+public:
+	Force(uint32_t group = ForceGroupBonded)
+		: m_Group(group) {
+	}
+	virtual ~Force() {}
+
+	// Accumulates this term's forces and returns its potential energy
+	virtual double Compute(ForceContext& ctx) = 0;
+	virtual const char* GetName() const = 0;
+
+	// Forces that read the shared neighbor list report the cutoff they need
+	virtual bool UsesNeighborList() const { return false; }
+	virtual float GetCutoff() const { return 0.0f; }
+
+	uint32_t GetGroup() const { return m_Group; }
+	void SetGroup(uint32_t group) { m_Group = group; }
+
+protected:
+	uint32_t m_Group;
+};
@@ -0,0 +1,379 @@
+#include "nonbonded_force.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#include "../exclusion_list.h"
+#include "../../logging/log.h"
+
+
+NonbondedForce::NonbondedForce()
+	: Force(ForceGroupNonbonded)
+{
+	SetSimdLevel(CpuFeatures::Get().GetBestSimdLevel());
+}
+
+NonbondedForce::NonbondedForce(uint32_t typeCount, float cutoff)
+	: Force(ForceGroupNonbonded), m_Cutoff(cutoff)
+{
+	SetTypeCount(typeCount);
+	SetSimdLevel(CpuFeatures::Get().GetBestSimdLevel());
+}
+
+void NonbondedForce::SetTypeCount(uint32_t typeCount)
+{
+	m_TypeCount = typeCount;
+	m_C12.assign(typeCount * typeCount, 0.0f);
+	m_C6.assign(typeCount * typeCount, 0.0f);
+	m_Potentials.assign(typeCount * typeCount, PairPotential::LennardJones(0.0, 1.0));
+	m_CustomPotentials = false;
+	m_TablesDirty = true;
+}
+
+void NonbondedForce::SetPair(uint32_t a, uint32_t b, float epsilon, float sigma)
+{
+	float s6 = sigma * sigma * sigma * sigma * sigma * sigma;
+
+	m_C6[a * m_TypeCount + b] = m_C6[b * m_TypeCount + a] = 4.0f * epsilon * s6;
+	m_C12[a * m_TypeCount + b] = m_C12[b * m_TypeCount + a] = 4.0f * epsilon * s6 * s6;
+
+	m_Potentials[a * m_TypeCount + b] = m_Potentials[b * m_TypeCount + a] = PairPotential::LennardJones(epsilon, sigma);
+	m_TablesDirty = true;
+}
+
+void NonbondedForce::SetPairPotential(uint32_t a, uint32_t b, const PairPotential& potential)
+{
+	// The analytic kernels see these types as not interacting
+	m_C6[a * m_TypeCount + b] = m_C6[b * m_TypeCount + a] = 0.0f;
+	m_C12[a * m_TypeCount + b] = m_C12[b * m_TypeCount + a] = 0.0f;
+
+	m_Potentials[a * m_TypeCount + b] = m_Potentials[b * m_TypeCount + a] = potential;
+	m_CustomPotentials = true;
+	m_TablesDirty = true;
+}
+
+void NonbondedForce::UpdateTables()
+{
+	if (!m_TablesDirty)
+		return;
+	m_TablesDirty = false;
+
+	if (!m_Tabulated)
+	{
+		if (m_CustomPotentials)
+			PY_CORE_WARN("Nonbonded force has non Lennard-Jones pair potentials but is not tabulated, they are ignored");
+		m_VdwTables.Clear();
+		m_CoulombTable.Clear();
+		return;
+	}
+
+	std::vector<PairPotential> unique;
+	m_TableBase.assign(m_TypeCount * m_TypeCount, 0);
+	for (uint32_t a = 0; a < m_TypeCount; a++)
+	{
+		for (uint32_t b = a; b < m_TypeCount; b++)
+		{
+			m_TableBase[a * m_TypeCount + b] = m_TableBase[b * m_TypeCount + a] = static_cast<uint32_t>(unique.size());
+			unique.push_back(m_Potentials[a * m_TypeCount + b]);
+		}
+	}
+
+	m_VdwTables.Build(unique, m_Cutoff, m_TableProps);
+	m_CoulombTable.Build({ m_EwaldBeta > 0.0f ? PairPotential::EwaldRealSpace(m_EwaldBeta) : PairPotential::Coulomb() }, m_Cutoff, m_TableProps);
+
+	// Table index -> index of its first interval
+	for (uint32_t& base : m_TableBase)
+		base *= m_VdwTables.GetIntervals();
+
+	PY_CORE_INFO("Built {} nonbonded pair tables of {} intervals", unique.size(), m_VdwTables.GetIntervals());
+}
+
+void NonbondedForce::SetSimdLevel(SimdLevel level)
+{
+	SimdLevel best = CpuFeatures::Get().GetBestSimdLevel();
+	if (level > best)
+	{
+		PY_CORE_WARN("{} nonbonded kernel requested but CPU only supports {}", SimdLevelToString(level), SimdLevelToString(best));
+		level = best;
+	}
+
+	m_SimdLevel = level;
+	m_Kernel = GetNonbondedKernel(level);
+	m_KernelMixed = GetNonbondedKernelMixed(level);
+	PY_CORE_INFO("Using {} nonbonded kernel", SimdLevelToString(level));
+}
+
+template<typename Real, typename ForceT>
+BasicNonbondedKernelArgs<Real, ForceT> NonbondedForce::MakeKernelArgs(AtomStore& atoms, const NeighborList& neighbors) const
+{
+	BasicNonbondedKernelArgs<Real, ForceT> args;
+	if constexpr (std::is_same_v<Real, double>)
+	{
+		args.PosX = atoms.PrecisePosX.data();
+		args.PosY = atoms.PrecisePosY.data();
+		args.PosZ = atoms.PrecisePosZ.data();
+	}
+	else
+	{
+		args.PosX = atoms.PosX.data();
+		args.PosY = atoms.PosY.data();
+		args.PosZ = atoms.PosZ.data();
+	}
+	if constexpr (std::is_same_v<ForceT, double>)
+	{
+		args.ForceX = atoms.PreciseForceX.data();
+		args.ForceY = atoms.PreciseForceY.data();
+		args.ForceZ = atoms.PreciseForceZ.data();
+	}
+	else
+	{
+		args.ForceX = atoms.ForceX.data();
+		args.ForceY = atoms.ForceY.data();
+		args.ForceZ = atoms.ForceZ.data();
+	}
+	args.Charge = atoms.Charge.data();
+	args.TypeId = atoms.TypeId.data();
+
+	args.Offsets = neighbors.GetOffsets();
+	args.Neighbors = neighbors.GetNeighbors();
+	args.RowSegments = neighbors.GetRowSegments();
+	args.SegmentOffsets = neighbors.GetSegmentOffsets();
+	args.SegmentShift = neighbors.GetSegmentShifts();
+	args.ShiftVectors = neighbors.GetShiftVectors();
+
+	args.C12 = m_C12.data();
+	args.C6 = m_C6.data();
+	args.TypeCount = m_TypeCount;
+
+	args.CutoffSq = m_Cutoff * m_Cutoff;
+	args.CoulombConstant = m_CoulombConstant;
+	args.EwaldBeta = m_EwaldBeta;
+
+	args.Tabulated = !m_VdwTables.IsEmpty();
+	args.VdwTable = m_VdwTables.GetData();
+	args.VdwTableBase = m_TableBase.data();
+	args.CoulombTable = m_CoulombTable.GetData();
+	args.TableIntervals = static_cast<int32_t>(m_VdwTables.GetIntervals());
+	args.TableMinSq = m_VdwTables.GetMinSq();
+	args.TableInvSpacing = m_VdwTables.GetInvSpacing();
+
+	return args;
+}
+
+double NonbondedForce::Compute(ForceContext& ctx)
+{
+	if (ctx.Pool)
+		m_LastEnergy = Compute(ctx.Atoms, ctx.Neighbors, ctx.Box, *ctx.Pool, ctx.Buffers, ctx.Precision);
+	else
+		m_LastEnergy = Compute(ctx.Atoms, ctx.Neighbors, ctx.Box, ctx.Precision);
+
+	ctx.Virial += m_LastEnergy.Virial;
+	return m_LastEnergy.GetTotal();
+}
+
+NonbondedEnergy NonbondedForce::Compute(AtomStore& atoms, const NeighborList& neighbors, const SimulationBox& box, PrecisionMode precision)
+{
+	switch (precision)
+	{
+	case PrecisionMode::Mixed:  return ComputeSerial<float, double>(atoms, neighbors, box);
+	case PrecisionMode::Double: return ComputeSerial<double, double>(atoms, neighbors, box);
+	default:                    return ComputeSerial<float, float>(atoms, neighbors, box);
+	}
+}
+
+NonbondedEnergy NonbondedForce::Compute(AtomStore& atoms, const NeighborList& neighbors, const SimulationBox& box,
+	ThreadPool& pool, ThreadForceBuffers& buffers, PrecisionMode precision)
+{
+	switch (precision)
+	{
+	case PrecisionMode::Mixed:  return ComputeThreaded<float, double>(atoms, neighbors, box, pool, buffers);
+	case PrecisionMode::Double: return ComputeThreaded<double, double>(atoms, neighbors, box, pool, buffers);
+	default:                    return ComputeThreaded<float, float>(atoms, neighbors, box, pool, buffers);
+	}
+}
+
+template<typename Real, typename ForceT>
+NonbondedEnergy NonbondedForce::RunKernel(const BasicNonbondedKernelArgs<Real, ForceT>& args, uint32_t rowBegin, uint32_t rowEnd) const
+{
+	if constexpr (std::is_same_v<Real, double>)
+		return NonbondedKernelScalarDouble(args, rowBegin, rowEnd);
+	else if constexpr (std::is_same_v<ForceT, double>)
+		return m_KernelMixed(args, rowBegin, rowEnd);
+	else
+		return m_Kernel(args, rowBegin, rowEnd);
+}
+
+template<typename Real, typename ForceT>
+NonbondedEnergy NonbondedForce::ComputeSerial(AtomStore& atoms, const NeighborList& neighbors, const SimulationBox& box)
+{
+	UpdateTables();
+
+	// The list reaches out to cutoff + skin, the kernel drops the extra pairs
+	BasicNonbondedKernelArgs<Real, ForceT> args = MakeKernelArgs<Real, ForceT>(atoms, neighbors);
+	NonbondedEnergy energy = RunKernel(args, 0, neighbors.GetAtomCount());
+
+	if (const ExclusionList* exclusions = neighbors.GetExclusions(); exclusions && exclusions->GetPair14Count())
+		energy += ComputePairs14<Real>(atoms, *exclusions, box, args.ForceX, args.ForceY, args.ForceZ);
+	return energy;
+}
+
+template<typename Real, typename ForceT>
+NonbondedEnergy NonbondedForce::ComputeThreaded(AtomStore& atoms, const NeighborList& neighbors, const SimulationBox& box,
+	ThreadPool& pool, ThreadForceBuffers& buffers)
+{
+	UpdateTables();
+
+	const uint32_t threads = pool.GetThreadCount();
+	if (neighbors.GetBuildId() != m_PartitionBuildId || threads != m_PartitionThreads)
+		PartitionRows(neighbors, threads);
+
+	buffers.Resize(threads, static_cast<uint32_t>(atoms.Size()), std::is_same_v<ForceT, double>);
+	m_ThreadEnergy.assign(threads, ThreadEnergy());
+
+	const BasicNonbondedKernelArgs<Real, ForceT> shared = MakeKernelArgs<Real, ForceT>(atoms, neighbors);
+
+	pool.ParallelFor(static_cast<uint32_t>(m_ChunkBounds.size() - 1), 1, [&](uint32_t begin, uint32_t end, uint32_t thread)
+		{
+			BasicNonbondedKernelArgs<Real, ForceT> args = shared;
+			args.ForceX = buffers.GetX<ForceT>(thread);
+			args.ForceY = buffers.GetY<ForceT>(thread);
+			args.ForceZ = buffers.GetZ<ForceT>(thread);
+
+			for (uint32_t c = begin; c < end; c++)
+			{
+				m_ThreadEnergy[thread].Energy += RunKernel(args, m_ChunkBounds[c], m_ChunkBounds[c + 1]);
+				buffers.MarkTouched(thread, m_ChunkTouchedBegin[c], m_ChunkTouchedEnd[c]);
+			}
+		});
+
+	NonbondedEnergy energy;
+	for (const auto& e : m_ThreadEnergy)
+		energy += e.Energy;
+
+	// Too few 1-4 pairs to split up, they go into the first thread's buffer
+	if (const ExclusionList* exclusions = neighbors.GetExclusions(); exclusions && exclusions->GetPair14Count())
+	{
+		energy += ComputePairs14<Real>(atoms, *exclusions, box, buffers.GetX<ForceT>(0), buffers.GetY<ForceT>(0), buffers.GetZ<ForceT>(0));
+
+		const uint32_t* pairJ = exclusions->GetPair14J();
+		buffers.MarkTouched(0, exclusions->GetPair14I()[0], *std::max_element(pairJ, pairJ + exclusions->GetPair14Count()) + 1);
+	}
+	return energy;
+}
+
+template<typename Real, typename ForceT>
+NonbondedEnergy NonbondedForce::ComputePairs14(const AtomStore& atoms, const ExclusionList& exclusions, const SimulationBox& box,
+	ForceT* forceX, ForceT* forceY, ForceT* forceZ) const
+{
+	using Vec = std::conditional_t<std::is_same_v<Real, double>, glm::dvec3, glm::vec3>;
+	auto position = [&atoms](uint32_t i)
+	{
+		if constexpr (std::is_same_v<Real, double>)
+			return Vec(atoms.PrecisePosX[i], atoms.PrecisePosY[i], atoms.PrecisePosZ[i]);
+		else
+			return atoms.GetPosition(i);
+	};
+
+	const uint32_t* pairI = exclusions.GetPair14I();
+	const uint32_t* pairJ = exclusions.GetPair14J();
+	const uint32_t count = exclusions.GetPair14Count();
+	const bool tabulated = !m_VdwTables.IsEmpty();
+
+	NonbondedEnergy energy;
+	for (uint32_t p = 0; p < count; p++)
+	{
+		const uint32_t i = pairI[p], j = pairJ[p];
+		if (i >= atoms.Size() || j >= atoms.Size())
+			continue;
+
+		// Bonded atoms are close, the minimum image is the one the bonds act across
+		Vec d = position(i) - position(j);
+		if (box.Periodic)
+			d = box.MinimumImage(d);
+		const Real r2 = glm::dot(d, d);
+		if (r2 == Real(0))
+			continue;
+
+		const uint32_t pair = atoms.TypeId[i] * m_TypeCount + atoms.TypeId[j];
+		const Real inv2 = Real(1) / r2;
+
+		Real fscale, lennardJones;
+		if (tabulated)
+		{
+			// Tables are float, so is the lookup
+			float tableScale;
+			lennardJones = m_VdwTables.Evaluate(m_TableBase[pair] / m_VdwTables.GetIntervals(), (float)r2, tableScale);
+			fscale = tableScale;
+		}
+		else
+		{
+			const Real inv6 = inv2 * inv2 * inv2;
+			const Real c12 = m_C12[pair] * inv6 * inv6;
+			const Real c6 = m_C6[pair] * inv6;
+			fscale = (Real(12) * c12 - Real(6) * c6) * inv2;
+			lennardJones = c12 - c6;
+		}
+		fscale *= m_LennardJones14Scale;
+		lennardJones *= m_LennardJones14Scale;
+
+		Real coulomb = 0;
+		if (m_CoulombConstant != 0.0f)
+		{
+			coulomb = Real(m_Coulomb14Scale) * m_CoulombConstant * atoms.Charge[i] * atoms.Charge[j] * std::sqrt(inv2);
+			fscale += coulomb * inv2;
+		}
+
+		forceX[i] += fscale * d.x; forceY[i] += fscale * d.y; forceZ[i] += fscale * d.z;
+		forceX[j] -= fscale * d.x; forceY[j] -= fscale * d.y; forceZ[j] -= fscale * d.z;
+		energy.LennardJones += lennardJones;
+		energy.Coulomb += coulomb;
+		energy.Virial += fscale * r2;
+	}
+	return energy;
+}
+
+void NonbondedForce::PartitionRows(const NeighborList& neighbors, uint32_t threadCount)
+{
+	const uint32_t rows = neighbors.GetAtomCount();
+	const uint32_t* offsets = neighbors.GetOffsets();
+	const uint32_t* list = neighbors.GetNeighbors();
+
+	// Several chunks per thread, cut so each holds about the same number of pairs
+	const uint32_t chunkCount = std::max(1u, std::min(rows, threadCount * 8));
+	const uint64_t pairs = neighbors.GetPairCount();
+
+	m_ChunkBounds.assign(1, 0);
+	for (uint32_t c = 1; c < chunkCount; c++)
+	{
+		uint32_t target = static_cast<uint32_t>(pairs * c / chunkCount);
+		uint32_t row = static_cast<uint32_t>(std::lower_bound(offsets, offsets + rows + 1, target) - offsets);
+		row = std::clamp(row, m_ChunkBounds.back(), rows);
+		if (row > m_ChunkBounds.back())
+			m_ChunkBounds.push_back(row);
+	}
+	if (m_ChunkBounds.back() != rows || m_ChunkBounds.size() == 1)
+		m_ChunkBounds.push_back(rows);
+
+	const size_t chunks = m_ChunkBounds.size() - 1;
+	m_ChunkTouchedBegin.resize(chunks);
+	m_ChunkTouchedEnd.resize(chunks);
+	for (size_t c = 0; c < chunks; c++)
+	{
+		uint32_t lo = m_ChunkBounds[c], hi = m_ChunkBounds[c + 1];
+		for (uint32_t n = offsets[m_ChunkBounds[c]]; n < offsets[m_ChunkBounds[c + 1]]; n++)
+		{
+			lo = std::min(lo, list[n]);
+			hi = std::max(hi, list[n] + 1);
+		}
+		m_ChunkTouchedBegin[c] = lo;
+		m_ChunkTouchedEnd[c] = hi;
+	}
+
+	m_PartitionBuildId = neighbors.GetBuildId();
+	m_PartitionThreads = threadCount;
+}
+
+template NonbondedKernelArgs NonbondedForce::MakeKernelArgs<float, float>(AtomStore& atoms, const NeighborList& neighbors) const;
+template NonbondedKernelArgsMixed NonbondedForce::MakeKernelArgs<float, double>(AtomStore& atoms, const NeighborList& neighbors) const;
+template NonbondedKernelArgsDouble NonbondedForce::MakeKernelArgs<double, double>(AtomStore& atoms, const NeighborList& neighbors) const;
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "../aligned_allocator.h"
+#include "force.h"
+#include "nonbonded_kernels.h"
+#include "pair_table.h"
+
+
+// Short-range pair interactions: 12-6 Lennard-Jones with per-type-pair
+// parameters plus cutoff Coulomb, truncated at a single global cutoff. With an
+// Ewald coefficient set the Coulomb term becomes the real-space part of PME.
+// The inner loop runs through a SIMD kernel picked from the CPU at startup.
+// In tabulated mode every type pair can have an arbitrary PairPotential, the
+// kernels then look both terms up in PairTables instead. In mixed precision
+// the same kernels sum into double force arrays; in double precision the
+// pairs are evaluated in double by the scalar kernel, whatever the SIMD level.
+//
+// Pairs in the neighbor list's ExclusionList are not on the list. Of those,
+// the 1-4 pairs are evaluated here in a separate pass with both terms scaled
+// and plain, untruncated Coulomb; PmeForce takes the mesh's share of every
+// excluded pair back out.
+class NonbondedForce : public Force
+{
+public:
+	NonbondedForce();
+	NonbondedForce(uint32_t typeCount, float cutoff);
+
+	void SetTypeCount(uint32_t typeCount);
+	void SetCutoff(float cutoff) { m_Cutoff = cutoff; m_TablesDirty = true; }
+	// Sets the Lennard-Jones interaction between two atom types, symmetric in a and b
+	void SetPair(uint32_t a, uint32_t b, float epsilon, float sigma);
+	// Any other radial potential between two types, symmetric in a and b. Only
+	// the tabulated kernels can evaluate it
+	void SetPairPotential(uint32_t a, uint32_t b, const PairPotential& potential);
+	// Prefactor of q_i q_j / r, 0 turns electrostatics off
+	void SetCoulombConstant(float constant) { m_CoulombConstant = constant; }
+	// Screens q_i q_j / r by erfc(beta r), 0 restores plain cutoff Coulomb
+	void SetEwaldCoefficient(float beta) { m_EwaldBeta = beta; m_TablesDirty = true; }
+	// Scale factors on the Lennard-Jones and Coulomb terms between atoms three
+	// bonds apart, 0.5 and 1 / 1.2 by default as in AMBER
+	void Set14Scales(float lennardJones, float coulomb) { m_LennardJones14Scale = lennardJones; m_Coulomb14Scale = coulomb; }
+	float GetLennardJones14Scale() const { return m_LennardJones14Scale; }
+	float GetCoulomb14Scale() const { return m_Coulomb14Scale; }
+
+	// Switches between the analytic kernels and table lookups. Tables are
+	// rebuilt on the next evaluation after any parameter changes
+	void SetTabulated(bool tabulated) { m_Tabulated = tabulated; m_TablesDirty = true; }
+	bool IsTabulated() const { return m_Tabulated; }
+	void SetTableProps(const PairTableProps& props) { m_TableProps = props; m_TablesDirty = true; }
+	const PairTableProps& GetTableProps() const { return m_TableProps; }
+	void UpdateTables();
+
+	uint32_t GetTypeCount() const { return m_TypeCount; }
+	float GetCoulombConstant() const { return m_CoulombConstant; }
+	float GetEwaldCoefficient() const { return m_EwaldBeta; }
+
+	virtual double Compute(ForceContext& ctx) override;
+	virtual const char* GetName() const override { return "Nonbonded"; }
+	virtual bool UsesNeighborList() const override { return true; }
+	virtual float GetCutoff() const override { return m_Cutoff; }
+
+	// LJ / Coulomb split of the last evaluation
+	const NonbondedEnergy& GetLastEnergy() const { return m_LastEnergy; }
+
+	// Requested level is clamped to what the CPU supports, Scalar is the reference kernel
+	void SetSimdLevel(SimdLevel level);
+	SimdLevel GetSimdLevel() const { return m_SimdLevel; }
+
+	// Fills the kernel arguments for writing straight into the atom store's
+	// forces, with the tables as of the last UpdateTables. Double positions
+	// and forces are the precise streams
+	template<typename Real = float, typename ForceT = Real>
+	BasicNonbondedKernelArgs<Real, ForceT> MakeKernelArgs(AtomStore& atoms, const NeighborList& neighbors) const;
+	NonbondedKernelFn GetKernel() const { return m_Kernel; }
+
+	// Accumulates forces into the atom store and returns the potential energy,
+	// the 1-4 pairs of the list's exclusions included. The atom store's forces
+	// must match the precision, see ForceContext::Precision
+	NonbondedEnergy Compute(AtomStore& atoms, const NeighborList& neighbors, const SimulationBox& box, PrecisionMode precision);
+	// Runs pair-balanced chunks of neighbor rows on the pool, each thread writing
+	// its own force buffer. The caller reduces the buffers afterwards.
+	NonbondedEnergy Compute(AtomStore& atoms, const NeighborList& neighbors, const SimulationBox& box,
+		ThreadPool& pool, ThreadForceBuffers& buffers, PrecisionMode precision);
+
+private:
+	template<typename Real, typename ForceT>
+	NonbondedEnergy ComputeSerial(AtomStore& atoms, const NeighborList& neighbors, const SimulationBox& box);
+	template<typename Real, typename ForceT>
+	NonbondedEnergy ComputeThreaded(AtomStore& atoms, const NeighborList& neighbors, const SimulationBox& box,
+		ThreadPool& pool, ThreadForceBuffers& buffers);
+	// The kernel for the argument types: the SIMD one in float, its double
+	// accumulating twin in mixed, the scalar one in double
+	template<typename Real, typename ForceT>
+	NonbondedEnergy RunKernel(const BasicNonbondedKernelArgs<Real, ForceT>& args, uint32_t rowBegin, uint32_t rowEnd) const;
+
+	void PartitionRows(const NeighborList& neighbors, uint32_t threadCount);
+	// The scaled 1-4 pass, single threaded, into the given force arrays
+	template<typename Real, typename ForceT>
+	NonbondedEnergy ComputePairs14(const AtomStore& atoms, const ExclusionList& exclusions, const SimulationBox& box,
+		ForceT* forceX, ForceT* forceY, ForceT* forceZ) const;
+
+private:
+	uint32_t m_TypeCount = 0;
+	float m_Cutoff = 1.0f;
+	float m_CoulombConstant = 0.0f;
+	float m_EwaldBeta = 0.0f;
+	float m_LennardJones14Scale = 0.5f;
+	float m_Coulomb14Scale = 1.0f / 1.2f;
+
+	AlignedVector<float> m_C12;   // 4 * epsilon * sigma^12
+	AlignedVector<float> m_C6;    // 4 * epsilon * sigma^6
+
+	// Per type pair, symmetric like m_C12, and whether any is not Lennard-Jones
+	std::vector<PairPotential> m_Potentials;
+	bool m_CustomPotentials = false;
+
+	bool m_Tabulated = false;
+	bool m_TablesDirty = true;
+	PairTableProps m_TableProps;
+	PairTable m_VdwTables;         // one table per unordered type pair
+	PairTable m_CoulombTable;      // unit charges, scaled by q_i q_j C in the kernel
+	std::vector<uint32_t> m_TableBase;
+
+	SimdLevel m_SimdLevel = SimdLevel::Scalar;
+	NonbondedKernelFn m_Kernel = NonbondedKernelScalar;
+	NonbondedKernelMixedFn m_KernelMixed = NonbondedKernelScalarMixed;
+
+	// Row chunks and the atom range each one writes, redone after every list rebuild
+	std::vector<uint32_t> m_ChunkBounds;
+	std::vector<uint32_t> m_ChunkTouchedBegin;
+	std::vector<uint32_t> m_ChunkTouchedEnd;
+	uint64_t m_PartitionBuildId = ~0ull;
+	uint32_t m_PartitionThreads = 0;
+
+	struct alignas(64) ThreadEnergy
+	{
+		NonbondedEnergy Energy;
+	};
+	std::vector<ThreadEnergy> m_ThreadEnergy;
+
+	NonbondedEnergy m_LastEnergy;
+};
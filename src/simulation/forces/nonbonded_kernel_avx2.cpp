@@ -0,0 +1,223 @@
+#include "nonbonded_kernel_common.h"
+
+#if PY_SIMD_X86
+#include <immintrin.h>
+
+
+namespace
+{
+	inline float HorizontalSum(__m256 v)
+	{
+		__m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		__m128 shuf = _mm_movehdup_ps(lo);
+		__m128 sums = _mm_add_ps(lo, shuf);
+		shuf = _mm_movehl_ps(shuf, sums);
+		return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+	}
+
+	inline __m256 Exp(__m256 x)
+	{
+		x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(ExpLo)), _mm256_set1_ps(ExpHi));
+		__m256 fx = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(Log2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+		x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(ExpC1), x);
+		x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(ExpC2), x);
+
+		__m256 y = _mm256_set1_ps(ExpP0);
+		y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(ExpP1));
+		y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(ExpP2));
+		y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(ExpP3));
+		y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(ExpP4));
+		y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(ExpP5));
+		y = _mm256_add_ps(_mm256_fmadd_ps(y, _mm256_mul_ps(x, x), x), _mm256_set1_ps(1.0f));
+
+		__m256i n = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(fx), _mm256_set1_epi32(127)), 23);
+		return _mm256_mul_ps(y, _mm256_castsi256_ps(n));
+	}
+
+	// erfc(br) / r real-space Ewald term; returns the pair energy and adds the force to fs
+	inline __m256 EwaldPair(__m256 qq, __m256 r2, __m256 inv2, __m256 beta, __m256& fs)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+
+		__m256 invR = _mm256_sqrt_ps(inv2);
+		__m256 br = _mm256_mul_ps(beta, _mm256_mul_ps(r2, invR));
+		__m256 expTerm = Exp(_mm256_sub_ps(_mm256_setzero_ps(), _mm256_mul_ps(br, br)));
+
+		__m256 t = _mm256_div_ps(one, _mm256_fmadd_ps(_mm256_set1_ps(ErfcP), br, one));
+		__m256 poly = _mm256_fmadd_ps(_mm256_set1_ps(ErfcA5), t, _mm256_set1_ps(ErfcA4));
+		poly = _mm256_fmadd_ps(poly, t, _mm256_set1_ps(ErfcA3));
+		poly = _mm256_fmadd_ps(poly, t, _mm256_set1_ps(ErfcA2));
+		poly = _mm256_fmadd_ps(poly, t, _mm256_set1_ps(ErfcA1));
+		poly = _mm256_mul_ps(poly, t);
+
+		__m256 e = _mm256_mul_ps(_mm256_mul_ps(qq, _mm256_mul_ps(poly, expTerm)), invR);
+		__m256 de = _mm256_mul_ps(_mm256_mul_ps(qq, _mm256_mul_ps(beta, _mm256_set1_ps(TwoOverSqrtPi))), expTerm);
+		fs = _mm256_fmadd_ps(_mm256_add_ps(e, de), inv2, fs);
+		return e;
+	}
+
+	// Cubic of the PairTable interval under r2; returns U and sets fs = -2 dU/d(r^2).
+	// Indices are clamped to the table, so lanes past the cutoff read valid memory
+	inline __m256 TableLookup(const float* table, __m256i base, __m256 r2, __m256 minSq, __m256 invH, __m256i last, __m256& fs)
+	{
+		__m256 x = _mm256_mul_ps(_mm256_sub_ps(r2, minSq), invH);
+		__m256i k = _mm256_cvttps_epi32(_mm256_round_ps(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));
+		k = _mm256_min_epi32(_mm256_max_epi32(k, _mm256_setzero_si256()), last);
+		__m256 t = _mm256_sub_ps(x, _mm256_cvtepi32_ps(k));
+
+		__m256i index = _mm256_slli_epi32(_mm256_add_epi32(base, k), 2);
+		__m256 c0 = _mm256_i32gather_ps(table, index, 4);
+		__m256 c1 = _mm256_i32gather_ps(table + 1, index, 4);
+		__m256 c2 = _mm256_i32gather_ps(table + 2, index, 4);
+		__m256 c3 = _mm256_i32gather_ps(table + 3, index, 4);
+
+		__m256 dudt = _mm256_fmadd_ps(t, _mm256_fmadd_ps(_mm256_set1_ps(3.0f), _mm256_mul_ps(t, c3), _mm256_add_ps(c2, c2)), c1);
+		fs = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(-2.0f), invH), dudt);
+		return _mm256_fmadd_ps(t, _mm256_fmadd_ps(t, _mm256_fmadd_ps(t, c3, c2), c1), c0);
+	}
+
+	template<int Coulomb, bool Tabulated>
+	struct AVX2Kernel
+	{
+		template<typename ForceT>
+		static NonbondedEnergy Run(const BasicNonbondedKernelArgs<float, ForceT>& a, uint32_t rowBegin, uint32_t rowEnd)
+		{
+			const __m256 cutoff2 = _mm256_set1_ps(a.CutoffSq);
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 one = _mm256_set1_ps(1.0f);
+			const __m256 twelve = _mm256_set1_ps(12.0f);
+			const __m256 six = _mm256_set1_ps(6.0f);
+			const __m256 beta = _mm256_set1_ps(a.EwaldBeta);
+			const __m256 tableMin = _mm256_set1_ps(a.TableMinSq), tableInv = _mm256_set1_ps(a.TableInvSpacing);
+			const __m256i tableLast = _mm256_set1_epi32(a.TableIntervals - 1);
+
+			const int* typeIds = reinterpret_cast<const int*>(a.TypeId);
+
+			double elj = 0.0, ec = 0.0, virial = 0.0;
+
+			for (uint32_t i = rowBegin; i < rowEnd; i++)
+			{
+				const uint32_t typeRow = a.TypeId[i] * a.TypeCount;
+				const __m256i typeRowV = _mm256_set1_epi32((int)typeRow);
+
+				const __m256 qi = _mm256_set1_ps(a.Charge[i] * a.CoulombConstant);
+
+				__m256 fxi = zero, fyi = zero, fzi = zero;
+				__m256 eljV = zero, ecV = zero, virialV = zero;
+
+				ForceT fxs = 0, fys = 0, fzs = 0;
+
+				// One run of neighbors per periodic image, x_i is shifted once per run
+				for (uint32_t s = a.RowSegments[i]; s < a.RowSegments[i + 1]; s++)
+				{
+					const float* shift = a.ShiftVectors + 3 * a.SegmentShift[s];
+					const float sx = a.PosX[i] + shift[0], sy = a.PosY[i] + shift[1], sz = a.PosZ[i] + shift[2];
+					const __m256 xi = _mm256_set1_ps(sx), yi = _mm256_set1_ps(sy), zi = _mm256_set1_ps(sz);
+
+					uint32_t n = a.SegmentOffsets[s];
+					const uint32_t nEnd = a.SegmentOffsets[s + 1];
+
+					for (; n + 8 <= nEnd; n += 8)
+					{
+						const __m256i j = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.Neighbors + n));
+
+						__m256 dx = _mm256_sub_ps(xi, _mm256_i32gather_ps(a.PosX, j, 4));
+						__m256 dy = _mm256_sub_ps(yi, _mm256_i32gather_ps(a.PosY, j, 4));
+						__m256 dz = _mm256_sub_ps(zi, _mm256_i32gather_ps(a.PosZ, j, 4));
+
+						__m256 r2 = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+						__m256 mask = _mm256_and_ps(_mm256_cmp_ps(r2, cutoff2, _CMP_LT_OQ), _mm256_cmp_ps(r2, zero, _CMP_GT_OQ));
+						if (_mm256_movemask_ps(mask) == 0)
+							continue;
+
+						__m256 fs;
+						if constexpr (Tabulated)
+						{
+							__m256i pair = _mm256_add_epi32(typeRowV, _mm256_i32gather_epi32(typeIds, j, 4));
+							__m256i base = _mm256_i32gather_epi32(reinterpret_cast<const int*>(a.VdwTableBase), pair, 4);
+							__m256 e = TableLookup(a.VdwTable, base, r2, tableMin, tableInv, tableLast, fs);
+							eljV = _mm256_add_ps(eljV, _mm256_and_ps(mask, e));
+
+							if constexpr (Coulomb != CoulombNone)
+							{
+								__m256 qq = _mm256_mul_ps(qi, _mm256_i32gather_ps(a.Charge, j, 4));
+								__m256 fc;
+								__m256 ecPair = _mm256_mul_ps(qq, TableLookup(a.CoulombTable, _mm256_setzero_si256(), r2, tableMin, tableInv, tableLast, fc));
+								fs = _mm256_fmadd_ps(qq, fc, fs);
+								ecV = _mm256_add_ps(ecV, _mm256_and_ps(mask, ecPair));
+							}
+						}
+						else
+						{
+							// Masked-out lanes divide by one instead of zero or a huge distance
+							__m256 inv2 = _mm256_div_ps(one, _mm256_blendv_ps(one, r2, mask));
+							__m256 inv6 = _mm256_mul_ps(_mm256_mul_ps(inv2, inv2), inv2);
+
+							__m256i pair = _mm256_add_epi32(typeRowV, _mm256_i32gather_epi32(typeIds, j, 4));
+							__m256 c12 = _mm256_mul_ps(_mm256_i32gather_ps(a.C12, pair, 4), _mm256_mul_ps(inv6, inv6));
+							__m256 c6 = _mm256_mul_ps(_mm256_i32gather_ps(a.C6, pair, 4), inv6);
+
+							fs = _mm256_mul_ps(_mm256_fmsub_ps(twelve, c12, _mm256_mul_ps(six, c6)), inv2);
+							eljV = _mm256_add_ps(eljV, _mm256_and_ps(mask, _mm256_sub_ps(c12, c6)));
+
+							if constexpr (Coulomb == CoulombPlain)
+							{
+								__m256 qj = _mm256_i32gather_ps(a.Charge, j, 4);
+								__m256 e = _mm256_mul_ps(_mm256_mul_ps(qi, qj), _mm256_sqrt_ps(inv2));
+								fs = _mm256_fmadd_ps(e, inv2, fs);
+								ecV = _mm256_add_ps(ecV, _mm256_and_ps(mask, e));
+							}
+							else if constexpr (Coulomb == CoulombEwald)
+							{
+								__m256 qj = _mm256_i32gather_ps(a.Charge, j, 4);
+								__m256 e = EwaldPair(_mm256_mul_ps(qi, qj), _mm256_blendv_ps(one, r2, mask), inv2, beta, fs);
+								ecV = _mm256_add_ps(ecV, _mm256_and_ps(mask, e));
+							}
+						}
+
+						fs = _mm256_and_ps(mask, fs);
+						virialV = _mm256_fmadd_ps(fs, r2, virialV);
+						__m256 fx = _mm256_mul_ps(fs, dx), fy = _mm256_mul_ps(fs, dy), fz = _mm256_mul_ps(fs, dz);
+						fxi = _mm256_add_ps(fxi, fx); fyi = _mm256_add_ps(fyi, fy); fzi = _mm256_add_ps(fzi, fz);
+
+						// AVX2 has no scatter; neighbors within a row are distinct so lanes never collide
+						alignas(32) float tx[8], ty[8], tz[8];
+						_mm256_store_ps(tx, fx); _mm256_store_ps(ty, fy); _mm256_store_ps(tz, fz);
+						const uint32_t* jj = a.Neighbors + n;
+						for (int k = 0; k < 8; k++)
+						{
+							a.ForceX[jj[k]] -= tx[k]; a.ForceY[jj[k]] -= ty[k]; a.ForceZ[jj[k]] -= tz[k];
+						}
+					}
+
+					ProcessRowScalar<Coulomb, Tabulated>(a, i, sx, sy, sz, n, nEnd, fxs, fys, fzs, elj, ec, virial);
+				}
+
+				fxs += HorizontalSum(fxi); fys += HorizontalSum(fyi); fzs += HorizontalSum(fzi);
+				elj += HorizontalSum(eljV);
+				ec += HorizontalSum(ecV);
+				virial += HorizontalSum(virialV);
+
+				a.ForceX[i] += fxs; a.ForceY[i] += fys; a.ForceZ[i] += fzs;
+			}
+
+			NonbondedEnergy energy;
+			energy.LennardJones = elj;
+			energy.Coulomb = ec;
+			energy.Virial = virial;
+			return energy;
+		}
+	};
+}
+
+NonbondedEnergy NonbondedKernelAVX2(const NonbondedKernelArgs& args, uint32_t rowBegin, uint32_t rowEnd)
+{
+	return DispatchVariant<AVX2Kernel>(args, rowBegin, rowEnd);
+}
+
+NonbondedEnergy NonbondedKernelAVX2Mixed(const NonbondedKernelArgsMixed& args, uint32_t rowBegin, uint32_t rowEnd)
+{
+	return DispatchVariant<AVX2Kernel>(args, rowBegin, rowEnd);
+}
+
+#endif
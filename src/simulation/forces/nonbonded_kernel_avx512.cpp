@@ -0,0 +1,226 @@
+#include "nonbonded_kernel_common.h"
+
+#if PY_SIMD_X86
+#include <immintrin.h>
+
+
+namespace
+{
+	inline __m512 Exp(__m512 x)
+	{
+		x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(ExpLo)), _mm512_set1_ps(ExpHi));
+		__m512 fx = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(Log2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+		x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(ExpC1), x);
+		x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(ExpC2), x);
+
+		__m512 y = _mm512_set1_ps(ExpP0);
+		y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(ExpP1));
+		y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(ExpP2));
+		y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(ExpP3));
+		y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(ExpP4));
+		y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(ExpP5));
+		y = _mm512_add_ps(_mm512_fmadd_ps(y, _mm512_mul_ps(x, x), x), _mm512_set1_ps(1.0f));
+
+		// scalef multiplies by 2^fx directly, no exponent bit tricks needed
+		return _mm512_scalef_ps(y, fx);
+	}
+
+	// erfc(br) / r real-space Ewald term; returns the pair energy and adds the force to fs
+	inline __m512 EwaldPair(__m512 qq, __m512 r2, __m512 inv2, __m512 beta, __m512& fs)
+	{
+		const __m512 one = _mm512_set1_ps(1.0f);
+
+		__m512 invR = _mm512_sqrt_ps(inv2);
+		__m512 br = _mm512_mul_ps(beta, _mm512_mul_ps(r2, invR));
+		__m512 expTerm = Exp(_mm512_sub_ps(_mm512_setzero_ps(), _mm512_mul_ps(br, br)));
+
+		__m512 t = _mm512_div_ps(one, _mm512_fmadd_ps(_mm512_set1_ps(ErfcP), br, one));
+		__m512 poly = _mm512_fmadd_ps(_mm512_set1_ps(ErfcA5), t, _mm512_set1_ps(ErfcA4));
+		poly = _mm512_fmadd_ps(poly, t, _mm512_set1_ps(ErfcA3));
+		poly = _mm512_fmadd_ps(poly, t, _mm512_set1_ps(ErfcA2));
+		poly = _mm512_fmadd_ps(poly, t, _mm512_set1_ps(ErfcA1));
+		poly = _mm512_mul_ps(poly, t);
+
+		__m512 e = _mm512_mul_ps(_mm512_mul_ps(qq, _mm512_mul_ps(poly, expTerm)), invR);
+		__m512 de = _mm512_mul_ps(_mm512_mul_ps(qq, _mm512_mul_ps(beta, _mm512_set1_ps(TwoOverSqrtPi))), expTerm);
+		fs = _mm512_fmadd_ps(_mm512_add_ps(e, de), inv2, fs);
+		return e;
+	}
+
+	// Cubic of the PairTable interval under r2; returns U and sets fs = -2 dU/d(r^2).
+	// Masked-out lanes load nothing and come back as zero
+	inline __m512 TableLookup(const float* table, __m512i base, __m512 r2, __mmask16 mask, __m512 minSq, __m512 invH, __m512i last, __m512& fs)
+	{
+		const __m512 zero = _mm512_setzero_ps();
+
+		__m512 x = _mm512_mul_ps(_mm512_sub_ps(r2, minSq), invH);
+		__m512i k = _mm512_cvttps_epi32(_mm512_roundscale_ps(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));
+		k = _mm512_min_epi32(_mm512_max_epi32(k, _mm512_setzero_si512()), last);
+		__m512 t = _mm512_sub_ps(x, _mm512_cvtepi32_ps(k));
+
+		__m512i index = _mm512_slli_epi32(_mm512_add_epi32(base, k), 2);
+		__m512 c0 = _mm512_mask_i32gather_ps(zero, mask, index, table, 4);
+		__m512 c1 = _mm512_mask_i32gather_ps(zero, mask, index, table + 1, 4);
+		__m512 c2 = _mm512_mask_i32gather_ps(zero, mask, index, table + 2, 4);
+		__m512 c3 = _mm512_mask_i32gather_ps(zero, mask, index, table + 3, 4);
+
+		__m512 dudt = _mm512_fmadd_ps(t, _mm512_fmadd_ps(_mm512_set1_ps(3.0f), _mm512_mul_ps(t, c3), _mm512_add_ps(c2, c2)), c1);
+		fs = _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(-2.0f), invH), dudt);
+		return _mm512_fmadd_ps(t, _mm512_fmadd_ps(t, _mm512_fmadd_ps(t, c3, c2), c1), c0);
+	}
+
+	// force[j] -= f on the masked lanes. Neighbors within a row are distinct,
+	// so gather-subtract-scatter has no conflicts
+	inline void ScatterSubtract(float* force, __mmask16 mask, __m512i j, __m512 f)
+	{
+		__m512 fj = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, j, force, 4);
+		_mm512_mask_i32scatter_ps(force, mask, j, _mm512_sub_ps(fj, f), 4);
+	}
+
+	// Double forces go eight lanes at a time, widened before the subtraction
+	inline void ScatterSubtract(double* force, __mmask16 mask, __m512i j, __m512 f)
+	{
+		const __m256i jLo = _mm512_castsi512_si256(j), jHi = _mm512_extracti64x4_epi64(j, 1);
+		const __mmask8 maskLo = (__mmask8)mask, maskHi = (__mmask8)(mask >> 8);
+
+		__m512d fjLo = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), maskLo, jLo, force, 8);
+		__m512d fjHi = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), maskHi, jHi, force, 8);
+		_mm512_mask_i32scatter_pd(force, maskLo, jLo, _mm512_sub_pd(fjLo, _mm512_cvtps_pd(_mm512_castps512_ps256(f))), 8);
+		_mm512_mask_i32scatter_pd(force, maskHi, jHi, _mm512_sub_pd(fjHi, _mm512_cvtps_pd(_mm512_extractf32x8_ps(f, 1))), 8);
+	}
+
+	template<int Coulomb, bool Tabulated>
+	struct AVX512Kernel
+	{
+		template<typename ForceT>
+		static NonbondedEnergy Run(const BasicNonbondedKernelArgs<float, ForceT>& a, uint32_t rowBegin, uint32_t rowEnd)
+		{
+			const __m512 cutoff2 = _mm512_set1_ps(a.CutoffSq);
+			const __m512 zero = _mm512_setzero_ps();
+			const __m512 one = _mm512_set1_ps(1.0f);
+			const __m512 twelve = _mm512_set1_ps(12.0f);
+			const __m512 six = _mm512_set1_ps(6.0f);
+			const __m512 beta = _mm512_set1_ps(a.EwaldBeta);
+			const __m512 tableMin = _mm512_set1_ps(a.TableMinSq), tableInv = _mm512_set1_ps(a.TableInvSpacing);
+			const __m512i tableLast = _mm512_set1_epi32(a.TableIntervals - 1);
+
+			double elj = 0.0, ec = 0.0, virial = 0.0;
+
+			for (uint32_t i = rowBegin; i < rowEnd; i++)
+			{
+				const uint32_t typeRow = a.TypeId[i] * a.TypeCount;
+				const __m512i typeRowV = _mm512_set1_epi32((int)typeRow);
+
+				const __m512 qi = _mm512_set1_ps(a.Charge[i] * a.CoulombConstant);
+
+				__m512 fxi = zero, fyi = zero, fzi = zero;
+				__m512 eljV = zero, ecV = zero, virialV = zero;
+
+				ForceT fxs = 0, fys = 0, fzs = 0;
+
+				// One run of neighbors per periodic image, x_i is shifted once per run
+				for (uint32_t s = a.RowSegments[i]; s < a.RowSegments[i + 1]; s++)
+				{
+					const float* shift = a.ShiftVectors + 3 * a.SegmentShift[s];
+					const float sx = a.PosX[i] + shift[0], sy = a.PosY[i] + shift[1], sz = a.PosZ[i] + shift[2];
+					const __m512 xi = _mm512_set1_ps(sx), yi = _mm512_set1_ps(sy), zi = _mm512_set1_ps(sz);
+
+					uint32_t n = a.SegmentOffsets[s];
+					const uint32_t nEnd = a.SegmentOffsets[s + 1];
+
+					for (; n + 16 <= nEnd; n += 16)
+					{
+						const __m512i j = _mm512_loadu_si512(a.Neighbors + n);
+
+						__m512 dx = _mm512_sub_ps(xi, _mm512_i32gather_ps(j, a.PosX, 4));
+						__m512 dy = _mm512_sub_ps(yi, _mm512_i32gather_ps(j, a.PosY, 4));
+						__m512 dz = _mm512_sub_ps(zi, _mm512_i32gather_ps(j, a.PosZ, 4));
+
+						__m512 r2 = _mm512_fmadd_ps(dz, dz, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dx, dx)));
+						__mmask16 mask = _mm512_cmp_ps_mask(r2, cutoff2, _CMP_LT_OQ) & _mm512_cmp_ps_mask(r2, zero, _CMP_GT_OQ);
+						if (mask == 0)
+							continue;
+
+						__m512i pair = _mm512_add_epi32(typeRowV, _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), mask, j, a.TypeId, 4));
+
+						__m512 fs;
+						if constexpr (Tabulated)
+						{
+							__m512i base = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), mask, pair, a.VdwTableBase, 4);
+							eljV = _mm512_add_ps(eljV, TableLookup(a.VdwTable, base, r2, mask, tableMin, tableInv, tableLast, fs));
+
+							if constexpr (Coulomb != CoulombNone)
+							{
+								__m512 qq = _mm512_mul_ps(qi, _mm512_mask_i32gather_ps(zero, mask, j, a.Charge, 4));
+								__m512 fc;
+								__m512 ecPair = _mm512_mul_ps(qq, TableLookup(a.CoulombTable, _mm512_setzero_si512(), r2, mask, tableMin, tableInv, tableLast, fc));
+								fs = _mm512_fmadd_ps(qq, fc, fs);
+								ecV = _mm512_add_ps(ecV, ecPair);
+							}
+						}
+						else
+						{
+							__m512 inv2 = _mm512_maskz_div_ps(mask, one, r2);
+							__m512 inv6 = _mm512_mul_ps(_mm512_mul_ps(inv2, inv2), inv2);
+
+							__m512 c12 = _mm512_mul_ps(_mm512_mask_i32gather_ps(zero, mask, pair, a.C12, 4), _mm512_mul_ps(inv6, inv6));
+							__m512 c6 = _mm512_mul_ps(_mm512_mask_i32gather_ps(zero, mask, pair, a.C6, 4), inv6);
+
+							fs = _mm512_mul_ps(_mm512_fmsub_ps(twelve, c12, _mm512_mul_ps(six, c6)), inv2);
+							eljV = _mm512_add_ps(eljV, _mm512_sub_ps(c12, c6));
+
+							if constexpr (Coulomb == CoulombPlain)
+							{
+								__m512 qj = _mm512_mask_i32gather_ps(zero, mask, j, a.Charge, 4);
+								__m512 e = _mm512_mul_ps(_mm512_mul_ps(qi, qj), _mm512_sqrt_ps(inv2));
+								fs = _mm512_fmadd_ps(e, inv2, fs);
+								ecV = _mm512_add_ps(ecV, e);
+							}
+							else if constexpr (Coulomb == CoulombEwald)
+							{
+								// Masked-out lanes have qj = 0 and inv2 = 0, so they contribute nothing
+								__m512 qj = _mm512_mask_i32gather_ps(zero, mask, j, a.Charge, 4);
+								ecV = _mm512_add_ps(ecV, EwaldPair(_mm512_mul_ps(qi, qj), r2, inv2, beta, fs));
+							}
+						}
+
+						virialV = _mm512_mask3_fmadd_ps(fs, r2, virialV, mask);
+						__m512 fx = _mm512_mul_ps(fs, dx), fy = _mm512_mul_ps(fs, dy), fz = _mm512_mul_ps(fs, dz);
+						fxi = _mm512_add_ps(fxi, fx); fyi = _mm512_add_ps(fyi, fy); fzi = _mm512_add_ps(fzi, fz);
+
+						ScatterSubtract(a.ForceX, mask, j, fx);
+						ScatterSubtract(a.ForceY, mask, j, fy);
+						ScatterSubtract(a.ForceZ, mask, j, fz);
+					}
+
+					ProcessRowScalar<Coulomb, Tabulated>(a, i, sx, sy, sz, n, nEnd, fxs, fys, fzs, elj, ec, virial);
+				}
+
+				fxs += _mm512_reduce_add_ps(fxi); fys += _mm512_reduce_add_ps(fyi); fzs += _mm512_reduce_add_ps(fzi);
+				elj += _mm512_reduce_add_ps(eljV);
+				ec += _mm512_reduce_add_ps(ecV);
+				virial += _mm512_reduce_add_ps(virialV);
+
+				a.ForceX[i] += fxs; a.ForceY[i] += fys; a.ForceZ[i] += fzs;
+			}
+
+			NonbondedEnergy energy;
+			energy.LennardJones = elj;
+			energy.Coulomb = ec;
+			energy.Virial = virial;
+			return energy;
+		}
+	};
+}
+
+NonbondedEnergy NonbondedKernelAVX512(const NonbondedKernelArgs& args, uint32_t rowBegin, uint32_t rowEnd)
+{
+	return DispatchVariant<AVX512Kernel>(args, rowBegin, rowEnd);
+}
+
+NonbondedEnergy NonbondedKernelAVX512Mixed(const NonbondedKernelArgsMixed& args, uint32_t rowBegin, uint32_t rowEnd)
+{
+	return DispatchVariant<AVX512Kernel>(args, rowBegin, rowEnd);
+}
+
+#endif
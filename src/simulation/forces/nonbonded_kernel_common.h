@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#include "nonbonded_kernels.h"
+
+// Everything here has internal linkage so each kernel translation unit gets
+// its own copy compiled for its own instruction set.
+namespace
+{
+	enum CoulombMode
+	{
+		CoulombNone = 0,
+		CoulombPlain,
+		CoulombEwald
+	};
+
+	// 2 / sqrt(pi), in double for the double kernel
+	constexpr double TwoOverSqrtPi = 1.1283791670955126;
+
+	// Abramowitz & Stegun 7.1.26, erfc(x) ~ t * poly(t) * exp(-x^2) with
+	// t = 1 / (1 + p x) and |error| < 1.5e-7. The SIMD kernels use it since the
+	// exp(-x^2) factor is needed for the force anyway, scalar code calls std::erfc
+	constexpr float ErfcP = 0.3275911f;
+	constexpr float ErfcA1 = 0.254829592f;
+	constexpr float ErfcA2 = -0.284496736f;
+	constexpr float ErfcA3 = 1.421413741f;
+	constexpr float ErfcA4 = -1.453152027f;
+	constexpr float ErfcA5 = 1.061405429f;
+
+	// Cephes expf constants for 2^n * p(r) range reduction. The clamp keeps n
+	// inside the normal exponent range so 2^n can be built from integer bits
+	constexpr float ExpHi = 88.0f;
+	constexpr float ExpLo = -87.0f;
+	constexpr float Log2e = 1.44269504088896341f;
+	constexpr float ExpC1 = 0.693359375f;
+	constexpr float ExpC2 = -2.12194440e-4f;
+	constexpr float ExpP0 = 1.9875691500e-4f;
+	constexpr float ExpP1 = 1.3981999507e-3f;
+	constexpr float ExpP2 = 8.3334519073e-3f;
+	constexpr float ExpP3 = 4.1665795894e-2f;
+	constexpr float ExpP4 = 1.6666665459e-1f;
+	constexpr float ExpP5 = 5.0000001201e-1f;
+
+	// Cubic in t of one PairTable interval; returns U and sets fscale = -2 dU/d(r^2)
+	template<typename Real, typename ForceT>
+	inline Real TableLookupScalar(const BasicNonbondedKernelArgs<Real, ForceT>& a, const float* table, uint32_t base, Real r2, Real& fscale)
+	{
+		Real x = (r2 - a.TableMinSq) * a.TableInvSpacing;
+		int k = static_cast<int>(std::floor(x));
+		k = k < 0 ? 0 : (k >= a.TableIntervals ? a.TableIntervals - 1 : k);
+		Real t = x - static_cast<Real>(k);
+
+		const float* c = table + (size_t(base) + k) * 4;
+		fscale = Real(-2) * a.TableInvSpacing * (c[1] + t * (Real(2) * c[2] + Real(3) * t * c[3]));
+		return c[0] + t * (c[1] + t * (c[2] + t * c[3]));
+	}
+
+	template<typename Real>
+	struct ScalarPairResult
+	{
+		Real FScale;
+		Real LennardJones;
+		Real Coulomb;
+	};
+
+	// (xi, yi, zi) is atom i already moved by its segment's shift vector
+	template<int Coulomb, bool Tabulated, typename Real, typename ForceT>
+	inline bool EvaluatePairScalar(const BasicNonbondedKernelArgs<Real, ForceT>& a, Real xi, Real yi, Real zi, uint32_t j, uint32_t typeRow, Real qi,
+		Real& dx, Real& dy, Real& dz, ScalarPairResult<Real>& out)
+	{
+		dx = xi - a.PosX[j];
+		dy = yi - a.PosY[j];
+		dz = zi - a.PosZ[j];
+
+		Real r2 = dx * dx + dy * dy + dz * dz;
+		if (!(r2 < a.CutoffSq) || r2 == Real(0))
+			return false;
+
+		uint32_t pair = typeRow + a.TypeId[j];
+
+		if constexpr (Tabulated)
+		{
+			out.LennardJones = TableLookupScalar(a, a.VdwTable, a.VdwTableBase[pair], r2, out.FScale);
+			out.Coulomb = 0;
+
+			if constexpr (Coulomb != CoulombNone)
+			{
+				Real qq = qi * a.Charge[j], fc;
+				out.Coulomb = qq * TableLookupScalar(a, a.CoulombTable, 0, r2, fc);
+				out.FScale += qq * fc;
+			}
+			return true;
+		}
+
+		Real inv2 = Real(1) / r2;
+		Real inv6 = inv2 * inv2 * inv2;
+		Real c12 = a.C12[pair] * inv6 * inv6;
+		Real c6 = a.C6[pair] * inv6;
+
+		// F = -dU/dr * r_hat, folded into a scalar multiplying (dx, dy, dz)
+		out.FScale = (Real(12) * c12 - Real(6) * c6) * inv2;
+		out.LennardJones = c12 - c6;
+		out.Coulomb = 0;
+
+		if constexpr (Coulomb == CoulombPlain)
+		{
+			Real ec = qi * a.Charge[j] * std::sqrt(inv2);
+			out.FScale += ec * inv2;
+			out.Coulomb = ec;
+		}
+		else if constexpr (Coulomb == CoulombEwald)
+		{
+			Real qq = qi * a.Charge[j];
+			Real invR = std::sqrt(inv2);
+			Real br = a.EwaldBeta * r2 * invR;
+			Real expTerm = std::exp(-br * br);
+
+			Real ec = qq * std::erfc(br) * invR;
+			out.FScale += (ec + qq * a.EwaldBeta * Real(TwoOverSqrtPi) * expTerm) * inv2;
+			out.Coulomb = ec;
+		}
+
+		return true;
+	}
+
+	// Handles the neighbors [n, nEnd) of one shift segment of row i one by one,
+	// used for SIMD tails. Row sums are kept in the force type
+	template<int Coulomb, bool Tabulated, typename Real, typename ForceT>
+	inline void ProcessRowScalar(const BasicNonbondedKernelArgs<Real, ForceT>& a, uint32_t i, Real xi, Real yi, Real zi, uint32_t n, uint32_t nEnd,
+		ForceT& fxi, ForceT& fyi, ForceT& fzi, double& elj, double& ec, double& virial)
+	{
+		const uint32_t typeRow = a.TypeId[i] * a.TypeCount;
+		const Real qi = a.Charge[i] * a.CoulombConstant;
+
+		for (; n < nEnd; n++)
+		{
+			uint32_t j = a.Neighbors[n];
+			Real dx, dy, dz;
+			ScalarPairResult<Real> pair;
+			if (!EvaluatePairScalar<Coulomb, Tabulated>(a, xi, yi, zi, j, typeRow, qi, dx, dy, dz, pair))
+				continue;
+
+			fxi += pair.FScale * dx; fyi += pair.FScale * dy; fzi += pair.FScale * dz;
+			a.ForceX[j] -= pair.FScale * dx; a.ForceY[j] -= pair.FScale * dy; a.ForceZ[j] -= pair.FScale * dz;
+			elj += pair.LennardJones;
+			ec += pair.Coulomb;
+			virial += pair.FScale * (dx * dx + dy * dy + dz * dz);
+		}
+	}
+
+	// Picks the template instantiation matching the runtime flags
+	template<template<int, bool> class Kernel, bool Tabulated, typename Real, typename ForceT>
+	inline NonbondedEnergy DispatchCoulomb(const BasicNonbondedKernelArgs<Real, ForceT>& a, uint32_t rowBegin, uint32_t rowEnd)
+	{
+		if (a.CoulombConstant == 0.0f)
+			return Kernel<CoulombNone, Tabulated>::Run(a, rowBegin, rowEnd);
+		if (a.EwaldBeta > 0.0f)
+			return Kernel<CoulombEwald, Tabulated>::Run(a, rowBegin, rowEnd);
+		return Kernel<CoulombPlain, Tabulated>::Run(a, rowBegin, rowEnd);
+	}
+
+	template<template<int, bool> class Kernel, typename Real, typename ForceT>
+	inline NonbondedEnergy DispatchVariant(const BasicNonbondedKernelArgs<Real, ForceT>& a, uint32_t rowBegin, uint32_t rowEnd)
+	{
+		if (a.Tabulated)
+			return DispatchCoulomb<Kernel, true>(a, rowBegin, rowEnd);
+		return DispatchCoulomb<Kernel, false>(a, rowBegin, rowEnd);
+	}
+}
@@ -0,0 +1,50 @@
+#include "nonbonded_kernel_common.h"
+
+
+namespace
+{
+	// Reference implementation, every SIMD variant is validated against it.
+	// Runs in the precision of the arguments, float or double
+	template<int Coulomb, bool Tabulated>
+	struct ScalarKernel
+	{
+		template<typename Real, typename ForceT>
+		static NonbondedEnergy Run(const BasicNonbondedKernelArgs<Real, ForceT>& a, uint32_t rowBegin, uint32_t rowEnd)
+		{
+			double elj = 0.0, ec = 0.0, virial = 0.0;
+
+			for (uint32_t i = rowBegin; i < rowEnd; i++)
+			{
+				ForceT fxi = 0, fyi = 0, fzi = 0;
+				for (uint32_t s = a.RowSegments[i]; s < a.RowSegments[i + 1]; s++)
+				{
+					const float* shift = a.ShiftVectors + 3 * a.SegmentShift[s];
+					ProcessRowScalar<Coulomb, Tabulated>(a, i, a.PosX[i] + shift[0], a.PosY[i] + shift[1], a.PosZ[i] + shift[2],
+						a.SegmentOffsets[s], a.SegmentOffsets[s + 1], fxi, fyi, fzi, elj, ec, virial);
+				}
+				a.ForceX[i] += fxi; a.ForceY[i] += fyi; a.ForceZ[i] += fzi;
+			}
+
+			NonbondedEnergy energy;
+			energy.LennardJones = elj;
+			energy.Coulomb = ec;
+			energy.Virial = virial;
+			return energy;
+		}
+	};
+}
+
+NonbondedEnergy NonbondedKernelScalar(const NonbondedKernelArgs& args, uint32_t rowBegin, uint32_t rowEnd)
+{
+	return DispatchVariant<ScalarKernel>(args, rowBegin, rowEnd);
+}
+
+NonbondedEnergy NonbondedKernelScalarMixed(const NonbondedKernelArgsMixed& args, uint32_t rowBegin, uint32_t rowEnd)
+{
+	return DispatchVariant<ScalarKernel>(args, rowBegin, rowEnd);
+}
+
+NonbondedEnergy NonbondedKernelScalarDouble(const NonbondedKernelArgsDouble& args, uint32_t rowBegin, uint32_t rowEnd)
+{
+	return DispatchVariant<ScalarKernel>(args, rowBegin, rowEnd);
+}
@@ -0,0 +1,227 @@
+#include "nonbonded_kernel_common.h"
+
+#if PY_SIMD_X86
+#include <nmmintrin.h>
+
+
+namespace
+{
+	inline float HorizontalSum(__m128 v)
+	{
+		__m128 shuf = _mm_movehdup_ps(v);
+		__m128 sums = _mm_add_ps(v, shuf);
+		shuf = _mm_movehl_ps(shuf, sums);
+		return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+	}
+
+	inline __m128 Exp(__m128 x)
+	{
+		x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(ExpLo)), _mm_set1_ps(ExpHi));
+		__m128 fx = _mm_round_ps(_mm_mul_ps(x, _mm_set1_ps(Log2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+		x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(ExpC1)));
+		x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(ExpC2)));
+
+		__m128 y = _mm_set1_ps(ExpP0);
+		y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(ExpP1));
+		y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(ExpP2));
+		y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(ExpP3));
+		y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(ExpP4));
+		y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(ExpP5));
+		y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), x), _mm_set1_ps(1.0f));
+
+		__m128i n = _mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(fx), _mm_set1_epi32(127)), 23);
+		return _mm_mul_ps(y, _mm_castsi128_ps(n));
+	}
+
+	// erfc(br) / r real-space Ewald term; returns the pair energy and adds the force to fs
+	inline __m128 EwaldPair(__m128 qq, __m128 r2, __m128 inv2, __m128 beta, __m128& fs)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		__m128 invR = _mm_sqrt_ps(inv2);
+		__m128 br = _mm_mul_ps(beta, _mm_mul_ps(r2, invR));
+		__m128 expTerm = Exp(_mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(br, br)));
+
+		__m128 t = _mm_div_ps(one, _mm_add_ps(one, _mm_mul_ps(_mm_set1_ps(ErfcP), br)));
+		__m128 poly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ErfcA5), t), _mm_set1_ps(ErfcA4));
+		poly = _mm_add_ps(_mm_mul_ps(poly, t), _mm_set1_ps(ErfcA3));
+		poly = _mm_add_ps(_mm_mul_ps(poly, t), _mm_set1_ps(ErfcA2));
+		poly = _mm_add_ps(_mm_mul_ps(poly, t), _mm_set1_ps(ErfcA1));
+		poly = _mm_mul_ps(poly, t);
+
+		__m128 e = _mm_mul_ps(_mm_mul_ps(qq, _mm_mul_ps(poly, expTerm)), invR);
+		__m128 de = _mm_mul_ps(_mm_mul_ps(qq, _mm_mul_ps(beta, _mm_set1_ps(TwoOverSqrtPi))), expTerm);
+		fs = _mm_add_ps(fs, _mm_mul_ps(_mm_add_ps(e, de), inv2));
+		return e;
+	}
+
+	// Cubic of the PairTable interval under r2; returns U and sets fs = -2 dU/d(r^2).
+	// Each interval's four coefficients are one aligned vector, so the lanes
+	// load a row each and a transpose turns them into c0..c3
+	inline __m128 TableLookup(const float* table, const uint32_t* base, __m128 r2, __m128 minSq, __m128 invH, __m128i last, __m128& fs)
+	{
+		__m128 x = _mm_mul_ps(_mm_sub_ps(r2, minSq), invH);
+		__m128i k = _mm_cvttps_epi32(_mm_round_ps(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));
+		k = _mm_min_epi32(_mm_max_epi32(k, _mm_setzero_si128()), last);
+		__m128 t = _mm_sub_ps(x, _mm_cvtepi32_ps(k));
+
+		alignas(16) int32_t interval[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(interval), k);
+		__m128 c0 = _mm_load_ps(table + (size_t)(base[0] + interval[0]) * 4);
+		__m128 c1 = _mm_load_ps(table + (size_t)(base[1] + interval[1]) * 4);
+		__m128 c2 = _mm_load_ps(table + (size_t)(base[2] + interval[2]) * 4);
+		__m128 c3 = _mm_load_ps(table + (size_t)(base[3] + interval[3]) * 4);
+		_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+		__m128 dudt = _mm_add_ps(_mm_mul_ps(t, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_mul_ps(t, c3)), _mm_add_ps(c2, c2))), c1);
+		fs = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(-2.0f), invH), dudt);
+		return _mm_add_ps(_mm_mul_ps(t, _mm_add_ps(_mm_mul_ps(t, _mm_add_ps(_mm_mul_ps(t, c3), c2)), c1)), c0);
+	}
+
+	// SSE has no gather, the four neighbors are loaded lane by lane
+	template<int Coulomb, bool Tabulated>
+	struct SSE42Kernel
+	{
+		template<typename ForceT>
+		static NonbondedEnergy Run(const BasicNonbondedKernelArgs<float, ForceT>& a, uint32_t rowBegin, uint32_t rowEnd)
+		{
+			const __m128 cutoff2 = _mm_set1_ps(a.CutoffSq);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.0f);
+			const __m128 twelve = _mm_set1_ps(12.0f);
+			const __m128 six = _mm_set1_ps(6.0f);
+			const __m128 beta = _mm_set1_ps(a.EwaldBeta);
+			const __m128 tableMin = _mm_set1_ps(a.TableMinSq), tableInv = _mm_set1_ps(a.TableInvSpacing);
+			const __m128i tableLast = _mm_set1_epi32(a.TableIntervals - 1);
+			static const uint32_t coulombBase[4] = {};
+
+			double elj = 0.0, ec = 0.0, virial = 0.0;
+
+			for (uint32_t i = rowBegin; i < rowEnd; i++)
+			{
+				const uint32_t typeRow = a.TypeId[i] * a.TypeCount;
+				const float qiScalar = a.Charge[i] * a.CoulombConstant;
+
+				const __m128 qi = _mm_set1_ps(qiScalar);
+
+				__m128 fxi = zero, fyi = zero, fzi = zero;
+				__m128 eljV = zero, ecV = zero, virialV = zero;
+
+				ForceT fxs = 0, fys = 0, fzs = 0;
+
+				// One run of neighbors per periodic image, x_i is shifted once per run
+				for (uint32_t s = a.RowSegments[i]; s < a.RowSegments[i + 1]; s++)
+				{
+					const float* shift = a.ShiftVectors + 3 * a.SegmentShift[s];
+					const float sx = a.PosX[i] + shift[0], sy = a.PosY[i] + shift[1], sz = a.PosZ[i] + shift[2];
+					const __m128 xi = _mm_set1_ps(sx), yi = _mm_set1_ps(sy), zi = _mm_set1_ps(sz);
+
+					uint32_t n = a.SegmentOffsets[s];
+					const uint32_t nEnd = a.SegmentOffsets[s + 1];
+
+					for (; n + 4 <= nEnd; n += 4)
+					{
+						const uint32_t* j = a.Neighbors + n;
+
+						__m128 dx = _mm_sub_ps(xi, _mm_setr_ps(a.PosX[j[0]], a.PosX[j[1]], a.PosX[j[2]], a.PosX[j[3]]));
+						__m128 dy = _mm_sub_ps(yi, _mm_setr_ps(a.PosY[j[0]], a.PosY[j[1]], a.PosY[j[2]], a.PosY[j[3]]));
+						__m128 dz = _mm_sub_ps(zi, _mm_setr_ps(a.PosZ[j[0]], a.PosZ[j[1]], a.PosZ[j[2]], a.PosZ[j[3]]));
+
+						__m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+						__m128 mask = _mm_and_ps(_mm_cmplt_ps(r2, cutoff2), _mm_cmpgt_ps(r2, zero));
+						if (_mm_movemask_ps(mask) == 0)
+							continue;
+
+						__m128 fs;
+						if constexpr (Tabulated)
+						{
+							const uint32_t base[4] = { a.VdwTableBase[typeRow + a.TypeId[j[0]]], a.VdwTableBase[typeRow + a.TypeId[j[1]]],
+								a.VdwTableBase[typeRow + a.TypeId[j[2]]], a.VdwTableBase[typeRow + a.TypeId[j[3]]] };
+							__m128 e = TableLookup(a.VdwTable, base, r2, tableMin, tableInv, tableLast, fs);
+							eljV = _mm_add_ps(eljV, _mm_and_ps(mask, e));
+
+							if constexpr (Coulomb != CoulombNone)
+							{
+								__m128 qq = _mm_mul_ps(qi, _mm_setr_ps(a.Charge[j[0]], a.Charge[j[1]], a.Charge[j[2]], a.Charge[j[3]]));
+								__m128 fc;
+								__m128 ecPair = _mm_mul_ps(qq, TableLookup(a.CoulombTable, coulombBase, r2, tableMin, tableInv, tableLast, fc));
+								fs = _mm_add_ps(fs, _mm_mul_ps(qq, fc));
+								ecV = _mm_add_ps(ecV, _mm_and_ps(mask, ecPair));
+							}
+						}
+						else
+						{
+							// Masked-out lanes divide by one instead of zero or a huge distance
+							__m128 inv2 = _mm_div_ps(one, _mm_blendv_ps(one, r2, mask));
+							__m128 inv6 = _mm_mul_ps(_mm_mul_ps(inv2, inv2), inv2);
+
+							__m128 c12 = _mm_setr_ps(a.C12[typeRow + a.TypeId[j[0]]], a.C12[typeRow + a.TypeId[j[1]]],
+								a.C12[typeRow + a.TypeId[j[2]]], a.C12[typeRow + a.TypeId[j[3]]]);
+							__m128 c6 = _mm_setr_ps(a.C6[typeRow + a.TypeId[j[0]]], a.C6[typeRow + a.TypeId[j[1]]],
+								a.C6[typeRow + a.TypeId[j[2]]], a.C6[typeRow + a.TypeId[j[3]]]);
+							c12 = _mm_mul_ps(c12, _mm_mul_ps(inv6, inv6));
+							c6 = _mm_mul_ps(c6, inv6);
+
+							fs = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(twelve, c12), _mm_mul_ps(six, c6)), inv2);
+							eljV = _mm_add_ps(eljV, _mm_and_ps(mask, _mm_sub_ps(c12, c6)));
+
+							if constexpr (Coulomb == CoulombPlain)
+							{
+								__m128 qj = _mm_setr_ps(a.Charge[j[0]], a.Charge[j[1]], a.Charge[j[2]], a.Charge[j[3]]);
+								__m128 e = _mm_mul_ps(_mm_mul_ps(qi, qj), _mm_sqrt_ps(inv2));
+								fs = _mm_add_ps(fs, _mm_mul_ps(e, inv2));
+								ecV = _mm_add_ps(ecV, _mm_and_ps(mask, e));
+							}
+							else if constexpr (Coulomb == CoulombEwald)
+							{
+								__m128 qj = _mm_setr_ps(a.Charge[j[0]], a.Charge[j[1]], a.Charge[j[2]], a.Charge[j[3]]);
+								__m128 e = EwaldPair(_mm_mul_ps(qi, qj), _mm_blendv_ps(one, r2, mask), inv2, beta, fs);
+								ecV = _mm_add_ps(ecV, _mm_and_ps(mask, e));
+							}
+						}
+
+						fs = _mm_and_ps(mask, fs);
+						virialV = _mm_add_ps(virialV, _mm_mul_ps(fs, r2));
+						__m128 fx = _mm_mul_ps(fs, dx), fy = _mm_mul_ps(fs, dy), fz = _mm_mul_ps(fs, dz);
+						fxi = _mm_add_ps(fxi, fx); fyi = _mm_add_ps(fyi, fy); fzi = _mm_add_ps(fzi, fz);
+
+						// Neighbors within a row are distinct, so the scatter has no conflicts
+						alignas(16) float tx[4], ty[4], tz[4];
+						_mm_store_ps(tx, fx); _mm_store_ps(ty, fy); _mm_store_ps(tz, fz);
+						for (int k = 0; k < 4; k++)
+						{
+							a.ForceX[j[k]] -= tx[k]; a.ForceY[j[k]] -= ty[k]; a.ForceZ[j[k]] -= tz[k];
+						}
+					}
+
+					ProcessRowScalar<Coulomb, Tabulated>(a, i, sx, sy, sz, n, nEnd, fxs, fys, fzs, elj, ec, virial);
+				}
+
+				fxs += HorizontalSum(fxi); fys += HorizontalSum(fyi); fzs += HorizontalSum(fzi);
+				elj += HorizontalSum(eljV);
+				ec += HorizontalSum(ecV);
+				virial += HorizontalSum(virialV);
+
+				a.ForceX[i] += fxs; a.ForceY[i] += fys; a.ForceZ[i] += fzs;
+			}
+
+			NonbondedEnergy energy;
+			energy.LennardJones = elj;
+			energy.Coulomb = ec;
+			energy.Virial = virial;
+			return energy;
+		}
+	};
+}
+
+NonbondedEnergy NonbondedKernelSSE42(const NonbondedKernelArgs& args, uint32_t rowBegin, uint32_t rowEnd)
+{
+	return DispatchVariant<SSE42Kernel>(args, rowBegin, rowEnd);
+}
+
+NonbondedEnergy NonbondedKernelSSE42Mixed(const NonbondedKernelArgsMixed& args, uint32_t rowBegin, uint32_t rowEnd)
+{
+	return DispatchVariant<SSE42Kernel>(args, rowBegin, rowEnd);
+}
+
+#endif
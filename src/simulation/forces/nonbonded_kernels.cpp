@@ -0,0 +1,36 @@
+#include "nonbonded_kernels.h"
+
+
+NonbondedKernelFn GetNonbondedKernel(SimdLevel level)
+{
+	SimdLevel best = CpuFeatures::Get().GetBestSimdLevel();
+	if (level > best)
+		level = best;
+
+	switch (level)
+	{
+#if PY_SIMD_X86
+	case SimdLevel::AVX512: return NonbondedKernelAVX512;
+	case SimdLevel::AVX2:   return NonbondedKernelAVX2;
+	case SimdLevel::SSE42:  return NonbondedKernelSSE42;
+#endif
+	default:                return NonbondedKernelScalar;
+	}
+}
+
+NonbondedKernelMixedFn GetNonbondedKernelMixed(SimdLevel level)
+{
+	SimdLevel best = CpuFeatures::Get().GetBestSimdLevel();
+	if (level > best)
+		level = best;
+
+	switch (level)
+	{
+#if PY_SIMD_X86
+	case SimdLevel::AVX512: return NonbondedKernelAVX512Mixed;
+	case SimdLevel::AVX2:   return NonbondedKernelAVX2Mixed;
+	case SimdLevel::SSE42:  return NonbondedKernelSSE42Mixed;
+#endif
+	default:                return NonbondedKernelScalarMixed;
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../cpu_features.h"
+
+// Kept free of glm and the atom store on purpose: the kernel translation units
+// are built with different instruction set flags and must not instantiate
+// shared inline code the linker could pick for the baseline build.
+
+
+// Real is the precision of positions and the pair math, ForceT the one forces
+// accumulate in; parameters and tables stay float either way
+template<typename Real, typename ForceT = Real>
+struct BasicNonbondedKernelArgs
+{
+	// Atom streams
+	const Real* PosX;
+	const Real* PosY;
+	const Real* PosZ;
+	const float* Charge;
+	const uint32_t* TypeId;
+
+	// Force accumulators, may be a per-thread buffer rather than the atom store
+	ForceT* ForceX;
+	ForceT* ForceY;
+	ForceT* ForceZ;
+
+	// Half neighbor list in CSR form
+	const uint32_t* Offsets;
+	const uint32_t* Neighbors;
+
+	// Shift segments of the list: row i is split into the segments
+	// [RowSegments[i], RowSegments[i + 1]), segment s holds the neighbors
+	// Neighbors[SegmentOffsets[s] .. SegmentOffsets[s + 1]) that all interact
+	// with the same image of atom i, x_i + ShiftVectors[3 * SegmentShift[s] ..]
+	const uint32_t* RowSegments;
+	const uint32_t* SegmentOffsets;
+	const uint8_t* SegmentShift;
+	const float* ShiftVectors;
+
+	// Per-type-pair Lennard-Jones coefficients, indexed typeI * TypeCount + typeJ
+	const float* C12;
+	const float* C6;
+	uint32_t TypeCount;
+
+	float CutoffSq;
+	// Coulomb prefactor 1 / (4 pi eps0) in engine units, 0 skips electrostatics
+	float CoulombConstant;
+	// Ewald splitting coefficient, > 0 turns the Coulomb term into the
+	// erfc(beta r) / r real-space part of an Ewald sum
+	float EwaldBeta;
+
+	// Tabulated evaluation, see PairTable. Replaces the Lennard-Jones term by
+	// the type pair's table and the Coulomb term by q_i q_j times the shared
+	// Coulomb table; both tables use the same r^2 grid
+	bool Tabulated;
+	const float* VdwTable;
+	const uint32_t* VdwTableBase;   // first interval of each type pair's table, indexed like C12
+	const float* CoulombTable;
+	int32_t TableIntervals;
+	float TableMinSq;
+	float TableInvSpacing;
+};
+
+using NonbondedKernelArgs = BasicNonbondedKernelArgs<float>;
+using NonbondedKernelArgsMixed = BasicNonbondedKernelArgs<float, double>;
+using NonbondedKernelArgsDouble = BasicNonbondedKernelArgs<double>;
+
+struct NonbondedEnergy
+{
+	// Van der Waals part, the tabulated potential in tabulated mode
+	double LennardJones = 0.0;
+	double Coulomb = 0.0;
+	// Sum of r_ij . F_ij over the pairs within the cutoff, for the pressure
+	double Virial = 0.0;
+
+	double GetTotal() const { return LennardJones + Coulomb; }
+
+	NonbondedEnergy& operator+=(const NonbondedEnergy& other)
+	{
+		LennardJones += other.LennardJones;
+		Coulomb += other.Coulomb;
+		Virial += other.Virial;
+		return *this;
+	}
+};
+
+// Evaluates the neighbor rows [rowBegin, rowEnd) and accumulates into the force arrays
+using NonbondedKernelFn = NonbondedEnergy(*)(const NonbondedKernelArgs& args, uint32_t rowBegin, uint32_t rowEnd);
+// Same pair math, forces summed into double arrays
+using NonbondedKernelMixedFn = NonbondedEnergy(*)(const NonbondedKernelArgsMixed& args, uint32_t rowBegin, uint32_t rowEnd);
+
+NonbondedEnergy NonbondedKernelScalar(const NonbondedKernelArgs& args, uint32_t rowBegin, uint32_t rowEnd);
+NonbondedEnergy NonbondedKernelScalarMixed(const NonbondedKernelArgsMixed& args, uint32_t rowBegin, uint32_t rowEnd);
+#if PY_SIMD_X86
+NonbondedEnergy NonbondedKernelSSE42(const NonbondedKernelArgs& args, uint32_t rowBegin, uint32_t rowEnd);
+NonbondedEnergy NonbondedKernelSSE42Mixed(const NonbondedKernelArgsMixed& args, uint32_t rowBegin, uint32_t rowEnd);
+NonbondedEnergy NonbondedKernelAVX2(const NonbondedKernelArgs& args, uint32_t rowBegin, uint32_t rowEnd);
+NonbondedEnergy NonbondedKernelAVX2Mixed(const NonbondedKernelArgsMixed& args, uint32_t rowBegin, uint32_t rowEnd);
+NonbondedEnergy NonbondedKernelAVX512(const NonbondedKernelArgs& args, uint32_t rowBegin, uint32_t rowEnd);
+NonbondedEnergy NonbondedKernelAVX512Mixed(const NonbondedKernelArgsMixed& args, uint32_t rowBegin, uint32_t rowEnd);
+#endif
+
+// Double precision forces, positions and pair math. No SIMD variants, this is
+// the reference kernel run in double
+NonbondedEnergy NonbondedKernelScalarDouble(const NonbondedKernelArgsDouble& args, uint32_t rowBegin, uint32_t rowEnd);
+
+// Kernel for the requested level, clamped to what the CPU supports
+NonbondedKernelFn GetNonbondedKernel(SimdLevel level);
+NonbondedKernelMixedFn GetNonbondedKernelMixed(SimdLevel level);
@@ -0,0 +1,119 @@
+#include "pair_table.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+PairPotential PairPotential::LennardJones(double epsilon, double sigma)
+{
+	return { [=](double r, double& energy, double& dUdr)
+		{
+			double sr6 = std::pow(sigma / r, 6.0);
+			energy = 4.0 * epsilon * (sr6 * sr6 - sr6);
+			dUdr = -24.0 * epsilon * (2.0 * sr6 * sr6 - sr6) / r;
+		} };
+}
+
+PairPotential PairPotential::Buckingham(double a, double b, double c)
+{
+	return { [=](double r, double& energy, double& dUdr)
+		{
+			double rep = a * std::exp(-b * r);
+			double r6 = std::pow(r, 6.0);
+			energy = rep - c / r6;
+			dUdr = -b * rep + 6.0 * c / (r6 * r);
+		} };
+}
+
+PairPotential PairPotential::Morse(double depth, double alpha, double r0)
+{
+	return { [=](double r, double& energy, double& dUdr)
+		{
+			double e = std::exp(-alpha * (r - r0));
+			energy = depth * ((1.0 - e) * (1.0 - e) - 1.0);
+			dUdr = 2.0 * depth * alpha * (1.0 - e) * e;
+		} };
+}
+
+PairPotential PairPotential::Coulomb()
+{
+	return { [](double r, double& energy, double& dUdr)
+		{
+			energy = 1.0 / r;
+			dUdr = -1.0 / (r * r);
+		} };
+}
+
+PairPotential PairPotential::EwaldRealSpace(double beta)
+{
+	return { [=](double r, double& energy, double& dUdr)
+		{
+			// 2 / sqrt(pi)
+			constexpr double twoOverSqrtPi = 1.1283791670955126;
+			energy = std::erfc(beta * r) / r;
+			dUdr = -(energy + twoOverSqrtPi * beta * std::exp(-beta * beta * r * r)) / r;
+		} };
+}
+
+void PairTable::Build(const std::vector<PairPotential>& potentials, float cutoff, const PairTableProps& props)
+{
+	m_TableCount = static_cast<uint32_t>(potentials.size());
+	m_Intervals = std::max(props.Intervals, 2u);
+
+	const double minSq = double(props.MinDistance) * props.MinDistance;
+	// One interval of headroom so r^2 just below the cutoff never indexes past the end
+	const double spacing = (double(cutoff) * cutoff - minSq) / (m_Intervals - 1);
+	m_MinSq = static_cast<float>(minSq);
+	m_InvSpacing = static_cast<float>(1.0 / spacing);
+
+	m_Data.assign(size_t(m_TableCount) * m_Intervals * 4, 0.0f);
+
+	for (uint32_t t = 0; t < m_TableCount; t++)
+	{
+		// U and h * dU/d(r^2) at the knots, with dU/d(r^2) = dU/dr / 2r
+		auto knot = [&](uint32_t k, double& u, double& slope)
+		{
+			double r2 = minSq + spacing * k;
+			double r = std::sqrt(r2);
+			double dUdr;
+			potentials[t].Evaluate(r, u, dUdr);
+			slope = spacing * dUdr / (2.0 * r);
+		};
+
+		double u0, d0;
+		knot(0, u0, d0);
+		for (uint32_t k = 0; k < m_Intervals; k++)
+		{
+			double u1, d1;
+			knot(k + 1, u1, d1);
+
+			float* c = &m_Data[(size_t(t) * m_Intervals + k) * 4];
+			c[0] = static_cast<float>(u0);
+			c[1] = static_cast<float>(d0);
+			c[2] = static_cast<float>(3.0 * (u1 - u0) - 2.0 * d0 - d1);
+			c[3] = static_cast<float>(2.0 * (u0 - u1) + d0 + d1);
+
+			u0 = u1;
+			d0 = d1;
+		}
+	}
+}
+
+void PairTable::Clear()
+{
+	m_Data.clear();
+	m_TableCount = 0;
+	m_Intervals = 0;
+}
+
+float PairTable::Evaluate(uint32_t table, float r2, float& fscale) const
+{
+	float x = (r2 - m_MinSq) * m_InvSpacing;
+	int k = std::clamp(static_cast<int>(std::floor(x)), 0, static_cast<int>(m_Intervals) - 1);
+	float t = x - static_cast<float>(k);
+
+	const float* c = &m_Data[(size_t(table) * m_Intervals + k) * 4];
+	float dudt = c[1] + t * (2.0f * c[2] + 3.0f * t * c[3]);
+	fscale = -2.0f * m_InvSpacing * dudt;
+	return c[0] + t * (c[1] + t * (c[2] + t * c[3]));
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "../aligned_allocator.h"
+
+
+// A radial pair potential for tabulation. Evaluate fills U(r) and dU/dr,
+// it runs in double and only while tables are built, so it can be as
+// expensive as it likes.
+struct PairPotential
+{
+	std::function<void(double r, double& energy, double& dUdr)> Evaluate;
+
+	// 4 epsilon ((sigma / r)^12 - (sigma / r)^6)
+	static PairPotential LennardJones(double epsilon, double sigma);
+	// A exp(-B r) - C / r^6
+	static PairPotential Buckingham(double a, double b, double c);
+	// D ((1 - exp(-alpha (r - r0)))^2 - 1), minimum -D at r0
+	static PairPotential Morse(double depth, double alpha, double r0);
+	// 1 / r and erfc(beta r) / r, for unit charges
+	static PairPotential Coulomb();
+	static PairPotential EwaldRealSpace(double beta);
+};
+
+struct PairTableProps
+{
+	// Intervals per table over the r^2 range
+	uint32_t Intervals;
+	// Start of the table, closer pairs reuse the first interval's polynomial
+	float MinDistance;
+
+	PairTableProps(uint32_t intervals = 2048, float minDistance = 0.05f)
+		: Intervals(intervals), MinDistance(minDistance) {
+	}
+};
+
+// Tables of U(r^2) as cubic Hermite splines on a uniform r^2 grid, which the
+// nonbonded kernels evaluate without a square root or division. Every
+// interval stores 4 polynomial coefficients in t = (r^2 - r0^2) / h, so a
+// lookup is one aligned 16-byte load. The force comes from the derivative of
+// the same polynomial and is therefore consistent with the energy. All tables
+// of one PairTable share the grid and sit back to back in one array.
+class PairTable
+{
+public:
+	PairTable() {}
+
+	void Build(const std::vector<PairPotential>& potentials, float cutoff, const PairTableProps& props);
+	void Clear();
+
+	bool IsEmpty() const { return m_Data.empty(); }
+	uint32_t GetTableCount() const { return m_TableCount; }
+	uint32_t GetIntervals() const { return m_Intervals; }
+	float GetMinSq() const { return m_MinSq; }
+	float GetInvSpacing() const { return m_InvSpacing; }
+
+	// Coefficients of interval k of table t start at (t * Intervals + k) * 4
+	const float* GetData() const { return m_Data.data(); }
+
+	// Reference lookup with the kernel arithmetic; returns U and sets
+	// fscale = -(dU/dr) / r, the factor multiplying the separation vector
+	float Evaluate(uint32_t table, float r2, float& fscale) const;
+
+private:
+	AlignedVector<float> m_Data;
+	uint32_t m_TableCount = 0;
+	uint32_t m_Intervals = 0;
+	float m_MinSq = 0.0f;
+	float m_InvSpacing = 0.0f;
+};
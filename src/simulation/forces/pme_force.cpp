@@ -0,0 +1,518 @@
+#include "pme_force.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#include "nonbonded_force.h"
+#include "../exclusion_list.h"
+#include "../../logging/log.h"
+
+
+namespace
+{
+	constexpr double Pi = 3.14159265358979323846;
+
+	template<typename F>
+	void ParallelRange(ThreadPool* pool, uint32_t count, uint32_t grain, const F& body)
+	{
+		if (pool)
+			pool->ParallelFor(count, grain, body);
+		else
+			body(0, count, 0);
+	}
+}
+
+PmeForce::PmeForce(NonbondedForce& nonbonded, const PmeProps& props)
+	: Force(ForceGroupLongRange), m_Nonbonded(nonbonded)
+{
+	SetProps(props);
+}
+
+void PmeForce::SetProps(const PmeProps& props)
+{
+	m_Props = props;
+	if (m_Props.Order < 3 || m_Props.Order > MaxOrder)
+	{
+		PY_CORE_WARN("PME order {} outside [3, {}], clamping", m_Props.Order, MaxOrder);
+		m_Props.Order = std::clamp(m_Props.Order, 3u, MaxOrder);
+	}
+
+	float cutoff = m_Nonbonded.GetCutoff();
+	float beta = ComputeEwaldCoefficient(cutoff, m_Props.EwaldTolerance);
+	m_Nonbonded.SetEwaldCoefficient(beta);
+	PY_CORE_INFO("PME Ewald coefficient {} for cutoff {}", beta, cutoff);
+
+	// Forces the grid and influence function to be rebuilt on the next evaluation
+	m_SetupBox = SimulationBox(glm::vec3(0.0f));
+}
+
+float PmeForce::GetEwaldCoefficient() const
+{
+	return m_Nonbonded.GetEwaldCoefficient();
+}
+
+float PmeForce::ComputeEwaldCoefficient(float cutoff, float tolerance)
+{
+	double high = 5.0;
+	while (std::erfc(high * cutoff) > tolerance)
+		high *= 2.0;
+
+	double low = 0.0;
+	for (int i = 0; i < 60; i++)
+	{
+		double beta = 0.5 * (low + high);
+		if (std::erfc(beta * cutoff) > tolerance)
+			low = beta;
+		else
+			high = beta;
+	}
+	return (float)high;
+}
+
+double PmeForce::Compute(ForceContext& ctx)
+{
+	const float beta = m_Nonbonded.GetEwaldCoefficient();
+	const float coulomb = m_Nonbonded.GetCoulombConstant();
+	if (coulomb == 0.0f || beta <= 0.0f || ctx.Atoms.Size() == 0)
+		return 0.0;
+
+	if (!ctx.Box.Periodic)
+	{
+		if (!m_WarnedNonPeriodic)
+			PY_CORE_WARN("PME needs a periodic box, reciprocal-space electrostatics skipped");
+		m_WarnedNonPeriodic = true;
+		return 0.0;
+	}
+
+	if (ctx.Box != m_SetupBox || beta != m_SetupBeta || coulomb != m_SetupCoulomb)
+		Setup(ctx.Box, beta, coulomb);
+
+	ComputeSplines(ctx.Atoms, ctx.Pool);
+	SpreadCharges(ctx.Atoms, ctx.Pool);
+
+	m_FFT.Forward(m_Grid.data(), m_Spectrum.data(), ctx.Pool);
+	double virial = 0.0;
+	m_ReciprocalEnergy = Convolve(ctx.Pool, virial);
+	m_FFT.Inverse(m_Spectrum.data(), m_Grid.data(), ctx.Pool);
+
+	// The mesh and its interpolation stay float, precise forces only sum the result in double
+	if (ctx.IsPrecise())
+		GatherForces<double>(ctx);
+	else
+		GatherForces<float>(ctx);
+
+	// Each charge's interaction with its own screening cloud, and the uniform
+	// background that neutralizes a net charge
+	double sumQ = 0.0, sumQ2 = 0.0;
+	for (float q : ctx.Atoms.Charge)
+	{
+		sumQ += q;
+		sumQ2 += (double)q * q;
+	}
+	const double background = -coulomb * Pi * sumQ * sumQ / (2.0 * ctx.Box.GetVolume() * beta * beta);
+	m_SelfEnergy = -coulomb * beta / std::sqrt(Pi) * sumQ2 + background;
+
+	// The background term goes as 1 / V, so its virial -3 V dE/dV is 3 E
+	ctx.Virial += virial + 3.0 * background;
+
+	m_ExclusionEnergy = 0.0;
+	if (const ExclusionList* exclusions = ctx.Neighbors.GetExclusions(); exclusions && !exclusions->IsEmpty())
+		m_ExclusionEnergy = ctx.IsPrecise() ? SubtractExcluded<double>(ctx, *exclusions, beta, coulomb)
+			: SubtractExcluded<float>(ctx, *exclusions, beta, coulomb);
+
+	return m_ReciprocalEnergy + m_SelfEnergy + m_ExclusionEnergy;
+}
+
+template<typename Real>
+double PmeForce::SubtractExcluded(ForceContext& ctx, const ExclusionList& exclusions, float beta, float coulomb)
+{
+	AtomStore& atoms = ctx.Atoms;
+	const uint32_t count = std::min(exclusions.GetAtomCount(), static_cast<uint32_t>(atoms.Size()));
+	const uint32_t* offsets = exclusions.GetOffsets();
+	const uint32_t* partners = exclusions.GetPartners();
+
+	// Bonded pairs are few, one thread writes them into its buffer like the mesh gather does
+	const ForceArrays<Real> forces = ctx.GetForces<Real>(0);
+	auto separation = [&](uint32_t i, uint32_t j)
+	{
+		if constexpr (std::is_same_v<Real, double>)
+			return ctx.Box.MinimumImage(glm::dvec3(atoms.PrecisePosX[i] - atoms.PrecisePosX[j],
+				atoms.PrecisePosY[i] - atoms.PrecisePosY[j], atoms.PrecisePosZ[i] - atoms.PrecisePosZ[j]));
+		else
+			return ctx.Box.MinimumImage(atoms.GetPosition(i) - atoms.GetPosition(j));
+	};
+
+	// U = -k q_i q_j erf(beta r) / r, and -dU/dr / r is
+	// k q_i q_j (2 beta / sqrt(pi) exp(-beta^2 r^2) - erf(beta r) / r) / r^2
+	const double twoBetaOverSqrtPi = 2.0 * beta / std::sqrt(Pi);
+	double energy = 0.0, virial = 0.0;
+	uint32_t touchedBegin = count, touchedEnd = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const float qi = atoms.Charge[i];
+		if (qi == 0.0f)
+			continue;
+
+		for (uint32_t n = offsets[i]; n < offsets[i + 1]; n++)
+		{
+			const uint32_t j = partners[n];
+			if (j >= atoms.Size() || atoms.Charge[j] == 0.0f)
+				continue;
+
+			const auto d = separation(i, j);
+			const double r2 = glm::dot(d, d);
+			if (r2 == 0.0)
+				continue;
+
+			const double r = std::sqrt(r2);
+			const double qq = (double)coulomb * qi * atoms.Charge[j];
+			const double erfTerm = std::erf(beta * r) / r;
+			const double fscale = qq * (twoBetaOverSqrtPi * std::exp(-(double)beta * beta * r2) - erfTerm) / r2;
+
+			forces.X[i] += (Real)(fscale * d.x); forces.Y[i] += (Real)(fscale * d.y); forces.Z[i] += (Real)(fscale * d.z);
+			forces.X[j] -= (Real)(fscale * d.x); forces.Y[j] -= (Real)(fscale * d.y); forces.Z[j] -= (Real)(fscale * d.z);
+			energy -= qq * erfTerm;
+			virial += fscale * r2;
+			touchedBegin = std::min(touchedBegin, i);
+			touchedEnd = std::max(touchedEnd, j + 1);
+		}
+	}
+
+	if (ctx.Pool && touchedEnd > 0)
+		ctx.Buffers.MarkTouched(0, touchedBegin, touchedEnd);
+	ctx.Virial += virial;
+	return energy;
+}
+
+void PmeForce::Setup(const SimulationBox& box, float beta, float coulomb)
+{
+	const uint32_t order = m_Props.Order;
+
+	// Mesh lines run along the box vectors
+	const float lengths[3] = { glm::length(box.GetA()), glm::length(box.GetB()), glm::length(box.GetC()) };
+	glm::uvec3 size;
+	for (int d = 0; d < 3; d++)
+	{
+		uint32_t points = (uint32_t)std::ceil(lengths[d] / m_Props.GridSpacing);
+		size[d] = FFTPlan::NextFastLength(std::max(points, order));
+	}
+	box.GetReciprocalVectors(m_Reciprocal[0], m_Reciprocal[1], m_Reciprocal[2]);
+
+	if (size != m_GridSize)
+	{
+		m_GridSize = size;
+		m_FFT.Init(size.x, size.y, size.z);
+		m_Grid.resize(m_FFT.GetRealCount());
+		m_Spectrum.resize(m_FFT.GetComplexCount());
+		PY_CORE_INFO("PME grid {}x{}x{}, order {}", size.x, size.y, size.z, order);
+	}
+
+	std::vector<float> moduliX, moduliY, moduliZ;
+	ComputeModuli(order, size.x, moduliX);
+	ComputeModuli(order, size.y, moduliY);
+	ComputeModuli(order, size.z, moduliZ);
+
+	// C(m) = k exp(-pi^2 m^2 / beta^2) / (pi V m^2) * B(m), so that the energy
+	// is 1/2 sum_m C(m) |S(m)|^2 over the structure factor of the spread charges.
+	// m = mx a* + my b* + mz c* is a reciprocal lattice vector. Differentiating
+	// each term by the box gives the trace of the virial as its energy times
+	// 1 - 2 pi^2 m^2 / beta^2
+	const uint32_t nzc = m_FFT.GetComplexSizeZ();
+	const double factor = Pi * Pi / ((double)beta * beta);
+	const double prefactor = coulomb / (Pi * box.GetVolume());
+
+	const glm::dvec3 ra(m_Reciprocal[0]), rb(m_Reciprocal[1]), rc(m_Reciprocal[2]);
+
+	m_Influence.resize(m_FFT.GetComplexCount());
+	m_VirialWeight.resize(m_FFT.GetComplexCount());
+	for (uint32_t x = 0; x < size.x; x++)
+	{
+		const glm::dvec3 mx = ra * (x <= size.x / 2 ? (double)x : (double)x - size.x);
+		for (uint32_t y = 0; y < size.y; y++)
+		{
+			const glm::dvec3 mxy = mx + rb * (y <= size.y / 2 ? (double)y : (double)y - size.y);
+			float* row = m_Influence.data() + ((size_t)x * size.y + y) * nzc;
+			float* weight = m_VirialWeight.data() + ((size_t)x * size.y + y) * nzc;
+			for (uint32_t z = 0; z < nzc; z++)
+			{
+				const glm::dvec3 m = mxy + rc * (double)z;
+				double m2 = glm::dot(m, m);
+				row[z] = m2 == 0.0 ? 0.0f
+					: (float)(prefactor * std::exp(-factor * m2) / m2 * moduliX[x] * moduliY[y] * moduliZ[z]);
+				weight[z] = (float)(1.0 - 2.0 * factor * m2);
+			}
+		}
+	}
+
+	m_SetupBox = box;
+	m_SetupBeta = beta;
+	m_SetupCoulomb = coulomb;
+}
+
+void PmeForce::ComputeSplines(const AtomStore& atoms, ThreadPool* pool)
+{
+	const uint32_t count = static_cast<uint32_t>(atoms.Size());
+	const uint32_t order = m_Props.Order;
+
+	m_ThetaX.resize((size_t)count * order); m_ThetaY.resize((size_t)count * order); m_ThetaZ.resize((size_t)count * order);
+	m_DThetaX.resize((size_t)count * order); m_DThetaY.resize((size_t)count * order); m_DThetaZ.resize((size_t)count * order);
+	m_StartX.resize(count); m_StartY.resize(count); m_StartZ.resize(count);
+
+	const float* pos[3] = { atoms.PosX.data(), atoms.PosY.data(), atoms.PosZ.data() };
+	float* theta[3] = { m_ThetaX.data(), m_ThetaY.data(), m_ThetaZ.data() };
+	float* dtheta[3] = { m_DThetaX.data(), m_DThetaY.data(), m_DThetaZ.data() };
+	uint32_t* start[3] = { m_StartX.data(), m_StartY.data(), m_StartZ.data() };
+
+	ParallelRange(pool, count, 1024, [&](uint32_t begin, uint32_t end, uint32_t)
+		{
+			for (int d = 0; d < 3; d++)
+			{
+				const uint32_t points = m_GridSize[d];
+				const glm::vec3 r = m_Reciprocal[d];
+				for (uint32_t i = begin; i < end; i++)
+				{
+					// Fractional coordinate scaled to grid units, wrapped into [0, points)
+					float s = r.x * pos[0][i] + r.y * pos[1][i] + r.z * pos[2][i];
+					float u = (s - std::floor(s)) * points;
+					uint32_t base = std::min((uint32_t)u, points - 1);
+
+					FillBSpline(u - base, order, theta[d] + (size_t)i * order, dtheta[d] + (size_t)i * order);
+					start[d][i] = (base + points - (order - 1)) % points;
+				}
+			}
+		});
+}
+
+// Slab-parallel spreading: every thread owns a range of x planes and only
+// writes inside it, so no atomics or private grids are needed
+void PmeForce::SpreadCharges(const AtomStore& atoms, ThreadPool* pool)
+{
+	const uint32_t count = static_cast<uint32_t>(atoms.Size());
+	const uint32_t order = m_Props.Order;
+	const uint32_t nx = m_GridSize.x, ny = m_GridSize.y, nz = m_GridSize.z;
+
+	m_PlaneOffsets.assign(nx + 1, 0);
+	for (uint32_t i = 0; i < count; i++)
+		m_PlaneOffsets[m_StartX[i] + 1]++;
+	for (uint32_t x = 0; x < nx; x++)
+		m_PlaneOffsets[x + 1] += m_PlaneOffsets[x];
+
+	m_PlaneAtoms.resize(count);
+	std::vector<uint32_t> cursor(m_PlaneOffsets.begin(), m_PlaneOffsets.end() - 1);
+	for (uint32_t i = 0; i < count; i++)
+		m_PlaneAtoms[cursor[m_StartX[i]]++] = i;
+
+	const float* charge = atoms.Charge.data();
+	float* grid = m_Grid.data();
+
+	ParallelRange(pool, nx, 1, [&](uint32_t begin, uint32_t end, uint32_t)
+		{
+			std::fill(grid + (size_t)begin * ny * nz, grid + (size_t)end * ny * nz, 0.0f);
+
+			// Atoms starting up to order - 1 planes before the slab still reach into it
+			const uint32_t span = std::min(end - begin + order - 1, nx);
+			for (uint32_t s = 0; s < span; s++)
+			{
+				const uint32_t plane = (begin + nx - (order - 1) + s) % nx;
+				for (uint32_t a = m_PlaneOffsets[plane]; a < m_PlaneOffsets[plane + 1]; a++)
+				{
+					const uint32_t i = m_PlaneAtoms[a];
+					const float q = charge[i];
+					if (q == 0.0f)
+						continue;
+
+					const float* tx = m_ThetaX.data() + (size_t)i * order;
+					const float* ty = m_ThetaY.data() + (size_t)i * order;
+					const float* tz = m_ThetaZ.data() + (size_t)i * order;
+
+					for (uint32_t ix = 0; ix < order; ix++)
+					{
+						uint32_t px = (m_StartX[i] + ix) % nx;
+						if (px < begin || px >= end)
+							continue;
+
+						const float qx = q * tx[ix];
+						for (uint32_t iy = 0; iy < order; iy++)
+						{
+							uint32_t py = (m_StartY[i] + iy) % ny;
+							float* row = grid + ((size_t)px * ny + py) * nz;
+							const float qxy = qx * ty[iy];
+
+							uint32_t pz = m_StartZ[i];
+							for (uint32_t iz = 0; iz < order; iz++)
+							{
+								row[pz] += qxy * tz[iz];
+								if (++pz == nz)
+									pz = 0;
+							}
+						}
+					}
+				}
+			}
+		});
+}
+
+double PmeForce::Convolve(ThreadPool* pool, double& virial)
+{
+	const uint32_t nx = m_GridSize.x, ny = m_GridSize.y, nz = m_GridSize.z;
+	const uint32_t nzc = m_FFT.GetComplexSizeZ();
+
+	m_ThreadEnergy.assign(pool ? pool->GetThreadCount() : 1, ThreadEnergy());
+
+	ParallelRange(pool, nx, 1, [&](uint32_t begin, uint32_t end, uint32_t thread)
+		{
+			double energy = 0.0, threadVirial = 0.0;
+			for (size_t row = (size_t)begin * ny; row < (size_t)end * ny; row++)
+			{
+				RealFFT3D::Complex* s = m_Spectrum.data() + row * nzc;
+				const float* c = m_Influence.data() + row * nzc;
+				const float* v = m_VirialWeight.data() + row * nzc;
+				for (uint32_t z = 0; z < nzc; z++)
+				{
+					// Every stored column except z = 0 and z = nz / 2 stands for its mirror too
+					double weight = (z == 0 || 2 * z == nz) ? 1.0 : 2.0;
+					double term = weight * c[z] * std::norm(s[z]);
+					energy += term;
+					threadVirial += term * v[z];
+					s[z] *= c[z];
+				}
+			}
+			m_ThreadEnergy[thread].Energy += energy;
+			m_ThreadEnergy[thread].Virial += threadVirial;
+		});
+
+	double energy = 0.0;
+	virial = 0.0;
+	for (const auto& e : m_ThreadEnergy)
+	{
+		energy += e.Energy;
+		virial += e.Virial;
+	}
+	virial *= 0.5;
+	return 0.5 * energy;
+}
+
+template<typename Real>
+void PmeForce::GatherForces(ForceContext& ctx)
+{
+	AtomStore& atoms = ctx.Atoms;
+	const uint32_t count = static_cast<uint32_t>(atoms.Size());
+	const uint32_t order = m_Props.Order;
+	const uint32_t nx = m_GridSize.x, ny = m_GridSize.y, nz = m_GridSize.z;
+
+	// Spline derivatives are per grid unit along each box vector; n_d r_d turns
+	// them into a Cartesian gradient. The reciprocal matrix is upper triangular
+	const glm::vec3 ra = m_Reciprocal[0] * (float)nx, rb = m_Reciprocal[1] * (float)ny, rc = m_Reciprocal[2] * (float)nz;
+	const float* potential = m_Grid.data();
+
+	ParallelRange(ctx.Pool, count, 256, [&](uint32_t begin, uint32_t end, uint32_t thread)
+		{
+			const ForceArrays<Real> forces = ctx.GetForces<Real>(thread);
+
+			for (uint32_t i = begin; i < end; i++)
+			{
+				const float q = atoms.Charge[i];
+				if (q == 0.0f)
+					continue;
+
+				const float* tx = m_ThetaX.data() + (size_t)i * order;
+				const float* ty = m_ThetaY.data() + (size_t)i * order;
+				const float* tz = m_ThetaZ.data() + (size_t)i * order;
+				const float* dtx = m_DThetaX.data() + (size_t)i * order;
+				const float* dty = m_DThetaY.data() + (size_t)i * order;
+				const float* dtz = m_DThetaZ.data() + (size_t)i * order;
+
+				float gx = 0.0f, gy = 0.0f, gz = 0.0f;
+				for (uint32_t ix = 0; ix < order; ix++)
+				{
+					uint32_t px = (m_StartX[i] + ix) % nx;
+					for (uint32_t iy = 0; iy < order; iy++)
+					{
+						uint32_t py = (m_StartY[i] + iy) % ny;
+						const float* row = potential + ((size_t)px * ny + py) * nz;
+
+						const float dxy = dtx[ix] * ty[iy];
+						const float xdy = tx[ix] * dty[iy];
+						const float xy = tx[ix] * ty[iy];
+
+						uint32_t pz = m_StartZ[i];
+						for (uint32_t iz = 0; iz < order; iz++)
+						{
+							const float phi = row[pz];
+							gx += dxy * tz[iz] * phi;
+							gy += xdy * tz[iz] * phi;
+							gz += xy * dtz[iz] * phi;
+							if (++pz == nz)
+								pz = 0;
+						}
+					}
+				}
+
+				forces.X[i] -= q * gx * ra.x;
+				forces.Y[i] -= q * (gx * ra.y + gy * rb.y);
+				forces.Z[i] -= q * (gx * ra.z + gy * rb.z + gz * rc.z);
+			}
+
+			if (ctx.Pool)
+				ctx.Buffers.MarkTouched(thread, begin, end);
+		});
+}
+
+// Cardinal B-spline weights for the order grid points an atom at fractional
+// offset w touches, and their derivatives (Essmann et al. appendix)
+void PmeForce::FillBSpline(float w, uint32_t order, float* theta, float* dtheta)
+{
+	theta[order - 1] = 0.0f;
+	theta[1] = w;
+	theta[0] = 1.0f - w;
+
+	for (uint32_t k = 3; k < order; k++)
+	{
+		float div = 1.0f / (k - 1);
+		theta[k - 1] = div * w * theta[k - 2];
+		for (uint32_t j = 1; j < k - 1; j++)
+			theta[k - j - 1] = div * ((w + j) * theta[k - j - 2] + (k - j - w) * theta[k - j - 1]);
+		theta[0] = div * (1.0f - w) * theta[0];
+	}
+
+	// Derivatives come from the order - 1 spline before the last recursion step
+	dtheta[0] = -theta[0];
+	for (uint32_t j = 1; j < order; j++)
+		dtheta[j] = theta[j - 1] - theta[j];
+
+	float div = 1.0f / (order - 1);
+	theta[order - 1] = div * w * theta[order - 2];
+	for (uint32_t j = 1; j < order - 1; j++)
+		theta[order - j - 1] = div * ((w + j) * theta[order - j - 2] + (order - j - w) * theta[order - j - 1]);
+	theta[0] = div * (1.0f - w) * theta[0];
+}
+
+// |b(m)|^2 from the Euler exponential spline, one value per grid index
+void PmeForce::ComputeModuli(uint32_t order, uint32_t size, std::vector<float>& moduli)
+{
+	// theta[j] = M_n(order - 1 - j) at integer arguments
+	float theta[MaxOrder], dtheta[MaxOrder];
+	FillBSpline(0.0f, order, theta, dtheta);
+
+	moduli.assign(size, 0.0f);
+	for (uint32_t m = 0; m < size; m++)
+	{
+		double re = 0.0, im = 0.0;
+		for (uint32_t k = 0; k + 1 < order; k++)
+		{
+			double angle = 2.0 * Pi * m * k / size;
+			re += theta[order - 2 - k] * std::cos(angle);
+			im += theta[order - 2 - k] * std::sin(angle);
+		}
+		double denominator = re * re + im * im;
+		moduli[m] = denominator > 1e-7 ? (float)(1.0 / denominator) : 0.0f;
+	}
+
+	// Odd orders vanish at m = size / 2, patch those from the neighbors
+	for (uint32_t m = 0; m < size; m++)
+	{
+		if (moduli[m] == 0.0f)
+			moduli[m] = 0.5f * (moduli[(m + size - 1) % size] + moduli[(m + 1) % size]);
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "../aligned_allocator.h"
+#include "../fft.h"
+#include "force.h"
+
+class NonbondedForce;
+
+
+struct PmeProps
+{
+	// Upper bound on the mesh spacing, grid sizes are rounded up to fast FFT lengths
+	float GridSpacing;
+	// B-spline interpolation order, 4 is cubic
+	uint32_t Order;
+	// erfc(beta * cutoff), picks the Ewald coefficient that splits real and reciprocal space
+	float EwaldTolerance;
+
+	PmeProps(float gridSpacing = 0.12f, uint32_t order = 4, float ewaldTolerance = 1e-5f)
+		: GridSpacing(gridSpacing), Order(order), EwaldTolerance(ewaldTolerance) {
+	}
+};
+
+// Reciprocal-space half of smooth particle mesh Ewald (Essmann et al. 1995).
+// Charges are spread onto a mesh with B-splines, convolved with the Ewald
+// influence function through a real-to-complex FFT and the forces are
+// interpolated back with the spline derivatives. The erfc real-space half
+// runs inside the nonbonded kernels, so this force owns the Ewald coefficient
+// of the NonbondedForce it is paired with. Periodic boxes only; the mesh
+// follows the box vectors and the k-space sum runs over the reciprocal
+// lattice, so triclinic cells work the same as rectangular ones.
+//
+// The mesh sums erf(beta r) / r over every pair, so the pairs the neighbor
+// list's ExclusionList leaves out of the real-space sum get that term taken
+// back out again here.
+class PmeForce : public Force
+{
+public:
+	static constexpr uint32_t MaxOrder = 8;
+
+	PmeForce(NonbondedForce& nonbonded, const PmeProps& props = PmeProps());
+
+	// Also re-derives the Ewald coefficient from the nonbonded cutoff, call after changing it
+	void SetProps(const PmeProps& props);
+	const PmeProps& GetProps() const { return m_Props; }
+
+	float GetEwaldCoefficient() const;
+	const glm::uvec3& GetGridSize() const { return m_GridSize; }
+
+	virtual double Compute(ForceContext& ctx) override;
+	virtual const char* GetName() const override { return "PME"; }
+
+	// Split of the last evaluation, the self and net-charge terms are constant per configuration
+	double GetReciprocalEnergy() const { return m_ReciprocalEnergy; }
+	double GetSelfEnergy() const { return m_SelfEnergy; }
+	// Mesh energy of the excluded pairs, subtracted from the total
+	double GetExclusionEnergy() const { return m_ExclusionEnergy; }
+
+	// Smallest beta with erfc(beta * cutoff) <= tolerance
+	static float ComputeEwaldCoefficient(float cutoff, float tolerance);
+
+private:
+	void Setup(const SimulationBox& box, float beta, float coulomb);
+	void ComputeSplines(const AtomStore& atoms, ThreadPool* pool);
+	void SpreadCharges(const AtomStore& atoms, ThreadPool* pool);
+	double Convolve(ThreadPool* pool, double& virial);
+	// Real is the precision of the forces written, see ForceContext::GetForces
+	template<typename Real>
+	void GatherForces(ForceContext& ctx);
+	template<typename Real>
+	double SubtractExcluded(ForceContext& ctx, const ExclusionList& exclusions, float beta, float coulomb);
+
+	static void FillBSpline(float w, uint32_t order, float* theta, float* dtheta);
+	static void ComputeModuli(uint32_t order, uint32_t size, std::vector<float>& moduli);
+
+private:
+	NonbondedForce& m_Nonbonded;
+	PmeProps m_Props;
+
+	// Values the grid and influence function were built for
+	glm::uvec3 m_GridSize = glm::uvec3(0);
+	SimulationBox m_SetupBox{ glm::vec3(0.0f) };
+	glm::vec3 m_Reciprocal[3];                   // a*, b*, c* of the setup box
+	float m_SetupBeta = 0.0f;
+	float m_SetupCoulomb = 0.0f;
+	bool m_WarnedNonPeriodic = false;
+
+	RealFFT3D m_FFT;
+	AlignedVector<float> m_Grid;                 // charges, then the convolved potential
+	std::vector<RealFFT3D::Complex> m_Spectrum;
+	AlignedVector<float> m_Influence;            // per half-spectrum point, includes the spline moduli
+	AlignedVector<float> m_VirialWeight;         // per half-spectrum point, virial over energy of its term
+
+	// Per-atom spline weights, Order values per atom and axis, and the first grid point they hit
+	AlignedVector<float> m_ThetaX, m_ThetaY, m_ThetaZ;
+	AlignedVector<float> m_DThetaX, m_DThetaY, m_DThetaZ;
+	std::vector<uint32_t> m_StartX, m_StartY, m_StartZ;
+
+	// Atoms bucketed by their first x plane, so each slab only visits the atoms reaching it
+	std::vector<uint32_t> m_PlaneOffsets;
+	std::vector<uint32_t> m_PlaneAtoms;
+
+	struct alignas(64) ThreadEnergy
+	{
+		double Energy;
+		double Virial;
+	};
+	std::vector<ThreadEnergy> m_ThreadEnergy;
+
+	double m_ReciprocalEnergy = 0.0;
+	double m_SelfEnergy = 0.0;
+	double m_ExclusionEnergy = 0.0;
+};
@@ -0,0 +1,38 @@
+#include "barostat.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../units.h"
+
+
+Barostat::Barostat(const BarostatProps& props)
+	: m_Props(props), m_Random(props.Seed)
+{
+}
+
+double Barostat::Couple(double twiceKinetic, double virial, double volume, double dt)
+{
+	if (volume <= 0.0)
+		return 1.0;
+
+	// P = (2 K + W) / 3V with W = sum r . F
+	m_LastPressure = (twiceKinetic + virial) / (3.0 * volume) * BarPerPressureUnit;
+
+	const uint32_t interval = std::max(m_Props.Interval, 1u);
+	if (++m_Calls % interval != 0)
+		return 1.0;
+
+	// d(ln V) = -(beta / tau) (P0 - P - kT / V) dt + sqrt(2 kT beta dt / (V tau)) dW
+	const double period = dt * interval;
+	const double beta = m_Props.Compressibility;
+	const double tau = std::max((double)m_Props.TimeConstant, period);
+	const double kTOverV = BoltzmannConstant * m_Props.Temperature / volume * BarPerPressureUnit;
+
+	std::normal_distribution<double> normal;
+	const double drift = -beta / tau * (m_Props.Pressure - m_LastPressure - kTOverV) * period;
+	const double noise = std::sqrt(2.0 * kTOverV * beta * period / tau) * normal(m_Random);
+
+	// Isotropic, so each box vector takes a third of the log-volume change
+	return std::exp((drift + noise) / 3.0);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+
+struct BarostatProps
+{
+	// Reference pressure in bar
+	float Pressure;
+	// Relaxation time of the volume in ps
+	float TimeConstant;
+	// Isothermal compressibility in 1 / bar, water's by default. Only sets how
+	// fast the volume responds, the fluctuations come out right regardless
+	float Compressibility;
+	// Temperature of the volume noise in K, normally the thermostat's
+	float Temperature;
+	// Steps between couplings; each coupling scales for the whole interval
+	uint32_t Interval;
+	uint64_t Seed;
+
+	BarostatProps(float pressure = 1.0f, float timeConstant = 2.0f, float compressibility = 4.5e-5f, float temperature = 300.0f,
+		uint32_t interval = 10, uint64_t seed = 0xba5e)
+		: Pressure(pressure), TimeConstant(timeConstant), Compressibility(compressibility), Temperature(temperature),
+		  Interval(interval), Seed(seed) {
+	}
+};
+
+// Isotropic stochastic cell rescaling (C-rescale, Bernetti & Bussi 2020),
+// first order in the volume like Berendsen's barostat but with the noise that
+// makes it sample the isothermal-isobaric ensemble.
+//
+// Couple takes the kinetic energy and virial the last step produced anyway
+// and returns the factor the box and positions are to be scaled by. The
+// integrator applies it inside the next kick-drift loop, positions scaled by
+// it and velocities by its inverse, and scales the box with World::ScaleBox,
+// which keeps the neighbor list.
+class Barostat
+{
+public:
+	Barostat(const BarostatProps& props = BarostatProps());
+
+	const BarostatProps& GetProps() const { return m_Props; }
+	void SetPressure(float pressure) { m_Props.Pressure = pressure; }
+
+	// twiceKinetic is sum m v^2, virial sum r . F, volume the box volume.
+	// Called every step; only every Interval-th call returns anything but 1.
+	// Every rank of a decomposed world calls it with the same global sums
+	double Couple(double twiceKinetic, double virial, double volume, double dt);
+
+	// Instantaneous pressure in bar as of the last Couple
+	double GetLastPressure() const { return m_LastPressure; }
+
+private:
+	BarostatProps m_Props;
+	std::mt19937_64 m_Random;
+	uint64_t m_Calls = 0;
+	double m_LastPressure = 0.0;
+};
@@ -0,0 +1,55 @@
+#include "ensemble_coupling.h"
+
+#include "../domain/domain_decomposition.h"
+#include "../units.h"
+#include "../world.h"
+
+
+void EnsembleCoupling::Couple(World& world, double twiceKinetic, uint32_t movingAtoms, double dt)
+{
+	// Ghosts have no inverse mass, so the ranks' sums add up to the global ones
+	if (DomainDecomposition* domain = world.GetDomain())
+	{
+		double sums[2] = { twiceKinetic, (double)movingAtoms };
+		domain->GetTransport().AllReduceSum(sums, 2);
+		twiceKinetic = sums[0];
+		movingAtoms = (uint32_t)sums[1];
+	}
+
+	// Momentum is conserved, so the centre of mass takes three degrees of freedom with it
+	const ConstraintSolver& constraints = world.GetConstraints();
+	double degrees = 3.0 * movingAtoms - (double)world.GetTopology().GetConstrainedDegrees();
+	if (movingAtoms > 1)
+		degrees -= 3.0;
+
+	const double velocityScale = m_Thermostat ? m_Thermostat->Couple(twiceKinetic, degrees, dt) : 1.0;
+
+	const SimulationBox& box = world.GetBox();
+	double pressure = 0.0;
+	double positionScale = 1.0;
+	if (box.Periodic)
+	{
+		const double virial = world.GetVirial() + (constraints.IsEmpty() ? 0.0 : constraints.GetVirial());
+		const double volume = box.GetVolume();
+		pressure = (twiceKinetic + virial) / (3.0 * volume) * BarPerPressureUnit;
+		if (m_Barostat)
+			positionScale = m_Barostat->Couple(twiceKinetic, virial, volume, dt);
+	}
+
+	m_PendingVelocityScale = velocityScale;
+	m_PendingPositionScale = positionScale;
+
+	// As the next step will see it, after the scaling
+	const double applied = velocityScale / positionScale;
+	m_Observables.KineticEnergy = 0.5 * twiceKinetic * applied * applied;
+	m_Observables.DegreesOfFreedom = degrees;
+	m_Observables.Temperature = degrees > 0.0 ? 2.0 * m_Observables.KineticEnergy / (degrees * BoltzmannConstant) : 0.0;
+	m_Observables.Pressure = pressure;
+}
+
+void EnsembleCoupling::TakeScales(double& velocityScale, double& positionScale)
+{
+	velocityScale = m_PendingVelocityScale;
+	positionScale = m_PendingPositionScale;
+	m_PendingVelocityScale = m_PendingPositionScale = 1.0;
+}
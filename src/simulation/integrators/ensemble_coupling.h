@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "barostat.h"
+#include "thermostat.h"
+
+class World;
+
+
+// Instantaneous state at the end of the last step, made from what the update
+// loops and force kernels summed up on the side
+struct EnsembleObservables
+{
+	double KineticEnergy = 0.0;
+	double DegreesOfFreedom = 0.0;
+	double Temperature = 0.0;   // K
+	double Pressure = 0.0;      // bar, 0 for open boxes
+};
+
+// The thermostat and barostat an integrator couples once per step. Couple
+// takes the kinetic energy of the step's closing kick and the virial of its
+// force evaluation and decides the scaling; the integrator takes it with
+// TakeScales at the start of its next step and applies it there.
+class EnsembleCoupling
+{
+public:
+	// nullptr removes it. Any scaling still pending from the old one is dropped
+	void SetThermostat(std::unique_ptr<Thermostat> thermostat) { m_Thermostat = std::move(thermostat); m_PendingVelocityScale = 1.0; }
+	void SetBarostat(std::unique_ptr<Barostat> barostat) { m_Barostat = std::move(barostat); m_PendingPositionScale = 1.0; }
+	Thermostat* GetThermostat() { return m_Thermostat.get(); }
+	Barostat* GetBarostat() { return m_Barostat.get(); }
+
+	// twiceKinetic is sum m v^2 after the step and movingAtoms the atoms it
+	// runs over, both of this rank; dt is the step the scaling is for
+	void Couple(World& world, double twiceKinetic, uint32_t movingAtoms, double dt);
+	// Velocity and position scales the last Couple decided, 1 once taken
+	void TakeScales(double& velocityScale, double& positionScale);
+
+	const EnsembleObservables& GetObservables() const { return m_Observables; }
+
+private:
+	std::unique_ptr<Thermostat> m_Thermostat;
+	std::unique_ptr<Barostat> m_Barostat;
+	double m_PendingVelocityScale = 1.0;
+	double m_PendingPositionScale = 1.0;
+
+	EnsembleObservables m_Observables;
+};
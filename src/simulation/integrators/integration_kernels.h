@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "../atom_store.h"
+#include "../precision.h"
+
+
+// Streaming update loops shared by the integrators. Forces come in through
+// ForceStreams so callers can pass forces from any buffer laid out like the
+// store's; positions and velocities go through StateStreams.
+
+// The positions and velocities a policy advances. In single precision these
+// are the store's float streams, otherwise the precise ones, and every update
+// publishes a rounded copy to the float streams for the force kernels.
+template<typename Policy>
+struct StateStreams
+{
+	using State = typename Policy::State;
+
+	State* PosX; State* PosY; State* PosZ;
+	State* VelX; State* VelY; State* VelZ;
+	float* OutPosX; float* OutPosY; float* OutPosZ;
+	float* OutVelX; float* OutVelY; float* OutVelZ;
+
+	StateStreams(AtomStore& atoms)
+		: OutPosX(atoms.PosX.data()), OutPosY(atoms.PosY.data()), OutPosZ(atoms.PosZ.data()),
+		  OutVelX(atoms.VelX.data()), OutVelY(atoms.VelY.data()), OutVelZ(atoms.VelZ.data())
+	{
+		if constexpr (Policy::HasPreciseState)
+		{
+			PosX = atoms.PrecisePosX.data(); PosY = atoms.PrecisePosY.data(); PosZ = atoms.PrecisePosZ.data();
+			VelX = atoms.PreciseVelX.data(); VelY = atoms.PreciseVelY.data(); VelZ = atoms.PreciseVelZ.data();
+		}
+		else
+		{
+			PosX = OutPosX; PosY = OutPosY; PosZ = OutPosZ;
+			VelX = OutVelX; VelY = OutVelY; VelZ = OutVelZ;
+		}
+	}
+
+	void PublishPosition(uint32_t i) const
+	{
+		if constexpr (Policy::HasPreciseState)
+		{
+			OutPosX[i] = (float)PosX[i]; OutPosY[i] = (float)PosY[i]; OutPosZ[i] = (float)PosZ[i];
+		}
+	}
+
+	void PublishVelocity(uint32_t i) const
+	{
+		if constexpr (Policy::HasPreciseState)
+		{
+			OutVelX[i] = (float)VelX[i]; OutVelY[i] = (float)VelY[i]; OutVelZ[i] = (float)VelZ[i];
+		}
+	}
+
+	// Takes over changes something else made to the float streams since the
+	// last publish, e.g. constraint corrections, as a delta on the precise state
+	void Absorb(uint32_t begin, uint32_t end) const
+	{
+		if constexpr (Policy::HasPreciseState)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				PosX[i] += OutPosX[i] - (float)PosX[i]; PosY[i] += OutPosY[i] - (float)PosY[i]; PosZ[i] += OutPosZ[i] - (float)PosZ[i];
+				VelX[i] += OutVelX[i] - (float)VelX[i]; VelY[i] += OutVelY[i] - (float)VelY[i]; VelZ[i] += OutVelZ[i] - (float)VelZ[i];
+			}
+		}
+	}
+};
+
+// The forces a policy kicks with: the float streams, or the double ones with
+// precise forces. Store is an AtomStore or anything else holding ForceX /
+// PreciseForceX style streams, such as a RESPA level's saved forces
+template<typename Policy>
+struct ForceStreams
+{
+	using ForceReal = typename Policy::ForceReal;
+
+	const ForceReal* X; const ForceReal* Y; const ForceReal* Z;
+
+	template<typename Store>
+	ForceStreams(const Store& store)
+	{
+		if constexpr (Policy::HasPreciseForces)
+		{
+			X = store.PreciseForceX.data(); Y = store.PreciseForceY.data(); Z = store.PreciseForceZ.data();
+		}
+		else
+		{
+			X = store.ForceX.data(); Y = store.ForceY.data(); Z = store.ForceZ.data();
+		}
+	}
+};
+
+// Sums the update loops hand back on the side, so thermostats and barostats
+// need no reduction pass of their own
+struct KineticSums
+{
+	// sum m v^2 over the atoms that move
+	double TwiceKinetic = 0.0;
+	// Atoms with a nonzero inverse mass, ghosts and frozen atoms do not count
+	uint32_t MovingAtoms = 0;
+
+	KineticSums& operator+=(const KineticSums& other)
+	{
+		TwiceKinetic += other.TwiceKinetic;
+		MovingAtoms += other.MovingAtoms;
+		return *this;
+	}
+};
+
+// SplitMix64 finalizer. Hashing (key, counter) gives random bits that do not
+// depend on which thread asks for them
+inline uint64_t MixBits(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+// Two standard normal deviates from 64 random bits, by Box-Muller
+template<typename Real>
+inline void GaussianPair(uint64_t bits, Real& a, Real& b)
+{
+	const Real u1 = (Real)(((bits >> 32) + 0.5) * (1.0 / 4294967296.0));
+	const Real u2 = (Real)(((bits & 0xffffffffull) + 0.5) * (1.0 / 4294967296.0));
+	const Real radius = std::sqrt(Real(-2) * std::log(u1));
+	const Real angle = Real(6.283185307179586) * u2;
+	a = radius * std::cos(angle);
+	b = radius * std::sin(angle);
+}
+
+// v += dt/2 * F/m, returning sum m v^2 of the kicked velocities
+template<typename Policy>
+inline KineticSums KickAtoms(const StateStreams<Policy>& s, const ForceStreams<Policy>& f,
+	const float* invMass, const float* mass, uint32_t begin, uint32_t end, typename Policy::Real halfDt)
+{
+	using Real = typename Policy::Real;
+	Real twiceKinetic = 0;
+	uint32_t moving = 0;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		Real k = halfDt * invMass[i];
+		s.VelX[i] += k * f.X[i]; s.VelY[i] += k * f.Y[i]; s.VelZ[i] += k * f.Z[i];
+		s.PublishVelocity(i);
+
+		Real vx = (Real)s.VelX[i], vy = (Real)s.VelY[i], vz = (Real)s.VelZ[i];
+		twiceKinetic += invMass[i] > 0.0f ? mass[i] * (vx * vx + vy * vy + vz * vz) : Real(0);
+		moving += invMass[i] > 0.0f;
+	}
+
+	KineticSums sums;
+	sums.TwiceKinetic = twiceKinetic;
+	sums.MovingAtoms = moving;
+	return sums;
+}
+
+// x += dt * v
+template<typename Policy>
+inline void DriftAtoms(const StateStreams<Policy>& s, uint32_t begin, uint32_t end, typename Policy::Real dt)
+{
+	using Real = typename Policy::Real;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		s.PosX[i] += dt * (Real)s.VelX[i]; s.PosY[i] += dt * (Real)s.VelY[i]; s.PosZ[i] += dt * (Real)s.VelZ[i];
+		s.PublishPosition(i);
+	}
+}
+
+// v *= velocityScale, x *= positionScale, for integrators whose update
+// loops have no room for the thermostat and barostat scaling
+template<typename Policy>
+inline void ScaleAtoms(const StateStreams<Policy>& s, uint32_t begin, uint32_t end,
+	typename Policy::Real velocityScale, typename Policy::Real positionScale)
+{
+	for (uint32_t i = begin; i < end; i++)
+	{
+		s.VelX[i] *= velocityScale; s.VelY[i] *= velocityScale; s.VelZ[i] *= velocityScale;
+		s.PosX[i] *= positionScale; s.PosY[i] *= positionScale; s.PosZ[i] *= positionScale;
+		s.PublishVelocity(i);
+		s.PublishPosition(i);
+	}
+}
+
+// Kick followed by drift, fused so the arrays are streamed once. Thermostat
+// and barostat scaling rides along: velocities are scaled by velocityScale
+// before the kick and positions by positionScale before the drift
+template<typename Policy>
+inline void KickDriftAtoms(const StateStreams<Policy>& s, const ForceStreams<Policy>& f,
+	const float* invMass, uint32_t begin, uint32_t end, typename Policy::Real dt,
+	typename Policy::Real velocityScale = 1, typename Policy::Real positionScale = 1)
+{
+	using Real = typename Policy::Real;
+	const Real halfDt = Real(0.5) * dt;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		Real k = halfDt * invMass[i];
+		s.VelX[i] = velocityScale * s.VelX[i] + k * f.X[i];
+		s.VelY[i] = velocityScale * s.VelY[i] + k * f.Y[i];
+		s.VelZ[i] = velocityScale * s.VelZ[i] + k * f.Z[i];
+		s.PosX[i] = positionScale * s.PosX[i] + dt * (Real)s.VelX[i];
+		s.PosY[i] = positionScale * s.PosY[i] + dt * (Real)s.VelY[i];
+		s.PosZ[i] = positionScale * s.PosZ[i] + dt * (Real)s.VelZ[i];
+		s.PublishVelocity(i);
+		s.PublishPosition(i);
+	}
+}
+
+// Kick, half drift, Langevin friction and noise, half drift: the B A O A part
+// of BAOAB in one loop. friction is exp(-gamma dt) and kT the bath's k_B T;
+// the noise of atom i is keyed on (key, i). Scales as in KickDriftAtoms
+template<typename Policy>
+inline void KickDriftLangevinAtoms(const StateStreams<Policy>& s, const ForceStreams<Policy>& f,
+	const float* invMass, uint32_t begin, uint32_t end, typename Policy::Real dt,
+	typename Policy::Real friction, typename Policy::Real kT, uint64_t key,
+	typename Policy::Real velocityScale = 1, typename Policy::Real positionScale = 1)
+{
+	using Real = typename Policy::Real;
+	using State = typename Policy::State;
+	const Real halfDt = Real(0.5) * dt;
+	const Real noise = std::sqrt((Real(1) - friction * friction) * kT);
+	for (uint32_t i = begin; i < end; i++)
+	{
+		Real k = halfDt * invMass[i];
+		Real vx = (Real)(velocityScale * s.VelX[i] + k * f.X[i]);
+		Real vy = (Real)(velocityScale * s.VelY[i] + k * f.Y[i]);
+		Real vz = (Real)(velocityScale * s.VelZ[i] + k * f.Z[i]);
+		State x = positionScale * s.PosX[i] + halfDt * vx;
+		State y = positionScale * s.PosY[i] + halfDt * vy;
+		State z = positionScale * s.PosZ[i] + halfDt * vz;
+
+		Real gx, gy, gz, unused;
+		GaussianPair(MixBits(key + 2 * uint64_t(i)), gx, gy);
+		GaussianPair(MixBits(key + 2 * uint64_t(i) + 1), gz, unused);
+		const Real sigma = noise * std::sqrt((Real)invMass[i]);
+		vx = friction * vx + sigma * gx; vy = friction * vy + sigma * gy; vz = friction * vz + sigma * gz;
+
+		s.VelX[i] = vx; s.VelY[i] = vy; s.VelZ[i] = vz;
+		s.PosX[i] = x + halfDt * vx; s.PosY[i] = y + halfDt * vy; s.PosZ[i] = z + halfDt * vz;
+		s.PublishVelocity(i);
+		s.PublishPosition(i);
+	}
+}
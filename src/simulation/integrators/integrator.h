@@ -0,0 +1,17 @@
+#pragma once
+
+class World;
+
+
+class Integrator
+{
+public:
+	Integrator() {}
+	virtual ~Integrator() {}
+
+	// Advances the world by one timestep, leaving forces valid for the new positions
+	virtual void Step(World& world) = 0;
+
+	virtual float GetTimestep() const = 0;
+	virtual void SetTimestep(float dt) = 0;
+};
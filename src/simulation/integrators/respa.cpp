@@ -0,0 +1,300 @@
+#include "respa.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "integration_kernels.h"
+#include "../world.h"
+#include "../../logging/log.h"
+
+
+RespaIntegrator::RespaIntegrator(float innerTimestep)
+	: m_InnerTimestep(innerTimestep)
+{
+	std::fill(std::begin(m_GroupInterval), std::end(m_GroupInterval), 1u);
+}
+
+void RespaIntegrator::SetGroupInterval(uint32_t group, uint32_t interval)
+{
+	m_GroupInterval[group] = std::max(1u, interval);
+	m_ConfiguredGroups |= ForceGroupBit(group);
+	m_LevelsDirty = true;
+}
+
+bool RespaIntegrator::SetThermostat(std::unique_ptr<Thermostat> thermostat)
+{
+	if (thermostat && thermostat->IsLangevin())
+	{
+		PY_CORE_ERROR("RESPA does not support the Langevin thermostat, use one of the rescaling ones");
+		return false;
+	}
+
+	if (thermostat)
+		PY_CORE_INFO("RESPA couples the {0} thermostat once per outer step", ThermostatKindToString(thermostat->GetKind()));
+	m_Coupling.SetThermostat(std::move(thermostat));
+	return true;
+}
+
+void RespaIntegrator::SetBarostat(std::unique_ptr<Barostat> barostat)
+{
+	if (barostat)
+		PY_CORE_INFO("RESPA couples the barostat once per outer step");
+	m_Coupling.SetBarostat(std::move(barostat));
+}
+
+float RespaIntegrator::GetTimestep() const
+{
+	// Groups left at the default interval of 1 cannot change the outermost one
+	const std::vector<LevelPlan> plan = PlanLevels(m_ConfiguredGroups);
+	return m_InnerTimestep * (plan.empty() ? 1u : plan.back().Interval);
+}
+
+void RespaIntegrator::SetTimestep(float dt)
+{
+	const std::vector<LevelPlan> plan = PlanLevels(m_ConfiguredGroups);
+	m_InnerTimestep = dt / (plan.empty() ? 1u : plan.back().Interval);
+}
+
+std::vector<RespaIntegrator::LevelPlan> RespaIntegrator::PlanLevels(uint32_t groups) const
+{
+	std::vector<uint32_t> intervals;
+	for (uint32_t group = 0; group < MaxForceGroups; group++)
+	{
+		if (groups & ForceGroupBit(group))
+			intervals.push_back(m_GroupInterval[group]);
+	}
+	std::sort(intervals.begin(), intervals.end());
+	intervals.erase(std::unique(intervals.begin(), intervals.end()), intervals.end());
+
+	// Each interval is rounded up to a multiple of the one below, which may
+	// merge it into the next level
+	std::vector<LevelPlan> plan;
+	for (uint32_t interval : intervals)
+	{
+		uint32_t mask = 0;
+		for (uint32_t group = 0; group < MaxForceGroups; group++)
+		{
+			if ((groups & ForceGroupBit(group)) && m_GroupInterval[group] == interval)
+				mask |= ForceGroupBit(group);
+		}
+
+		if (!plan.empty() && interval % plan.back().Interval != 0)
+			interval = (interval / plan.back().Interval + 1) * plan.back().Interval;
+		if (!plan.empty() && plan.back().Interval == interval)
+			plan.back().GroupMask |= mask;
+		else
+			plan.push_back({ interval, mask });
+	}
+	return plan;
+}
+
+void RespaIntegrator::BuildLevels(uint32_t usedGroups)
+{
+	m_Levels.clear();
+
+	// Configured groups without forces still count, so the levels take the
+	// outer timestep GetTimestep reports
+	for (const LevelPlan& planned : PlanLevels(usedGroups | m_ConfiguredGroups))
+	{
+		for (uint32_t group = 0; group < MaxForceGroups; group++)
+		{
+			if ((planned.GroupMask & ForceGroupBit(group)) && m_GroupInterval[group] != planned.Interval)
+				PY_CORE_WARN("RESPA interval {} of force group {} does not divide the levels above it, using {}", m_GroupInterval[group], group, planned.Interval);
+		}
+
+		Level level;
+		level.Interval = planned.Interval;
+		level.GroupMask = planned.GroupMask;
+		m_Levels.push_back(std::move(level));
+	}
+
+	m_LevelGroups = usedGroups;
+	m_LevelsDirty = false;
+	m_ForcesPrimed = false;
+}
+
+void RespaIntegrator::ComputeLevelForces(World& world, Level& level)
+{
+	AtomStore& atoms = world.GetAtoms();
+
+	// A level of configured groups without forces only sets the pace
+	if (!(level.GroupMask & m_LevelGroups))
+	{
+		level.ForceX.assign(atoms.Size(), 0.0f);
+		level.ForceY.assign(atoms.Size(), 0.0f);
+		level.ForceZ.assign(atoms.Size(), 0.0f);
+		level.PreciseForceX.assign(atoms.HasPreciseForces() ? atoms.Size() : 0, 0.0);
+		level.PreciseForceY.assign(atoms.HasPreciseForces() ? atoms.Size() : 0, 0.0);
+		level.PreciseForceZ.assign(atoms.HasPreciseForces() ? atoms.Size() : 0, 0.0);
+		return;
+	}
+
+	world.ComputeForces(level.GroupMask);
+
+	// Swapping keeps the level's forces without copying, StoreTotalForces puts
+	// the full force back at the end of the step
+	level.ForceX.resize(atoms.Size());
+	level.ForceY.resize(atoms.Size());
+	level.ForceZ.resize(atoms.Size());
+	std::swap(level.ForceX, atoms.ForceX);
+	std::swap(level.ForceY, atoms.ForceY);
+	std::swap(level.ForceZ, atoms.ForceZ);
+	if (atoms.HasPreciseForces())
+	{
+		level.PreciseForceX.resize(atoms.Size());
+		level.PreciseForceY.resize(atoms.Size());
+		level.PreciseForceZ.resize(atoms.Size());
+		std::swap(level.PreciseForceX, atoms.PreciseForceX);
+		std::swap(level.PreciseForceY, atoms.PreciseForceY);
+		std::swap(level.PreciseForceZ, atoms.PreciseForceZ);
+	}
+	world.DiscardForces();
+}
+
+void RespaIntegrator::StoreTotalForces(World& world)
+{
+	AtomStore& atoms = world.GetAtoms();
+	const bool precise = atoms.HasPreciseForces();
+	world.ParallelForAtoms([&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				if (precise)
+				{
+					double x = 0.0, y = 0.0, z = 0.0;
+					for (const Level& level : m_Levels)
+					{
+						x += level.PreciseForceX[i]; y += level.PreciseForceY[i]; z += level.PreciseForceZ[i];
+					}
+					atoms.PreciseForceX[i] = x; atoms.PreciseForceY[i] = y; atoms.PreciseForceZ[i] = z;
+				}
+				else
+				{
+					float x = 0.0f, y = 0.0f, z = 0.0f;
+					for (const Level& level : m_Levels)
+					{
+						x += level.ForceX[i]; y += level.ForceY[i]; z += level.ForceZ[i];
+					}
+					atoms.ForceX[i] = x; atoms.ForceY[i] = y; atoms.ForceZ[i] = z;
+				}
+			}
+			if (precise)
+				atoms.RoundPreciseForces(begin, end);
+		});
+	world.MarkForcesCurrent();
+}
+
+template<typename Policy>
+void RespaIntegrator::StepOuter(World& world)
+{
+	using Real = typename Policy::Real;
+
+	AtomStore& atoms = world.GetAtoms();
+	ConstraintSolver& constraints = world.GetConstraints();
+	const StateStreams<Policy> state(atoms);
+
+	// Coupling decided at the end of the last step. The level kicks and drifts
+	// are too many to carry it, so it gets a pass of its own when there is any
+	double velocityScale, positionScale;
+	m_Coupling.TakeScales(velocityScale, positionScale);
+	if (velocityScale != 1.0 || positionScale != 1.0)
+	{
+		if (positionScale != 1.0)
+			world.ScaleBox((float)positionScale);
+		world.ParallelForAtoms([&](uint32_t begin, uint32_t end)
+			{
+				ScaleAtoms(state, begin, end, (Real)(velocityScale / positionScale), (Real)positionScale);
+			});
+	}
+
+	KineticSums sums = StepLevel<Policy>(world, static_cast<uint32_t>(m_Levels.size() - 1));
+
+	if (!constraints.IsEmpty())
+	{
+		constraints.ConstrainVelocities(atoms, world.GetBox(), world.GetThreadPool());
+		world.ParallelForAtoms([&](uint32_t begin, uint32_t end) { state.Absorb(begin, end); });
+		sums.TwiceKinetic += 2.0 * constraints.GetKineticEnergyChange();
+	}
+
+	m_Coupling.Couple(world, sums.TwiceKinetic, sums.MovingAtoms, m_InnerTimestep * m_Levels.back().Interval);
+}
+
+template<typename Policy>
+KineticSums RespaIntegrator::StepLevel(World& world, uint32_t levelIndex)
+{
+	using Real = typename Policy::Real;
+
+	AtomStore& atoms = world.GetAtoms();
+	ConstraintSolver& constraints = world.GetConstraints();
+	Level& level = m_Levels[levelIndex];
+	const Real dt = Real(m_InnerTimestep) * level.Interval;
+	const StateStreams<Policy> state(atoms);
+
+	auto kick = [&]()
+	{
+		const ForceStreams<Policy> forces(level);
+		return world.ParallelReduceAtoms<KineticSums>([&](uint32_t begin, uint32_t end)
+			{
+				return KickAtoms(state, forces, atoms.InvMass.data(), atoms.Mass.data(), begin, end, Real(0.5) * dt);
+			});
+	};
+
+	kick();
+
+	if (levelIndex == 0)
+	{
+		const bool constrained = !constraints.IsEmpty();
+		if (constrained)
+			constraints.SaveReference(atoms, world.GetThreadPool());
+
+		world.ParallelForAtoms([&](uint32_t begin, uint32_t end)
+			{
+				DriftAtoms(state, begin, end, dt);
+			});
+
+		if (constrained)
+		{
+			constraints.ConstrainPositions(atoms, world.GetBox(), (float)dt, world.GetThreadPool());
+			world.ParallelForAtoms([&](uint32_t begin, uint32_t end) { state.Absorb(begin, end); });
+		}
+	}
+	else
+	{
+		uint32_t substeps = level.Interval / m_Levels[levelIndex - 1].Interval;
+		for (uint32_t s = 0; s < substeps; s++)
+			StepLevel<Policy>(world, levelIndex - 1);
+	}
+
+	ComputeLevelForces(world, level);
+
+	return kick();
+}
+
+void RespaIntegrator::Step(World& world)
+{
+	uint32_t usedGroups = world.GetUsedForceGroups();
+	if (m_LevelsDirty || usedGroups != m_LevelGroups)
+	{
+		BuildLevels(usedGroups);
+		if (!m_Levels.empty() && !world.GetConstraints().IsEmpty())
+			PY_CORE_INFO("RESPA constrains positions after every innermost drift and velocities once per outer step");
+	}
+
+	if (m_Levels.empty())
+		return;
+
+	// Level forces are stale after anything touched the system outside the integrator
+	if (!m_ForcesPrimed || world.GetRevision() != m_PrimedRevision)
+	{
+		for (auto& level : m_Levels)
+			ComputeLevelForces(world, level);
+		m_ForcesPrimed = true;
+		m_PrimedRevision = world.GetRevision();
+	}
+
+	DispatchPrecision(world.GetPrecision(), [&](auto policy) { StepOuter<decltype(policy)>(world); });
+
+	// Everything after the step, writers, the renderer and switching
+	// integrators, reads the full force from the store
+	StoreTotalForces(world);
+}
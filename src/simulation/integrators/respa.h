@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ensemble_coupling.h"
+#include "integrator.h"
+#include "../aligned_allocator.h"
+#include "../forces/force.h"
+
+struct KineticSums;
+
+
+// Reversible multiple-time-step integrator (r-RESPA). Every force group is
+// given an interval k in units of the innermost timestep; groups sharing an
+// interval form one level and each level kicks with its own forces around
+// the levels below it:
+//
+//   kick(F_L, dt_L / 2), (k_L / k_L-1) x inner level, recompute F_L, kick(F_L, dt_L / 2)
+//
+// Intervals of successive levels must divide each other. Groups without an
+// interval are evaluated every inner step.
+//
+// Constraints in the world's topology are solved as in velocity Verlet,
+// positions after every inner drift and velocities after the outer step's
+// closing kick. A thermostat and a barostat couple once per outer step: they
+// see the kinetic energy after the closing kick, and their scaling is applied
+// in a pass of its own before the next outer step.
+class RespaIntegrator : public Integrator
+{
+public:
+	RespaIntegrator(float innerTimestep = 0.001f);
+
+	void SetGroupInterval(uint32_t group, uint32_t interval);
+	uint32_t GetGroupInterval(uint32_t group) const { return m_GroupInterval[group]; }
+
+	virtual void Step(World& world) override;
+
+	// Time advanced per Step(), i.e. the outermost level's timestep. Worked
+	// out from the configured intervals, so it is right before the first step
+	virtual float GetTimestep() const override;
+	// Sets the outermost timestep, the inner one follows from the intervals
+	// configured so far; changing them later keeps the inner timestep
+	virtual void SetTimestep(float dt) override;
+
+	float GetInnerTimestep() const { return m_InnerTimestep; }
+	void SetInnerTimestep(float dt) { m_InnerTimestep = dt; }
+
+	// nullptr removes it. Refuses Langevin, whose friction acts inside every
+	// drift, false after logging why
+	bool SetThermostat(std::unique_ptr<Thermostat> thermostat);
+	void SetBarostat(std::unique_ptr<Barostat> barostat);
+	Thermostat* GetThermostat() { return m_Coupling.GetThermostat(); }
+	Barostat* GetBarostat() { return m_Coupling.GetBarostat(); }
+
+	const EnsembleObservables& GetObservables() const { return m_Coupling.GetObservables(); }
+
+private:
+	struct Level
+	{
+		uint32_t Interval;
+		uint32_t GroupMask;
+		// The store's force streams as of the level's last evaluation, the
+		// precise ones only filled with precise forces
+		AlignedVector<float> ForceX, ForceY, ForceZ;
+		AlignedVector<double> PreciseForceX, PreciseForceY, PreciseForceZ;
+	};
+
+	// Intervals of the given groups after rounding, ascending
+	struct LevelPlan
+	{
+		uint32_t Interval;
+		uint32_t GroupMask;
+	};
+	std::vector<LevelPlan> PlanLevels(uint32_t groups) const;
+	void BuildLevels(uint32_t usedGroups);
+	template<typename Policy>
+	void StepOuter(World& world);
+	// Returns the sums of the level's closing kick
+	template<typename Policy>
+	KineticSums StepLevel(World& world, uint32_t level);
+	void ComputeLevelForces(World& world, Level& level);
+	// Sums the levels' forces back into the store's force streams
+	void StoreTotalForces(World& world);
+
+private:
+	float m_InnerTimestep;
+	uint32_t m_GroupInterval[MaxForceGroups];
+	// Groups given an interval with SetGroupInterval
+	uint32_t m_ConfiguredGroups = 0;
+
+	std::vector<Level> m_Levels;
+	bool m_LevelsDirty = true;
+	uint32_t m_LevelGroups = 0;
+	bool m_ForcesPrimed = false;
+	uint64_t m_PrimedRevision = 0;
+
+	EnsembleCoupling m_Coupling;
+};
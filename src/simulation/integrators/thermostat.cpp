@@ -0,0 +1,177 @@
+#include "thermostat.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "integration_kernels.h"
+#include "../units.h"
+
+
+namespace
+{
+	constexpr double Pi = 3.14159265358979323846;
+}
+
+const char* ThermostatKindToString(ThermostatKind kind)
+{
+	switch (kind)
+	{
+	case ThermostatKind::Berendsen:       return "Berendsen";
+	case ThermostatKind::VelocityRescale: return "velocity rescale";
+	case ThermostatKind::NoseHooverChain: return "Nose-Hoover chain";
+	case ThermostatKind::Langevin:        return "Langevin";
+	}
+	return "unknown";
+}
+
+Thermostat::Thermostat(const ThermostatProps& props)
+	: m_Props(props), m_Random(props.Seed)
+{
+	Reset();
+}
+
+void Thermostat::Reset()
+{
+	m_ChainPositions.assign(std::max(m_Props.ChainLength, 1u), 0.0);
+	m_ChainVelocities.assign(std::max(m_Props.ChainLength, 1u), 0.0);
+	m_ChainDegrees = 0.0;
+	m_ExchangedEnergy = 0.0;
+}
+
+double Thermostat::GetKT() const
+{
+	return BoltzmannConstant * m_Props.Temperature;
+}
+
+double Thermostat::GetFrictionFactor(double dt) const
+{
+	return m_Props.TimeConstant > 0.0f ? std::exp(-dt / m_Props.TimeConstant) : 0.0;
+}
+
+uint64_t Thermostat::NextNoiseKey(uint32_t rank)
+{
+	m_NoiseStep++;
+	return MixBits(MixBits(m_Props.Seed ^ (m_NoiseStep << 20)) + rank);
+}
+
+double Thermostat::Couple(double twiceKinetic, double degrees, double dt)
+{
+	if (twiceKinetic <= 0.0 || degrees <= 0.0)
+		return 1.0;
+
+	const double kinetic = 0.5 * twiceKinetic;
+	double scale = 1.0;
+
+	switch (m_Props.Kind)
+	{
+	case ThermostatKind::Berendsen:
+	{
+		const double temperature = twiceKinetic / (degrees * BoltzmannConstant);
+		const double tau = std::max((double)m_Props.TimeConstant, dt);
+		// Clamped like GROMACS does, so a bad start does not blow the system apart
+		scale = std::sqrt(std::clamp(1.0 + dt / tau * (m_Props.Temperature / temperature - 1.0), 0.64, 1.5625));
+		break;
+	}
+	case ThermostatKind::VelocityRescale:
+		scale = StochasticRescale(kinetic, degrees, dt);
+		break;
+	case ThermostatKind::NoseHooverChain:
+	{
+		// The half update closing this step and the one opening the next meet
+		// here, with nothing in between, so both run now
+		const double first = PropagateChain(twiceKinetic, degrees, 0.5 * dt);
+		const double second = PropagateChain(twiceKinetic * first * first, degrees, 0.5 * dt);
+		return first * second;
+	}
+	case ThermostatKind::Langevin:
+		return 1.0;
+	}
+
+	m_ExchangedEnergy += kinetic * (1.0 - scale * scale);
+	return scale;
+}
+
+double Thermostat::StochasticRescale(double kinetic, double degrees, double dt)
+{
+	// Bussi, Donadio & Parrinello 2007: the kinetic energy follows its own
+	// Langevin equation with the canonical distribution as stationary state
+	std::normal_distribution<double> normal;
+	const double target = 0.5 * degrees * GetKT();
+	const double c = m_Props.TimeConstant > 0.0f ? std::exp(-dt / m_Props.TimeConstant) : 0.0;
+
+	const double r1 = normal(m_Random);
+	// Sum of degrees - 1 squared normal deviates
+	double sumSquares = 0.0;
+	if (degrees > 1.0)
+	{
+		std::gamma_distribution<double> gamma(0.5 * (degrees - 1.0), 1.0);
+		sumSquares = 2.0 * gamma(m_Random);
+	}
+
+	const double ratio = target / (degrees * kinetic);
+	const double alpha2 = c + (1.0 - c) * (sumSquares + r1 * r1) * ratio + 2.0 * r1 * std::sqrt(c * (1.0 - c) * ratio);
+	const double sign = (c < 1.0 && r1 + std::sqrt(c / ((1.0 - c) * ratio)) < 0.0) ? -1.0 : 1.0;
+	return sign * std::sqrt(std::max(alpha2, 0.0));
+}
+
+double Thermostat::PropagateChain(double twiceKinetic, double degrees, double h)
+{
+	const size_t length = m_ChainVelocities.size();
+	const double kT = GetKT();
+	const double tau = std::max((double)m_Props.TimeConstant, 1e-6);
+
+	// Masses for oscillations of period tau, the first one couples to every degree of freedom
+	const double unitMass = kT * tau * tau / (4.0 * Pi * Pi);
+	auto mass = [&](size_t k) { return k == 0 ? degrees * unitMass : unitMass; };
+	auto force = [&](size_t k, double twoK)
+	{
+		if (k == 0)
+			return (twoK - degrees * kT) / mass(0);
+		return (mass(k - 1) * m_ChainVelocities[k - 1] * m_ChainVelocities[k - 1] - kT) / mass(k);
+	};
+
+	std::vector<double>& v = m_ChainVelocities;
+	const double quarter = 0.25 * h;
+
+	// Outside in: each thermostat is kicked by the one before it and damped by the one after
+	v[length - 1] += 0.5 * h * force(length - 1, twiceKinetic);
+	for (size_t k = length - 1; k-- > 0;)
+	{
+		const double damp = std::exp(-quarter * v[k + 1]);
+		v[k] = v[k] * damp * damp + 0.5 * h * force(k, twiceKinetic) * damp;
+	}
+
+	const double scale = std::exp(-h * v[0]);
+	twiceKinetic *= scale * scale;
+	for (size_t k = 0; k < length; k++)
+		m_ChainPositions[k] += h * v[k];
+
+	for (size_t k = 0; k + 1 < length; k++)
+	{
+		const double damp = std::exp(-quarter * v[k + 1]);
+		v[k] = v[k] * damp * damp + 0.5 * h * force(k, twiceKinetic) * damp;
+	}
+	v[length - 1] += 0.5 * h * force(length - 1, twiceKinetic);
+
+	m_ChainDegrees = degrees;
+	return scale;
+}
+
+double Thermostat::GetReservoirEnergy() const
+{
+	if (m_Props.Kind != ThermostatKind::NoseHooverChain)
+		return m_ExchangedEnergy;
+
+	const double kT = GetKT();
+	const double tau = std::max((double)m_Props.TimeConstant, 1e-6);
+	const double unitMass = kT * tau * tau / (4.0 * Pi * Pi);
+
+	double energy = 0.0;
+	for (size_t k = 0; k < m_ChainVelocities.size(); k++)
+	{
+		const double mass = k == 0 ? m_ChainDegrees * unitMass : unitMass;
+		energy += 0.5 * mass * m_ChainVelocities[k] * m_ChainVelocities[k];
+		energy += (k == 0 ? m_ChainDegrees : 1.0) * kT * m_ChainPositions[k];
+	}
+	return energy;
+}
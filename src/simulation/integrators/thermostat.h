@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+
+enum class ThermostatKind
+{
+	Berendsen,
+	VelocityRescale,
+	NoseHooverChain,
+	Langevin
+};
+
+const char* ThermostatKindToString(ThermostatKind kind);
+
+struct ThermostatProps
+{
+	ThermostatKind Kind;
+	// Reference temperature in K
+	float Temperature;
+	// Coupling time in ps: tau_T of the rescaling thermostats, the period of
+	// the chain's oscillation, and one over the friction for Langevin
+	float TimeConstant;
+	// Thermostats in a Nose-Hoover chain
+	uint32_t ChainLength;
+	uint64_t Seed;
+
+	ThermostatProps(ThermostatKind kind = ThermostatKind::VelocityRescale, float temperature = 300.0f, float timeConstant = 0.1f,
+		uint32_t chainLength = 3, uint64_t seed = 0x5eed)
+		: Kind(kind), Temperature(temperature), TimeConstant(timeConstant), ChainLength(chainLength), Seed(seed) {
+	}
+};
+
+// Temperature coupling for velocity Verlet. None of the kinds has a loop of
+// its own over the atoms:
+//
+//   Berendsen         weak coupling, velocities scaled towards the reference
+//   VelocityRescale   Bussi's stochastic rescaling, samples the canonical ensemble
+//   NoseHooverChain   deterministic chain of Martyna, Klein & Tuckerman
+//   Langevin          friction and noise on every atom (BAOAB splitting)
+//
+// The first three only need the kinetic energy the closing kick sums up on
+// the side. Couple turns it into a velocity scale, which the integrator folds
+// into the next step's first kick; the velocities in the store lag that scale
+// by a step. Langevin acts inside the kick-drift loop itself, with per-atom
+// noise from a counter-based generator.
+class Thermostat
+{
+public:
+	Thermostat(const ThermostatProps& props = ThermostatProps());
+
+	const ThermostatProps& GetProps() const { return m_Props; }
+	ThermostatKind GetKind() const { return m_Props.Kind; }
+	void SetTemperature(float temperature) { m_Props.Temperature = temperature; }
+	// k_B T of the reference temperature in engine units
+	double GetKT() const;
+
+	bool IsLangevin() const { return m_Props.Kind == ThermostatKind::Langevin; }
+	// exp(-dt / tau), the share of the velocity the Langevin friction keeps over dt
+	double GetFrictionFactor(double dt) const;
+	// Key for the next step's per-atom Langevin noise, distinct per step and rank
+	uint64_t NextNoiseKey(uint32_t rank);
+
+	// Called at the end of every step with sum m v^2 and the degrees of
+	// freedom it is spread over. Returns the factor the velocities are to be
+	// scaled by, 1 for Langevin. Every rank of a decomposed world calls it with
+	// the same global sums and draws the same random numbers
+	double Couple(double twiceKinetic, double degrees, double dt);
+
+	// Energy the thermostat has taken out of the system, including the chain's
+	// own; total energy plus this is conserved. Not tracked for Langevin
+	double GetReservoirEnergy() const;
+	// Forgets the chain state and the energy exchanged so far
+	void Reset();
+
+private:
+	double StochasticRescale(double kinetic, double degrees, double dt);
+	// One Nose-Hoover chain update of length h, returns the velocity scale
+	double PropagateChain(double twiceKinetic, double degrees, double h);
+
+private:
+	ThermostatProps m_Props;
+	std::mt19937_64 m_Random;
+	uint64_t m_NoiseStep = 0;
+
+	std::vector<double> m_ChainPositions;
+	std::vector<double> m_ChainVelocities;
+	double m_ChainDegrees = 0.0;
+	double m_ExchangedEnergy = 0.0;
+};
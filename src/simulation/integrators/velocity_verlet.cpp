@@ -0,0 +1,80 @@
+#include "velocity_verlet.h"
+
+#include "integration_kernels.h"
+#include "../domain/domain_decomposition.h"
+#include "../world.h"
+
+
+void VelocityVerletIntegrator::Step(World& world)
+{
+	DispatchPrecision(world.GetPrecision(), [&](auto policy) { StepWith<decltype(policy)>(world); });
+}
+
+template<typename Policy>
+void VelocityVerletIntegrator::StepWith(World& world)
+{
+	using Real = typename Policy::Real;
+
+	AtomStore& atoms = world.GetAtoms();
+	ConstraintSolver& constraints = world.GetConstraints();
+	const bool constrained = !constraints.IsEmpty();
+	const Real dt = m_Timestep;
+
+	if (!world.AreForcesCurrent())
+		world.ComputeForces();
+
+	if (constrained)
+		constraints.SaveReference(atoms, world.GetThreadPool());
+
+	// Coupling decided at the end of the last step. Velocities are scaled by
+	// the thermostat and, with the box, against the positions by the barostat
+	double pendingVelocityScale, positionScale;
+	m_Coupling.TakeScales(pendingVelocityScale, positionScale);
+	const Real velocityScale = (Real)(pendingVelocityScale / positionScale);
+	if (positionScale != 1.0)
+		world.ScaleBox((float)positionScale);
+
+	const StateStreams<Policy> state(atoms);
+	const ForceStreams<Policy> forces(atoms);
+	Thermostat* thermostat = m_Coupling.GetThermostat();
+	if (thermostat && thermostat->IsLangevin())
+	{
+		const Real friction = (Real)thermostat->GetFrictionFactor(dt);
+		const Real kT = (Real)thermostat->GetKT();
+		const uint64_t key = thermostat->NextNoiseKey(world.GetDomain() ? world.GetDomain()->GetTransport().GetRank() : 0);
+		world.ParallelForAtoms([&](uint32_t begin, uint32_t end)
+			{
+				KickDriftLangevinAtoms(state, forces, atoms.InvMass.data(), begin, end, dt, friction, kT, key,
+					velocityScale, (Real)positionScale);
+			});
+	}
+	else
+	{
+		world.ParallelForAtoms([&](uint32_t begin, uint32_t end)
+			{
+				KickDriftAtoms(state, forces, atoms.InvMass.data(), begin, end, dt, velocityScale, (Real)positionScale);
+			});
+	}
+
+	if (constrained)
+	{
+		constraints.ConstrainPositions(atoms, world.GetBox(), m_Timestep, world.GetThreadPool());
+		world.ParallelForAtoms([&](uint32_t begin, uint32_t end) { state.Absorb(begin, end); });
+	}
+
+	world.ComputeForces();
+
+	KineticSums sums = world.ParallelReduceAtoms<KineticSums>([&](uint32_t begin, uint32_t end)
+		{
+			return KickAtoms(state, forces, atoms.InvMass.data(), atoms.Mass.data(), begin, end, Real(0.5) * dt);
+		});
+
+	if (constrained)
+	{
+		constraints.ConstrainVelocities(atoms, world.GetBox(), world.GetThreadPool());
+		world.ParallelForAtoms([&](uint32_t begin, uint32_t end) { state.Absorb(begin, end); });
+		sums.TwiceKinetic += 2.0 * constraints.GetKineticEnergyChange();
+	}
+
+	m_Coupling.Couple(world, sums.TwiceKinetic, sums.MovingAtoms, m_Timestep);
+}
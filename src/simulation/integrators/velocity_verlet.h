@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+
+#include "ensemble_coupling.h"
+#include "integrator.h"
+
+
+// Velocity Verlet: half kick, drift, force evaluation, half kick.
+// Forces from the end of one step are reused at the start of the next.
+// With constraints in the world's topology this becomes SHAKE / RATTLE:
+// positions are constrained after the drift, velocities after the last kick.
+//
+// A thermostat and a barostat can be attached. They work out their scaling
+// from the kinetic energy of the closing kick and the virial of the force
+// evaluation, and the next step's kick-drift loop applies it, so coupling
+// costs no pass over the atoms of its own.
+class VelocityVerletIntegrator : public Integrator
+{
+public:
+	VelocityVerletIntegrator(float dt = 0.002f)
+		: m_Timestep(dt) {
+	}
+
+	virtual void Step(World& world) override;
+
+	virtual float GetTimestep() const override { return m_Timestep; }
+	virtual void SetTimestep(float dt) override { m_Timestep = dt; }
+
+	// nullptr removes it. Any scaling still pending from the old one is dropped
+	void SetThermostat(std::unique_ptr<Thermostat> thermostat) { m_Coupling.SetThermostat(std::move(thermostat)); }
+	void SetBarostat(std::unique_ptr<Barostat> barostat) { m_Coupling.SetBarostat(std::move(barostat)); }
+	Thermostat* GetThermostat() { return m_Coupling.GetThermostat(); }
+	Barostat* GetBarostat() { return m_Coupling.GetBarostat(); }
+
+	const EnsembleObservables& GetObservables() const { return m_Coupling.GetObservables(); }
+
+private:
+	template<typename Policy>
+	void StepWith(World& world);
+
+private:
+	float m_Timestep;
+
+	// Scaling decided at the end of one step is applied by the next one's kick-drift
+	EnsembleCoupling m_Coupling;
+};
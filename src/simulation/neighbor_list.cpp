@@ -0,0 +1,190 @@
+#include "neighbor_list.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "exclusion_list.h"
+
+bool NeighborList::Update(AtomStore& atoms, const SimulationBox& box)
+{
+	m_Stats.Updates++;
+
+	if (!NeedsRebuild(atoms, box))
+		return false;
+
+	Build(atoms, box);
+	return true;
+}
+
+bool NeighborList::NeedsRebuild(const AtomStore& atoms, const SimulationBox& box)
+{
+	if (m_Dirty || atoms.Size() != m_RefX.size() || box != m_BuiltBox)
+		return true;
+
+	// Atoms are only wrapped at a rebuild, so displacements need no minimum image.
+	// After ScaleBox they are measured from the scaled reference positions
+	const uint32_t count = static_cast<uint32_t>(atoms.Size());
+	const float refScale = m_RefScale;
+	float maxDisp2 = 0.0f;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float dx = atoms.PosX[i] - refScale * m_RefX[i];
+		float dy = atoms.PosY[i] - refScale * m_RefY[i];
+		float dz = atoms.PosZ[i] - refScale * m_RefZ[i];
+
+		maxDisp2 = std::max(maxDisp2, dx * dx + dy * dy + dz * dz);
+	}
+
+	// Scaling moves a pair at the list radius by |s - 1| of it, shared between
+	// its two atoms like their displacements are
+	m_Stats.LastMaxDisplacement = std::sqrt(maxDisp2) + 0.5f * std::abs(refScale - 1.0f) * GetListRadius();
+
+	return m_Stats.LastMaxDisplacement > 0.5f * m_Skin;
+}
+
+void NeighborList::ScaleBox(const SimulationBox& box, float scale)
+{
+	m_RefScale *= scale;
+	m_BuiltBox = box;
+	SetShiftVectors(box);
+}
+
+void NeighborList::SetShiftVectors(const SimulationBox& box)
+{
+	for (uint32_t s = 0; s < CellList::ShiftCount; s++)
+	{
+		glm::vec3 shift = box.Periodic ? box.GetShiftVector(CellList::UnpackShift(static_cast<uint8_t>(s))) : glm::vec3(0.0f);
+		m_ShiftVectors[3 * s] = shift.x;
+		m_ShiftVectors[3 * s + 1] = shift.y;
+		m_ShiftVectors[3 * s + 2] = shift.z;
+	}
+}
+
+void NeighborList::Build(AtomStore& atoms, const SimulationBox& box)
+{
+	const uint32_t count = static_cast<uint32_t>(atoms.Size());
+	const float radius = GetListRadius();
+	const float radius2 = radius * radius;
+
+	// The shifts picked below hold until the next rebuild only for atoms that start inside
+	if (box.Periodic)
+		atoms.WrapPositions(box, 0, count);
+
+	SetShiftVectors(box);
+	m_CellList.Build(atoms, box, radius);
+
+	m_Offsets.resize(count + 1);
+	m_RowSegments.resize(count + 1);
+	m_Neighbors.clear();
+	m_SegmentOffsets.clear();
+	m_SegmentShift.clear();
+
+	uint32_t rowSegment = 0;
+	auto beginRow = [&](uint32_t i)
+	{
+		m_Offsets[i] = static_cast<uint32_t>(m_Neighbors.size());
+		m_RowSegments[i] = rowSegment = static_cast<uint32_t>(m_SegmentShift.size());
+	};
+
+	const uint32_t owned = std::min(m_OwnedCount, count);
+	const ExclusionList* exclusions = m_Exclusions && !m_Exclusions->IsEmpty() ? m_Exclusions : nullptr;
+	auto tryAdd = [&](uint32_t i, uint32_t j, uint8_t shift)
+	{
+		if (i >= owned || j >= owned)
+		{
+			if (i >= owned && j >= owned)
+				return;
+			if (m_GlobalIds[i < owned ? i : j] > m_GlobalIds[i < owned ? j : i])
+				return;
+		}
+
+		const float* v = &m_ShiftVectors[3 * shift];
+		float dx = atoms.PosX[i] + v[0] - atoms.PosX[j];
+		float dy = atoms.PosY[i] + v[1] - atoms.PosY[j];
+		float dz = atoms.PosZ[i] + v[2] - atoms.PosZ[j];
+
+		if (dx * dx + dy * dy + dz * dz >= radius2)
+			return;
+		if (exclusions && exclusions->Contains(i, j))
+			return;
+
+		// A row opens a new segment whenever the shift changes
+		if (m_SegmentShift.size() == rowSegment || m_SegmentShift.back() != shift)
+		{
+			m_SegmentOffsets.push_back(static_cast<uint32_t>(m_Neighbors.size()));
+			m_SegmentShift.push_back(shift);
+		}
+		m_Neighbors.push_back(j);
+	};
+
+	if (m_CellList.IsUsable())
+	{
+		const uint32_t* sorted = m_CellList.GetSortedAtoms();
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			beginRow(i);
+
+			uint32_t cell = m_CellList.GetAtomCell(i);
+
+			// Atoms after i in its own cell, then everything in the forward half shell
+			for (uint32_t b = m_CellList.GetAtomSlot(i) + 1; b < m_CellList.CellEnd(cell); b++)
+				tryAdd(i, sorted[b], CellList::CenterShift);
+
+			const uint32_t* shell = m_CellList.GetHalfShell(cell);
+			const uint8_t* shifts = m_CellList.GetHalfShellShifts(cell);
+			for (uint32_t n = 0; n < CellList::HalfShellSize; n++)
+			{
+				if (shell[n] == CellList::InvalidCell)
+					continue;
+
+				for (uint32_t b = m_CellList.CellBegin(shell[n]); b < m_CellList.CellEnd(shell[n]); b++)
+					tryAdd(i, sorted[b], shifts[n]);
+			}
+		}
+	}
+	else
+	{
+		// Too few cells for a half shell: every pair meets its nearest image,
+		// grouped by shift before it goes into the row
+		for (uint32_t i = 0; i < count; i++)
+		{
+			beginRow(i);
+
+			m_RowScratch.clear();
+			for (uint32_t j = i + 1; j < count; j++)
+			{
+				uint8_t shift = CellList::CenterShift;
+				if (box.Periodic)
+				{
+					glm::vec3 d = atoms.GetPosition(i) - atoms.GetPosition(j);
+					glm::vec3 s = glm::round(box.ToFractional(box.MinimumImage(d) - d));
+					int sx = std::clamp(static_cast<int>(s.x), -1, 1);
+					int sy = std::clamp(static_cast<int>(s.y), -1, 1);
+					int sz = std::clamp(static_cast<int>(s.z), -1, 1);
+					shift = static_cast<uint8_t>((sx + 1) + 3 * (sy + 1) + 9 * (sz + 1));
+				}
+				m_RowScratch.push_back({ shift, j });
+			}
+
+			std::stable_sort(m_RowScratch.begin(), m_RowScratch.end(),
+				[](const auto& a, const auto& b) { return a.first < b.first; });
+			for (const auto& [shift, j] : m_RowScratch)
+				tryAdd(i, j, shift);
+		}
+	}
+	m_Offsets[count] = static_cast<uint32_t>(m_Neighbors.size());
+	m_RowSegments[count] = static_cast<uint32_t>(m_SegmentShift.size());
+	m_SegmentOffsets.push_back(static_cast<uint32_t>(m_Neighbors.size()));
+
+	m_RefX.assign(atoms.PosX.begin(), atoms.PosX.end());
+	m_RefY.assign(atoms.PosY.begin(), atoms.PosY.end());
+	m_RefZ.assign(atoms.PosZ.begin(), atoms.PosZ.end());
+	m_RefScale = 1.0f;
+	m_BuiltBox = box;
+	m_Dirty = false;
+	m_BuildId++;
+
+	m_Stats.Rebuilds++;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "aligned_allocator.h"
+#include "atom_store.h"
+#include "cell_list.h"
+#include "simulation_box.h"
+
+class ExclusionList;
+
+
+struct NeighborListStats
+{
+	uint64_t Updates = 0;
+	uint64_t Rebuilds = 0;
+	// Largest displacement since the build, plus what box scaling adds to it
+	float LastMaxDisplacement = 0.0f;
+
+	float GetStepsPerRebuild() const { return Rebuilds ? (float)Updates / (float)Rebuilds : 0.0f; }
+};
+
+// Half Verlet list stored as CSR: the neighbors of atom i are
+// Neighbors[Offsets[i] .. Offsets[i + 1]) and every pair is stored only once.
+// Pairs are collected out to cutoff + skin and the list is only rebuilt once
+// some atom has moved more than half the skin since the last build.
+//
+// Periodic images are settled at build time: a rebuild wraps the atoms into
+// the box, and each row is split into segments of neighbors that all meet
+// the same image of atom i. Kernels add the segment's shift vector to x_i
+// once instead of finding the minimum image of every pair.
+class NeighborList
+{
+public:
+	NeighborList() {}
+	NeighborList(float cutoff, float skin)
+		: m_Cutoff(cutoff), m_Skin(skin) {
+	}
+
+	void SetCutoff(float cutoff) { m_Cutoff = cutoff; m_Dirty = true; }
+	void SetSkin(float skin) { m_Skin = skin; m_Dirty = true; }
+	float GetCutoff() const { return m_Cutoff; }
+	float GetSkin() const { return m_Skin; }
+	float GetListRadius() const { return m_Cutoff + m_Skin; }
+
+	// Rebuilds when needed, returns true if it did. Rebuilding moves atoms of a
+	// periodic box back inside and counts the crossings in their image flags
+	bool Update(AtomStore& atoms, const SimulationBox& box);
+	void Build(AtomStore& atoms, const SimulationBox& box);
+	bool NeedsRebuild(const AtomStore& atoms, const SimulationBox& box);
+	// Forces the next Update to rebuild, e.g. after atoms were added or reordered
+	void Invalidate() { m_Dirty = true; }
+	// Follows a barostat scaling the box and every position about the origin
+	// by scale, without a rebuild. Pair distances change by up to |scale - 1|
+	// of the list radius, which counts against the skin like displacements do
+	void ScaleBox(const SimulationBox& box, float scale);
+
+	// Domain decomposition: atoms from ownedCount on are ghost copies of other
+	// ranks' atoms. Pairs of two ghosts are left out and a pair of an owned atom
+	// and a ghost is only kept on the rank owning the lower global id, so each
+	// pair is evaluated on exactly one rank. globalIds is read by every Build
+	void SetGhosts(uint32_t ownedCount, const uint32_t* globalIds) { m_OwnedCount = ownedCount; m_GlobalIds = globalIds; m_Dirty = true; }
+	void ClearGhosts() { SetGhosts(~0u, nullptr); }
+
+	// Pairs to leave off the list, read by every Build. Forces that have to
+	// account for the missing pairs, like the 1-4 pass or the PME correction,
+	// find them here
+	void SetExclusions(const ExclusionList* exclusions) { m_Exclusions = exclusions; m_Dirty = true; }
+	const ExclusionList* GetExclusions() const { return m_Exclusions; }
+
+	uint32_t GetAtomCount() const { return m_Offsets.empty() ? 0 : (uint32_t)(m_Offsets.size() - 1); }
+	uint32_t GetPairCount() const { return (uint32_t)m_Neighbors.size(); }
+	const uint32_t* GetOffsets() const { return m_Offsets.data(); }
+	const uint32_t* GetNeighbors() const { return m_Neighbors.data(); }
+
+	// Row i owns segments [RowSegments[i], RowSegments[i + 1]), segment s the
+	// neighbors [SegmentOffsets[s], SegmentOffsets[s + 1]) and the shift vector
+	// at GetShiftVectors() + 3 * SegmentShifts[s]
+	uint32_t GetSegmentCount() const { return (uint32_t)m_SegmentShift.size(); }
+	const uint32_t* GetRowSegments() const { return m_RowSegments.data(); }
+	const uint32_t* GetSegmentOffsets() const { return m_SegmentOffsets.data(); }
+	const uint8_t* GetSegmentShifts() const { return m_SegmentShift.data(); }
+	// x, y, z of every CellList shift in the box of the last build
+	const float* GetShiftVectors() const { return m_ShiftVectors; }
+
+	// Changes on every rebuild, lets callers cache data derived from the list
+	uint64_t GetBuildId() const { return m_BuildId; }
+
+	const NeighborListStats& GetStats() const { return m_Stats; }
+	void ResetStats() { m_Stats = NeighborListStats(); }
+
+private:
+	void SetShiftVectors(const SimulationBox& box);
+
+private:
+	float m_Cutoff = 1.0f;
+	float m_Skin = 0.3f;
+	bool m_Dirty = true;
+	uint64_t m_BuildId = 0;
+	SimulationBox m_BuiltBox;
+	uint32_t m_OwnedCount = ~0u;
+	const uint32_t* m_GlobalIds = nullptr;
+	const ExclusionList* m_Exclusions = nullptr;
+
+	CellList m_CellList;
+
+	AlignedVector<uint32_t> m_Offsets;
+	AlignedVector<uint32_t> m_Neighbors;
+
+	AlignedVector<uint32_t> m_RowSegments;
+	AlignedVector<uint32_t> m_SegmentOffsets;
+	AlignedVector<uint8_t> m_SegmentShift;
+	float m_ShiftVectors[CellList::ShiftCount * 3] = {};
+	std::vector<std::pair<uint8_t, uint32_t>> m_RowScratch;
+
+	// Positions at the last build, used for the displacement criterion, and
+	// the box scaling since then
+	AlignedVector<float> m_RefX, m_RefY, m_RefZ;
+	float m_RefScale = 1.0f;
+
+	NeighborListStats m_Stats;
+};
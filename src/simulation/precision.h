@@ -0,0 +1,60 @@
+#pragma once
+
+#include <type_traits>
+
+
+// Precision of the integration core: what positions and velocities live in
+// between steps, what the update loops compute in, and what forces are
+// evaluated and accumulated in.
+//
+//   Single: float everywhere, the float streams are the state
+//   Mixed:  float pair and update math, double positions / velocities. The
+//           SIMD kernels sum into double thread buffers and force streams;
+//           the cheap bonded terms and PME corrections run in double
+//   Double: double positions / velocities, update math and forces. Pairs run
+//           through the scalar kernel in double, every term accumulates into
+//           double force streams; only the PME mesh stays float
+enum class PrecisionMode
+{
+	Single,
+	Mixed,
+	Double
+};
+
+template<typename TReal, typename TState, typename TForce, PrecisionMode TMode>
+struct PrecisionPolicy
+{
+	using Real = TReal;
+	using State = TState;
+	using ForceReal = TForce;
+
+	static constexpr PrecisionMode Mode = TMode;
+	// The float streams the kernels read are copies of a wider state
+	static constexpr bool HasPreciseState = !std::is_same_v<TState, float>;
+	// Forces are summed into the double streams, the float ones are rounded
+	// copies for readers
+	static constexpr bool HasPreciseForces = !std::is_same_v<TForce, float>;
+};
+
+using SinglePrecision = PrecisionPolicy<float, float, float, PrecisionMode::Single>;
+using MixedPrecision = PrecisionPolicy<float, double, double, PrecisionMode::Mixed>;
+using DoublePrecision = PrecisionPolicy<double, double, double, PrecisionMode::Double>;
+
+// Build default, set by the PY_PRECISION CMake option
+#ifndef PY_DEFAULT_PRECISION
+	#define PY_DEFAULT_PRECISION Single
+#endif
+constexpr PrecisionMode DefaultPrecision = PrecisionMode::PY_DEFAULT_PRECISION;
+
+// Calls func with a default-constructed policy object for the runtime mode,
+// every policy gets instantiated in the caller
+template<typename F>
+decltype(auto) DispatchPrecision(PrecisionMode mode, F&& func)
+{
+	switch (mode)
+	{
+	case PrecisionMode::Mixed:  return func(MixedPrecision());
+	case PrecisionMode::Double: return func(DoublePrecision());
+	default:                    return func(SinglePrecision());
+	}
+}
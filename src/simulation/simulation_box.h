@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+
+// Periodic cell spanned by the box vectors
+//   A = (Size.x, 0, 0), B = (Tilt.x, Size.y, 0), C = (Tilt.y, Tilt.z, Size.z)
+// Any cell can be rotated into this lower triangular form. With zero tilts it
+// is the axis-aligned box [0, Size), otherwise a triclinic one; either way
+// the wrapped region is fractional coordinates [0, 1) along A, B and C.
+struct SimulationBox
+{
+	glm::vec3 Size = glm::vec3(10.0f);
+	// xy, xz and yz tilt factors: B.x, C.x and C.y
+	glm::vec3 Tilt = glm::vec3(0.0f);
+	bool Periodic = true;
+
+	SimulationBox() {}
+	SimulationBox(const glm::vec3& size, bool periodic = true)
+		: Size(size), Periodic(periodic) {
+	}
+	SimulationBox(const glm::vec3& size, const glm::vec3& tilt, bool periodic = true)
+		: Size(size), Tilt(tilt), Periodic(periodic) {
+	}
+
+	// Cell from crystallographic edge lengths and the angles alpha (B, C),
+	// beta (A, C) and gamma (A, B), in degrees
+	static SimulationBox FromLengthsAndAngles(const glm::vec3& lengths, float alpha, float beta, float gamma, bool periodic = true)
+	{
+		const float toRadians = 3.14159265358979f / 180.0f;
+		float cosA = std::cos(alpha * toRadians), cosB = std::cos(beta * toRadians);
+		float cosG = std::cos(gamma * toRadians), sinG = std::sin(gamma * toRadians);
+
+		float bx = lengths.y * cosG, by = lengths.y * sinG;
+		float cx = lengths.z * cosB;
+		float cy = lengths.z * (cosA - cosB * cosG) / sinG;
+		float cz = std::sqrt(std::max(lengths.z * lengths.z - cx * cx - cy * cy, 0.0f));
+		return SimulationBox({ lengths.x, by, cz }, { bx, cx, cy }, periodic);
+	}
+
+	bool IsTriclinic() const { return Tilt.x != 0.0f || Tilt.y != 0.0f || Tilt.z != 0.0f; }
+	bool operator==(const SimulationBox& other) const { return Size == other.Size && Tilt == other.Tilt && Periodic == other.Periodic; }
+	bool operator!=(const SimulationBox& other) const { return !(*this == other); }
+
+	glm::vec3 GetA() const { return { Size.x, 0.0f, 0.0f }; }
+	glm::vec3 GetB() const { return { Tilt.x, Size.y, 0.0f }; }
+	glm::vec3 GetC() const { return { Tilt.y, Tilt.z, Size.z }; }
+
+	float GetVolume() const { return Size.x * Size.y * Size.z; }
+
+	// Distances between opposite faces. Cell grids and cutoffs are limited by
+	// these rather than by the edge lengths
+	glm::vec3 GetPerpendicularWidths() const
+	{
+		const float volume = GetVolume();
+		return { volume / glm::length(glm::cross(GetB(), GetC())), volume / glm::length(glm::cross(GetC(), GetA())), Size.z };
+	}
+
+	// Reciprocal vectors a*, b*, c*, the rows of the inverse box matrix, so
+	// that the fractional coordinates of p are (a* . p, b* . p, c* . p)
+	void GetReciprocalVectors(glm::vec3& a, glm::vec3& b, glm::vec3& c) const
+	{
+		a = { 1.0f / Size.x, -Tilt.x / (Size.x * Size.y), (Tilt.x * Tilt.z - Size.y * Tilt.y) / (Size.x * Size.y * Size.z) };
+		b = { 0.0f, 1.0f / Size.y, -Tilt.z / (Size.y * Size.z) };
+		c = { 0.0f, 0.0f, 1.0f / Size.z };
+	}
+
+	glm::vec3 ToFractional(const glm::vec3& p) const
+	{
+		float sz = p.z / Size.z;
+		float sy = (p.y - sz * Tilt.z) / Size.y;
+		float sx = (p.x - sy * Tilt.x - sz * Tilt.y) / Size.x;
+		return { sx, sy, sz };
+	}
+
+	glm::vec3 ToCartesian(const glm::vec3& s) const
+	{
+		return { s.x * Size.x + s.y * Tilt.x + s.z * Tilt.y, s.y * Size.y + s.z * Tilt.z, s.z * Size.z };
+	}
+
+	// Lattice translation by whole box vectors
+	glm::vec3 GetShiftVector(const glm::ivec3& shift) const { return ToCartesian(glm::vec3(shift)); }
+
+	// Moves p into the cell and adds the box vectors it was moved by to image,
+	// so p + image shifts stays the unwrapped position
+	void WrapPosition(glm::vec3& p, glm::ivec3& image) const
+	{
+		glm::vec3 crossed = glm::floor(ToFractional(p));
+		p -= ToCartesian(crossed);
+		image += glm::ivec3(crossed);
+	}
+
+	// Shortest image of a separation. C is removed first, then B, then A, so
+	// each step only touches the axes the remaining vectors lean into. Exact
+	// in reduced boxes (IsReduced) for separations under half the smallest
+	// perpendicular width. Works in the precision of d, vec3 or dvec3
+	template<typename Vec>
+	Vec MinimumImage(Vec d) const
+	{
+		auto sz = std::nearbyint(d.z / Size.z);
+		d.x -= sz * Tilt.y; d.y -= sz * Tilt.z; d.z -= sz * Size.z;
+		auto sy = std::nearbyint(d.y / Size.y);
+		d.x -= sy * Tilt.x; d.y -= sy * Size.y;
+		d.x -= Size.x * std::nearbyint(d.x / Size.x);
+		return d;
+	}
+
+	// Tilts within half the box length they lean along, the same restriction
+	// GROMACS puts on triclinic cells. Every cell has a reduced equivalent
+	bool IsReduced() const
+	{
+		return std::abs(Tilt.x) <= 0.5f * Size.x && std::abs(Tilt.y) <= 0.5f * Size.x && std::abs(Tilt.z) <= 0.5f * Size.y;
+	}
+
+	// Brings a coordinate back into [0, length) along one axis
+	static float Wrap(float x, float length)
+	{
+		return x - length * std::floor(x / length);
+	}
+};
@@ -0,0 +1,124 @@
+#include "spatial_sort.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../threading/thread_pool.h"
+
+
+namespace
+{
+	constexpr uint32_t MaxBits = 21;
+
+	// Spreads the low 21 bits of v so two zero bits follow each one
+	uint64_t SpreadBits(uint64_t v)
+	{
+		v &= 0x1fffff;
+		v = (v | v << 32) & 0x1f00000000ffffull;
+		v = (v | v << 16) & 0x1f0000ff0000ffull;
+		v = (v | v << 8) & 0x100f00f00f00f00full;
+		v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+		v = (v | v << 2) & 0x1249249249249249ull;
+		return v;
+	}
+}
+
+uint64_t SpatialSorter::MortonKey(uint32_t x, uint32_t y, uint32_t z)
+{
+	return SpreadBits(x) << 2 | SpreadBits(y) << 1 | SpreadBits(z);
+}
+
+uint64_t SpatialSorter::HilbertKey(uint32_t x, uint32_t y, uint32_t z, uint32_t bits)
+{
+	// Skilling's transform ("Programming the Hilbert curve", 2004): turns the
+	// axes into the transposed Hilbert index, which interleaves like a Morton key
+	uint32_t X[3] = { x, y, z };
+	const uint32_t top = 1u << (bits - 1);
+
+	for (uint32_t q = top; q > 1; q >>= 1)
+	{
+		const uint32_t p = q - 1;
+		for (int i = 0; i < 3; i++)
+		{
+			if (X[i] & q)
+			{
+				X[0] ^= p;
+			}
+			else
+			{
+				uint32_t t = (X[0] ^ X[i]) & p;
+				X[0] ^= t;
+				X[i] ^= t;
+			}
+		}
+	}
+
+	X[1] ^= X[0];
+	X[2] ^= X[1];
+	uint32_t t = 0;
+	for (uint32_t q = top; q > 1; q >>= 1)
+	{
+		if (X[2] & q)
+			t ^= q - 1;
+	}
+	for (int i = 0; i < 3; i++)
+		X[i] ^= t;
+
+	return MortonKey(X[0], X[1], X[2]);
+}
+
+const std::vector<uint32_t>& SpatialSorter::ComputeOrder(const AtomStore& atoms, const SimulationBox& box, float binSize, ThreadPool* pool)
+{
+	const uint32_t count = static_cast<uint32_t>(atoms.Size());
+
+	uint32_t dims[3];
+	uint32_t maxDim = 1;
+	const glm::vec3 widths = box.GetPerpendicularWidths();
+	for (int c = 0; c < 3; c++)
+	{
+		float bins = std::ceil(widths[c] / binSize);
+		dims[c] = static_cast<uint32_t>(std::clamp(bins, 1.0f, static_cast<float>(1u << MaxBits)));
+		maxDim = std::max(maxDim, dims[c]);
+	}
+
+	uint32_t bits = 1;
+	while ((1u << bits) < maxDim)
+		bits++;
+
+	m_Keys.resize(count);
+	auto computeKeys = [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			// Bins are a grid in fractional coordinates, sheared along with a triclinic box
+			glm::vec3 s = box.ToFractional(atoms.GetPosition(i));
+			uint32_t cell[3];
+			for (int c = 0; c < 3; c++)
+			{
+				// Atoms outside a non-periodic box go to the edge bins
+				float x = box.Periodic ? s[c] - std::floor(s[c]) : s[c];
+				int bin = static_cast<int>(std::floor(x * dims[c]));
+				cell[c] = static_cast<uint32_t>(std::clamp(bin, 0, static_cast<int>(dims[c]) - 1));
+			}
+
+			uint64_t key = m_Curve == SpaceFillingCurve::Hilbert
+				? HilbertKey(cell[0], cell[1], cell[2], bits)
+				: MortonKey(cell[0], cell[1], cell[2]);
+			m_Keys[i] = { key, i };
+		}
+	};
+
+	if (pool)
+		pool->ParallelFor(count, 4096, [&](uint32_t begin, uint32_t end, uint32_t) { computeKeys(begin, end); });
+	else
+		computeKeys(0, count);
+
+	// Pairs compare by index after key, so the sort is stable within a bin
+	std::sort(m_Keys.begin(), m_Keys.end());
+
+	m_Order.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+		m_Order[i] = m_Keys[i].second;
+
+	return m_Order;
+}
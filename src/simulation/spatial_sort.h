@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "atom_store.h"
+#include "simulation_box.h"
+
+class ThreadPool;
+
+
+enum class SpaceFillingCurve
+{
+	Morton,
+	Hilbert
+};
+
+// Orders atoms along a space-filling curve through a grid of bins so atoms
+// that are close in space end up close in memory. Hilbert keys keep
+// consecutive bins face-adjacent, Morton keys are cheaper but jump at
+// power-of-two boundaries.
+class SpatialSorter
+{
+public:
+	SpatialSorter() {}
+
+	void SetCurve(SpaceFillingCurve curve) { m_Curve = curve; }
+	SpaceFillingCurve GetCurve() const { return m_Curve; }
+
+	// order[slot] is the current index of the atom that belongs in slot. Ties
+	// inside a bin keep their current relative order
+	const std::vector<uint32_t>& ComputeOrder(const AtomStore& atoms, const SimulationBox& box, float binSize, ThreadPool* pool);
+
+	// Keys of a bin with coordinates below 2^21 on every axis
+	static uint64_t MortonKey(uint32_t x, uint32_t y, uint32_t z);
+	static uint64_t HilbertKey(uint32_t x, uint32_t y, uint32_t z, uint32_t bits);
+
+private:
+	SpaceFillingCurve m_Curve = SpaceFillingCurve::Hilbert;
+
+	std::vector<std::pair<uint64_t, uint32_t>> m_Keys;
+	std::vector<uint32_t> m_Order;
+};
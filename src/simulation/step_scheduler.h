@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+
+enum class StepMode
+{
+	// A fixed number of physics steps every rendered frame
+	FixedCount = 0,
+	// As many steps as fit in a wall-clock budget per frame
+	TimeBudget,
+	// Accumulates frame time and runs one step per StepInterval of it
+	RealTime
+};
+
+struct StepSchedulerProps
+{
+	StepMode Mode = StepMode::FixedCount;
+	uint32_t StepsPerFrame = 1;
+	// Seconds of wall time the physics may use per frame in TimeBudget mode
+	double FrameBudget = 1.0 / 120.0;
+	// Wall seconds per physics step in RealTime mode
+	double StepInterval = 1.0 / 240.0;
+	// Cap so a long hitch cannot make the next frame take forever
+	uint32_t MaxStepsPerFrame = 256;
+};
+
+// Decides how many fixed-size physics steps run inside each rendered frame,
+// so throughput is set in steps per second rather than tied to frame rate.
+class StepScheduler
+{
+public:
+	StepScheduler(const StepSchedulerProps& props = StepSchedulerProps())
+		: m_Props(props) {
+	}
+
+	void SetProps(const StepSchedulerProps& props) { m_Props = props; m_Accumulator = 0.0; }
+	const StepSchedulerProps& GetProps() const { return m_Props; }
+
+	// Runs step() for this frame and returns how many steps were taken
+	template<typename F>
+	uint32_t RunFrame(double frameDelta, F&& step)
+	{
+		using Clock = std::chrono::steady_clock;
+		auto start = Clock::now();
+
+		uint32_t steps = 0;
+		switch (m_Props.Mode)
+		{
+		case StepMode::FixedCount:
+			for (; steps < std::min(m_Props.StepsPerFrame, m_Props.MaxStepsPerFrame); steps++)
+				step();
+			break;
+
+		case StepMode::TimeBudget:
+		{
+			auto budget = std::chrono::duration<double>(m_Props.FrameBudget);
+			do
+			{
+				step();
+				steps++;
+			} while (steps < m_Props.MaxStepsPerFrame && Clock::now() - start < budget);
+			break;
+		}
+
+		case StepMode::RealTime:
+			m_Accumulator += frameDelta;
+			while (m_Accumulator >= m_Props.StepInterval && steps < m_Props.MaxStepsPerFrame)
+			{
+				step();
+				steps++;
+				m_Accumulator -= m_Props.StepInterval;
+			}
+			// Drop the backlog we could not catch up on instead of spiralling
+			if (steps == m_Props.MaxStepsPerFrame)
+				m_Accumulator = 0.0;
+			break;
+		}
+
+		double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		if (steps > 0 && elapsed > 0.0)
+		{
+			double rate = steps / elapsed;
+			m_StepsPerSecond = m_StepsPerSecond == 0.0 ? rate : 0.9 * m_StepsPerSecond + 0.1 * rate;
+		}
+
+		return steps;
+	}
+
+	// Smoothed physics throughput while stepping, excluding render time
+	double GetStepsPerSecond() const { return m_StepsPerSecond; }
+
+private:
+	StepSchedulerProps m_Props;
+	double m_Accumulator = 0.0;
+	double m_StepsPerSecond = 0.0;
+};
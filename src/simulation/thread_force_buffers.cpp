@@ -0,0 +1,111 @@
+#include "thread_force_buffers.h"
+
+#include <algorithm>
+
+
+void ThreadForceBuffers::Resize(uint32_t threadCount, uint32_t atomCount, bool precise)
+{
+	if (threadCount == m_Buffers.size() && atomCount == m_AtomCount && precise == m_Precise)
+		return;
+
+	m_AtomCount = atomCount;
+	m_Precise = precise;
+	m_Buffers.resize(threadCount);
+	for (auto& buffer : m_Buffers)
+	{
+		if (precise)
+		{
+			buffer.X = {}; buffer.Y = {}; buffer.Z = {};
+			buffer.PreciseX.assign(atomCount, 0.0);
+			buffer.PreciseY.assign(atomCount, 0.0);
+			buffer.PreciseZ.assign(atomCount, 0.0);
+		}
+		else
+		{
+			buffer.X.assign(atomCount, 0.0f);
+			buffer.Y.assign(atomCount, 0.0f);
+			buffer.Z.assign(atomCount, 0.0f);
+			buffer.PreciseX = {}; buffer.PreciseY = {}; buffer.PreciseZ = {};
+		}
+		buffer.TouchedBegin = 0xffffffffu;
+		buffer.TouchedEnd = 0;
+	}
+}
+
+void ThreadForceBuffers::MarkTouched(uint32_t thread, uint32_t begin, uint32_t end)
+{
+	Buffer& buffer = m_Buffers[thread];
+	buffer.TouchedBegin = std::min(buffer.TouchedBegin, begin);
+	buffer.TouchedEnd = std::max(buffer.TouchedEnd, end);
+}
+
+void ThreadForceBuffers::Reduce(AtomStore& atoms, ThreadPool* pool)
+{
+	auto reducePrecise = [this, &atoms](uint32_t begin, uint32_t end, uint32_t)
+	{
+		double* fx = atoms.PreciseForceX.data();
+		double* fy = atoms.PreciseForceY.data();
+		double* fz = atoms.PreciseForceZ.data();
+
+		for (auto& buffer : m_Buffers)
+		{
+			uint32_t b = std::max(begin, buffer.TouchedBegin);
+			uint32_t e = std::min(end, buffer.TouchedEnd);
+
+			double* bx = buffer.PreciseX.data();
+			double* by = buffer.PreciseY.data();
+			double* bz = buffer.PreciseZ.data();
+
+			for (uint32_t i = b; i < e; i++)
+			{
+				fx[i] += bx[i]; bx[i] = 0.0;
+				fy[i] += by[i]; by[i] = 0.0;
+				fz[i] += bz[i]; bz[i] = 0.0;
+			}
+		}
+	};
+
+	auto reduceBlock = [this, &atoms](uint32_t begin, uint32_t end, uint32_t)
+	{
+		float* fx = atoms.ForceX.data();
+		float* fy = atoms.ForceY.data();
+		float* fz = atoms.ForceZ.data();
+
+		for (auto& buffer : m_Buffers)
+		{
+			uint32_t b = std::max(begin, buffer.TouchedBegin);
+			uint32_t e = std::min(end, buffer.TouchedEnd);
+
+			float* bx = buffer.X.data();
+			float* by = buffer.Y.data();
+			float* bz = buffer.Z.data();
+
+			// Clearing in the same pass saves a second sweep over the buffers
+			for (uint32_t i = b; i < e; i++)
+			{
+				fx[i] += bx[i]; bx[i] = 0.0f;
+				fy[i] += by[i]; by[i] = 0.0f;
+				fz[i] += bz[i]; bz[i] = 0.0f;
+			}
+		}
+	};
+
+	if (m_Precise)
+	{
+		if (pool)
+			pool->ParallelFor(m_AtomCount, 4096, reducePrecise);
+		else
+			reducePrecise(0, m_AtomCount, 0);
+	}
+	else if (pool)
+		pool->ParallelFor(m_AtomCount, 4096, reduceBlock);
+	else
+		reduceBlock(0, m_AtomCount, 0);
+
+	for (auto& buffer : m_Buffers)
+	{
+		buffer.TouchedBegin = 0xffffffffu;
+		buffer.TouchedEnd = 0;
+	}
+}
+
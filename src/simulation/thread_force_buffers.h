@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "aligned_allocator.h"
+#include "atom_store.h"
+#include "../threading/thread_pool.h"
+
+
+// Private force accumulators, one set per pool thread, so kernels that apply
+// Newton's third law can write any atom without atomics. Reduce() folds them
+// into the atom store and clears them again for the next evaluation. Precise
+// buffers hold doubles and reduce into the store's precise forces.
+class ThreadForceBuffers
+{
+public:
+	ThreadForceBuffers() {}
+
+	void Resize(uint32_t threadCount, uint32_t atomCount, bool precise = false);
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Buffers.size()); }
+	bool IsPrecise() const { return m_Precise; }
+
+	// T is double for precise buffers, float otherwise
+	template<typename T = float> T* GetX(uint32_t thread) { return Select<T>(m_Buffers[thread].X, m_Buffers[thread].PreciseX); }
+	template<typename T = float> T* GetY(uint32_t thread) { return Select<T>(m_Buffers[thread].Y, m_Buffers[thread].PreciseY); }
+	template<typename T = float> T* GetZ(uint32_t thread) { return Select<T>(m_Buffers[thread].Z, m_Buffers[thread].PreciseZ); }
+
+	// Widens the atom range a thread wrote to, only that range is reduced and cleared
+	void MarkTouched(uint32_t thread, uint32_t begin, uint32_t end);
+
+	// Adds every touched range into the atom forces, split over atom blocks.
+	// Precise buffers go into the precise forces
+	void Reduce(AtomStore& atoms, ThreadPool* pool);
+
+private:
+	template<typename T>
+	static T* Select(AlignedVector<float>& single, AlignedVector<double>& precise)
+	{
+		if constexpr (std::is_same_v<T, double>)
+			return precise.data();
+		else
+			return single.data();
+	}
+
+private:
+	struct Buffer
+	{
+		// Only one of the two sets is allocated
+		AlignedVector<float> X, Y, Z;
+		AlignedVector<double> PreciseX, PreciseY, PreciseZ;
+		uint32_t TouchedBegin = 0xffffffffu;
+		uint32_t TouchedEnd = 0;
+	};
+
+	std::vector<Buffer> m_Buffers;
+	uint32_t m_AtomCount = 0;
+	bool m_Precise = false;
+};
@@ -0,0 +1,82 @@
+#include "topology.h"
+
+#include <algorithm>
+
+
+namespace
+{
+	template<typename Term>
+	void SwapRemoveAtom(std::vector<Term>& terms, uint32_t index, uint32_t last)
+	{
+		constexpr size_t atomCount = sizeof(Term::Atoms) / sizeof(uint32_t);
+
+		auto touchesRemoved = [index](const Term& term)
+		{
+			return std::find(term.Atoms, term.Atoms + atomCount, index) != term.Atoms + atomCount;
+		};
+		terms.erase(std::remove_if(terms.begin(), terms.end(), touchesRemoved), terms.end());
+
+		for (Term& term : terms)
+			std::replace(term.Atoms, term.Atoms + atomCount, last, index);
+	}
+
+	template<typename Term>
+	void RemapAtoms(std::vector<Term>& terms, const std::vector<uint32_t>& newIndex)
+	{
+		for (Term& term : terms)
+		{
+			for (uint32_t& atom : term.Atoms)
+			{
+				if (atom < newIndex.size())
+					atom = newIndex[atom];
+			}
+		}
+	}
+}
+
+size_t Topology::GetTermCount() const
+{
+	return m_Bonds.size() + m_Angles.size() + m_Torsions.size() + m_RBTorsions.size() + m_Impropers.size();
+}
+
+void Topology::Clear()
+{
+	m_Bonds.clear();
+	m_Angles.clear();
+	m_Torsions.clear();
+	m_RBTorsions.clear();
+	m_Impropers.clear();
+	m_Constraints.clear();
+	m_Waters.clear();
+	m_Revision++;
+}
+
+void Topology::OnAtomSwapRemoved(uint32_t index, uint32_t last)
+{
+	if (IsEmpty())
+		return;
+
+	SwapRemoveAtom(m_Bonds, index, last);
+	SwapRemoveAtom(m_Angles, index, last);
+	SwapRemoveAtom(m_Torsions, index, last);
+	SwapRemoveAtom(m_RBTorsions, index, last);
+	SwapRemoveAtom(m_Impropers, index, last);
+	SwapRemoveAtom(m_Constraints, index, last);
+	SwapRemoveAtom(m_Waters, index, last);
+	m_Revision++;
+}
+
+void Topology::Remap(const std::vector<uint32_t>& newIndex)
+{
+	if (IsEmpty())
+		return;
+
+	RemapAtoms(m_Bonds, newIndex);
+	RemapAtoms(m_Angles, newIndex);
+	RemapAtoms(m_Torsions, newIndex);
+	RemapAtoms(m_RBTorsions, newIndex);
+	RemapAtoms(m_Impropers, newIndex);
+	RemapAtoms(m_Constraints, newIndex);
+	RemapAtoms(m_Waters, newIndex);
+	m_Revision++;
+}
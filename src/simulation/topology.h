@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// U = 1/2 K (r - Length)^2
+struct HarmonicBond
+{
+	uint32_t Atoms[2];
+	float K;
+	float Length;
+};
+
+// U = 1/2 K (theta - Angle)^2, Atoms[1] is the vertex
+struct HarmonicAngle
+{
+	uint32_t Atoms[3];
+	float K;
+	float Angle;
+};
+
+// U = K (1 + cos(n phi - Phase))
+struct PeriodicTorsion
+{
+	uint32_t Atoms[4];
+	float K;
+	float Phase;
+	uint32_t Multiplicity;
+};
+
+// Ryckaert-Bellemans, U = sum_n C[n] cos^n(phi - 180 deg)
+struct RBTorsion
+{
+	uint32_t Atoms[4];
+	float C[6];
+};
+
+// U = 1/2 K (xi - Angle)^2 on the i-j-k-l dihedral, keeps planar groups planar
+struct ImproperTorsion
+{
+	uint32_t Atoms[4];
+	float K;
+	float Angle;
+};
+
+// |r_i - r_j| held at Distance by SHAKE / RATTLE
+struct DistanceConstraint
+{
+	uint32_t Atoms[2];
+	float Distance;
+};
+
+// Rigid 3-site water solved analytically by SETTLE, Atoms = { O, H1, H2 }
+struct RigidWater
+{
+	uint32_t Atoms[3];
+	float OHDistance;
+	float HHDistance;
+};
+
+// Bonded connectivity by dense atom index. Terms are kept in the order they
+// were added; BondedForce compiles them into sorted flat arrays and redoes so
+// whenever the revision changes.
+class Topology
+{
+public:
+	Topology() {}
+
+	uint32_t AddBond(const HarmonicBond& bond) { m_Bonds.push_back(bond); m_Revision++; return (uint32_t)m_Bonds.size() - 1; }
+	uint32_t AddAngle(const HarmonicAngle& angle) { m_Angles.push_back(angle); m_Revision++; return (uint32_t)m_Angles.size() - 1; }
+	uint32_t AddTorsion(const PeriodicTorsion& torsion) { m_Torsions.push_back(torsion); m_Revision++; return (uint32_t)m_Torsions.size() - 1; }
+	uint32_t AddRBTorsion(const RBTorsion& torsion) { m_RBTorsions.push_back(torsion); m_Revision++; return (uint32_t)m_RBTorsions.size() - 1; }
+	uint32_t AddImproper(const ImproperTorsion& improper) { m_Impropers.push_back(improper); m_Revision++; return (uint32_t)m_Impropers.size() - 1; }
+	uint32_t AddConstraint(const DistanceConstraint& constraint) { m_Constraints.push_back(constraint); m_Revision++; return (uint32_t)m_Constraints.size() - 1; }
+	uint32_t AddRigidWater(const RigidWater& water) { m_Waters.push_back(water); m_Revision++; return (uint32_t)m_Waters.size() - 1; }
+
+	const std::vector<HarmonicBond>& GetBonds() const { return m_Bonds; }
+	const std::vector<HarmonicAngle>& GetAngles() const { return m_Angles; }
+	const std::vector<PeriodicTorsion>& GetTorsions() const { return m_Torsions; }
+	const std::vector<RBTorsion>& GetRBTorsions() const { return m_RBTorsions; }
+	const std::vector<ImproperTorsion>& GetImpropers() const { return m_Impropers; }
+	const std::vector<DistanceConstraint>& GetConstraints() const { return m_Constraints; }
+	const std::vector<RigidWater>& GetRigidWaters() const { return m_Waters; }
+
+	// Potential energy terms, constraints not included
+	size_t GetTermCount() const;
+	// Degrees of freedom the constraints remove, 3 per rigid water
+	size_t GetConstrainedDegrees() const { return m_Constraints.size() + 3 * m_Waters.size(); }
+	bool IsEmpty() const { return GetTermCount() == 0 && GetConstrainedDegrees() == 0; }
+	void Clear();
+
+	// Follows AtomStore::SwapRemove: terms on the removed atom are dropped and
+	// references to the last atom move to its new slot
+	void OnAtomSwapRemoved(uint32_t index, uint32_t last);
+	// Follows a reorder of the atom arrays, atom i is now at newIndex[i]
+	void Remap(const std::vector<uint32_t>& newIndex);
+
+	uint64_t GetRevision() const { return m_Revision; }
+
+private:
+	std::vector<HarmonicBond> m_Bonds;
+	std::vector<HarmonicAngle> m_Angles;
+	std::vector<PeriodicTorsion> m_Torsions;
+	std::vector<RBTorsion> m_RBTorsions;
+	std::vector<ImproperTorsion> m_Impropers;
+	std::vector<DistanceConstraint> m_Constraints;
+	std::vector<RigidWater> m_Waters;
+
+	uint64_t m_Revision = 0;
+};
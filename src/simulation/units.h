@@ -0,0 +1,8 @@
+#pragma once
+
+
+// Engine units are those of GROMACS: nm, ps, amu, kJ/mol and e. Thermostats
+// and barostats take temperatures in K and pressures in bar and convert with
+// these.
+constexpr double BoltzmannConstant = 0.0083144626181532;  // kJ / (mol K)
+constexpr double BarPerPressureUnit = 16.6054;             // one kJ / (mol nm^3) in bar
@@ -0,0 +1,290 @@
+#include "world.h"
+
+#include <algorithm>
+
+#include "../logging/log.h"
+#include "domain/domain_decomposition.h"
+#include "integrators/velocity_verlet.h"
+
+
+World::World()
+	: m_Integrator(std::make_unique<VelocityVerletIntegrator>())
+{
+	m_Nonbonded = &AddForce<NonbondedForce>();
+	m_NeighborList.SetExclusions(&m_Exclusions);
+	m_Atoms.SetPreciseState(m_Precision != PrecisionMode::Single);
+	m_Atoms.SetPreciseForces(m_Precision != PrecisionMode::Single);
+}
+
+entt::entity World::CreateAtom(const glm::vec3& position, const glm::vec3& velocity, float mass, uint32_t typeId, float charge)
+{
+	entt::entity atom = m_Registry.create();
+	uint32_t index = m_Atoms.Push(position, velocity, mass, typeId, charge);
+
+	m_Registry.emplace<AtomComponent>(atom, index);
+	m_Entities.push_back(atom);
+	m_NeighborList.Invalidate();
+	InvalidateForces();
+
+	return atom;
+}
+
+uint32_t World::CreateAtoms(const AtomStore& source)
+{
+	uint32_t first = m_Atoms.Append(source);
+
+	m_Entities.reserve(m_Atoms.Size());
+	for (uint32_t index = first; index < m_Atoms.Size(); index++)
+	{
+		entt::entity atom = m_Registry.create();
+		m_Registry.emplace<AtomComponent>(atom, index);
+		m_Entities.push_back(atom);
+	}
+	m_NeighborList.Invalidate();
+	InvalidateForces();
+
+	return first;
+}
+
+void World::DestroyAtom(entt::entity atom)
+{
+	if (!m_Registry.valid(atom))
+	{
+		PY_CORE_WARN("Tried to destroy an invalid atom entity");
+		return;
+	}
+
+	uint32_t index = m_Registry.get<AtomComponent>(atom).Index;
+	uint32_t last = static_cast<uint32_t>(m_Atoms.Size() - 1);
+
+	m_Atoms.SwapRemove(index);
+	if (index != last)
+	{
+		// The last atom now lives in the freed slot, point its entity there
+		m_Entities[index] = m_Entities[last];
+		m_Registry.get<AtomComponent>(m_Entities[index]).Index = index;
+	}
+	m_Entities.pop_back();
+	m_Topology.OnAtomSwapRemoved(index, last);
+	m_NeighborList.Invalidate();
+	InvalidateForces();
+
+	m_Registry.destroy(atom);
+}
+
+void World::Clear()
+{
+	m_Registry.clear();
+	m_Atoms.Clear();
+	m_Entities.clear();
+	m_Topology.Clear();
+	m_NeighborList.Invalidate();
+	InvalidateForces();
+}
+
+void World::ComputeForces(uint32_t groupMask)
+{
+	m_Atoms.ClearForces();
+
+	// Bonded neighbors are left off the list, so it follows every change to the bonds
+	if (m_Exclusions.Update(m_Topology, static_cast<uint32_t>(m_Atoms.Size())))
+		m_NeighborList.Invalidate();
+
+	// One shared list, wide enough for the longest cutoff among the forces run now.
+	// Under domain decomposition it is only rebuilt together with the halo
+	float listCutoff = GetListCutoff(groupMask);
+	if (m_Domain)
+		m_Domain->UpdateGhostPositions();
+	else if (listCutoff > 0.0f)
+	{
+		if (m_NeighborList.GetCutoff() != listCutoff)
+			m_NeighborList.SetCutoff(listCutoff);
+		m_NeighborList.Update(m_Atoms, m_Box);
+	}
+
+	for (uint32_t group = 0; group < MaxForceGroups; group++)
+	{
+		if (groupMask & ForceGroupBit(group))
+		{
+			m_GroupEnergy[group] = 0.0;
+			m_GroupVirial[group] = 0.0;
+		}
+	}
+
+	if (m_ThreadPool)
+		m_ForceBuffers.Resize(m_ThreadPool->GetThreadCount(), static_cast<uint32_t>(m_Atoms.Size()), m_Atoms.HasPreciseForces());
+
+	ForceContext ctx{ m_Atoms, m_Box, m_NeighborList, m_ThreadPool, m_ForceBuffers, m_Precision };
+	for (const auto& force : m_Forces)
+	{
+		if (!(groupMask & ForceGroupBit(force->GetGroup())))
+			continue;
+
+		ctx.Virial = 0.0;
+		m_GroupEnergy[force->GetGroup()] += force->Compute(ctx);
+		m_GroupVirial[force->GetGroup()] += ctx.Virial;
+	}
+
+	if (m_ThreadPool)
+		m_ForceBuffers.Reduce(m_Atoms, m_ThreadPool);
+
+	// Ghost forces go back to their owners, energies and virials are summed over the ranks
+	if (m_Domain)
+		m_Domain->ReduceForces(m_GroupEnergy, m_GroupVirial, groupMask);
+
+	// Integrators kick with the double forces, everything else reads the float copies
+	if (m_Atoms.HasPreciseForces())
+		ParallelForAtoms([this](uint32_t begin, uint32_t end) { m_Atoms.RoundPreciseForces(begin, end); });
+
+	// A partial evaluation leaves only some groups' forces in the store
+	uint32_t used = GetUsedForceGroups();
+	m_ForcesCurrent = (groupMask & used) == used;
+}
+
+void World::SetBox(const SimulationBox& box)
+{
+	if (box.Periodic && !box.IsReduced())
+		PY_CORE_WARN("Box tilts exceed half the box length they lean along, minimum images may be wrong");
+
+	m_Box = box;
+	InvalidateForces();
+}
+
+void World::ScaleBox(float scale)
+{
+	m_Box.Size *= scale;
+	m_Box.Tilt *= scale;
+	m_NeighborList.ScaleBox(m_Box, scale);
+	if (m_Domain)
+		m_Domain->OnBoxScaled();
+}
+
+void World::SetPrecision(PrecisionMode mode)
+{
+	m_Precision = mode;
+	m_Atoms.SetPreciseState(mode != PrecisionMode::Single);
+	m_Atoms.SetPreciseForces(mode != PrecisionMode::Single);
+	InvalidateForces();
+}
+
+float World::GetListCutoff(uint32_t groupMask) const
+{
+	float cutoff = 0.0f;
+	for (const auto& force : m_Forces)
+	{
+		if ((groupMask & ForceGroupBit(force->GetGroup())) && force->UsesNeighborList())
+			cutoff = std::max(cutoff, force->GetCutoff());
+	}
+	return cutoff;
+}
+
+bool World::AttachDomain(DomainDecomposition* domain)
+{
+	if (!m_Topology.IsEmpty() || !m_Constraints.IsEmpty())
+	{
+		PY_CORE_ERROR("Domain decomposition does not support bonded terms or constraints yet");
+		return false;
+	}
+	for (const auto& force : m_Forces)
+	{
+		if (!force->UsesNeighborList())
+		{
+			PY_CORE_ERROR("Domain decomposition does not support the {0} force, only forces on the neighbor list", force->GetName());
+			return false;
+		}
+	}
+
+	m_Domain = domain;
+	return true;
+}
+
+uint32_t World::GetUsedForceGroups() const
+{
+	uint32_t used = 0;
+	for (const auto& force : m_Forces)
+		used |= ForceGroupBit(force->GetGroup());
+	return used;
+}
+
+double World::GetPotentialEnergy() const
+{
+	double energy = 0.0;
+	for (double groupEnergy : m_GroupEnergy)
+		energy += groupEnergy;
+	return energy;
+}
+
+double World::GetVirial() const
+{
+	double virial = 0.0;
+	for (double groupVirial : m_GroupVirial)
+		virial += groupVirial;
+	return virial;
+}
+
+bool World::Step()
+{
+	// Atoms only change rank between steps, where nothing holds on to indices
+	if (m_Domain && !m_Domain->Update())
+		return false;
+
+	m_Integrator->Step(*this);
+	if (m_Domain && m_Domain->HasFailed())
+		return false;
+
+	m_StepCount++;
+	m_SimulationTime += m_Integrator->GetTimestep();
+
+	// The domain reorders its owned atoms itself while it repartitions
+	if (m_ReorderInterval && !m_Domain && m_StepCount % m_ReorderInterval == 0)
+		ReorderAtoms();
+	return true;
+}
+
+void World::ReorderAtoms()
+{
+	const uint32_t count = static_cast<uint32_t>(m_Atoms.Size());
+	if (count < 2)
+		return;
+
+	// Half-radius bins, finer than the cell list so atoms of one cell are grouped too
+	const std::vector<uint32_t>& order = m_Sorter.ComputeOrder(m_Atoms, m_Box, 0.5f * m_NeighborList.GetListRadius(), m_ThreadPool);
+
+	m_ReorderScratch.SetPreciseState(m_Atoms.HasPreciseState());
+	m_ReorderScratch.SetPreciseForces(m_Atoms.HasPreciseForces());
+	m_ReorderScratch.Resize(count);
+	m_EntityScratch.resize(count);
+	m_NewIndex.resize(count);
+	ParallelForAtoms([&](uint32_t begin, uint32_t end)
+		{
+			m_ReorderScratch.Gather(m_Atoms, order.data(), begin, end);
+			for (uint32_t i = begin; i < end; i++)
+			{
+				m_EntityScratch[i] = m_Entities[order[i]];
+				m_NewIndex[order[i]] = i;
+			}
+		});
+	std::swap(m_Atoms, m_ReorderScratch);
+	std::swap(m_Entities, m_EntityScratch);
+
+	m_Registry.view<AtomComponent>().each([this](AtomComponent& atom) { atom.Index = m_NewIndex[atom.Index]; });
+	m_Topology.Remap(m_NewIndex);
+	m_NeighborList.Invalidate();
+
+	// The force streams moved along with the atoms and stay valid, only
+	// integrators holding their own per-atom copies need to refresh them
+	m_Revision++;
+}
+
+void World::OnUpdate(double frameDelta)
+{
+	if (m_Atoms.Size() == 0)
+		return;
+
+	m_Scheduler.RunFrame(frameDelta, [this]() { Step(); });
+}
+
+uint32_t World::GetAtomIndex(entt::entity atom) const
+{
+	return m_Registry.get<AtomComponent>(atom).Index;
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <entt/entt.hpp>
+#include <glm/glm.hpp>
+
+#include "atom_store.h"
+#include "constraints.h"
+#include "exclusion_list.h"
+#include "neighbor_list.h"
+#include "precision.h"
+#include "simulation_box.h"
+#include "spatial_sort.h"
+#include "step_scheduler.h"
+#include "thread_force_buffers.h"
+#include "topology.h"
+#include "integrators/integrator.h"
+#include "forces/nonbonded_force.h"
+
+
+class DomainDecomposition;
+
+// Attached to every atom entity, points at its slot in the AtomStore.
+// The index changes when other atoms are destroyed, the entity does not.
+struct AtomComponent
+{
+	uint32_t Index;
+};
+
+class World
+{
+public:
+	World();
+
+	entt::entity CreateAtom(const glm::vec3& position, const glm::vec3& velocity, float mass, uint32_t typeId, float charge = 0.0f);
+	// Creates an atom for every atom of source at once, the way to add large
+	// systems. Returns the dense index of the first one
+	uint32_t CreateAtoms(const AtomStore& source);
+	void DestroyAtom(entt::entity atom);
+	void Clear();
+
+	uint32_t GetAtomIndex(entt::entity atom) const;
+	entt::entity GetAtomEntity(uint32_t index) const { return m_Entities[index]; }
+	size_t GetAtomCount() const { return m_Atoms.Size(); }
+
+	// Clears the AtomStore forces and evaluates every force whose group is in
+	// groupMask, refreshing the neighbor list first if one of them needs it
+	void ComputeForces(uint32_t groupMask = AllForceGroups);
+	// True while the AtomStore force streams hold the full force for the current positions
+	bool AreForcesCurrent() const { return m_ForcesCurrent; }
+	// Call after editing the system from outside the integrator, e.g. moving atoms by hand
+	void InvalidateForces() { m_ForcesCurrent = false; m_Revision++; }
+	// For integrators that reused the force streams as scratch space
+	void DiscardForces() { m_ForcesCurrent = false; }
+	// For integrators that put the full force back into the streams afterwards
+	void MarkForcesCurrent() { m_ForcesCurrent = true; }
+	// Bumped on every change made outside the integrator, lets integrators
+	// keeping their own force copies know when to recompute them
+	uint64_t GetRevision() const { return m_Revision; }
+
+	// One integrator step. False, with the step not counted, once the domain
+	// decomposition has failed; the ranks no longer agree on the system then
+	bool Step();
+	// Runs however many steps the scheduler allots to a rendered frame
+	void OnUpdate(double frameDelta);
+
+	// Forces are recomputed after a switch, the new integrator may split them differently
+	void SetIntegrator(std::unique_ptr<Integrator> integrator) { m_Integrator = std::move(integrator); InvalidateForces(); }
+	Integrator& GetIntegrator() { return *m_Integrator; }
+	StepScheduler& GetStepScheduler() { return m_Scheduler; }
+
+	uint64_t GetStepCount() const { return m_StepCount; }
+	double GetSimulationTime() const { return m_SimulationTime; }
+
+	// Runs func(begin, end) over blocks of atom indices, on the pool when there is one
+	template<typename F>
+	void ParallelForAtoms(F&& func)
+	{
+		const uint32_t count = static_cast<uint32_t>(m_Atoms.Size());
+		if (m_ThreadPool)
+			m_ThreadPool->ParallelFor(count, 4096, [&func](uint32_t begin, uint32_t end, uint32_t) { func(begin, end); });
+		else
+			func(0, count);
+	}
+
+	// Like ParallelForAtoms for update loops that also sum something up:
+	// func(begin, end) returns a T, the blocks of one thread add into their
+	// own partial and the partials are added at the end
+	template<typename T, typename F>
+	T ParallelReduceAtoms(F&& func)
+	{
+		const uint32_t count = static_cast<uint32_t>(m_Atoms.Size());
+		if (!m_ThreadPool)
+			return func(0, count);
+
+		struct alignas(64) Partial
+		{
+			T Value{};
+		};
+		std::vector<Partial> partials(m_ThreadPool->GetThreadCount());
+		m_ThreadPool->ParallelFor(count, 4096, [&func, &partials](uint32_t begin, uint32_t end, uint32_t thread) { partials[thread].Value += func(begin, end); });
+
+		T total{};
+		for (const Partial& partial : partials)
+			total += partial.Value;
+		return total;
+	}
+
+	// Force evaluation runs single threaded until a pool is set
+	void SetThreadPool(ThreadPool* pool) { m_ThreadPool = pool; }
+	ThreadPool* GetThreadPool() const { return m_ThreadPool; }
+
+	// Every interval steps the atom arrays are re-sorted along the sorter's
+	// curve so neighbors in space stay neighbors in memory. Dense indices
+	// change, entities, the topology and the forces follow. 0 turns it off
+	void SetReorderInterval(uint32_t steps) { m_ReorderInterval = steps; }
+	uint32_t GetReorderInterval() const { return m_ReorderInterval; }
+	SpatialSorter& GetSpatialSorter() { return m_Sorter; }
+	void ReorderAtoms();
+
+	// Precision the integrators advance the system in, defaults to the build's
+	// PY_PRECISION. Mixed and double keep double positions and velocities in
+	// the AtomStore next to the float streams, and sum forces in double,
+	// leaving rounded copies in the float force streams; double also
+	// evaluates the forces in double
+	void SetPrecision(PrecisionMode mode);
+	PrecisionMode GetPrecision() const { return m_Precision; }
+
+	// Periodic atoms are kept wrapped into the box from the next neighbor list
+	// rebuild on, AtomStore image flags record the box vectors they crossed
+	void SetBox(const SimulationBox& box);
+	const SimulationBox& GetBox() const { return m_Box; }
+	// For barostats that scale every position about the origin by the same
+	// factor in their own update loop. Unlike SetBox this keeps the forces and
+	// the neighbor list, the small change in the forces is neglected
+	void ScaleBox(float scale);
+	NeighborList& GetNeighborList() { return m_NeighborList; }
+	// Longest cutoff among the neighbor list forces in groupMask, 0 if there are none
+	float GetListCutoff(uint32_t groupMask = AllForceGroups) const;
+
+	// Set while a DomainDecomposition is attached. Atoms from its owned count on
+	// are then ghost copies of other ranks' atoms, refreshed before every force
+	// evaluation, and energies are summed over all ranks
+	DomainDecomposition* GetDomain() const { return m_Domain; }
+
+	template<typename T, typename... Args>
+	T& AddForce(Args&&... args)
+	{
+		auto force = std::make_unique<T>(std::forward<Args>(args)...);
+		T& ref = *force;
+		m_Forces.push_back(std::move(force));
+		InvalidateForces();
+		return ref;
+	}
+	const std::vector<std::unique_ptr<Force>>& GetForces() const { return m_Forces; }
+	// Bit set of the groups that have at least one force
+	uint32_t GetUsedForceGroups() const;
+
+	// Bonded terms by dense atom index, kept valid across DestroyAtom. Evaluated
+	// once a BondedForce is added on it
+	Topology& GetTopology() { return m_Topology; }
+	const Topology& GetTopology() const { return m_Topology; }
+	// Solves the topology's constraints and rigid waters inside velocity Verlet
+	ConstraintSolver& GetConstraints() { return m_Constraints; }
+	// Pairs the topology's bonds take off the nonbonded interactions, as of the
+	// last force evaluation
+	const ExclusionList& GetExclusions() const { return m_Exclusions; }
+
+	NonbondedForce& GetNonbondedForce() { return *m_Nonbonded; }
+	const NonbondedEnergy& GetNonbondedEnergy() const { return m_Nonbonded->GetLastEnergy(); }
+
+	// Energy of a group as of the last time it was evaluated
+	double GetGroupEnergy(uint32_t group) const { return m_GroupEnergy[group]; }
+	double GetPotentialEnergy() const;
+	// Virial sum r . F of a group, and of all groups, as of their last evaluation
+	double GetGroupVirial(uint32_t group) const { return m_GroupVirial[group]; }
+	double GetVirial() const;
+
+	AtomStore& GetAtoms() { return m_Atoms; }
+	const AtomStore& GetAtoms() const { return m_Atoms; }
+	entt::registry& GetRegistry() { return m_Registry; }
+
+private:
+	// Migrates atoms between ranks without invalidating the forces they carry
+	friend class DomainDecomposition;
+
+	// Only the pair forces on the neighbor list are split over ranks. Refuses,
+	// false after logging why, while the system has bonded terms, constraints
+	// or a force off the list such as PME
+	bool AttachDomain(DomainDecomposition* domain);
+
+	entt::registry m_Registry;
+	AtomStore m_Atoms;
+
+	// Dense index -> owning entity, kept parallel to the AtomStore streams
+	std::vector<entt::entity> m_Entities;
+
+	Topology m_Topology;
+	ConstraintSolver m_Constraints{ m_Topology };
+	ExclusionList m_Exclusions;
+
+	PrecisionMode m_Precision = DefaultPrecision;
+	SimulationBox m_Box;
+	NeighborList m_NeighborList;
+	DomainDecomposition* m_Domain = nullptr;
+	ThreadPool* m_ThreadPool = nullptr;
+	ThreadForceBuffers m_ForceBuffers;
+
+	std::vector<std::unique_ptr<Force>> m_Forces;
+	NonbondedForce* m_Nonbonded = nullptr;
+	double m_GroupEnergy[MaxForceGroups] = {};
+	double m_GroupVirial[MaxForceGroups] = {};
+	bool m_ForcesCurrent = false;
+	uint64_t m_Revision = 0;
+
+	SpatialSorter m_Sorter;
+	uint32_t m_ReorderInterval = 1000;
+	AtomStore m_ReorderScratch;
+	std::vector<entt::entity> m_EntityScratch;
+	std::vector<uint32_t> m_NewIndex;
+
+	std::unique_ptr<Integrator> m_Integrator;
+	StepScheduler m_Scheduler;
+	uint64_t m_StepCount = 0;
+	double m_SimulationTime = 0.0;
+};
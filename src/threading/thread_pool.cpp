@@ -0,0 +1,203 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+#include "../logging/log.h"
+
+#if defined(_WIN32)
+	#define NOMINMAX
+	#include <windows.h>
+#elif defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+
+static thread_local uint32_t s_ThreadIndex = 0;
+
+ThreadPool::ThreadPool(const ThreadPoolProps& props)
+{
+	uint32_t workers = props.WorkerCount;
+	if (workers == 0)
+		workers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+	for (uint32_t i = 0; i < workers + 1; i++)
+		m_Queues.push_back(std::make_unique<WorkQueue>());
+
+	m_Workers.reserve(workers);
+	for (uint32_t i = 1; i <= workers; i++)
+		m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i, props.PinThreads, props.CoreOffset);
+
+	if (props.PinThreads)
+		PY_CORE_INFO("Thread pool started with {} workers (pinned from core {})", workers, props.CoreOffset + 1);
+	else
+		PY_CORE_INFO("Thread pool started with {} workers", workers);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_Stop = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (auto& worker : m_Workers)
+		worker.join();
+}
+
+uint32_t ThreadPool::GetCurrentThreadIndex()
+{
+	return s_ThreadIndex;
+}
+
+void ThreadPool::Submit(Task task)
+{
+	// Workers keep their own spawned work local, everyone else spreads it out
+	uint32_t queue = s_ThreadIndex != 0 ? s_ThreadIndex : m_NextQueue.fetch_add(1) % GetThreadCount();
+
+	// Counted before it becomes visible so the counter never drops below zero
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_QueuedTasks++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Queues[queue]->Mutex);
+		m_Queues[queue]->Tasks.push_back(std::move(task));
+	}
+	m_WakeCondition.notify_one();
+}
+
+void ThreadPool::ParallelFor(uint32_t count, uint32_t grain, const RangeFn& body)
+{
+	if (count == 0)
+		return;
+
+	// A few chunks per thread so stealing can even out uneven work
+	uint32_t chunks = std::max(1u, std::min(GetThreadCount() * 4, count / std::max(1u, grain)));
+
+	std::vector<uint32_t> bounds(chunks + 1);
+	for (uint32_t c = 0; c <= chunks; c++)
+		bounds[c] = static_cast<uint32_t>((uint64_t)count * c / chunks);
+
+	ParallelForChunks(bounds, body);
+}
+
+void ThreadPool::ParallelForChunks(const std::vector<uint32_t>& bounds, const RangeFn& body)
+{
+	if (bounds.size() < 2)
+		return;
+
+	const uint32_t chunks = static_cast<uint32_t>(bounds.size() - 1);
+	if (chunks == 1 || m_Workers.empty())
+	{
+		for (uint32_t c = 0; c < chunks; c++)
+			body(bounds[c], bounds[c + 1], s_ThreadIndex);
+		return;
+	}
+
+	std::atomic<uint32_t> remaining = chunks;
+
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_QueuedTasks += chunks;
+	}
+
+	// Deal chunks out round-robin so every deque starts with contiguous work
+	for (uint32_t c = 0; c < chunks; c++)
+	{
+		uint32_t queue = c % GetThreadCount();
+		std::lock_guard<std::mutex> lock(m_Queues[queue]->Mutex);
+		m_Queues[queue]->Tasks.push_back([&body, &remaining, begin = bounds[c], end = bounds[c + 1]]()
+			{
+				body(begin, end, s_ThreadIndex);
+				remaining.fetch_sub(1, std::memory_order_release);
+			});
+	}
+	m_WakeCondition.notify_all();
+
+	// The caller works too instead of blocking
+	while (remaining.load(std::memory_order_acquire) != 0)
+	{
+		if (!TryRunOne(s_ThreadIndex))
+			std::this_thread::yield();
+	}
+}
+
+void ThreadPool::WorkerLoop(uint32_t index, bool pin, uint32_t coreOffset)
+{
+	s_ThreadIndex = index;
+	if (pin)
+		PinCurrentThread(coreOffset + index);
+
+	while (true)
+	{
+		if (TryRunOne(index))
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		m_WakeCondition.wait(lock, [this]() { return m_Stop || m_QueuedTasks > 0; });
+		if (m_Stop)
+			return;
+	}
+}
+
+bool ThreadPool::TryRunOne(uint32_t self)
+{
+	Task task;
+	if (!TryPop(self, task) && !TrySteal(self, task))
+		return false;
+
+	m_QueuedTasks--;
+	task();
+	return true;
+}
+
+bool ThreadPool::TryPop(uint32_t self, Task& task)
+{
+	WorkQueue& queue = *m_Queues[self];
+	std::lock_guard<std::mutex> lock(queue.Mutex);
+	if (queue.Tasks.empty())
+		return false;
+
+	task = std::move(queue.Tasks.back());
+	queue.Tasks.pop_back();
+	return true;
+}
+
+bool ThreadPool::TrySteal(uint32_t self, Task& task)
+{
+	const uint32_t count = GetThreadCount();
+	for (uint32_t offset = 1; offset < count; offset++)
+	{
+		WorkQueue& victim = *m_Queues[(self + offset) % count];
+		std::unique_lock<std::mutex> lock(victim.Mutex, std::try_to_lock);
+		if (!lock.owns_lock() || victim.Tasks.empty())
+			continue;
+
+		task = std::move(victim.Tasks.front());
+		victim.Tasks.pop_front();
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::PinCurrentThread(uint32_t core)
+{
+	uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+	core %= cores;
+
+#if defined(_WIN32)
+	if (!SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core))
+		PY_CORE_WARN("Failed to pin worker thread to core {}", core);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		PY_CORE_WARN("Failed to pin worker thread to core {}", core);
+#else
+	PY_CORE_WARN("Thread pinning is not supported on this platform");
+#endif
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+struct ThreadPoolProps
+{
+	// Worker threads besides the calling thread, 0 picks hardware_concurrency - 1
+	uint32_t WorkerCount;
+	// Pins thread i to logical core CoreOffset + i (the calling thread stays
+	// where it is). Pools of several processes on one machine give each its
+	// own offset so they do not stack on the same cores
+	bool PinThreads;
+	uint32_t CoreOffset;
+
+	ThreadPoolProps(uint32_t workerCount = 0, bool pinThreads = false, uint32_t coreOffset = 0)
+		: WorkerCount(workerCount), PinThreads(pinThreads), CoreOffset(coreOffset) {
+	}
+};
+
+// Work-stealing pool: every thread owns a deque, pops its own work from the
+// back and steals from the front of the others when it runs dry. The thread
+// that calls ParallelFor takes part as thread 0, workers are 1..N.
+class ThreadPool
+{
+public:
+	using Task = std::function<void()>;
+	// Called with [begin, end) and the index of the thread running the chunk
+	using RangeFn = std::function<void(uint32_t begin, uint32_t end, uint32_t threadIndex)>;
+
+	ThreadPool(const ThreadPoolProps& props = ThreadPoolProps());
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Workers plus the calling thread, the size per-thread buffers need
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Queues.size()); }
+
+	void Submit(Task task);
+
+	// Splits [0, count) into chunks of at least grain items, runs them across
+	// all threads and returns once every chunk has finished
+	void ParallelFor(uint32_t count, uint32_t grain, const RangeFn& body);
+	// Same, but with explicit chunk boundaries: chunk c is [bounds[c], bounds[c + 1])
+	void ParallelForChunks(const std::vector<uint32_t>& bounds, const RangeFn& body);
+
+	// 0 on any thread that is not a worker of a pool
+	static uint32_t GetCurrentThreadIndex();
+
+private:
+	struct WorkQueue
+	{
+		std::mutex Mutex;
+		std::deque<Task> Tasks;
+	};
+
+	void WorkerLoop(uint32_t index, bool pin, uint32_t coreOffset);
+	bool TryRunOne(uint32_t self);
+	bool TryPop(uint32_t self, Task& task);
+	bool TrySteal(uint32_t self, Task& task);
+
+	static void PinCurrentThread(uint32_t core);
+
+private:
+	std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+	std::vector<std::thread> m_Workers;
+
+	std::atomic<bool> m_Stop = false;
+	std::atomic<uint32_t> m_QueuedTasks = 0;
+	std::atomic<uint32_t> m_NextQueue = 0;
+
+	std::mutex m_SleepMutex;
+	std::condition_variable m_WakeCondition;
+};